@@ -0,0 +1,949 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/ImageUtils>
+#include <osgEarth/TileSource>
+#include <osgEarth/HTTPClient>
+#include <osgEarth/Horizon>
+#include <osgEarth/GeoData>
+#include <osgEarth/GeoMath>
+#include <osgEarth/Map>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/ElevationPool>
+#include <osgEarthDrivers/gdal/GDALOptions>
+#include <osgEarthDrivers/mbtiles/MBTilesOptions>
+#include <osgEarth/Registry>
+#include <osgEarthUtil/ClusterIndex>
+#include <osgEarthUtil/LineOfSightEngine>
+#include <osgEarthUtil/kdbush.hpp>
+#include <osg/ArgumentParser>
+#include <osg/Timer>
+#include <osg/Image>
+#include <osg/Shape>
+#include <osg/Viewport>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Atomic>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <set>
+
+using namespace osgEarth;
+
+// documentation
+int usage(char** argv)
+{
+    std::cout
+        << "Micro-benchmarks for osgEarth's hot paths.\n\n"
+        << argv[0]
+        << "\n    --imageutils                        : ImageUtils kernels vs. the generic pixel path"
+        << "\n    --iterations [int]                  : iterations per test (default = 50)"
+        << "\n    --size [int]                        : image size in pixels, or viewshed grid size with --los (default = 256)"
+        << "\n    --gdal [file]                       : GDAL tile reads per second vs. thread count"
+        << "\n    --elevation                         : with --gdal, read heightfields instead of images"
+        << "\n    --level [int]                       : with --gdal, --mbtiles or --los, level to use (default = the data's max level; 12 for --mbtiles)"
+        << "\n    --tiles [int]                       : with --gdal or --mbtiles, tiles per test (default = 256; 4096 for --mbtiles)"
+        << "\n    --mbtiles [file]                    : MBTiles tiles written and read per second vs. thread count (creates the file)"
+        << "\n    --max-threads [int]                 : with --gdal, --mbtiles, --http or --los, largest thread count to test (default = 16)"
+        << "\n    --http [url]                        : HTTP requests per second, blocking client vs. asynchronous"
+        << "\n    --requests [int]                    : with --http, requests per test (default = 500)"
+        << "\n    --cluster                           : ClusterNode clustering, screen-space rebuild vs. ClusterIndex"
+        << "\n    --points [int]                      : with --cluster, number of points (default = 1000000)"
+        << "\n    --radius [int]                      : with --cluster, clustering radius in pixels (default = 50)"
+        << "\n    --los [file]                        : lines of sight and viewsheds per second vs. thread count, on a GDAL elevation file"
+        << "\n    --queries [int]                     : with --los, lines of sight per test (default = 10000)"
+        << "\n    --range [meters]                    : with --los, length of the lines of sight and viewshed radius (default = 10000)"
+        << std::endl;
+
+    return 0;
+}
+
+namespace
+{
+    osg::Image* createTestImage(int size, GLenum pixelFormat, GLenum dataType)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(size, size, 1, pixelFormat, dataType);
+        image->setInternalTextureFormat(pixelFormat);
+
+        unsigned bytes = image->getTotalSizeInBytes();
+        if (dataType == GL_FLOAT)
+        {
+            float* f = reinterpret_cast<float*>(image->data());
+            for (unsigned i = 0; i < bytes / sizeof(float); ++i)
+                f[i] = (float)(rand() % 9000);
+        }
+        else
+        {
+            for (unsigned i = 0; i < bytes; ++i)
+                image->data()[i] = (unsigned char)(rand() & 0xFF);
+        }
+        return image;
+    }
+
+    const char* formatName(const osg::Image* image)
+    {
+        return
+            image->getDataType() == GL_FLOAT ? "R32F" :
+            image->getPixelFormat() == GL_RGBA ? "RGBA8" :
+            image->getPixelFormat() == GL_RGB ? "RGB8" :
+            "other";
+    }
+
+    // One ImageUtils operation on a test image.
+    struct ImageOp
+    {
+        virtual const char* name() const = 0;
+        virtual void run(const osg::Image* image) = 0;
+        virtual bool accepts(const osg::Image* image) const { return true; }
+        virtual ~ImageOp() { }
+    };
+
+    struct ResizeOp : public ImageOp
+    {
+        bool _bilinear;
+        ResizeOp(bool bilinear) : _bilinear(bilinear) { }
+        const char* name() const { return _bilinear ? "resize (bilinear)" : "resize (nearest)"; }
+        void run(const osg::Image* image) {
+            osg::ref_ptr<osg::Image> output;
+            ImageUtils::resizeImage(image, image->s()/2, image->t()/2, output, 0, _bilinear);
+        }
+    };
+
+    struct MixOp : public ImageOp
+    {
+        const char* name() const { return "mix"; }
+        void run(const osg::Image* image) {
+            osg::ref_ptr<osg::Image> dest = ImageUtils::cloneImage(image);
+            ImageUtils::mix(dest.get(), image, 0.5f);
+        }
+    };
+
+    struct PremultiplyOp : public ImageOp
+    {
+        const char* name() const { return "premultiply"; }
+        void run(const osg::Image* image) {
+            osg::ref_ptr<osg::Image> copy = ImageUtils::cloneImage(image);
+            ImageUtils::convertToPremultipliedAlpha(copy.get());
+        }
+    };
+
+    struct ConvertOp : public ImageOp
+    {
+        const char* name() const { return "convert"; }
+        bool accepts(const osg::Image* image) const { return image->getDataType() == GL_UNSIGNED_BYTE; }
+        void run(const osg::Image* image) {
+            // RGBA8 <-> RGB8, so it's a real conversion and not a clone
+            GLenum pixelFormat = image->getPixelFormat() == GL_RGBA ? GL_RGB : GL_RGBA;
+            osg::ref_ptr<osg::Image> output = ImageUtils::convert(image, pixelFormat, GL_UNSIGNED_BYTE);
+        }
+    };
+
+    struct MipmapOp : public ImageOp
+    {
+        const char* name() const { return "mipmaps"; }
+        void run(const osg::Image* image) {
+            osg::ref_ptr<osg::Image> mipmapped = ImageUtils::buildNearestNeighborMipmaps(image);
+        }
+    };
+
+    struct BicubicOp : public ImageOp
+    {
+        const char* name() const { return "bicubicUpsample"; }
+        void run(const osg::Image* image) {
+            osg::ref_ptr<osg::Image> target = ImageUtils::cloneImage(image);
+            for (unsigned q = 0; q < 4; ++q)
+                ImageUtils::bicubicUpsample(image, target.get(), q, 1);
+        }
+    };
+
+    // average milliseconds per run
+    double timeOp(ImageOp& op, const osg::Image* image, int iterations)
+    {
+        op.run(image); // warm-up
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        for (int i = 0; i < iterations; ++i)
+            op.run(image);
+        return osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()) / (double)iterations;
+    }
+
+    int benchImageUtils(int size, int iterations)
+    {
+        osg::ref_ptr<osg::Image> images[3] = {
+            createTestImage(size, GL_RGBA, GL_UNSIGNED_BYTE),
+            createTestImage(size, GL_RGB, GL_UNSIGNED_BYTE),
+            createTestImage(size, GL_RED, GL_FLOAT)
+        };
+
+        ResizeOp nearest(false), bilinear(true);
+        MixOp mix;
+        PremultiplyOp premultiply;
+        ConvertOp convert;
+        MipmapOp mipmap;
+        BicubicOp bicubic;
+        ImageOp* ops[] = { &nearest, &bilinear, &mix, &premultiply, &convert, &mipmap, &bicubic };
+
+        std::cout
+            << "ImageUtils, " << size << "x" << size << ", " << iterations << " iterations\n"
+            << std::left << std::setw(20) << "operation" << std::setw(8) << "format"
+            << std::right << std::setw(12) << "generic ms" << std::setw(12) << "kernel ms" << std::setw(10) << "speedup"
+            << std::endl;
+
+        for (unsigned o = 0; o < sizeof(ops)/sizeof(ops[0]); ++o)
+        {
+            for (unsigned i = 0; i < 3; ++i)
+            {
+                if (!ops[o]->accepts(images[i].get()))
+                    continue;
+
+                ImageUtils::setKernelsEnabled(false);
+                double generic = timeOp(*ops[o], images[i].get(), iterations);
+
+                ImageUtils::setKernelsEnabled(true);
+                double kernel = timeOp(*ops[o], images[i].get(), iterations);
+
+                std::cout
+                    << std::left << std::setw(20) << ops[o]->name() << std::setw(8) << formatName(images[i].get())
+                    << std::right << std::fixed << std::setprecision(3)
+                    << std::setw(12) << generic << std::setw(12) << kernel
+                    << std::setprecision(2) << std::setw(9) << (kernel > 0.0 ? generic/kernel : 0.0) << "x"
+                    << std::endl;
+            }
+        }
+
+        ImageUtils::setKernelsEnabled(true);
+        return 0;
+    }
+
+    // Reads tiles off a shared list until there are none left.
+    struct TileReader : public OpenThreads::Thread
+    {
+        TileReader(TileSource* source, const std::vector<TileKey>& keys, OpenThreads::Atomic& next, bool elevation) :
+            _source(source), _keys(keys), _next(next), _elevation(elevation) { }
+
+        void run()
+        {
+            for(;;)
+            {
+                unsigned i = ++_next - 1u;
+                if (i >= _keys.size())
+                    break;
+
+                if (_elevation)
+                {
+                    osg::ref_ptr<osg::HeightField> hf = _source->createHeightField(_keys[i]);
+                }
+                else
+                {
+                    osg::ref_ptr<osg::Image> image = _source->createImage(_keys[i]);
+                }
+            }
+        }
+
+        TileSource*                 _source;
+        const std::vector<TileKey>& _keys;
+        OpenThreads::Atomic&        _next;
+        bool                        _elevation;
+    };
+
+    // tiles per second
+    double readTiles(TileSource* source, const std::vector<TileKey>& keys, unsigned numThreads, bool elevation)
+    {
+        OpenThreads::Atomic next(0u);
+        std::vector<TileReader*> readers;
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        for (unsigned i = 0; i < numThreads; ++i)
+        {
+            readers.push_back(new TileReader(source, keys, next, elevation));
+            readers.back()->start();
+        }
+
+        for (unsigned i = 0; i < readers.size(); ++i)
+        {
+            readers[i]->join();
+            delete readers[i];
+        }
+
+        double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+        return seconds > 0.0 ? (double)keys.size() / seconds : 0.0;
+    }
+
+    TileSource* openGDAL(const std::string& url, bool concurrent)
+    {
+        Drivers::GDALOptions options;
+        options.url() = url;
+        options.concurrentReads() = concurrent;
+        options.L2CacheSize() = 0; // measure the reads, not the cache
+
+        osg::ref_ptr<TileSource> source = TileSourceFactory::create(options);
+        if (!source.valid() || source->open().isError())
+        {
+            std::cout << "Failed to open " << url << std::endl;
+            return 0L;
+        }
+        return source.release();
+    }
+
+    int benchGDAL(const std::string& url, int level, unsigned numTiles, unsigned maxThreads, bool elevation)
+    {
+        std::vector<TileKey> keys;
+        {
+            osg::ref_ptr<TileSource> source = openGDAL(url, false);
+            if (!source.valid() || source->getDataExtents().empty())
+                return -1;
+
+            const DataExtent& extent = source->getDataExtents().front();
+            if (level < 0)
+                level = extent.maxLevel().isSet() ? (int)extent.maxLevel().get() : 0;
+
+            source->getProfile()->getIntersectingTiles(extent, (unsigned)level, keys);
+            if (keys.size() > numTiles)
+                keys.resize(numTiles);
+        }
+
+        if (keys.empty())
+        {
+            std::cout << "No tiles to read at level " << level << std::endl;
+            return -1;
+        }
+
+        std::cout
+            << "GDAL " << (elevation ? "heightfields" : "images") << ", " << url << ", "
+            << keys.size() << " tiles at level " << level << "\n"
+            << std::setw(8) << "threads" << std::setw(20) << "serialized tiles/s" << std::setw(20) << "concurrent tiles/s"
+            << std::endl;
+
+        for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+        {
+            double rate[2];
+            for (int concurrent = 0; concurrent < 2; ++concurrent)
+            {
+                // a fresh source each time, so GDAL's block cache is the only thing carried over
+                osg::ref_ptr<TileSource> source = openGDAL(url, concurrent == 1);
+                if (!source.valid())
+                    return -1;
+
+                rate[concurrent] = readTiles(source.get(), keys, numThreads, elevation);
+            }
+
+            std::cout
+                << std::fixed << std::setprecision(1)
+                << std::setw(8) << numThreads << std::setw(20) << rate[0] << std::setw(20) << rate[1]
+                << std::endl;
+        }
+
+        return 0;
+    }
+
+    // Stores one image under each key, off a shared counter.
+    struct TileWriter : public OpenThreads::Thread
+    {
+        TileWriter(TileSource* source, const std::vector<TileKey>& keys, osg::Image* image, OpenThreads::Atomic& next) :
+            _source(source), _keys(keys), _image(image), _next(next) { }
+
+        void run()
+        {
+            for(;;)
+            {
+                unsigned i = ++_next - 1u;
+                if (i >= _keys.size())
+                    break;
+
+                _source->storeImage(_keys[i], _image, 0L);
+            }
+        }
+
+        TileSource*                 _source;
+        const std::vector<TileKey>& _keys;
+        osg::Image*                 _image;
+        OpenThreads::Atomic&        _next;
+    };
+
+    TileSource* openMBTiles(const std::string& filename, bool write)
+    {
+        Drivers::MBTilesTileSourceOptions options;
+        options.filename() = filename;
+        options.format() = "png";
+        options.computeLevels() = !write;
+        options.L2CacheSize() = 0; // measure the reads, not the cache
+        if (write)
+            options.profile() = ProfileOptions("spherical-mercator");
+
+        osg::ref_ptr<TileSource> source = TileSourceFactory::create(options);
+        if (!source.valid() ||
+            source->open(write ? (TileSource::MODE_WRITE | TileSource::MODE_CREATE) : TileSource::MODE_READ).isError())
+        {
+            std::cout << "Failed to open " << filename << std::endl;
+            return 0L;
+        }
+        return source.release();
+    }
+
+    // tiles per second, including the time to flush them to disk
+    double writeTiles(const std::string& filename, const std::vector<TileKey>& keys, osg::Image* image, unsigned numThreads)
+    {
+        // start from an empty file each time
+        ::remove(filename.c_str());
+        ::remove((filename + "-wal").c_str());
+        ::remove((filename + "-shm").c_str());
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        {
+            osg::ref_ptr<TileSource> source = openMBTiles(filename, true);
+            if (!source.valid())
+                return 0.0;
+
+            OpenThreads::Atomic next(0u);
+            std::vector<TileWriter*> writers;
+            for (unsigned i = 0; i < numThreads; ++i)
+            {
+                writers.push_back(new TileWriter(source.get(), keys, image, next));
+                writers.back()->start();
+            }
+
+            for (unsigned i = 0; i < writers.size(); ++i)
+            {
+                writers[i]->join();
+                delete writers[i];
+            }
+        } // closing the source writes anything still queued
+
+        double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+        return seconds > 0.0 ? (double)keys.size() / seconds : 0.0;
+    }
+
+    int benchMBTiles(const std::string& filename, int level, unsigned numTiles, unsigned maxThreads)
+    {
+        const Profile* profile = Registry::instance()->getSphericalMercatorProfile();
+        if (level < 0)
+            level = 12;
+
+        unsigned cols, rows;
+        profile->getNumTiles((unsigned)level, cols, rows);
+        numTiles = osg::minimum(numTiles, cols*rows);
+
+        std::vector<TileKey> keys;
+        for (unsigned i = 0; i < numTiles; ++i)
+            keys.push_back(TileKey((unsigned)level, i % cols, i / cols, profile));
+
+        // something PNG can't squeeze down to nothing
+        osg::ref_ptr<osg::Image> image = new osg::Image();
+        image->allocateImage(256, 256, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        for (unsigned i = 0; i < image->getTotalSizeInBytes(); ++i)
+            image->data()[i] = (unsigned char)((i & 0xff) ^ (rand() & 0x0f));
+
+        std::cout
+            << "MBTiles, " << filename << ", " << keys.size() << " PNG tiles at level " << level << "\n"
+            << std::setw(8) << "threads" << std::setw(20) << "written tiles/s" << std::setw(20) << "read tiles/s"
+            << std::endl;
+
+        for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+        {
+            double writeRate = writeTiles(filename, keys, image.get(), numThreads);
+
+            osg::ref_ptr<TileSource> source = openMBTiles(filename, false);
+            if (!source.valid())
+                return -1;
+
+            double readRate = readTiles(source.get(), keys, numThreads, false);
+
+            std::cout
+                << std::fixed << std::setprecision(1)
+                << std::setw(8) << numThreads << std::setw(20) << writeRate << std::setw(20) << readRate
+                << std::endl;
+        }
+
+        return 0;
+    }
+
+    HTTPRequest makeRequest(const std::string& url, unsigned i)
+    {
+        // a distinct query string per request keeps any cache in the middle honest
+        HTTPRequest request(url);
+        request.addParameter("request", (int)i);
+        return request;
+    }
+
+    // Makes blocking requests off a shared counter until there are none left.
+    struct HTTPReader : public OpenThreads::Thread
+    {
+        HTTPReader(const std::string& url, unsigned numRequests, OpenThreads::Atomic& next, OpenThreads::Atomic& failures) :
+            _url(url), _numRequests(numRequests), _next(next), _failures(failures) { }
+
+        void run()
+        {
+            for(;;)
+            {
+                unsigned i = ++_next - 1u;
+                if (i >= _numRequests)
+                    break;
+
+                if (!HTTPClient::readString(makeRequest(_url, i)).succeeded())
+                    ++_failures;
+            }
+        }
+
+        std::string          _url;
+        unsigned             _numRequests;
+        OpenThreads::Atomic& _next;
+        OpenThreads::Atomic& _failures;
+    };
+
+    // requests per second
+    double fetchBlocking(const std::string& url, unsigned numRequests, unsigned numThreads, unsigned& failures)
+    {
+        OpenThreads::Atomic next(0u), failed(0u);
+        std::vector<HTTPReader*> readers;
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        for (unsigned i = 0; i < numThreads; ++i)
+        {
+            readers.push_back(new HTTPReader(url, numRequests, next, failed));
+            readers.back()->start();
+        }
+
+        for (unsigned i = 0; i < readers.size(); ++i)
+        {
+            readers[i]->join();
+            delete readers[i];
+        }
+
+        double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+        failures = failed;
+        return seconds > 0.0 ? (double)numRequests / seconds : 0.0;
+    }
+
+    // requests per second, all submitted at once from this thread
+    double fetchAsync(const std::string& url, unsigned numRequests, unsigned& failures)
+    {
+        std::vector< Threading::Future<ReadResultObject> > results;
+        results.reserve(numRequests);
+
+        osg::Timer_t start = osg::Timer::instance()->tick();
+
+        for (unsigned i = 0; i < numRequests; ++i)
+            results.push_back(HTTPClient::readStringAsync(makeRequest(url, i)));
+
+        failures = 0u;
+        for (unsigned i = 0; i < results.size(); ++i)
+        {
+            ReadResultObject* r = results[i].get();
+            if (!r || !r->_result.succeeded())
+                ++failures;
+        }
+
+        double seconds = osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+        return seconds > 0.0 ? (double)numRequests / seconds : 0.0;
+    }
+
+    int benchHTTP(const std::string& url, unsigned numRequests, unsigned maxThreads)
+    {
+        HTTPClient::globalInit();
+
+        std::cout
+            << "HTTP, " << url << ", " << numRequests << " requests per test\n"
+            << std::left << std::setw(24) << "client"
+            << std::right << std::setw(14) << "requests/s" << std::setw(10) << "failed"
+            << std::endl;
+
+        unsigned failures = 0u;
+        for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+        {
+            double rate = fetchBlocking(url, numRequests, numThreads, failures);
+
+            std::stringstream label;
+            label << "blocking, " << numThreads << (numThreads == 1 ? " thread" : " threads");
+            std::cout
+                << std::left << std::setw(24) << label.str()
+                << std::right << std::fixed << std::setprecision(1) << std::setw(14) << rate << std::setw(10) << failures
+                << std::endl;
+        }
+
+        double rate = fetchAsync(url, numRequests, failures);
+        std::cout
+            << std::left << std::setw(24) << "async, 1 thread"
+            << std::right << std::fixed << std::setprecision(1) << std::setw(14) << rate << std::setw(10) << failures
+            << std::endl;
+
+        return 0;
+    }
+
+    typedef std::pair<int, int> TPoint;
+
+    // A camera looking straight down at (lon, lat) from some altitude.
+    struct ClusterView
+    {
+        const char*   name;
+        osg::Matrixd  view, proj;
+        osg::Vec3d    eye;
+
+        ClusterView(const char* n, const SpatialReference* srs, double lon, double lat, double alt) : name(n)
+        {
+            osg::Vec3d center;
+            GeoPoint(srs, lon, lat, alt, ALTMODE_ABSOLUTE).toWorld(eye);
+            GeoPoint(srs, lon, lat, 0.0, ALTMODE_ABSOLUTE).toWorld(center);
+            view.makeLookAt(eye, center, osg::Vec3d(0, 0, 1));
+            proj.makePerspective(30.0, 1920.0/1080.0, 1.0, 1e8);
+        }
+    };
+
+    // The way ClusterNode used to cluster: project every point and cluster on screen,
+    // rebuilding the spatial index each time. Returns the number of clusters.
+    unsigned clusterOnScreen(const std::vector<osg::Vec3d>& world, const ClusterView& cv, const osg::Viewport& vp, Horizon& horizon, int radius)
+    {
+        horizon.setEye(cv.eye);
+        osg::Matrixd mvpw = cv.view * cv.proj * vp.computeWindowMatrix();
+
+        std::vector<TPoint> points;
+        for (unsigned i = 0; i < world.size(); ++i)
+        {
+            if (!horizon.isVisible(world[i]))
+                continue;
+
+            osg::Vec3d screen = world[i] * mvpw;
+            if (screen.x() >= 0 && screen.x() <= vp.width() && screen.y() >= 0 && screen.y() <= vp.height())
+                points.push_back(TPoint(screen.x(), screen.y()));
+        }
+
+        if (points.empty())
+            return 0u;
+
+        kdbush::KDBush<TPoint> index(points);
+        std::set<unsigned> clustered;
+        std::vector<std::size_t> ids;
+        unsigned clusters = 0u;
+
+        for (unsigned i = 0; i < points.size(); ++i)
+        {
+            if (clustered.find(i) != clustered.end())
+                continue;
+
+            ids.clear();
+            index.range(points[i].first - radius, points[i].second - radius, points[i].first + radius, points[i].second + radius, ids);
+            for (unsigned j = 0; j < ids.size(); ++j)
+                clustered.insert(ids[j]);
+            clustered.insert(i);
+            ++clusters;
+        }
+        return clusters;
+    }
+
+    // The way ClusterNode clusters now: query the index and collect each cluster's members.
+    unsigned clusterFromIndex(const Util::ClusterIndex& index, const ClusterView& cv, const osg::Viewport& vp, Horizon& horizon, int radius)
+    {
+        horizon.setEye(cv.eye);
+
+        Util::ClusterIndex::ClusterList clusters;
+        index.query(cv.view, cv.proj, vp, (float)radius, &horizon, clusters);
+
+        std::vector<unsigned> members;
+        for (unsigned i = 0; i < clusters.size(); ++i)
+        {
+            members.clear();
+            index.getPoints(clusters[i].cell, members);
+        }
+        return clusters.size();
+    }
+
+    int benchCluster(unsigned numPoints, int radius, int iterations)
+    {
+        osg::ref_ptr<const SpatialReference> srs = SpatialReference::get("wgs84");
+        osg::ref_ptr<osg::Viewport> vp = new osg::Viewport(0, 0, 1920, 1080);
+        osg::ref_ptr<Horizon> horizon = new Horizon(srs.get());
+
+        std::vector<osg::Vec3d> world(numPoints);
+        for (unsigned i = 0; i < numPoints; ++i)
+        {
+            double lon = -180.0 + 360.0 * (double)rand() / (double)RAND_MAX;
+            double lat = osg::RadiansToDegrees(asin(-1.0 + 2.0 * (double)rand() / (double)RAND_MAX));
+            GeoPoint(srs.get(), lon, lat, 0.0, ALTMODE_ABSOLUTE).toWorld(world[i]);
+        }
+
+        osg::ref_ptr<Util::ClusterIndex> index = new Util::ClusterIndex(srs.get());
+        osg::Timer_t start = osg::Timer::instance()->tick();
+        for (unsigned i = 0; i < numPoints; ++i)
+            index->insert(i, world[i]);
+        double buildMS = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+        // move 1% of the points, one at a time
+        unsigned numMoved = osg::maximum(numPoints / 100u, 1u);
+        start = osg::Timer::instance()->tick();
+        for (unsigned i = 0; i < numMoved; ++i)
+        {
+            unsigned id = (unsigned)rand() % numPoints;
+            index->remove(id);
+            index->insert(id, world[(id + 1u) % numPoints]);
+        }
+        double moveUS = 1000.0 * osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()) / (double)numMoved;
+
+        std::cout
+            << "Clustering, " << numPoints << " points, " << radius << " px radius, " << iterations << " iterations\n"
+            << "index built in " << std::fixed << std::setprecision(1) << buildMS << " ms; "
+            << "moving a point takes " << std::setprecision(2) << moveUS << " us\n"
+            << std::left << std::setw(12) << "view"
+            << std::right << std::setw(12) << "clusters" << std::setw(12) << "screen ms"
+            << std::setw(12) << "clusters" << std::setw(12) << "index ms" << std::setw(10) << "speedup"
+            << std::endl;
+
+        ClusterView views[] = {
+            ClusterView("globe",    srs.get(), -70.0, 40.0, 2e7),
+            ClusterView("region",   srs.get(), -70.0, 40.0, 1e6),
+            ClusterView("city",     srs.get(), -70.0, 40.0, 2e4)
+        };
+
+        for (unsigned v = 0; v < sizeof(views)/sizeof(views[0]); ++v)
+        {
+            unsigned screenClusters = 0u, indexClusters = 0u;
+
+            start = osg::Timer::instance()->tick();
+            for (int i = 0; i < iterations; ++i)
+                screenClusters = clusterOnScreen(world, views[v], *vp.get(), *horizon.get(), radius);
+            double screenMS = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()) / (double)iterations;
+
+            start = osg::Timer::instance()->tick();
+            for (int i = 0; i < iterations; ++i)
+                indexClusters = clusterFromIndex(*index.get(), views[v], *vp.get(), *horizon.get(), radius);
+            double indexMS = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()) / (double)iterations;
+
+            std::cout
+                << std::left << std::setw(12) << views[v].name
+                << std::right << std::setw(12) << screenClusters
+                << std::fixed << std::setprecision(3) << std::setw(12) << screenMS
+                << std::setw(12) << indexClusters << std::setw(12) << indexMS
+                << std::setprecision(2) << std::setw(9) << (indexMS > 0.0 ? screenMS / indexMS : 0.0) << "x"
+                << std::endl;
+        }
+
+        return 0;
+    }
+    // A random point in an extent (geographic degrees), 2m above the ground.
+    GeoPoint randomPoint(const GeoExtent& extent)
+    {
+        return GeoPoint(extent.getSRS(),
+            extent.xMin() + extent.width() * (double)rand() / (double)RAND_MAX,
+            extent.yMin() + extent.height() * (double)rand() / (double)RAND_MAX,
+            2.0, ALTMODE_RELATIVE);
+    }
+
+    int benchLineOfSight(const std::string& url, int level, unsigned numQueries, double range, unsigned size, unsigned maxThreads)
+    {
+        Drivers::GDALOptions options;
+        options.url() = url;
+
+        osg::ref_ptr<Map> map = new Map();
+        osg::ref_ptr<ElevationLayer> layer = new ElevationLayer("elevation", options);
+        map->addLayer(layer.get());
+        if (layer->getStatus().isError() || layer->getDataExtents().empty())
+        {
+            std::cout << "Failed to open " << url << std::endl;
+            return -1;
+        }
+
+        if (level < 0)
+        {
+            const DataExtent& de = layer->getDataExtents().front();
+            level = de.maxLevel().isSet() ? (int)de.maxLevel().get() : 12;
+        }
+
+        // keep the area's tiles in memory, so the tests measure the engine and not GDAL
+        map->getElevationPool()->setMaxEntries(4096u);
+
+        GeoExtent extent = layer->getDataExtentsUnion().transform(map->getSRS()->getGeographicSRS());
+
+        typedef Util::LineOfSightEngine Engine;
+        std::vector<Engine::Query> queries(numQueries);
+        for (unsigned i = 0; i < numQueries; ++i)
+        {
+            GeoPoint start = randomPoint(extent);
+            double lat, lon, bearing = 2.0 * osg::PI * (double)rand() / (double)RAND_MAX;
+            GeoMath::destination(osg::DegreesToRadians(start.y()), osg::DegreesToRadians(start.x()), bearing, range, lat, lon);
+            queries[i] = Engine::Query(start, GeoPoint(extent.getSRS(), osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), 2.0, ALTMODE_RELATIVE));
+        }
+
+        std::vector<GeoPoint> observers(osg::maximum(maxThreads * 2u, 8u));
+        for (unsigned i = 0; i < observers.size(); ++i)
+            observers[i] = randomPoint(extent);
+
+        osg::ref_ptr<Engine> engine = new Engine(map.get(), (unsigned)level);
+
+        // warm up the elevation pool, and see how far R2 is from the exact R3
+        Engine::Results results;
+        engine->computeLineOfSight(queries, results);
+
+        unsigned numVisible = 0u;
+        for (unsigned i = 0; i < results.size(); ++i)
+            if (results[i].visible)
+                ++numVisible;
+
+        double agreement = 0.0;
+        GeoImage r2, r3;
+        if (engine->computeViewshed(observers.front(), range, size, r2, Engine::ALGORITHM_R2) &&
+            engine->computeViewshed(observers.front(), range, size, r3, Engine::ALGORITHM_R3))
+        {
+            unsigned same = 0u;
+            for (unsigned j = 0; j < size; ++j)
+                for (unsigned i = 0; i < size; ++i)
+                    if (memcmp(r2.getImage()->data(i, j), r3.getImage()->data(i, j), 4) == 0)
+                        ++same;
+            agreement = 100.0 * (double)same / (double)(size * size);
+        }
+
+        std::cout
+            << "Line of sight, " << url << ", level " << level
+            << " (" << std::fixed << std::setprecision(1) << engine->getSampleSpacing() << " m samples)\n"
+            << numQueries << " lines of " << range << " m, " << numVisible << " clear; "
+            << observers.size() << " viewsheds of " << size << "x" << size << " cells, "
+            << "R2 matches R3 on " << agreement << "% of cells\n"
+            << std::setw(8) << "threads" << std::setw(14) << "LOS/s"
+            << std::setw(18) << "R2 viewsheds/s" << std::setw(18) << "R3 viewsheds/s"
+            << std::endl;
+
+        std::vector<GeoImage> images;
+        for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+        {
+            engine->setNumThreads(numThreads);
+
+            osg::Timer_t start = osg::Timer::instance()->tick();
+            engine->computeLineOfSight(queries, results);
+            double losRate = (double)numQueries / osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            start = osg::Timer::instance()->tick();
+            engine->computeViewsheds(observers, range, size, images, Engine::ALGORITHM_R2);
+            double r2Rate = (double)observers.size() / osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            start = osg::Timer::instance()->tick();
+            engine->computeViewsheds(observers, range, size, images, Engine::ALGORITHM_R3);
+            double r3Rate = (double)observers.size() / osg::Timer::instance()->delta_s(start, osg::Timer::instance()->tick());
+
+            std::cout
+                << std::fixed << std::setprecision(1)
+                << std::setw(8) << numThreads << std::setw(14) << losRate
+                << std::setw(18) << r2Rate << std::setw(18) << r3Rate
+                << std::endl;
+        }
+
+        return 0;
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    osg::ArgumentParser args(&argc, argv);
+
+    if (argc <= 1 || args.read("--help"))
+        return usage(argv);
+
+    int iterations = 50;
+    args.read("--iterations", iterations);
+
+    int size = 256;
+    args.read("--size", size);
+
+    srand(12345);
+
+    int result = 0;
+
+    if (args.read("--imageutils"))
+        result |= benchImageUtils(size, iterations);
+
+    std::string gdalURL;
+    if (args.read("--gdal", gdalURL))
+    {
+        bool elevation = args.read("--elevation");
+
+        int level = -1;
+        args.read("--level", level);
+
+        unsigned numTiles = 256u;
+        args.read("--tiles", numTiles);
+
+        unsigned maxThreads = 16u;
+        args.read("--max-threads", maxThreads);
+
+        result |= benchGDAL(gdalURL, level, numTiles, maxThreads, elevation);
+    }
+
+    std::string mbtilesFile;
+    if (args.read("--mbtiles", mbtilesFile))
+    {
+        int level = -1;
+        args.read("--level", level);
+
+        unsigned numTiles = 4096u;
+        args.read("--tiles", numTiles);
+
+        unsigned maxThreads = 16u;
+        args.read("--max-threads", maxThreads);
+
+        result |= benchMBTiles(mbtilesFile, level, numTiles, maxThreads);
+    }
+
+    std::string httpURL;
+    if (args.read("--http", httpURL))
+    {
+        unsigned numRequests = 500u;
+        args.read("--requests", numRequests);
+
+        unsigned maxThreads = 16u;
+        args.read("--max-threads", maxThreads);
+
+        result |= benchHTTP(httpURL, numRequests, maxThreads);
+    }
+
+    if (args.read("--cluster"))
+    {
+        unsigned numPoints = 1000000u;
+        args.read("--points", numPoints);
+
+        int radius = 50;
+        args.read("--radius", radius);
+
+        result |= benchCluster(numPoints, radius, iterations);
+    }
+
+    std::string losURL;
+    if (args.read("--los", losURL))
+    {
+        int level = -1;
+        args.read("--level", level);
+
+        unsigned numQueries = 10000u;
+        args.read("--queries", numQueries);
+
+        double range = 10000.0;
+        args.read("--range", range);
+
+        unsigned maxThreads = 16u;
+        args.read("--max-threads", maxThreads);
+
+        result |= benchLineOfSight(losURL, level, numQueries, range, (unsigned)size, maxThreads);
+    }
+
+    return result;
+}
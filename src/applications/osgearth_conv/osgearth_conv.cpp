@@ -48,6 +48,9 @@ int usage(char** argv)
         << "\n    --profile [profile def]             : set an output profile (optional; default = same as input)"
         << "\n    --min-level [int]                   : minimum level of detail"
         << "\n    --max-level [int]                   : maximum level of detail"
+        << "\n    --threads [int]                     : number of threads to use"
+        << "\n    --pyramid                           : read the source at the max level only, and downsample the levels above it"
+        << "\n    --checkpoint [file]                 : with --pyramid, record progress in a file, and resume from it"
         << "\n    --osg-options [OSG options string]  : options to pass to OSG readers/writers"
         << "\n    --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy"
         << std::endl;
@@ -59,7 +62,7 @@ int usage(char** argv)
 // TileHandler that copies images from an ImageLayer to a TileSource.
 // This will automatically handle any mosaicing and reprojection that is
 // necessary to translate from one Profile/SRS to another.
-struct ImageLayerToTileSource : public TileHandler
+struct ImageLayerToTileSource : public PyramidTileHandler
 {
     ImageLayerToTileSource(ImageLayer* source, TileSource* dest)
         : _source(source), _dest(dest)
@@ -67,17 +70,32 @@ struct ImageLayerToTileSource : public TileHandler
         //nop
     }
 
-    bool handleTile(const TileKey& key, const TileVisitor& tv)
+    osg::ref_ptr<osg::Object> createTile(const TileKey& key)
     {
-        bool ok = false;
         GeoImage image = _source->createImage(key);
         if (image.valid())
         {
             //OE_INFO << "Read " << key.str() << ", image size = " << image.getImage()->s() << std::endl;
-            ok = _dest->storeImage(key, image.getImage(), 0L);
+            if (_dest->storeImage(key, image.getImage(), 0L))
+                return image.getImage();
         }
+        return 0L;
+    }
 
-        return ok;
+    bool storeParentTile(const TileKey& key, osg::Object* tile)
+    {
+        osg::Image* image = dynamic_cast<osg::Image*>(tile);
+        return image && _dest->storeImage(key, image, 0L);
+    }
+
+    osg::ref_ptr<osg::Object> readTile(const TileKey& key)
+    {
+        return _dest->createImage(key);
+    }
+
+    void flush()
+    {
+        _dest->flush();
     }
 
     bool hasData(const TileKey& key) const
@@ -93,7 +111,7 @@ struct ImageLayerToTileSource : public TileHandler
 // TileHandler that copies images from an ElevationLayer to a TileSource.
 // This will automatically handle any mosaicing and reprojection that is
 // necessary to translate from one Profile/SRS to another.
-struct ElevationLayerToTileSource : public TileHandler
+struct ElevationLayerToTileSource : public PyramidTileHandler
 {
     ElevationLayerToTileSource(ElevationLayer* source, TileSource* dest)
         : _source(source), _dest(dest)
@@ -101,13 +119,28 @@ struct ElevationLayerToTileSource : public TileHandler
         //nop
     }
 
-    bool handleTile(const TileKey& key, const TileVisitor& tv)
+    osg::ref_ptr<osg::Object> createTile(const TileKey& key)
     {
-        bool ok = false;
         GeoHeightField hf = _source->createHeightField(key, 0L);
-        if ( hf.valid() )
-            ok = _dest->storeHeightField(key, hf.getHeightField(), 0L);
-        return ok;
+        if ( hf.valid() && _dest->storeHeightField(key, hf.getHeightField(), 0L) )
+            return const_cast<osg::HeightField*>(hf.getHeightField());
+        return 0L;
+    }
+
+    bool storeParentTile(const TileKey& key, osg::Object* tile)
+    {
+        osg::HeightField* hf = dynamic_cast<osg::HeightField*>(tile);
+        return hf && _dest->storeHeightField(key, hf, 0L);
+    }
+
+    osg::ref_ptr<osg::Object> readTile(const TileKey& key)
+    {
+        return _dest->createHeightField(key);
+    }
+
+    void flush()
+    {
+        _dest->flush();
     }
 
     bool hasData(const TileKey& key) const
@@ -200,6 +233,9 @@ struct ProgressReporter : public osgEarth::ProgressCallback
  *      --min-level [int]     : min level of detail to copy
  *      --max-level [int]     : max level of detail to copy
  *      --threads [n]         : threads to use (may crash. Careful.)
+ *      --pyramid             : build the levels above the max level by downsampling
+ *                              the one below, instead of reading the source again
+ *      --checkpoint [file]   : with --pyramid, resume from (and record progress in) a file
  *
  *      --extents [minLat] [minLong] [maxLat] [maxLong] : Lat/Long extends to copy (*)
  *
@@ -333,7 +369,20 @@ main(int argc, char** argv)
     osg::ref_ptr<TileVisitor> visitor;
 
     unsigned numThreads = 1;
-    if (args.read("--threads", numThreads))
+    bool threads = args.read("--threads", numThreads);
+
+    if (args.read("--pyramid"))
+    {
+        PyramidTileVisitor* ptv = new PyramidTileVisitor();
+        ptv->setNumThreads( threads ? osg::maximum(numThreads, 1u) : 1u );
+
+        std::string checkpoint;
+        if (args.read("--checkpoint", checkpoint))
+            ptv->setCheckpointFile( checkpoint );
+
+        visitor = ptv;
+    }
+    else if (threads)
     {
         MultithreadedTileVisitor* mtv = new MultithreadedTileVisitor();
         mtv->setNumThreads( numThreads < 1 ? 1 : numThreads );
@@ -437,6 +486,13 @@ main(int argc, char** argv)
 
     osg::Timer_t t1 = osg::Timer::instance()->tick();
 
+    output->flush();
+    if ( output->hasWriteError() )
+    {
+        OE_WARN << LC << "Failed to write some tiles to the output." << std::endl;
+        return -1;
+    }
+
     std::cout
         << "Time = "
         << std::fixed
@@ -29,6 +29,7 @@
 #include <osgEarth/Cache>
 #include <osgEarth/CacheEstimator>
 #include <osgEarth/CacheSeed>
+#include <osgEarth/CachePack>
 #include <osgEarth/MapNode>
 #include <osgEarth/Registry>
 #include <osgEarth/FileUtils>
@@ -53,6 +54,7 @@ using namespace osgEarth::Drivers;
 int list( osg::ArgumentParser& args );
 int seed( osg::ArgumentParser& args );
 int purge( osg::ArgumentParser& args );
+int pack( osg::ArgumentParser& args );
 int usage( const std::string& msg );
 int message( const std::string& msg );
 
@@ -68,6 +70,8 @@ int
         return list( args );
     else if ( args.read( "--purge" ) )
         return purge( args );        
+    else if ( args.read( "--pack" ) )
+        return pack( args );
     else
     return usage("");
 }
@@ -94,10 +98,20 @@ int
         << "        [--index shapefile]             ; Use the feature extents in a shapefile to set the bounding boxes for seeding" << std::endl
         << "        [--mp]                          ; Use multiprocessing to process the tiles.  Useful for GDAL sources as this avoids the global GDAL lock" << std::endl
         << "        [--mt]                          ; Use multithreading to process the tiles." << std::endl
-        << "        [--concurrency]                 ; The number of threads or processes to use if --mp or --mt are provided." << std::endl
+        << "        [--pyramid]                     ; Read the layers at the max level only, and downsample the levels above it." << std::endl
+        << "        [--checkpoint file]             ; With --pyramid, record progress in a file, and resume from it." << std::endl
+        << "        [--concurrency]                 ; The number of threads or processes to use if --mp, --mt or --pyramid are provided." << std::endl
         << "        [--verbose]                     ; Displays progress of the seed operation" << std::endl
         << std::endl
         << "    --purge file.earth                  ; Purges a layer cache in a .earth file (interactive)" << std::endl
+        << std::endl
+        << "    --pack file.earth                   ; Copies a seeded cache into a read-only, memory-mapped cache pack (driver=\"pack\")" << std::endl
+        << "        --out file.pack                 ; Pack file to create" << std::endl
+        << "        [--compress]                    ; Store images compressed instead of as raw pixels" << std::endl
+        << "        [--min-level level]             ; Lowest LOD level to pack (default=0)" << std::endl
+        << "        [--max-level level]             ; Highest LOD level to pack (default=highest available)" << std::endl
+        << "        [--bounds xmin ymin xmax ymax]* ; Geospatial bounding box to pack (in map coordinates; default=entire map)" << std::endl
+        << "        [--verbose]                     ; Displays progress of the pack operation" << std::endl
         << std::endl;
 
     return -1;
@@ -153,6 +167,9 @@ seed( osg::ArgumentParser& args )
     args.read("-c", concurrency);
     args.read("--concurrency", concurrency);
 
+    std::string checkpoint;
+    args.read("--checkpoint", checkpoint);
+
     int imageLayerIndex = -1;
     args.read("--image", imageLayerIndex);
 
@@ -243,10 +260,23 @@ seed( osg::ArgumentParser& args )
     }
   
 
+    osg::ref_ptr< PyramidTileVisitor > pyramid;
+
     // If we dont' have a visitor create one.
     if (!visitor.valid())
     {
-        if (args.read("--mt"))
+        if (args.read("--pyramid"))
+        {
+            // Create a bottom-up pyramid builder
+            pyramid = new PyramidTileVisitor();
+            if (concurrency > 0)
+            {
+                pyramid->setNumThreads(concurrency);
+            }
+            pyramid->setCheckpointFile(checkpoint);
+            visitor = pyramid.get();
+        }
+        else if (args.read("--mt"))
         {
             // Create a multithreaded visitor
             MultithreadedTileVisitor* v = new MultithreadedTileVisitor();
@@ -371,6 +401,11 @@ seed( osg::ArgumentParser& args )
         {            
             osg::ref_ptr< TerrainLayer > layer = terrainLayers[i].get();
             OE_NOTICE << "Seeding layer" << layer->getName() << std::endl;            
+            if (pyramid.valid() && !checkpoint.empty())
+            {
+                // one checkpoint per layer
+                pyramid->setCheckpointFile(Stringify() << checkpoint << "." << i);
+            }
             osg::Timer_t start = osg::Timer::instance()->tick();
             seeder.run(layer.get(), map);            
             osg::Timer_t end = osg::Timer::instance()->tick();
@@ -589,4 +624,84 @@ purge( osg::ArgumentParser& args )
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+
+int
+pack( osg::ArgumentParser& args )
+{
+    std::string outFile;
+    if ( !args.read("--out", outFile) )
+        return usage( "Missing required --out argument." );
+
+    bool compress = args.read("--compress");
+
+    int minLevel = -1;
+    while (args.read("--min-level", minLevel));
+
+    int maxLevel = -1;
+    while (args.read("--max-level", maxLevel));
+
+    std::vector< Bounds > bounds;
+    double xmin=DBL_MAX, ymin=DBL_MAX, xmax=DBL_MIN, ymax=DBL_MIN;
+    while (args.read("--bounds", xmin, ymin, xmax, ymax ))
+    {        
+        Bounds b;
+        b.xMin() = xmin, b.yMin() = ymin, b.xMax() = xmax, b.yMax() = ymax;
+        bounds.push_back( b );
+    }    
+
+    bool verbose = args.read("--verbose");
+
+    // Only read what is already in the cache; never go to the data sources.
+    Registry::instance()->setOverrideCachePolicy( CachePolicy::CACHE_ONLY );
+
+    osg::ref_ptr<osg::Node> node = osgDB::readNodeFiles( args );
+    if ( !node.valid() )
+        return usage( "Failed to read .earth file." );
+
+    MapNode* mapNode = MapNode::findMapNode( node.get() );
+    if ( !mapNode )
+        return usage( "Input file was not a .earth file" );
+
+    osgEarth::Map* map = mapNode->getMap();
+    if ( !map->getCache() )
+        return message( "Earth file does not contain a cache." );
+
+    osg::ref_ptr<CachePackWriter> writer = new CachePackWriter( outFile, compress );
+    if ( !writer->isOpen() )
+        return message( "Failed to create the output file." );
+
+    osg::ref_ptr< TileVisitor > visitor = new TileVisitor();
+
+    if (verbose)
+        visitor->setProgressCallback( new ConsoleProgressCallback() );
+    if ( minLevel >= 0 )
+        visitor->setMinLevel( minLevel );
+    if ( maxLevel >= 0 )
+        visitor->setMaxLevel( maxLevel );
+
+    for (unsigned int i = 0; i < bounds.size(); i++)
+    {
+        visitor->addExtent( GeoExtent(mapNode->getMapSRS(), bounds[i]) );
+    }
+
+    CacheSeed seeder;
+    seeder.setVisitor( visitor.get() );
+
+    TerrainLayerVector terrainLayers;
+    map->getLayers( terrainLayers );
+
+    for (unsigned int i = 0; i < terrainLayers.size(); ++i)
+    {
+        TerrainLayer* layer = terrainLayers[i].get();
+        OE_NOTICE << "Packing layer " << layer->getName() << std::endl;
+        seeder.pack( layer, map, writer.get() );
+    }
+
+    if ( !writer->close() )
+        return message( "Failed to write the cache pack." );
+
+    std::cout << "Wrote " << writer->getNumRecords() << " records to " << outFile << std::endl;
+    return 0;
+}
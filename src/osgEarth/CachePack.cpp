@@ -0,0 +1,298 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/CachePack>
+#include <osgEarth/IOTypes>
+#include <osgEarth/Registry>
+#include <osg/Image>
+#include <osg/Shape>
+#include <osgDB/Registry>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#define LC "[CachePackWriter] "
+
+using namespace osgEarth;
+
+const char CachePack::MAGIC[8] = { 'O', 'E', 'P', 'A', 'C', 'K', '\0', '\0' };
+
+CachePackWriter::CachePackWriter(const std::string& filename, bool compressImages) :
+_filename      ( filename ),
+_open          ( false ),
+_compressImages( compressImages ),
+_offset        ( 0u ),
+_numRecords    ( 0u )
+{
+    _out.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (_out.is_open())
+    {
+        // placeholder; the real header is written by close().
+        CachePack::Header header;
+        ::memset(&header, 0, sizeof(header));
+        append(&header, sizeof(header));
+        _open = _out.good();
+    }
+
+    if (!_open)
+    {
+        OE_WARN << LC << "Failed to open \"" << filename << "\" for writing" << std::endl;
+    }
+}
+
+CachePackWriter::~CachePackWriter()
+{
+    close();
+}
+
+unsigned long long
+CachePackWriter::append(const void* data, unsigned long long length)
+{
+    // pad so that every payload starts on an aligned boundary
+    static const char zeros[CachePack::ALIGNMENT] = { 0 };
+    unsigned pad = (unsigned)((CachePack::ALIGNMENT - (_offset % CachePack::ALIGNMENT)) % CachePack::ALIGNMENT);
+    if (pad > 0)
+    {
+        _out.write(zeros, pad);
+        _offset += pad;
+    }
+
+    unsigned long long start = _offset;
+    if (length > 0)
+    {
+        _out.write(static_cast<const char*>(data), (std::streamsize)length);
+        _offset += length;
+    }
+    return start;
+}
+
+void
+CachePackWriter::setBinMetadata(const std::string& binID, const Config& meta)
+{
+    Threading::ScopedMutexLock lock(_mutex);
+    _bins[binID]._meta = meta;
+}
+
+bool
+CachePackWriter::encode(const osg::Object* object, CachePack::Record& rec)
+{
+    const StringObject* str = dynamic_cast<const StringObject*>(object);
+    if (str)
+    {
+        rec.type = CachePack::PAYLOAD_STRING;
+        rec.dataLength = str->getString().length();
+        rec.dataOffset = append(str->getString().data(), rec.dataLength);
+        return true;
+    }
+
+    const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+    if (image && !_compressImages && image->getNumMipmapLevels() <= 1 && image->isDataContiguous() && image->data())
+    {
+        // raw pixels, so the reader can point an osg::Image right at the mapped file.
+        rec.type = CachePack::PAYLOAD_IMAGE;
+        rec.s = image->s();
+        rec.t = image->t();
+        rec.r = image->r();
+        rec.internalFormat = image->getInternalTextureFormat();
+        rec.pixelFormat = image->getPixelFormat();
+        rec.dataType = image->getDataType();
+        rec.packing = image->getPacking();
+        rec.dataLength = image->getTotalSizeInBytes();
+        rec.dataOffset = append(image->data(), rec.dataLength);
+        return true;
+    }
+
+    const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object);
+    if (hf && hf->getFloatArray() && hf->getRotation().zeroRotation())
+    {
+        CachePack::HeightFieldHeader hfh;
+        ::memset(&hfh, 0, sizeof(hfh));
+        hfh.originX = hf->getOrigin().x();
+        hfh.originY = hf->getOrigin().y();
+        hfh.originZ = hf->getOrigin().z();
+        hfh.xInterval = hf->getXInterval();
+        hfh.yInterval = hf->getYInterval();
+        hfh.skirtHeight = hf->getSkirtHeight();
+        hfh.borderWidth = hf->getBorderWidth();
+        hfh.columns = hf->getNumColumns();
+        hfh.rows = hf->getNumRows();
+
+        rec.type = CachePack::PAYLOAD_HEIGHTFIELD;
+        rec.s = hfh.columns;
+        rec.t = hfh.rows;
+        rec.r = 1;
+        rec.dataOffset = append(&hfh, sizeof(hfh));
+        unsigned long long samples = (unsigned long long)hfh.columns * hfh.rows * sizeof(float);
+        _out.write((const char*)&hf->getFloatArray()->front(), (std::streamsize)samples);
+        _offset += samples;
+        rec.dataLength = sizeof(hfh) + samples;
+        return true;
+    }
+
+    // Anything else goes through the osgb serializer.
+    osgDB::ReaderWriter* rw = osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+    if (!rw)
+        return false;
+
+    osg::ref_ptr<osgDB::Options> dbo = Registry::cloneOrCreateOptions();
+    dbo->setPluginStringData("Compressor", "zlib");
+
+    std::stringstream buf;
+    osgDB::ReaderWriter::WriteResult wr =
+        image ? rw->writeImage(*image, buf, dbo.get()) :
+        rw->writeObject(*object, buf, dbo.get());
+
+    if (!wr.success())
+        return false;
+
+    std::string data = buf.str();
+    rec.type = CachePack::PAYLOAD_OSGB;
+    rec.dataLength = data.length();
+    rec.dataOffset = append(data.data(), rec.dataLength);
+    return true;
+}
+
+bool
+CachePackWriter::write(const std::string&  binID,
+                       const std::string&  key,
+                       const osg::Object*  object,
+                       const Config&       meta,
+                       TimeStamp           timestamp)
+{
+    if (!object)
+        return false;
+
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (!_open)
+        return false;
+
+    PendingRecord pr;
+    ::memset(&pr._rec, 0, sizeof(pr._rec));
+    pr._key = key;
+    pr._rec.hash = CachePack::hashKey(key.data(), key.length());
+    pr._rec.timestamp = (long long)timestamp;
+
+    if (!encode(object, pr._rec))
+    {
+        OE_WARN << LC << "Failed to encode record \"" << key << "\" in bin [" << binID << "]" << std::endl;
+        return false;
+    }
+
+    pr._rec.keyLength = key.length();
+    pr._rec.keyOffset = append(key.data(), key.length());
+
+    if (!meta.empty())
+    {
+        std::string json = meta.toJSON(false);
+        pr._rec.metaLength = json.length();
+        pr._rec.metaOffset = append(json.data(), json.length());
+    }
+
+    if (!_out.good())
+    {
+        OE_WARN << LC << "Error writing to \"" << _filename << "\"" << std::endl;
+        _open = false;
+        return false;
+    }
+
+    _bins[binID]._records.push_back(pr);
+    ++_numRecords;
+    return true;
+}
+
+bool
+CachePackWriter::close()
+{
+    Threading::ScopedMutexLock lock(_mutex);
+
+    if (!_open)
+        return false;
+
+    _open = false;
+
+    // names and bin metadata go in the payload area:
+    std::vector<CachePack::Bin> bins;
+    for (std::map<std::string, PendingBin>::iterator i = _bins.begin(); i != _bins.end(); ++i)
+    {
+        CachePack::Bin bin;
+        ::memset(&bin, 0, sizeof(bin));
+        bin.nameLength = i->first.length();
+        bin.nameOffset = append(i->first.data(), i->first.length());
+
+        if (!i->second._meta.empty())
+        {
+            std::string json = i->second._meta.toJSON(false);
+            bin.metaLength = json.length();
+            bin.metaOffset = append(json.data(), json.length());
+        }
+
+        bin.numRecords = i->second._records.size();
+        bins.push_back(bin);
+    }
+
+    // bin table, followed by each bin's sorted record table:
+    unsigned long long binsOffset = append(0L, 0u);
+    unsigned long long recordsOffset = binsOffset + bins.size() * sizeof(CachePack::Bin);
+    unsigned b = 0;
+    for (std::map<std::string, PendingBin>::iterator i = _bins.begin(); i != _bins.end(); ++i, ++b)
+    {
+        bins[b].recordsOffset = recordsOffset;
+        recordsOffset += i->second._records.size() * sizeof(CachePack::Record);
+    }
+
+    if (!bins.empty())
+        append(&bins.front(), bins.size() * sizeof(CachePack::Bin));
+
+    for (std::map<std::string, PendingBin>::iterator i = _bins.begin(); i != _bins.end(); ++i)
+    {
+        std::vector<PendingRecord>& records = i->second._records;
+        std::sort(records.begin(), records.end());
+        for (std::vector<PendingRecord>::const_iterator r = records.begin(); r != records.end(); ++r)
+        {
+            _out.write((const char*)&r->_rec, sizeof(CachePack::Record));
+            _offset += sizeof(CachePack::Record);
+        }
+    }
+
+    // and finally the real header:
+    CachePack::Header header;
+    ::memset(&header, 0, sizeof(header));
+    ::memcpy(header.magic, CachePack::MAGIC, sizeof(header.magic));
+    header.version = CachePack::VERSION;
+    header.byteOrder = CachePack::BYTE_ORDER_MARK;
+    header.binsOffset = binsOffset;
+    header.numBins = bins.size();
+    _out.seekp(0);
+    _out.write((const char*)&header, sizeof(header));
+
+    bool ok = _out.good();
+    _out.close();
+    _bins.clear();
+
+    if (ok)
+    {
+        OE_INFO << LC << "Wrote " << _numRecords << " records to \"" << _filename << "\"" << std::endl;
+    }
+    else
+    {
+        OE_WARN << LC << "Error writing to \"" << _filename << "\"" << std::endl;
+    }
+
+    return ok;
+}
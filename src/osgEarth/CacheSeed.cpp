@@ -22,6 +22,8 @@
 
 #include <osgEarth/CacheSeed>
 #include <osgEarth/ImageLayer>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/Cache>
 
 #define LC "[CacheSeed] "
 
@@ -72,6 +74,50 @@ bool CacheTileHandler::hasData( const TileKey& key ) const
     return _layer->mayHaveData(key);
 }
 
+osg::ref_ptr<osg::Object> CacheTileHandler::createTile(const TileKey& key)
+{
+    ImageLayer* imageLayer = dynamic_cast< ImageLayer* >( _layer.get() );
+    ElevationLayer* elevationLayer = dynamic_cast< ElevationLayer* >( _layer.get() );
+
+    // the layer caches what it creates.
+    if (imageLayer)
+    {
+        GeoImage image = imageLayer->createImage( key );
+        if (image.valid())
+            return image.getImage();
+    }
+    else if (elevationLayer)
+    {
+        GeoHeightField hf = elevationLayer->createHeightField( key, 0L );
+        if (hf.valid())
+            return const_cast<osg::HeightField*>( hf.getHeightField() );
+    }
+    return 0L;
+}
+
+bool CacheTileHandler::storeParentTile(const TileKey& key, osg::Object* tile)
+{
+    CacheSettings* settings = _layer->getCacheSettings();
+    CacheBin* bin = settings ? settings->getCacheBin() : 0L;
+    if (!bin || !settings->cachePolicy()->isCacheWriteable())
+        return false;
+
+    ImageLayer* imageLayer = dynamic_cast< ImageLayer* >( _layer.get() );
+
+    // same cache key the layer uses when it writes the tile.
+    std::string cacheKey = Cache::makeCacheKey(
+        Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature(),
+        imageLayer ? "image" : "elevation");
+
+    return bin->write(cacheKey, tile, 0L);
+}
+
+osg::ref_ptr<osg::Object> CacheTileHandler::readTile(const TileKey& key)
+{
+    // comes from the cache, if it's there.
+    return createTile( key );
+}
+
 std::string CacheTileHandler::getProcessString() const
 {
     std::stringstream buf;
@@ -96,6 +142,48 @@ std::string CacheTileHandler::getProcessString() const
 
 
 
+/***************************************************************************************/
+
+CachePackTileHandler::CachePackTileHandler( TerrainLayer* layer, const Map* map, CachePackWriter* writer ):
+_layer( layer ),
+_map( map ),
+_writer( writer )
+{
+}
+
+bool CachePackTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
+{
+    CacheBin* bin = _layer->getCacheSettings()->getCacheBin();
+    if (!bin)
+        return false;
+
+    ImageLayer* imageLayer = dynamic_cast< ImageLayer* >( _layer.get() );
+
+    // same cache key the layer uses when it writes the tile.
+    std::string cacheKey = Cache::makeCacheKey(
+        Stringify() << key.str() << "-" << key.getProfile()->getHorizSignature(),
+        imageLayer ? "image" : "elevation");
+
+    ReadResult r = imageLayer ? bin->readImage(cacheKey, 0L) : bin->readObject(cacheKey, 0L);
+    if (r.succeeded())
+    {
+        return _writer->write(bin->getID(), cacheKey, r.getObject(), r.metadata(), r.lastModifiedTime());
+    }
+
+    // Nothing cached, but the key may be above the layer's min level; keep going.
+    if (!_layer->isKeyInLegalRange(key))
+    {
+        return true;
+    }
+
+    return false;
+}
+
+bool CachePackTileHandler::hasData( const TileKey& key ) const
+{
+    return _layer->mayHaveData(key);
+}
+
 /***************************************************************************************/
 
 CacheSeed::CacheSeed():
@@ -116,5 +204,53 @@ void CacheSeed::setVisitor(TileVisitor* visitor)
 void CacheSeed::run( TerrainLayer* layer, const Map* map )
 {
     _visitor->setTileHandler( new CacheTileHandler( layer, map ) );
+
+    // A pyramid reads the source only at its max level, so don't let that
+    // be deeper than the layer's data.
+    PyramidTileVisitor* pyramid = dynamic_cast< PyramidTileVisitor* >( _visitor.get() );
+    unsigned int maxLevel = _visitor->getMaxLevel();
+    if (pyramid && layer->getProfile())
+    {
+        unsigned int dataMaxLevel = 0;
+        for (DataExtentList::const_iterator i = layer->getDataExtents().begin(); i != layer->getDataExtents().end(); ++i)
+        {
+            if (i->maxLevel().isSet())
+            {
+                dataMaxLevel = osg::maximum( dataMaxLevel, map->getProfile()->getEquivalentLOD(layer->getProfile(), i->maxLevel().get()) );
+            }
+        }
+
+        if (dataMaxLevel > 0 && dataMaxLevel < maxLevel)
+        {
+            OE_INFO << LC << "Building the pyramid for \"" << layer->getName() << "\" from level " << dataMaxLevel << std::endl;
+            _visitor->setMaxLevel( dataMaxLevel );
+        }
+    }
+
     _visitor->run( map->getProfile() );
-}
\ No newline at end of file
+    _visitor->setMaxLevel( maxLevel );
+}
+
+void CacheSeed::pack( TerrainLayer* layer, const Map* map, CachePackWriter* writer )
+{
+    CacheBin* bin = layer->getCacheSettings()->getCacheBin();
+    if (!bin)
+    {
+        OE_WARN << LC << "Layer \"" << layer->getName() << "\" has no cache to pack" << std::endl;
+        return;
+    }
+
+    writer->setBinMetadata( bin->getID(), bin->readMetadata() );
+
+    // the layer's metadata record (see TerrainLayer::getMetadataKey), so that
+    // the layer can open from the pack in cache-only mode.
+    std::string metaKey = Stringify() << map->getProfile()->getHorizSignature() << "_metadata";
+    ReadResult r = bin->readString( metaKey, 0L );
+    if (r.succeeded())
+    {
+        writer->write( bin->getID(), metaKey, r.getObject(), r.metadata(), r.lastModifiedTime() );
+    }
+
+    _visitor->setTileHandler( new CachePackTileHandler( layer, map, writer ) );
+    _visitor->run( map->getProfile() );
+}
@@ -0,0 +1,154 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarth/DeclutterGrid>
+#include <osg/Math>
+
+using namespace osgEarth;
+
+//----------------------------------------------------------------------------
+
+namespace
+{
+    enum { CELL_SIZE = 64, MAX_CELLS = 256 };
+}
+
+DeclutterGrid::DeclutterGrid() :
+_x0(0.0f), _y0(0.0f), _cols(1), _rows(1)
+{
+    //nop
+}
+
+void
+DeclutterGrid::reset(const osg::Viewport* vp)
+{
+    _boxes.clear();
+    _unbounded.clear();
+
+    _x0 = vp->x();
+    _y0 = vp->y();
+    _cols = osg::clampBetween((int)ceil(vp->width()  / CELL_SIZE), 1, (int)MAX_CELLS);
+    _rows = osg::clampBetween((int)ceil(vp->height() / CELL_SIZE), 1, (int)MAX_CELLS);
+
+    // keep the cells' storage from frame to frame
+    if ( _cells.size() < (unsigned)(_cols*_rows) )
+        _cells.resize( _cols*_rows );
+    for(unsigned i=0; i<_cells.size(); ++i)
+        _cells[i].clear();
+}
+
+void
+DeclutterGrid::insert(const osg::Node* parent, const osg::BoundingBox& box)
+{
+    unsigned index = _boxes.size();
+    _boxes.push_back( std::make_pair(parent, box) );
+
+    int c0, c1, r0, r1;
+    if ( !range(box, c0, c1, r0, r1) )
+    {
+        _unbounded.push_back( index );
+        return;
+    }
+
+    for(int r=r0; r<=r1; ++r)
+        for(int c=c0; c<=c1; ++c)
+            _cells[r*_cols+c].push_back( index );
+}
+
+bool
+DeclutterGrid::isClear(const osg::Node* parent, const osg::BoundingBox& box) const
+{
+    for(unsigned i=0; i<_unbounded.size(); ++i)
+        if ( overlaps(parent, box, _boxes[_unbounded[i]]) )
+            return false;
+
+    int c0, c1, r0, r1;
+    if ( !range(box, c0, c1, r0, r1) )
+    {
+        // a NaN box overlaps everything, same as a brute-force test would find
+        for(unsigned i=0; i<_boxes.size(); ++i)
+            if ( overlaps(parent, box, _boxes[i]) )
+                return false;
+        return true;
+    }
+
+    for(int r=r0; r<=r1; ++r)
+    {
+        for(int c=c0; c<=c1; ++c)
+        {
+            const std::vector<unsigned>& cell = _cells[r*_cols+c];
+            for(unsigned i=0; i<cell.size(); ++i)
+                if ( overlaps(parent, box, _boxes[cell[i]]) )
+                    return false;
+        }
+    }
+    return true;
+}
+
+bool
+DeclutterGrid::overlaps(const osg::Node* parent, const osg::BoundingBox& box, const RenderLeafBox& used)
+{
+    // only need a 2D test since we're in clip space
+    bool isClear =
+        box.xMin() > used.second.xMax() ||
+        box.xMax() < used.second.xMin() ||
+        box.yMin() > used.second.yMax() ||
+        box.yMax() < used.second.yMin();
+
+    // a conflict with the same drawable parent is acceptable.
+    return !isClear && parent != used.first;
+}
+
+bool
+DeclutterGrid::range(const osg::BoundingBox& box, int& c0, int& c1, int& r0, int& r1) const
+{
+    if ( osg::isNaN(box.xMin()) || osg::isNaN(box.xMax()) ||
+         osg::isNaN(box.yMin()) || osg::isNaN(box.yMax()) )
+        return false;
+
+    // An inverted box (min > max) can still overlap a box that spans it,
+    // so index it over the span between its corners.
+    c0 = cell(osg::minimum(box.xMin(), box.xMax()), _x0, _cols);
+    c1 = cell(osg::maximum(box.xMin(), box.xMax()), _x0, _cols);
+    r0 = cell(osg::minimum(box.yMin(), box.yMax()), _y0, _rows);
+    r1 = cell(osg::maximum(box.yMin(), box.yMax()), _y0, _rows);
+    return true;
+}
+
+int
+DeclutterGrid::cell(float v, float origin, int count)
+{
+    float c = (v - origin) / (float)CELL_SIZE;
+    return c <= 0.0f ? 0 : c >= (float)(count-1) ? count-1 : (int)c;
+}
+
+//----------------------------------------------------------------------------
+
+bool
+DeclutterRecord::matches(const osg::Drawable* drawable, const osg::Node* parent, float priority, const osg::BoundingBox& box, float tolerance) const
+{
+    return
+        tolerance > 0.0f &&
+        _drawable == drawable &&
+        _parent   == parent   &&
+        _priority == priority &&
+        osg::absolute(_box.xMin() - box.xMin()) <= tolerance &&
+        osg::absolute(_box.xMax() - box.xMax()) <= tolerance &&
+        osg::absolute(_box.yMin() - box.yMin()) <= tolerance &&
+        osg::absolute(_box.yMax() - box.yMax()) <= tolerance;
+}
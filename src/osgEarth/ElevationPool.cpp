@@ -19,6 +19,12 @@
 #include <osgEarth/ElevationPool>
 #include <osgEarth/Map>
 #include <osgEarth/Metrics>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OE_ELEVATION_POOL_SSE2
+#endif
 
 using namespace osgEarth;
 
@@ -27,11 +33,19 @@ using namespace osgEarth;
 #define OE_TEST OE_DEBUG
 
 
+#define NUM_SHARDS 16u
+
 ElevationPool::ElevationPool() :
-_entries(0u),
-_maxEntries( 128u ),
+_loads( 0u ),
+_loadTime( 0.0 ),
 _tileSize( 257u )
 {
+    _maxEntries.exchange(128u);
+
+    _shards.resize(NUM_SHARDS);
+    for (unsigned i = 0; i < _shards.size(); ++i)
+        _shards[i] = new Shard();
+
     //nop
     //_opQueue = Registry::instance()->getAsyncOperationQueue();
     if (!_opQueue.valid())
@@ -50,23 +64,76 @@ _tileSize( 257u )
 ElevationPool::~ElevationPool()
 {
     stopThreading();
+
+    for (unsigned i = 0; i < _shards.size(); ++i)
+        delete _shards[i];
 }
 
 void
 ElevationPool::setMap(const Map* map)
 {
-    Threading::ScopedMutexLock lock(_tilesMutex);
-    _map = map;
+    {
+        Threading::ScopedMutexLock lock(_tilesMutex);
+        _map = map;
+    }
     clearImpl();
 }
 
 void
 ElevationPool::clear()
 {
-    Threading::ScopedMutexLock lock(_tilesMutex);
     clearImpl();
 }
 
+void
+ElevationPool::setMaxEntries(unsigned maxEntries)
+{
+    _maxEntries.exchange(maxEntries);
+
+    for (unsigned i = 0; i < _shards.size(); ++i)
+    {
+        Threading::ScopedMutexLock lock(_shards[i]->_mutex);
+        trim(*_shards[i]);
+    }
+}
+
+unsigned
+ElevationPool::getNumEntries() const
+{
+    unsigned count = 0u;
+    for (unsigned i = 0; i < _shards.size(); ++i)
+    {
+        Threading::ScopedMutexLock lock(_shards[i]->_mutex);
+        count += _shards[i]->_index.size();
+    }
+    return count;
+}
+
+float
+ElevationPool::getHitRate() const
+{
+    unsigned hits = _hits, misses = _misses;
+    return hits + misses > 0u ? (float)hits / (float)(hits + misses) : 0.0f;
+}
+
+double
+ElevationPool::getAverageLoadTime() const
+{
+    Threading::ScopedMutexLock lock(_statsMutex);
+    return _loads > 0u ? _loadTime / (double)_loads : 0.0;
+}
+
+void
+ElevationPool::resetStats()
+{
+    _hits.exchange(0u);
+    _misses.exchange(0u);
+
+    Threading::ScopedMutexLock lock(_statsMutex);
+    _loads = 0u;
+    _loadTime = 0.0;
+}
+
 void
 ElevationPool::stopThreading()
 {
@@ -79,16 +146,20 @@ ElevationPool::stopThreading()
 void
 ElevationPool::setElevationLayers(const ElevationLayerVector& layers)
 {
-    Threading::ScopedMutexLock lock(_tilesMutex);
-    _layers = layers;
+    {
+        Threading::ScopedMutexLock lock(_tilesMutex);
+        _layers = layers;
+    }
     clearImpl();
 }
 
 void
 ElevationPool::setTileSize(unsigned value)
 {
-    Threading::ScopedMutexLock lock(_tilesMutex);
-    _tileSize = value;
+    {
+        Threading::ScopedMutexLock lock(_tilesMutex);
+        _tileSize = value;
+    }
     clearImpl();
 }
 
@@ -101,6 +172,100 @@ ElevationPool::getElevation(const GeoPoint& point, unsigned lod)
     return result;
 }
 
+namespace
+{
+    // One set of batch workers shared by every pool, so that each pool
+    // doesn't start a thread per processor of its own.
+    osg::ref_ptr<TaskService> s_batchService;
+    Threading::Mutex          s_batchServiceMutex;
+
+    TaskService* getBatchService()
+    {
+        Threading::ScopedMutexLock lock(s_batchServiceMutex);
+        if (!s_batchService.valid())
+        {
+            // the calling thread runs one chunk itself
+            int numThreads = osg::maximum(OpenThreads::GetNumberOfProcessors()-1, 1);
+            s_batchService = new TaskService("ElevationPool", numThreads);
+        }
+        return s_batchService.get();
+    }
+}
+
+struct ElevationPool::GetElevationsChunk
+{
+    osg::ref_ptr<ElevationEnvelope> _envelope;
+    const double* _x;
+    const double* _y;
+    unsigned      _count;
+    float*        _elevations;
+    float*        _resolutions;
+    unsigned      _numValid;
+
+    void execute()
+    {
+        _numValid = _envelope->getElevations(_x, _y, _count, _elevations, _resolutions);
+    }
+};
+
+unsigned
+ElevationPool::getElevations(const SpatialReference* srs,
+                             unsigned                lod,
+                             const double*           x,
+                             const double*           y,
+                             unsigned                count,
+                             float*                  out_elevations,
+                             float*                  out_resolutions,
+                             bool                    parallel)
+{
+    // Below this many points per thread, splitting isn't worth the overhead.
+    const unsigned minChunkSize = 4096u;
+
+    unsigned numThreads = parallel ? osg::maximum(OpenThreads::GetNumberOfProcessors(), 1) : 1u;
+    unsigned numChunks = osg::minimum(numThreads, (count + minChunkSize - 1u) / minChunkSize);
+
+    if (numChunks <= 1u)
+    {
+        osg::ref_ptr<ElevationEnvelope> env = createEnvelope(srs, lod);
+        return env->getElevations(x, y, count, out_elevations, out_resolutions);
+    }
+
+    TaskService* service = getBatchService();
+
+    // Each chunk gets its own envelope since envelopes are not thread-safe.
+    // The first chunk runs on the calling thread.
+    unsigned chunkSize = (count + numChunks - 1u) / numChunks;
+
+    std::vector< osg::ref_ptr< ParallelTask<GetElevationsChunk> > > chunks;
+    Threading::MultiEvent done(numChunks - 1u);
+
+    for (unsigned c = 0; c < numChunks; ++c)
+    {
+        unsigned start = c * chunkSize;
+        ParallelTask<GetElevationsChunk>* chunk = new ParallelTask<GetElevationsChunk>(&done);
+        chunk->_envelope = createEnvelope(srs, lod);
+        chunk->_x = x + start;
+        chunk->_y = y + start;
+        chunk->_count = osg::minimum(chunkSize, count - start);
+        chunk->_elevations = out_elevations + start;
+        chunk->_resolutions = out_resolutions ? out_resolutions + start : 0L;
+        chunk->_numValid = 0u;
+        chunks.push_back(chunk);
+
+        if (c > 0u)
+            service->add(chunk);
+    }
+
+    chunks.front()->execute();
+    done.wait();
+
+    unsigned total = 0u;
+    for (unsigned c = 0; c < chunks.size(); ++c)
+        total += chunks[c]->_numValid;
+
+    return total;
+}
+
 ElevationPool::GetElevationOp::GetElevationOp(ElevationPool* pool, const GeoPoint& point, unsigned lod) :
 _pool(pool), _point(point), _lod(lod)
 {
@@ -124,8 +289,17 @@ ElevationPool::fetchTileFromMap(const TileKey& key, const ElevationLayerVector&
 {
     tile->_loadTime = osg::Timer::instance()->tick();
 
+    // snapshot the settings, which another thread may change during the load
+    ElevationLayerVector poolLayers;
+    unsigned tileSize;
+    {
+        Threading::ScopedMutexLock lock(_tilesMutex);
+        poolLayers = _layers;
+        tileSize = _tileSize;
+    }
+
     osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
-    hf->allocate( _tileSize, _tileSize );
+    hf->allocate( tileSize, tileSize );
 
     // Initialize the heightfield to nodata
     hf->getFloatArray()->assign( hf->getFloatArray()->size(), NO_DATA_VALUE );
@@ -134,7 +308,7 @@ ElevationPool::fetchTileFromMap(const TileKey& key, const ElevationLayerVector&
     while( !tile->_hf.valid() && keyToUse.valid() )
     {
         bool ok;
-        if (_layers.empty())
+        if (poolLayers.empty())
         {
             OE_TEST << LC << "Populating from envelope (" << keyToUse.str() << ")\n";
             ok = layers.populateHeightFieldAndNormalMap(hf.get(), 0L, keyToUse, 0L, INTERP_BILINEAR, 0L);
@@ -142,7 +316,7 @@ ElevationPool::fetchTileFromMap(const TileKey& key, const ElevationLayerVector&
         else
         {
             OE_TEST << LC << "Populating from layers (" << keyToUse.str() << ")\n";
-            ok = _layers.populateHeightFieldAndNormalMap(hf.get(), 0L, keyToUse, 0L, INTERP_BILINEAR, 0L);
+            ok = poolLayers.populateHeightFieldAndNormalMap(hf.get(), 0L, keyToUse, 0L, INTERP_BILINEAR, 0L);
         }
 
         if (ok)
@@ -159,156 +333,177 @@ ElevationPool::fetchTileFromMap(const TileKey& key, const ElevationLayerVector&
     return tile->_hf.valid();
 }
 
-void
-ElevationPool::popMRU()
+ElevationPool::Shard&
+ElevationPool::getShard(const TileKey& key) const
 {
-    // first rememeber the key of the item we're about the pop:
-    TileKey key = _mru.back()->_key;
-
-    // establish a temporary observer on the item:
-    osg::observer_ptr<Tile> temp = _mru.back().get();
-
-    // pop the Tile from the MRU:
-    _mru.pop_back();
-
-    // if our observer went to NULL, we know there are no more pointers
-    // to that Tile in the MRU, and we can remove it from the main list:
-    if (!temp.valid())
-    {
-        _tiles.erase(key);
-    }
+    return *_shards[TileKey::Hash()(key) % _shards.size()];
 }
 
-bool
-ElevationPool::tryTile(const TileKey& key, const ElevationLayerVector& layers, osg::ref_ptr<Tile>& out)
+unsigned
+ElevationPool::getShardCapacity() const
 {
-    // first see whether the tile is available
-    _tilesMutex.lock();
-
-    // locate the tile in the local tile cache:
-    osg::observer_ptr<Tile>& tile_obs = _tiles[key];
+    unsigned maxEntries = _maxEntries;
+    return osg::maximum((maxEntries + (unsigned)_shards.size() - 1u) / (unsigned)_shards.size(), 1u);
+}
 
-    osg::ref_ptr<Tile> tile;
+void
+ElevationPool::insert(Shard& shard, Tile* tile)
+{
+    unsigned capacity = getShardCapacity();
 
-    // Get a safe pointer to it. If this is NULL, we need to create and
-    // fetch a new tile from the Map.
-    if (!tile_obs.lock(tile))
+    unsigned pos;
+    if (shard._ring.size() < capacity)
     {
-        // a new tile; status -> EMPTY
-        tile = new Tile();
-        tile->_key = key;
-
-        // update the LRU:
-        _mru.push_front(tile.get());
-
-        // prune the MRU if necessary:
-        if (++_entries > _maxEntries )
+        pos = shard._ring.size();
+        shard._ring.push_back(0L);
+    }
+    else
+    {
+        // Sweep the hand until it finds a tile that's neither recently used
+        // nor still loading. If every tile is loading, grow the ring instead.
+        pos = shard._ring.size();
+        for (unsigned sweeps = 0; sweeps < 2u * shard._ring.size(); ++sweeps)
         {
-            popMRU();
-            --_entries;
+            unsigned hand = shard._hand;
+            shard._hand = (shard._hand + 1u) % shard._ring.size();
+
+            Tile* victim = shard._ring[hand].get();
+            if (victim->_referenced)
+            {
+                victim->_referenced = false;
+            }
+            else if (victim->_status != STATUS_IN_PROGRESS)
+            {
+                shard._index.erase(victim->_key);
+                pos = hand;
+                break;
+            }
         }
 
-        // add to the main cache (after putting it on the LRU).
-        tile_obs = tile;
+        if (pos == shard._ring.size())
+            shard._ring.push_back(0L);
     }
-       
-    // This means the tile object exists but has yet to be populated:
-    if ( tile->_status == STATUS_EMPTY )
-    {
-        OE_TEST << "  getTile(" << key.str() << ") -> fetch from map\n";
-        tile->_status.exchange(STATUS_IN_PROGRESS);
-        _tilesMutex.unlock();
 
-        bool ok = fetchTileFromMap(key, layers, tile.get());
-        tile->_status.exchange( ok ? STATUS_AVAILABLE : STATUS_FAIL );
-        
-        out = ok ? tile.get() : 0L;
-        return ok;
-    }
+    tile->_referenced = false;
+    shard._ring[pos] = tile;
+    shard._index[tile->_key] = pos;
+}
 
-    // This means the tile object is populated and available for use:
-    else if ( tile->_status == STATUS_AVAILABLE )
-    {
-        OE_TEST << "  getTile(" << key.str() << ") -> available\n";
-        out = tile.get();
+void
+ElevationPool::trim(Shard& shard)
+{
+    unsigned capacity = getShardCapacity();
+    if (shard._ring.size() <= capacity)
+        return;
 
-        // Mark this tile as recently used:
-        _mru.push_front(tile.get());
+    // Keep the tiles still loading (their waiters hold them anyway), then
+    // the recently used ones, then the rest, in clock order from the hand.
+    std::vector<osg::ref_ptr<Tile> > keep;
+    keep.reserve(shard._ring.size());
 
-        // prune the MRU if necessary
-        if (++_entries > _maxEntries)
+    for (unsigned pass = 0; pass < 3u; ++pass)
+    {
+        for (unsigned i = 0; i < shard._ring.size(); ++i)
         {
-            popMRU();
-            --_entries;
+            Tile* tile = shard._ring[(shard._hand + i) % shard._ring.size()].get();
+            bool loading = tile->_status == STATUS_IN_PROGRESS;
+            bool wanted =
+                pass == 0u ? loading :
+                pass == 1u ? !loading && tile->_referenced :
+                             !loading && !tile->_referenced;
+
+            if (wanted && (loading || keep.size() < capacity))
+                keep.push_back(tile);
         }
-
-        _tilesMutex.unlock();
-        return true;
-    }
-
-    // This means the attempt to populate the tile with data failed.
-    else if ( tile->_status == STATUS_FAIL )
-    {
-        OE_TEST << "  getTile(" << key.str() << ") -> fail\n";
-        _tilesMutex.unlock();
-        out = 0L;
-        return false;
     }
 
-    // This means tile data fetch is still in progress (in another thread)
-    // and the caller should check back later.
-    else //if ( tile->_status == STATUS_IN_PROGRESS )
-    {
-        OE_DEBUG << "  getTile(" << key.str() << ") -> in progress...waiting\n";
-        _tilesMutex.unlock();
-        out = 0L;
-        return true;            // out:NULL => check back later please.
-    }
+    shard._ring.swap(keep);
+    shard._index.clear();
+    for (unsigned i = 0; i < shard._ring.size(); ++i)
+        shard._index[shard._ring[i]->_key] = i;
+    shard._hand = 0u;
 }
 
 void
 ElevationPool::clearImpl()
 {
-    // assumes the tiles lock is taken.
-    _tiles.clear();
-    _mru.clear();
-    _entries = 0u;
+    for (unsigned i = 0; i < _shards.size(); ++i)
+    {
+        Shard& shard = *_shards[i];
+        Threading::ScopedMutexLock lock(shard._mutex);
+        shard._index.clear();
+        shard._ring.clear();
+        shard._hand = 0u;
+    }
 }
 
 bool
 ElevationPool::getTile(const TileKey& key, const ElevationLayerVector& layers, osg::ref_ptr<ElevationPool::Tile>& output)
-{   
-    OE_START_TIMER(get);
-
-    const double timeout = 30.0;
+{
     osg::ref_ptr<Tile> tile;
-    while( tryTile(key, layers, tile) && !tile.valid() && OE_GET_TIMER(get) < timeout)
-    {
-        // condition: another thread is working on fetching the tile from the map,
-        // so wait and try again later. Do this until we succeed or time out.
-        OpenThreads::Thread::YieldCurrentThread();
-    }
+    bool load = false;
 
-    if ( !tile.valid() && OE_GET_TIMER(get) >= timeout )
+    // Find the tile, or claim responsibility for loading it:
     {
-        // this means we timed out trying to fetch the map tile.
-        OE_TEST << LC << "Timeout fetching tile " << key.str() << std::endl;
-    }
+        Shard& shard = getShard(key);
+        Threading::ScopedMutexLock lock(shard._mutex);
 
-    if ( tile.valid() )
-    {
-        if ( tile->_hf.valid() )
+        hash_map<TileKey, unsigned, TileKey::Hash>::const_iterator i = shard._index.find(key);
+        if (i != shard._index.end())
         {
-            // got a valid tile, so push it to the query set.
-            output = tile.get();
+            tile = shard._ring[i->second].get();
+            tile->_referenced = true;
         }
         else
         {
-            OE_WARN << LC << "Got a tile with an invalid HF (" << key.str() << ")\n";
+            tile = new Tile();
+            tile->_key = key;
+            tile->_status.exchange(STATUS_IN_PROGRESS);
+            insert(shard, tile.get());
+            load = true;
         }
     }
 
-    return tile.valid();
+    if (load)
+    {
+        ++_misses;
+
+        OE_TEST << "  getTile(" << key.str() << ") -> fetch from map\n";
+        bool ok = fetchTileFromMap(key, layers, tile.get());
+        tile->_status.exchange( ok ? STATUS_AVAILABLE : STATUS_FAIL );
+        tile->_ready.set();
+
+        double seconds = osg::Timer::instance()->delta_s(tile->_loadTime, osg::Timer::instance()->tick());
+        Threading::ScopedMutexLock lock(_statsMutex);
+        ++_loads;
+        _loadTime += seconds;
+    }
+    else if (tile->_status == STATUS_IN_PROGRESS)
+    {
+        ++_misses;
+
+        // Another thread is loading this tile; wait for it rather than
+        // loading it again.
+        OE_DEBUG << "  getTile(" << key.str() << ") -> in progress...waiting\n";
+        const unsigned timeout_ms = 30000u;
+        if (!tile->_ready.wait(timeout_ms))
+        {
+            OE_TEST << LC << "Timeout fetching tile " << key.str() << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        ++_hits;
+    }
+
+    if (tile->_status == STATUS_AVAILABLE && tile->_hf.valid())
+    {
+        output = tile.get();
+        return true;
+    }
+
+    return false;
 }
 
 ElevationEnvelope*
@@ -318,6 +513,8 @@ ElevationPool::createEnvelope(const SpatialReference* srs, unsigned lod)
     e->_inputSRS = srs; 
     e->_lod = lod;
     e->_pool = this;
+
+    Threading::ScopedMutexLock lock(_tilesMutex);
     
     osg::ref_ptr<const Map> map;
     if (_map.lock(map))
@@ -377,7 +574,7 @@ ElevationEnvelope::sample(double x, double y, float& out_elevation, float& out_r
                 // Found an intersecting tile; sample the elevation:
                 if (tile->_hf.getElevation(0L, p.x(), p.y(), INTERP_BILINEAR, 0L, out_elevation))
                 {
-                    out_resolution = tile->_hf.getXInterval();
+                    out_resolution = 0.5*(tile->_hf.getXInterval() + tile->_hf.getYInterval());
                     // got it; finished
                     break;
                 }
@@ -433,25 +630,321 @@ ElevationEnvelope::getElevationAndResolution(double x, double y)
     return std::make_pair(elevation, resolution);
 }
 
+namespace
+{
+    // Working storage for sampling a run of points from a single heightfield.
+    struct BilinearBatch
+    {
+        std::vector<double> _wx0, _wx1, _wy0, _wy1;
+        std::vector<float>  _ll, _lr, _ul, _ur;
+        std::vector<unsigned> _noData;
+
+        void resize(unsigned n)
+        {
+            if (_wx0.size() < n)
+            {
+                _wx0.resize(n); _wx1.resize(n); _wy0.resize(n); _wy1.resize(n);
+                _ll.resize(n); _lr.resize(n); _ul.resize(n); _ur.resize(n);
+            }
+            _noData.clear();
+        }
+    };
+
+    /**
+     * Bilinear sampling of a run of points from a heightfield, given in
+     * fractional pixel coordinates that are already clamped to the grid.
+     * This produces exactly the same results as calling
+     * HeightFieldUtils::getHeightAtPixel(INTERP_BILINEAR) for each point:
+     * the corner fetch and NO_DATA_VALUE replacement run per point, and the
+     * weighting runs two points at a time when SSE2 is available.
+     */
+    void sampleBilinear(const osg::HeightField* hf,
+                        const double*           px,
+                        const double*           py,
+                        unsigned                n,
+                        BilinearBatch&          b,
+                        float*                  out)
+    {
+        const int maxCol = (int)hf->getNumColumns() - 1;
+        const int maxRow = (int)hf->getNumRows() - 1;
+        const float* heights = &hf->getFloatArray()->front();
+        const int stride = (int)hf->getNumColumns();
+
+        b.resize(n);
+
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double c = px[i], r = py[i];
+
+            int rowMin = osg::maximum((int)floor(r), 0);
+            int rowMax = osg::maximum(osg::minimum((int)ceil(r), maxRow), 0);
+            int colMin = osg::maximum((int)floor(c), 0);
+            int colMax = osg::maximum(osg::minimum((int)ceil(c), maxCol), 0);
+
+            if (rowMin > rowMax) rowMin = rowMax;
+            if (colMin > colMax) colMin = colMax;
+
+            float ur = heights[rowMax*stride + colMax];
+            float ll = heights[rowMin*stride + colMin];
+            float ul = heights[rowMax*stride + colMin];
+            float lr = heights[rowMin*stride + colMax];
+
+            if (ur == NO_DATA_VALUE || ll == NO_DATA_VALUE || ul == NO_DATA_VALUE || lr == NO_DATA_VALUE)
+            {
+                // same replacement rule as HeightFieldUtils::validateSamples
+                float valid = ur;
+                if (valid == NO_DATA_VALUE) valid = ll;
+                if (valid == NO_DATA_VALUE) valid = ul;
+                if (valid == NO_DATA_VALUE) valid = lr;
+                if (valid == NO_DATA_VALUE)
+                {
+                    b._noData.push_back(i);
+                    valid = 0.0f;
+                }
+                if (ur == NO_DATA_VALUE) ur = valid;
+                if (ll == NO_DATA_VALUE) ll = valid;
+                if (ul == NO_DATA_VALUE) ul = valid;
+                if (lr == NO_DATA_VALUE) lr = valid;
+            }
+
+            // A degenerate axis (sample exactly on a grid line) takes all its
+            // weight from the min sample, matching the 1D cases of getHeightAtPixel.
+            if (colMax == colMin) { b._wx0[i] = 1.0; b._wx1[i] = 0.0; }
+            else { b._wx0[i] = (double)colMax - c; b._wx1[i] = c - (double)colMin; }
+
+            if (rowMax == rowMin) { b._wy0[i] = 1.0; b._wy1[i] = 0.0; }
+            else { b._wy0[i] = (double)rowMax - r; b._wy1[i] = r - (double)rowMin; }
+
+            b._ll[i] = ll; b._lr[i] = lr; b._ul[i] = ul; b._ur[i] = ur;
+        }
+
+        unsigned i = 0;
+
+#ifdef OE_ELEVATION_POOL_SSE2
+        for (; i + 2u <= n; i += 2u)
+        {
+            __m128d wx0 = _mm_loadu_pd(&b._wx0[i]);
+            __m128d wx1 = _mm_loadu_pd(&b._wx1[i]);
+            __m128d wy0 = _mm_loadu_pd(&b._wy0[i]);
+            __m128d wy1 = _mm_loadu_pd(&b._wy1[i]);
+
+            __m128d ll = _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)&b._ll[i])));
+            __m128d lr = _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)&b._lr[i])));
+            __m128d ul = _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)&b._ul[i])));
+            __m128d ur = _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)&b._ur[i])));
+
+            __m128d r1 = _mm_add_pd(_mm_mul_pd(wx0, ll), _mm_mul_pd(wx1, lr));
+            __m128d r2 = _mm_add_pd(_mm_mul_pd(wx0, ul), _mm_mul_pd(wx1, ur));
+            __m128d h  = _mm_add_pd(_mm_mul_pd(wy0, r1), _mm_mul_pd(wy1, r2));
+
+            _mm_store_sd((double*)&out[i], _mm_castps_pd(_mm_cvtpd_ps(h)));
+        }
+#endif
+
+        for (; i < n; ++i)
+        {
+            double r1 = b._wx0[i] * (double)b._ll[i] + b._wx1[i] * (double)b._lr[i];
+            double r2 = b._wx0[i] * (double)b._ul[i] + b._wx1[i] * (double)b._ur[i];
+            out[i] = (float)(b._wy0[i] * r1 + b._wy1[i] * r2);
+        }
+
+        for (std::vector<unsigned>::const_iterator k = b._noData.begin(); k != b._noData.end(); ++k)
+            out[*k] = NO_DATA_VALUE;
+    }
+
+    // Point index sorted by the map tile containing it.
+    struct TileSortedPoint
+    {
+        unsigned _tileY, _tileX, _index;
+        bool operator < (const TileSortedPoint& rhs) const {
+            if (_tileY != rhs._tileY) return _tileY < rhs._tileY;
+            if (_tileX != rhs._tileX) return _tileX < rhs._tileX;
+            return _index < rhs._index;
+        }
+    };
+}
+
+unsigned
+ElevationEnvelope::getElevations(const double* x,
+                                 const double* y,
+                                 unsigned      count,
+                                 float*        out_elevations,
+                                 float*        out_resolutions)
+{
+    METRIC_SCOPED_EX("ElevationEnvelope::getElevations", 1, "num", toString(count).c_str());
+
+    std::fill(out_elevations, out_elevations + count, NO_DATA_VALUE);
+    if (out_resolutions)
+        std::fill(out_resolutions, out_resolutions + count, 0.0f);
+
+    if (count == 0u || !_inputSRS.valid() || !_mapProfile.valid())
+        return 0u;
+
+    osg::ref_ptr<ElevationPool> pool;
+    if (!_pool.lock(pool))
+        return 0u;
+
+    const SpatialReference* mapSRS = _mapProfile->getSRS();
+
+    // Bring all the points into the map's SRS in one pass:
+    std::vector<osg::Vec3d> points(count);
+    for (unsigned i = 0; i < count; ++i)
+        points[i].set(x[i], y[i], 0.0);
+
+    std::vector<bool> xformOK(count, true);
+
+    if (!_inputSRS->transform(points, mapSRS))
+    {
+        // at least one point failed, so find out which ones:
+        for (unsigned i = 0; i < count; ++i)
+            xformOK[i] = _inputSRS->transform(osg::Vec3d(x[i], y[i], 0.0), mapSRS, points[i]);
+    }
+
+    // Sort the points by the tile that contains them at our LOD:
+    const GeoExtent& profileExtent = _mapProfile->getExtent();
+    unsigned tilesX, tilesY;
+    _mapProfile->getNumTiles(_lod, tilesX, tilesY);
+
+    std::vector<TileSortedPoint> sorted;
+    sorted.reserve(count);
+    std::vector<unsigned> stragglers;
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (!xformOK[i])
+            continue;
+
+        const osg::Vec3d& p = points[i];
+        if (!profileExtent.contains(p.x(), p.y()) || tilesX == 0u || tilesY == 0u)
+        {
+            stragglers.push_back(i);
+            continue;
+        }
+
+        // same math as Profile::createTileKey
+        double rx = (p.x() - profileExtent.xMin()) / profileExtent.width();
+        double ry = (p.y() - profileExtent.yMin()) / profileExtent.height();
+
+        TileSortedPoint sp;
+        sp._tileX = osg::clampBelow((unsigned)(rx * (double)tilesX), tilesX-1);
+        sp._tileY = osg::clampBelow((unsigned)((1.0-ry) * (double)tilesY), tilesY-1);
+        sp._index = i;
+        sorted.push_back(sp);
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+
+    // Sample each tile's points as a group, so the pool is visited once per tile:
+    std::vector<double> px, py;
+    std::vector<unsigned> indices;
+    std::vector<float> heights;
+    BilinearBatch batch;
+
+    osg::ref_ptr<ElevationPool::Tile> probe = new ElevationPool::Tile();
+
+    for (std::vector<TileSortedPoint>::const_iterator group = sorted.begin(); group != sorted.end(); )
+    {
+        std::vector<TileSortedPoint>::const_iterator groupEnd = group;
+        while (groupEnd != sorted.end() && groupEnd->_tileX == group->_tileX && groupEnd->_tileY == group->_tileY)
+            ++groupEnd;
+
+        TileKey key(_lod, group->_tileX, group->_tileY, _mapProfile.get());
+
+        // Look for the tile in our query set first, then in the pool:
+        osg::ref_ptr<ElevationPool::Tile> tile;
+        probe->_key = key;
+        ElevationPool::QuerySet::const_iterator existing = _tiles.find(probe);
+        if (existing != _tiles.end())
+        {
+            tile = existing->get();
+        }
+        else if (pool->getTile(key, _layers, tile))
+        {
+            _tiles.insert(tile.get());
+        }
+
+        if (tile.valid() && tile->_hf.valid())
+        {
+            const GeoExtent& ex = tile->_hf.getExtent();
+            const osg::HeightField* hf = tile->_hf.getHeightField();
+            double maxCol = (double)(hf->getNumColumns()-1);
+            double maxRow = (double)(hf->getNumRows()-1);
+            double dx = ex.width() / maxCol;
+            double dy = ex.height() / maxRow;
+            float resolution = 0.5*(tile->_hf.getXInterval() + tile->_hf.getYInterval());
+
+            px.clear(); py.clear(); indices.clear();
+
+            for (std::vector<TileSortedPoint>::const_iterator i = group; i != groupEnd; ++i)
+            {
+                const osg::Vec3d& p = points[i->_index];
+                if (tile->_bounds.contains(p.x(), p.y()))
+                {
+                    px.push_back(osg::clampBetween((p.x() - ex.xMin()) / dx, 0.0, maxCol));
+                    py.push_back(osg::clampBetween((p.y() - ex.yMin()) / dy, 0.0, maxRow));
+                    indices.push_back(i->_index);
+                }
+                else
+                {
+                    stragglers.push_back(i->_index);
+                }
+            }
+
+            if (!indices.empty())
+            {
+                heights.resize(indices.size());
+                sampleBilinear(hf, &px[0], &py[0], indices.size(), batch, &heights[0]);
+
+                for (unsigned k = 0; k < indices.size(); ++k)
+                {
+                    out_elevations[indices[k]] = heights[k];
+                    if (out_resolutions && heights[k] != NO_DATA_VALUE)
+                        out_resolutions[indices[k]] = resolution;
+                }
+            }
+        }
+
+        group = groupEnd;
+    }
+
+    // Points that didn't fit the grouping go through the single-point path:
+    for (std::vector<unsigned>::const_iterator i = stragglers.begin(); i != stragglers.end(); ++i)
+    {
+        float elevation, resolution;
+        sample(x[*i], y[*i], elevation, resolution);
+        out_elevations[*i] = elevation;
+        if (out_resolutions)
+            out_resolutions[*i] = resolution;
+    }
+
+    unsigned numValid = 0u;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        if (out_elevations[i] != NO_DATA_VALUE)
+            ++numValid;
+    }
+
+    return numValid;
+}
+
 unsigned
 ElevationEnvelope::getElevations(const std::vector<osg::Vec3d>& input,
                                  std::vector<float>& output)
 {
-    METRIC_SCOPED_EX("ElevationEnvelope::getElevations", 1, "num", toString(input.size()).c_str());
-
     unsigned count = 0u;
 
-    output.reserve(input.size());
-    output.clear();
+    output.resize(input.size());
 
-    // for each input point:
-    for (std::vector<osg::Vec3d>::const_iterator v = input.begin(); v != input.end(); ++v)
+    if (!input.empty())
     {
-        float elevation, resolution;
-        sample(v->x(), v->y(), elevation, resolution);
-        output.push_back(elevation);
-        if (elevation != NO_DATA_VALUE)
-            ++count;
+        std::vector<double> x(input.size()), y(input.size());
+        for (unsigned i = 0; i < input.size(); ++i)
+        {
+            x[i] = input[i].x();
+            y[i] = input[i].y();
+        }
+
+        count = getElevations(&x[0], &y[0], input.size(), &output[0]);
     }
 
     if (count < input.size())
@@ -22,11 +22,21 @@
 #include <osgEarth/HeightFieldUtils>
 #include <osgEarth/Registry>
 #include <osgEarth/Terrain>
+#include <osgEarth/TaskService>
+#include <osgEarth/StringUtils>
+#include <OpenThreads/Atomic>
 
 
 #include <gdal_priv.h>
 #include <gdalwarper.h>
 
+#include <cfloat>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OE_GEODATA_SSE2
+#endif
+
 
 using namespace osgEarth;
 
@@ -2006,6 +2016,365 @@ namespace
     }    
 
 
+    // Spacing, in destination pixels, of the first control point grid tried
+    // by manualReproject. The grid is refined until it meets the tolerance.
+    const unsigned REPROJECT_GRID_STEP = 16u;
+
+    // Default maximum error, in source pixels, of the interpolated source
+    // coordinates. Override with OSGEARTH_REPROJECT_TOLERANCE.
+    const double REPROJECT_DEFAULT_TOLERANCE = 0.125;
+
+    // Destination images smaller than this are reprojected on the calling thread.
+    const unsigned REPROJECT_MIN_PARALLEL_PIXELS = 32768u;
+
+    // Read from the environment on first use.
+    Threading::Mutex s_reprojectToleranceMutex;
+    double           s_reprojectTolerance = -1.0;
+
+    OpenThreads::Atomic s_parallelReprojectEnabled( 1u );
+
+    /**
+     * Maps destination pixel centers to source coordinates. Only a sparse grid
+     * of control points goes through the SRS transform; coordinates between
+     * them are interpolated bilinearly. With one node per pixel the mapping is
+     * exact. Nodes are stored column-major, like transformExtentPoints.
+     */
+    struct ReprojectionGrid
+    {
+        unsigned _width, _height;
+        unsigned _nx, _ny;
+        std::vector<double> _x, _y;
+        double _destX0, _destY0, _dx, _dy;
+
+        bool build(const GeoExtent& src_extent, const GeoExtent& dest_extent, unsigned width, unsigned height, unsigned step)
+        {
+            _width = width;
+            _height = height;
+            _nx = osg::maximum((width  - 1u + step - 1u) / step + 1u, 2u);
+            _ny = osg::maximum((height - 1u + step - 1u) / step + 1u, 2u);
+            _dx = dest_extent.width() / (double)width;
+            _dy = dest_extent.height() / (double)height;
+            _destX0 = dest_extent.xMin() + 0.5*_dx;
+            _destY0 = dest_extent.yMin() + 0.5*_dy;
+            _x.resize(_nx * _ny);
+            _y.resize(_nx * _ny);
+
+            return dest_extent.getSRS()->transformExtentPoints(
+                src_extent.getSRS(),
+                _destX0, _destY0,
+                dest_extent.xMax() - 0.5*_dx, dest_extent.yMax() - 0.5*_dy,
+                &_x[0], &_y[0], _nx, _ny);
+        }
+
+        // Source coordinates of a (possibly fractional) destination pixel.
+        inline void get(double c, double r, double& out_x, double& out_y) const
+        {
+            double u = _width  > 1u ? c * (double)(_nx-1u) / (double)(_width-1u)  : 0.0;
+            double v = _height > 1u ? r * (double)(_ny-1u) / (double)(_height-1u) : 0.0;
+            unsigned i = osg::minimum((unsigned)u, _nx-2u);
+            unsigned j = osg::minimum((unsigned)v, _ny-2u);
+            double fu = u - (double)i, fv = v - (double)j;
+
+            unsigned k00 = i*_ny + j, k01 = k00 + 1u, k10 = k00 + _ny, k11 = k10 + 1u;
+
+            out_x = (1.0-fu)*((1.0-fv)*_x[k00] + fv*_x[k01]) + fu*((1.0-fv)*_x[k10] + fv*_x[k11]);
+            out_y = (1.0-fu)*((1.0-fv)*_y[k00] + fv*_y[k01]) + fu*((1.0-fv)*_y[k10] + fv*_y[k11]);
+        }
+
+        // Largest interpolation error, in source pixels, found by transforming
+        // the center of each grid cell exactly.
+        double getMaxError(const GeoExtent& src_extent, const GeoExtent& dest_extent, double xfac, double yfac) const
+        {
+            std::vector<osg::Vec3d> probes;
+            probes.reserve((_nx-1u)*(_ny-1u));
+
+            double cstep = (double)(_width-1u) / (double)(_nx-1u);
+            double rstep = (double)(_height-1u) / (double)(_ny-1u);
+
+            for (unsigned i = 0; i < _nx-1u; ++i)
+                for (unsigned j = 0; j < _ny-1u; ++j)
+                    probes.push_back(osg::Vec3d(_destX0 + ((double)i+0.5)*cstep*_dx, _destY0 + ((double)j+0.5)*rstep*_dy, 0.0));
+
+            if (!dest_extent.getSRS()->transform(probes, src_extent.getSRS()))
+                return DBL_MAX;
+
+            double maxError = 0.0;
+            unsigned k = 0;
+            for (unsigned i = 0; i < _nx-1u; ++i)
+            {
+                for (unsigned j = 0; j < _ny-1u; ++j, ++k)
+                {
+                    double x, y;
+                    get(((double)i+0.5)*cstep, ((double)j+0.5)*rstep, x, y);
+                    maxError = osg::maximum(maxError, osg::maximum(fabs(x - probes[k].x())*xfac, fabs(y - probes[k].y())*yfac));
+                }
+            }
+            return maxError;
+        }
+    };
+
+    // Copies the nearest source pixel as raw bytes (any uncompressed format).
+    struct NearestSampler
+    {
+        const osg::Image* _src;
+        osg::Image* _dest;
+        unsigned _pixelBytes;
+
+        inline void operator()(float px, float py, unsigned c, unsigned r) const
+        {
+            int px_i = osg::clampBetween( (int)osg::round(px), 0, _src->s()-1 );
+            int py_i = osg::clampBetween( (int)osg::round(py), 0, _src->t()-1 );
+            ::memcpy(_dest->data(c, r), _src->data(px_i, py_i), _pixelBytes);
+        }
+    };
+
+    // Nearest source pixel through the pixel accessors (compressed or packed formats).
+    struct NearestAccessorSampler
+    {
+        ImageUtils::PixelReader& _reader;
+        ImageUtils::PixelWriter& _writer;
+
+        NearestAccessorSampler(ImageUtils::PixelReader& reader, ImageUtils::PixelWriter& writer) :
+            _reader(reader), _writer(writer) { }
+
+        inline void operator()(float px, float py, unsigned c, unsigned r)
+        {
+            int px_i = osg::clampBetween( (int)osg::round(px), 0, _reader._image->s()-1 );
+            int py_i = osg::clampBetween( (int)osg::round(py), 0, _reader._image->t()-1 );
+            _writer(_reader(px_i, py_i), c, r);
+        }
+    };
+
+    // Bilinear footprint of a sample point, following the original per-pixel
+    // reprojection: degenerate axes put all their weight on the min sample.
+    struct BilinearFootprint
+    {
+        int colMin, colMax, rowMin, rowMax;
+        float col1, col2, row1, row2;
+
+        inline void set(float px, float py, int s, int t)
+        {
+            rowMin = osg::maximum((int)floor(py), 0);
+            rowMax = osg::maximum(osg::minimum((int)ceil(py), t-1), 0);
+            colMin = osg::maximum((int)floor(px), 0);
+            colMax = osg::maximum(osg::minimum((int)ceil(px), s-1), 0);
+
+            if (rowMin > rowMax) rowMin = rowMax;
+            if (colMin > colMax) colMin = colMax;
+
+            if (colMax == colMin) { col1 = 1.0f; col2 = 0.0f; }
+            else { col1 = (float)colMax - px; col2 = px - (float)colMin; }
+
+            if (rowMax == rowMin) { row1 = 1.0f; row2 = 0.0f; }
+            else { row1 = (float)rowMax - py; row2 = py - (float)rowMin; }
+        }
+    };
+
+    // Bilinear sampler for N-channel images of type T, working directly on
+    // the raw channel values. Integer results are rounded to nearest.
+    template<typename T, unsigned N>
+    struct BilinearSampler
+    {
+        const osg::Image* _src;
+        osg::Image* _dest;
+
+        static inline T convert(float v) { return (T)v; }
+
+        inline void operator()(float px, float py, unsigned c, unsigned r) const
+        {
+            BilinearFootprint f;
+            f.set(px, py, _src->s(), _src->t());
+
+            const T* ll = (const T*)_src->data(f.colMin, f.rowMin);
+            const T* lr = (const T*)_src->data(f.colMax, f.rowMin);
+            const T* ul = (const T*)_src->data(f.colMin, f.rowMax);
+            const T* ur = (const T*)_src->data(f.colMax, f.rowMax);
+            T* out = (T*)_dest->data(c, r);
+
+            for (unsigned i = 0; i < N; ++i)
+            {
+                float r1 = f.col1 * (float)ll[i] + f.col2 * (float)lr[i];
+                float r2 = f.col1 * (float)ul[i] + f.col2 * (float)ur[i];
+                out[i] = convert(f.row1 * r1 + f.row2 * r2);
+            }
+        }
+    };
+
+    template<> inline GLubyte BilinearSampler<GLubyte,1>::convert(float v) { return (GLubyte)osg::clampBetween(v + 0.5f, 0.0f, 255.0f); }
+    template<> inline GLubyte BilinearSampler<GLubyte,2>::convert(float v) { return (GLubyte)osg::clampBetween(v + 0.5f, 0.0f, 255.0f); }
+    template<> inline GLubyte BilinearSampler<GLubyte,3>::convert(float v) { return (GLubyte)osg::clampBetween(v + 0.5f, 0.0f, 255.0f); }
+    template<> inline GLubyte BilinearSampler<GLubyte,4>::convert(float v) { return (GLubyte)osg::clampBetween(v + 0.5f, 0.0f, 255.0f); }
+
+#ifdef OE_GEODATA_SSE2
+    // 4-channel 8-bit pixels: all four channels in one SSE register.
+    template<>
+    inline void BilinearSampler<GLubyte,4>::operator()(float px, float py, unsigned c, unsigned r) const
+    {
+        BilinearFootprint f;
+        f.set(px, py, _src->s(), _src->t());
+
+        const __m128i zero = _mm_setzero_si128();
+        int ll, lr, ul, ur;
+        ::memcpy(&ll, _src->data(f.colMin, f.rowMin), 4);
+        ::memcpy(&lr, _src->data(f.colMax, f.rowMin), 4);
+        ::memcpy(&ul, _src->data(f.colMin, f.rowMax), 4);
+        ::memcpy(&ur, _src->data(f.colMax, f.rowMax), 4);
+
+        #define OE_UNPACK_RGBA8(V) _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(V), zero), zero))
+        __m128 vll = OE_UNPACK_RGBA8(ll), vlr = OE_UNPACK_RGBA8(lr);
+        __m128 vul = OE_UNPACK_RGBA8(ul), vur = OE_UNPACK_RGBA8(ur);
+        #undef OE_UNPACK_RGBA8
+
+        __m128 col1 = _mm_set1_ps(f.col1), col2 = _mm_set1_ps(f.col2);
+        __m128 r1 = _mm_add_ps(_mm_mul_ps(col1, vll), _mm_mul_ps(col2, vlr));
+        __m128 r2 = _mm_add_ps(_mm_mul_ps(col1, vul), _mm_mul_ps(col2, vur));
+        __m128 v  = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(f.row1), r1), _mm_mul_ps(_mm_set1_ps(f.row2), r2));
+
+        __m128i i32 = _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+        __m128i i16 = _mm_packs_epi32(i32, i32);
+        int out = _mm_cvtsi128_si32(_mm_packus_epi16(i16, i16));
+        ::memcpy(_dest->data(c, r), &out, 4);
+    }
+#endif
+
+    // Any other format, through PixelReader/PixelWriter.
+    struct GenericSampler
+    {
+        ImageUtils::PixelReader _reader;
+        ImageUtils::PixelWriter _writer;
+
+        GenericSampler(const osg::Image* src, osg::Image* dest) : _reader(src), _writer(dest) { }
+
+        inline void operator()(float px, float py, unsigned c, unsigned r)
+        {
+            const osg::Image* image = _reader._image;
+            BilinearFootprint f;
+            f.set(px, py, image->s(), image->t());
+
+            osg::Vec4 llColor = _reader(f.colMin, f.rowMin);
+            osg::Vec4 lrColor = _reader(f.colMax, f.rowMin);
+            osg::Vec4 ulColor = _reader(f.colMin, f.rowMax);
+            osg::Vec4 urColor = _reader(f.colMax, f.rowMax);
+
+            osg::Vec4 color;
+            for (unsigned int i = 0; i < 4; ++i)
+            {
+                float r1 = f.col1 * llColor[i] + f.col2 * lrColor[i];
+                float r2 = f.col1 * ulColor[i] + f.col2 * urColor[i];
+                color[i] = f.row1 * r1 + f.row2 * r2;
+            }
+
+            _writer(color, c, r);
+        }
+    };
+
+    // Walks a band of destination rows, mapping each pixel into the source.
+    template<typename SAMPLER>
+    void reprojectRows(const ReprojectionGrid& grid, const GeoExtent& src_extent, double xfac, double yfac,
+                       unsigned rowStart, unsigned rowEnd, SAMPLER& sampler)
+    {
+        const double xmin = src_extent.xMin(), xmax = src_extent.xMax();
+        const double ymin = src_extent.yMin(), ymax = src_extent.yMax();
+
+        for (unsigned r = rowStart; r < rowEnd; ++r)
+        {
+            for (unsigned c = 0; c < grid._width; ++c)
+            {
+                double src_x, src_y;
+                grid.get((double)c, (double)r, src_x, src_y);
+
+                // sample points outside the source extent stay transparent
+                if ( src_x < xmin || src_x > xmax || src_y < ymin || src_y > ymax )
+                    continue;
+
+                float px = (src_x - xmin) * xfac;
+                float py = (src_y - ymin) * yfac;
+
+                sampler(px, py, c, r);
+            }
+        }
+    }
+
+    // One band of rows of a reprojection, picking the sampler for the image format.
+    struct ReprojectRows
+    {
+        const osg::Image*       _src;
+        osg::Image*             _dest;
+        const ReprojectionGrid* _grid;
+        const GeoExtent*        _srcExtent;
+        bool                    _interpolate;
+        unsigned                _rowStart, _rowEnd;
+
+        template<typename SAMPLER>
+        void run(SAMPLER& sampler)
+        {
+            double xfac = (_src->s() - 1) / _srcExtent->width();
+            double yfac = (_src->t() - 1) / _srcExtent->height();
+            reprojectRows(*_grid, *_srcExtent, xfac, yfac, _rowStart, _rowEnd, sampler);
+        }
+
+        void execute()
+        {
+            GLenum type = _src->getDataType();
+            unsigned channels = osg::Image::computeNumComponents(_src->getPixelFormat());
+            bool raw = !_src->isCompressed() && _src->getPixelSizeInBits() % 8 == 0;
+
+            // with the kernels off, everything goes through the pixel accessors
+            bool kernels = raw && ImageUtils::getKernelsEnabled();
+
+            if (!_interpolate && raw)
+            {
+                NearestSampler sampler = { _src, _dest, _src->getPixelSizeInBits() / 8u };
+                run(sampler);
+            }
+            else if (kernels && type == GL_UNSIGNED_BYTE && channels == 4)
+            {
+                BilinearSampler<GLubyte,4> sampler = { _src, _dest };
+                run(sampler);
+            }
+            else if (kernels && type == GL_UNSIGNED_BYTE && channels == 3)
+            {
+                BilinearSampler<GLubyte,3> sampler = { _src, _dest };
+                run(sampler);
+            }
+            else if (kernels && type == GL_UNSIGNED_BYTE && channels == 1)
+            {
+                BilinearSampler<GLubyte,1> sampler = { _src, _dest };
+                run(sampler);
+            }
+            else if (kernels && type == GL_FLOAT && channels == 1)
+            {
+                BilinearSampler<GLfloat,1> sampler = { _src, _dest };
+                run(sampler);
+            }
+            else if (!_interpolate)
+            {
+                // compressed or bit-packed data: nearest neighbor through the pixel accessors
+                ImageUtils::PixelReader reader(_src);
+                ImageUtils::PixelWriter writer(_dest);
+                NearestAccessorSampler sampler(reader, writer);
+                run(sampler);
+            }
+            else
+            {
+                GenericSampler sampler(_src, _dest);
+                run(sampler);
+            }
+        }
+    };
+
+    // Shared pool for splitting reprojections across rows.
+    Threading::Mutex s_reprojectServiceMutex;
+    UID              s_reprojectServiceUID = -1;
+
+    TaskService* getReprojectService()
+    {
+        Threading::ScopedMutexLock lock(s_reprojectServiceMutex);
+        if (s_reprojectServiceUID < 0)
+            s_reprojectServiceUID = Registry::instance()->createUID();
+        return Registry::instance()->getTaskServiceManager()->getOrAdd(s_reprojectServiceUID);
+    }
+
     osg::Image* manualReproject(
         const osg::Image* image, 
         const GeoExtent&  src_extent, 
@@ -2023,166 +2392,107 @@ namespace
         }
 
         osg::Image *result = new osg::Image();
-        //result->allocateImage(width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE);
-        result->allocateImage(width, height, 1, image->getPixelFormat(), image->getDataType()); //GL_UNSIGNED_BYTE);
+        result->allocateImage(width, height, 1, image->getPixelFormat(), image->getDataType());
         result->setInternalTextureFormat(image->getInternalTextureFormat());
         ImageUtils::markAsUnNormalized(result, ImageUtils::isUnNormalized(image));
 
         //Initialize the image to be completely transparent/black
         memset(result->data(), 0, result->getImageSizeInBytes());
 
-        //ImageUtils::PixelReader ra(result);
-        ImageUtils::PixelWriter writer(result);
-        const double dx = dest_extent.width() / (double)width;
-        const double dy = dest_extent.height() / (double)height;
-
-        // offset the sample points by 1/2 a pixel so we are sampling "pixel center".
-        // (This is especially useful in the UnifiedCubeProfile since it nullifes the chances for
-        // edge ambiguity.)
-
-        unsigned int numPixels = width * height;
-
-        // Start by creating a sample grid over the destination
-        // extent. These will be the source coordinates. Then, reproject
-        // the sample grid into the source coordinate system.
-        double *srcPointsX = new double[numPixels * 2];
-        double *srcPointsY = srcPointsX + numPixels;
-
-        dest_extent.getSRS()->transformExtentPoints(
-            src_extent.getSRS(),
-            dest_extent.xMin() + .5 * dx, dest_extent.yMin() + .5 * dy,
-            dest_extent.xMax() - .5 * dx, dest_extent.yMax() - .5 * dy,
-            srcPointsX, srcPointsY, width, height);
-
-        // Next, go through the source-SRS sample grid, read the color at each point from the source image,
-        // and write it to the corresponding pixel in the destination image.
-        int pixel = 0;
-        ImageUtils::PixelReader ia(image);
+        // Build the grid of source coordinates. Start with a sparse grid of
+        // control points and refine it until interpolating between them is
+        // within tolerance; in the worst case this transforms every pixel.
+        // (Sample points are offset by 1/2 a pixel so we are sampling "pixel
+        // center"; this is especially useful in the UnifiedCubeProfile since
+        // it nullifes the chances for edge ambiguity.)
+        double tolerance = GeoImage::getReprojectTolerance();
         double xfac = (image->s() - 1) / src_extent.width();
         double yfac = (image->t() - 1) / src_extent.height();
-        for (unsigned int c = 0; c < width; ++c)
+
+        ReprojectionGrid grid;
+        unsigned step = tolerance > 0.0 ? REPROJECT_GRID_STEP : 1u;
+        while (step > 1u)
         {
-            for (unsigned int r = 0; r < height; ++r)
-            {   
-                double src_x = srcPointsX[pixel];
-                double src_y = srcPointsY[pixel];
+            if (grid.build(src_extent, dest_extent, width, height, step) &&
+                grid.getMaxError(src_extent, dest_extent, xfac, yfac) <= tolerance)
+            {
+                break;
+            }
+            step /= 2u;
+        }
 
-                if ( src_x < src_extent.xMin() || src_x > src_extent.xMax() || src_y < src_extent.yMin() || src_y > src_extent.yMax() )
-                {
-                    //If the sample point is outside of the bound of the source extent, increment the pixel and keep looping through.
-                    //OE_WARN << LC << "ERROR: sample point out of bounds: " << src_x << ", " << src_y << std::endl;
-                    pixel++;
-                    continue;
-                }
+        if (step == 1u)
+        {
+            grid.build(src_extent, dest_extent, width, height, 1u);
+        }
 
-                float px = (src_x - src_extent.xMin()) * xfac;
-                float py = (src_y - src_extent.yMin()) * yfac;
+        // Go through the destination rows, read the color at each point from
+        // the source image, and write it to the corresponding destination pixel.
+        // Large images are split into bands of rows that run in parallel.
+        TaskService* service =
+            width*height >= REPROJECT_MIN_PARALLEL_PIXELS && GeoImage::getParallelReprojectEnabled() ?
+            getReprojectService() : 0L;
+        unsigned numBands = service ? osg::minimum((unsigned)service->getNumThreads() + 1u, height) : 1u;
 
-                int px_i = osg::clampBetween( (int)osg::round(px), 0, image->s()-1 );
-                int py_i = osg::clampBetween( (int)osg::round(py), 0, image->t()-1 );
+        std::vector< osg::ref_ptr< ParallelTask<ReprojectRows> > > bands;
+        Threading::MultiEvent done(numBands - 1u);
 
-                osg::Vec4 color(0,0,0,0);
+        for (unsigned b = 0; b < numBands; ++b)
+        {
+            ParallelTask<ReprojectRows>* band = new ParallelTask<ReprojectRows>(&done);
+            band->_src = image;
+            band->_dest = result;
+            band->_grid = &grid;
+            band->_srcExtent = &src_extent;
+            band->_interpolate = interpolate;
+            band->_rowStart = (height * b) / numBands;
+            band->_rowEnd = (height * (b+1u)) / numBands;
+            bands.push_back(band);
+
+            if (b > 0u)
+                service->add(band);
+        }
 
-                // TODO: consider this again later. Causes blockiness.
-                if ( !interpolate ) //! isSrcContiguous ) // non-contiguous space- use nearest neighbot
-                {
-                    color = ia(px_i, py_i);
-                }
+        bands.front()->execute();
 
-                else // contiguous space - use bilinear sampling
-                {
-                    int rowMin = osg::maximum((int)floor(py), 0);
-                    int rowMax = osg::maximum(osg::minimum((int)ceil(py), (int)(image->t()-1)), 0);
-                    int colMin = osg::maximum((int)floor(px), 0);
-                    int colMax = osg::maximum(osg::minimum((int)ceil(px), (int)(image->s()-1)), 0);
-
-                    if (rowMin > rowMax) rowMin = rowMax;
-                    if (colMin > colMax) colMin = colMax;
-
-                    osg::Vec4 urColor = ia(colMax, rowMax);
-                    osg::Vec4 llColor = ia(colMin, rowMin);
-                    osg::Vec4 ulColor = ia(colMin, rowMax);
-                    osg::Vec4 lrColor = ia(colMax, rowMin);
-
-                    /*Average Interpolation*/
-                    /*double x_rem = px - (int)px;
-                    double y_rem = py - (int)py;
-
-                    double w00 = (1.0 - y_rem) * (1.0 - x_rem);
-                    double w01 = (1.0 - y_rem) * x_rem;
-                    double w10 = y_rem * (1.0 - x_rem);
-                    double w11 = y_rem * x_rem;
-                    double wsum = w00 + w01 + w10 + w11;
-                    wsum = 1.0/wsum;
-
-                    color.r() = (w00 * llColor.r() + w01 * lrColor.r() + w10 * ulColor.r() + w11 * urColor.r()) * wsum;
-                    color.g() = (w00 * llColor.g() + w01 * lrColor.g() + w10 * ulColor.g() + w11 * urColor.g()) * wsum;
-                    color.b() = (w00 * llColor.b() + w01 * lrColor.b() + w10 * ulColor.b() + w11 * urColor.b()) * wsum;
-                    color.a() = (w00 * llColor.a() + w01 * lrColor.a() + w10 * ulColor.a() + w11 * urColor.a()) * wsum;*/
-
-                    /*Nearest Neighbor Interpolation*/
-                    /*if (px_i >= 0 && px_i < image->s() &&
-                    py_i >= 0 && py_i < image->t())
-                    {
-                    //OE_NOTICE << "[osgEarth::GeoData] Sampling pixel " << px << "," << py << std::endl;
-                    color = ImageUtils::getColor(image, px_i, py_i);
-                    }
-                    else
-                    {
-                    OE_NOTICE << "[osgEarth::GeoData] Pixel out of range " << px_i << "," << py_i << "  image is " << image->s() << "x" << image->t() << std::endl;
-                    }*/
-
-                    /*Bilinear interpolation*/
-                    //Check for exact value
-                    if ((colMax == colMin) && (rowMax == rowMin))
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Exact value" << std::endl;
-                        color = ia(px_i, py_i);
-                    }
-                    else if (colMax == colMin)
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Vertically" << std::endl;
-                        //Linear interpolate vertically
-                        for (unsigned int i = 0; i < 4; ++i)
-                        {
-                            color[i] = ((float)rowMax - py) * llColor[i] + (py - (float)rowMin) * ulColor[i];
-                        }
-                    }
-                    else if (rowMax == rowMin)
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Horizontally" << std::endl;
-                        //Linear interpolate horizontally
-                        for (unsigned int i = 0; i < 4; ++i)
-                        {
-                            color[i] = ((float)colMax - px) * llColor[i] + (px - (float)colMin) * lrColor[i];
-                        }
-                    }
-                    else
-                    {
-                        //OE_NOTICE << "[osgEarth::GeoData] Bilinear" << std::endl;
-                        //Bilinear interpolate
-                        float col1 = colMax - px, col2 = px - colMin;
-                        float row1 = rowMax - py, row2 = py - rowMin;
-                        for (unsigned int i = 0; i < 4; ++i)
-                        {
-                            float r1 = col1 * llColor[i] + col2 * lrColor[i];
-                            float r2 = col1 * ulColor[i] + col2 * urColor[i];
-
-                            //OE_INFO << "r1, r2 = " << r1 << " , " << r2 << std::endl;
-                            color[i] = row1 * r1 + row2 * r2;
-                        }
-                    }
-                }
+        if (numBands > 1u)
+            done.wait();
 
-                writer(color, c, r);
-                pixel++;
-            }
-        }
+        return result;
+    }
+}
 
-        delete[] srcPointsX;
+void
+GeoImage::setReprojectTolerance(double value)
+{
+    Threading::ScopedMutexLock lock(s_reprojectToleranceMutex);
+    s_reprojectTolerance = osg::maximum(value, 0.0);
+}
 
-        return result;
+double
+GeoImage::getReprojectTolerance()
+{
+    Threading::ScopedMutexLock lock(s_reprojectToleranceMutex);
+    if (s_reprojectTolerance < 0.0)
+    {
+        const char* value = ::getenv(OSGEARTH_ENV_REPROJECT_TOLERANCE);
+        s_reprojectTolerance = value ?
+            osg::maximum(as<double>(value, REPROJECT_DEFAULT_TOLERANCE), 0.0) :
+            REPROJECT_DEFAULT_TOLERANCE;
     }
+    return s_reprojectTolerance;
+}
+
+void
+GeoImage::setParallelReprojectEnabled(bool value)
+{
+    s_parallelReprojectEnabled.exchange( value ? 1u : 0u );
+}
+
+bool
+GeoImage::getParallelReprojectEnabled()
+{
+    return s_parallelReprojectEnabled != 0u;
 }
 
 GeoImage
@@ -21,6 +21,7 @@
 #include <osgEarth/Metrics>
 #include <osgDB/ReadFile>
 #include <osgDB/FileNameUtils>
+#include <osg/OperationThread>
 #include <curl/curl.h>
 
 // Whether to use WinInet instead of cURL - CMAKE option
@@ -31,6 +32,9 @@
 
 #define LC "[HTTPClient] "
 
+#define OSGEARTH_ENV_HTTP_MAX_CONNECTIONS "OSGEARTH_HTTP_MAX_CONNECTIONS"
+#define OSGEARTH_ENV_HTTP_ASYNC_THREADS   "OSGEARTH_HTTP_ASYNC_THREADS"
+
 //#define OE_TEST OE_NOTICE
 #define OE_TEST OE_NULL
 
@@ -267,6 +271,7 @@ HTTPRequest::getURL() const
 HTTPResponse::HTTPResponse( long _code ) :
 _response_code( _code ),
 _cancelled(false),
+_timedOut(false),
 _duration_s(0.0),
 _lastModified(0u)
 {
@@ -278,6 +283,7 @@ _response_code( rhs._response_code ),
 _parts( rhs._parts ),
 _mimeType( rhs._mimeType ),
 _cancelled( rhs._cancelled ),
+_timedOut( rhs._timedOut ),
 _duration_s(0.0),
 _lastModified(0u)
 {
@@ -311,6 +317,11 @@ HTTPResponse::isCancelled() const {
     return _cancelled;
 }
 
+bool
+HTTPResponse::isTimedOut() const {
+    return _timedOut;
+}
+
 unsigned int
 HTTPResponse::getNumParts() const {
     return _parts.size();
@@ -390,6 +401,59 @@ namespace
     static osg::ref_ptr< CurlConfigHandler > s_curlConfigHandler;
 }
 
+namespace
+{
+    // Options shared by every easy handle, whether it runs a blocking
+    // request or an asynchronous one.
+    void setDefaultOptions(CURL* curl_handle)
+    {
+        //Get the user agent
+        std::string userAgent = s_userAgent;
+        const char* userAgentEnv = getenv("OSGEARTH_USERAGENT");
+        if (userAgentEnv)
+        {
+            userAgent = std::string(userAgentEnv);
+        }
+
+        OE_DEBUG << LC << "HTTPClient setting userAgent=" << userAgent << std::endl;
+
+        curl_easy_setopt( curl_handle, CURLOPT_USERAGENT, userAgent.c_str() );
+        curl_easy_setopt( curl_handle, CURLOPT_WRITEFUNCTION, osgEarth::StreamObjectReadCallback );
+        curl_easy_setopt( curl_handle, CURLOPT_HEADERFUNCTION, osgEarth::StreamObjectHeaderCallback );
+        curl_easy_setopt( curl_handle, CURLOPT_FOLLOWLOCATION, (void*)1 );
+        curl_easy_setopt( curl_handle, CURLOPT_MAXREDIRS, (void*)5 );
+        curl_easy_setopt( curl_handle, CURLOPT_PROGRESSFUNCTION, &CurlProgressCallback);
+        curl_easy_setopt( curl_handle, CURLOPT_NOPROGRESS, (void*)0 ); //0=enable.
+        curl_easy_setopt( curl_handle, CURLOPT_FILETIME, true );
+
+        // Enable automatic CURL decompression of known types. An empty string will automatically add all supported encoding types that are built into curl.
+        // Note that you must have curl built against zlib to support gzip or deflate encoding.
+        curl_easy_setopt( curl_handle, CURLOPT_ENCODING, "");
+
+        osg::ref_ptr< CurlConfigHandler > curlConfigHandler = HTTPClient::getCurlConfigHandler();
+        if (curlConfigHandler.valid()) {
+            curlConfigHandler->onInitialize(curl_handle);
+        }
+
+        long timeout = s_timeout;
+        const char* timeoutEnv = getenv("OSGEARTH_HTTP_TIMEOUT");
+        if (timeoutEnv)
+        {
+            timeout = osgEarth::as<long>(std::string(timeoutEnv), 0);
+        }
+        OE_DEBUG << LC << "Setting timeout to " << timeout << std::endl;
+        curl_easy_setopt( curl_handle, CURLOPT_TIMEOUT, timeout );
+        long connectTimeout = s_connectTimeout;
+        const char* connectTimeoutEnv = getenv("OSGEARTH_HTTP_CONNECTTIMEOUT");
+        if (connectTimeoutEnv)
+        {
+            connectTimeout = osgEarth::as<long>(std::string(connectTimeoutEnv), 0);
+        }
+        OE_DEBUG << LC << "Setting connect timeout to " << connectTimeout << std::endl;
+        curl_easy_setopt( curl_handle, CURLOPT_CONNECTTIMEOUT, connectTimeout );
+    }
+}
+
 HTTPClient&
 HTTPClient::getClient()
 {
@@ -421,14 +485,6 @@ HTTPClient::initializeImpl()
     _previousHttpAuthentication = 0;
     _curl_handle = curl_easy_init();
 
-    //Get the user agent
-    std::string userAgent = s_userAgent;
-    const char* userAgentEnv = getenv("OSGEARTH_USERAGENT");
-    if (userAgentEnv)
-    {
-        userAgent = std::string(userAgentEnv);
-    }
-
     //Check for a response-code simulation (for testing)
     const char* simCode = getenv("OSGEARTH_SIMULATE_HTTP_RESPONSE_CODE");
     if ( simCode )
@@ -452,42 +508,7 @@ HTTPClient::initializeImpl()
         OE_WARN << LC << "HTTP debugging enabled" << std::endl;
     }
 
-    OE_DEBUG << LC << "HTTPClient setting userAgent=" << userAgent << std::endl;
-
-    curl_easy_setopt( _curl_handle, CURLOPT_USERAGENT, userAgent.c_str() );
-    curl_easy_setopt( _curl_handle, CURLOPT_WRITEFUNCTION, osgEarth::StreamObjectReadCallback );
-    curl_easy_setopt( _curl_handle, CURLOPT_HEADERFUNCTION, osgEarth::StreamObjectHeaderCallback );
-    curl_easy_setopt( _curl_handle, CURLOPT_FOLLOWLOCATION, (void*)1 );
-    curl_easy_setopt( _curl_handle, CURLOPT_MAXREDIRS, (void*)5 );
-    curl_easy_setopt( _curl_handle, CURLOPT_PROGRESSFUNCTION, &CurlProgressCallback);
-    curl_easy_setopt( _curl_handle, CURLOPT_NOPROGRESS, (void*)0 ); //0=enable.
-    curl_easy_setopt( _curl_handle, CURLOPT_FILETIME, true );
-
-    // Enable automatic CURL decompression of known types. An empty string will automatically add all supported encoding types that are built into curl.
-    // Note that you must have curl built against zlib to support gzip or deflate encoding.
-    curl_easy_setopt( _curl_handle, CURLOPT_ENCODING, "");
-
-    osg::ref_ptr< CurlConfigHandler > curlConfigHandler = getCurlConfigHandler();
-    if (curlConfigHandler.valid()) {
-        curlConfigHandler->onInitialize(_curl_handle);
-    }
-
-    long timeout = s_timeout;
-    const char* timeoutEnv = getenv("OSGEARTH_HTTP_TIMEOUT");
-    if (timeoutEnv)
-    {
-        timeout = osgEarth::as<long>(std::string(timeoutEnv), 0);
-    }
-    OE_DEBUG << LC << "Setting timeout to " << timeout << std::endl;
-    curl_easy_setopt( _curl_handle, CURLOPT_TIMEOUT, timeout );
-    long connectTimeout = s_connectTimeout;
-    const char* connectTimeoutEnv = getenv("OSGEARTH_HTTP_CONNECTTIMEOUT");
-    if (connectTimeoutEnv)
-    {
-        connectTimeout = osgEarth::as<long>(std::string(connectTimeoutEnv), 0);
-    }
-    OE_DEBUG << LC << "Setting connect timeout to " << connectTimeout << std::endl;
-    curl_easy_setopt( _curl_handle, CURLOPT_CONNECTTIMEOUT, connectTimeout );
+    setDefaultOptions( _curl_handle );
 
     _initialized = true;
 }
@@ -566,7 +587,7 @@ HTTPClient::globalInit()
 }
 
 void
-HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port) const
+HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host, std::string& proxy_port)
 {
     // try to set proxy host/port by reading the CURL proxy options
     if ( options )
@@ -588,10 +609,73 @@ HTTPClient::readOptions(const osgDB::Options* options, std::string& proxy_host,
     }
 }
 
+// Resolves the proxy "host:port" and credentials from (in increasing order of
+// priority) the global settings, the read options, and the environment.
+void
+HTTPClient::getProxy(const osgDB::Options* options, std::string& proxy_addr, std::string& proxy_auth)
+{
+    std::string proxy_host;
+    std::string proxy_port = "8080";
+
+    //Try to get the proxy settings from the global settings
+    if (s_proxySettings.isSet())
+    {
+        proxy_host = s_proxySettings.get().hostName();
+        std::stringstream buf;
+        buf << s_proxySettings.get().port();
+        proxy_port = buf.str();
+
+        std::string proxy_username = s_proxySettings.get().userName();
+        std::string proxy_password = s_proxySettings.get().password();
+        if (!proxy_username.empty() && !proxy_password.empty())
+        {
+            proxy_auth = proxy_username + std::string(":") + proxy_password;
+        }
+    }
+
+    //Try to get the proxy settings from the local options that are passed in.
+    readOptions( options, proxy_host, proxy_port );
+
+    optional< ProxySettings > proxySettings;
+    ProxySettings::fromOptions( options, proxySettings );
+    if (proxySettings.isSet())
+    {
+        proxy_host = proxySettings.get().hostName();
+        proxy_port = toString<int>(proxySettings.get().port());
+        OE_DEBUG << LC << "Read proxy settings from options " << proxy_host << " " << proxy_port << std::endl;
+    }
+
+    //Try to get the proxy settings from the environment variable
+    const char* proxyEnvAddress = getenv("OSG_CURL_PROXY");
+    if (proxyEnvAddress) //Env Proxy Settings
+    {
+        proxy_host = std::string(proxyEnvAddress);
+
+        const char* proxyEnvPort = getenv("OSG_CURL_PROXYPORT"); //Searching Proxy Port on Env
+        if (proxyEnvPort)
+        {
+            proxy_port = std::string( proxyEnvPort );
+        }
+    }
+
+    const char* proxyEnvAuth = getenv("OSGEARTH_CURL_PROXYAUTH");
+    if (proxyEnvAuth)
+    {
+        proxy_auth = std::string(proxyEnvAuth);
+    }
+
+    if ( !proxy_host.empty() )
+    {
+        std::stringstream buf;
+        buf << proxy_host << ":" << proxy_port;
+        proxy_addr = buf.str();
+    }
+}
+
 bool
 HTTPClient::decodeMultipartStream(const std::string&   boundary,
                                   HTTPResponse::Part*  input,
-                                  HTTPResponse::Parts& output) const
+                                  HTTPResponse::Parts& output)
 {
     std::string bstr = std::string("--") + boundary;
     std::string line;
@@ -979,89 +1063,92 @@ HTTPClient::doGet(const HTTPRequest&    request,
 
 #else // OSGEARTH_USE_WININET_FOR_HTTP
 
-HTTPResponse
-HTTPClient::doGet(const HTTPRequest&    request,
-                  const osgDB::Options* options,
-                  ProgressCallback*     progress) const
+// Fills in a response from a finished transfer: content type, file time,
+// and the payload parts.
+void
+HTTPClient::readResponse(void*               curl_handle,
+                         int                 curl_result,
+                         HTTPResponse::Part* part,
+                         const Headers&      headers,
+                         HTTPResponse&       response)
 {
-    METRIC_BEGIN("HTTPClient::doGet", 1,
-                   "url", request.getURL().c_str());
-
-    initialize();
-
-    OE_START_TIMER(http_get);
-
-    std::string url = request.getURL();
-
-    const osgDB::AuthenticationMap* authenticationMap = (options && options->getAuthenticationMap()) ?
-            options->getAuthenticationMap() :
-            osgDB::Registry::instance()->getAuthenticationMap();
+    // read the response content type:
+    char* content_type_cp = NULL;
 
-    std::string proxy_host;
-    std::string proxy_port = "8080";
+    curl_easy_getinfo( curl_handle, CURLINFO_CONTENT_TYPE, &content_type_cp );
 
-    std::string proxy_auth;
+    if ( content_type_cp != NULL )
+    {
+        response._mimeType = content_type_cp;
+    }
 
-    //TODO: don't do all this proxy setup on every GET. Just do it once per client, or only when
-    // the proxy information changes.
+    // read the file time:
+    response._lastModified = getCurlFileTime( curl_handle );
 
-    //Try to get the proxy settings from the global settings
-    if (s_proxySettings.isSet())
+    if (curl_result == CURLE_OK)
     {
-        proxy_host = s_proxySettings.get().hostName();
-        std::stringstream buf;
-        buf << s_proxySettings.get().port();
-        proxy_port = buf.str();
+        // check for multipart content
+        if (response._mimeType.length() > 9 &&
+            ::strstr( response._mimeType.c_str(), "multipart" ) == response._mimeType.c_str() )
+        {
+            OE_DEBUG << LC << "detected multipart data; decoding..." << std::endl;
 
-        std::string proxy_username = s_proxySettings.get().userName();
-        std::string proxy_password = s_proxySettings.get().password();
-        if (!proxy_username.empty() && !proxy_password.empty())
+            //TODO: parse out the "wcs" -- this is WCS-specific
+            if ( !decodeMultipartStream( "wcs", part, response._parts ) )
+            {
+                // error decoding an invalid multipart stream.
+                // should we do anything, or just leave the response empty?
+            }
+        }
+        else
         {
-            proxy_auth = proxy_username + std::string(":") + proxy_password;
+            for (Headers::const_iterator itr = headers.begin(); itr != headers.end(); ++itr)
+            {
+                part->_headers[itr->first] = itr->second;
+            }
+
+            // Write the headers to the metadata
+            response._parts.push_back( part );
         }
     }
 
-    //Try to get the proxy settings from the local options that are passed in.
-    readOptions( options, proxy_host, proxy_port );
-
-    optional< ProxySettings > proxySettings;
-    ProxySettings::fromOptions( options, proxySettings );
-    if (proxySettings.isSet())
+    else if (curl_result == CURLE_ABORTED_BY_CALLBACK || curl_result == CURLE_OPERATION_TIMEDOUT)
     {
-        proxy_host = proxySettings.get().hostName();
-        proxy_port = toString<int>(proxySettings.get().port());
-        OE_DEBUG << LC << "Read proxy settings from options " << proxy_host << " " << proxy_port << std::endl;
+        //If we were aborted by a callback, then it was cancelled by a user
+        response._cancelled = true;
+        response._timedOut = curl_result == CURLE_OPERATION_TIMEDOUT;
     }
 
-    //Try to get the proxy settings from the environment variable
-    const char* proxyEnvAddress = getenv("OSG_CURL_PROXY");
-    if (proxyEnvAddress) //Env Proxy Settings
+    else
     {
-        proxy_host = std::string(proxyEnvAddress);
-
-        const char* proxyEnvPort = getenv("OSG_CURL_PROXYPORT"); //Searching Proxy Port on Env
-        if (proxyEnvPort)
-        {
-            proxy_port = std::string( proxyEnvPort );
-        }
+        response._message = curl_easy_strerror((CURLcode)curl_result);
     }
+}
 
-    const char* proxyEnvAuth = getenv("OSGEARTH_CURL_PROXYAUTH");
-    if (proxyEnvAuth)
-    {
-        proxy_auth = std::string(proxyEnvAuth);
-    }
+HTTPResponse
+HTTPClient::doGet(const HTTPRequest&    request,
+                  const osgDB::Options* options,
+                  ProgressCallback*     progress) const
+{
+    METRIC_BEGIN("HTTPClient::doGet", 1,
+                   "url", request.getURL().c_str());
+
+    initialize();
+
+    OE_START_TIMER(http_get);
+
+    std::string url = request.getURL();
+
+    const osgDB::AuthenticationMap* authenticationMap = (options && options->getAuthenticationMap()) ?
+            options->getAuthenticationMap() :
+            osgDB::Registry::instance()->getAuthenticationMap();
 
     // Set up proxy server:
     std::string proxy_addr;
-    if ( !proxy_host.empty() )
+    std::string proxy_auth;
+    getProxy( options, proxy_addr, proxy_auth );
+    if ( !proxy_addr.empty() )
     {
-        std::stringstream buf;
-        buf << proxy_host << ":" << proxy_port;
-        std::string bufStr;
-        bufStr = buf.str();
-        proxy_addr = bufStr;
-
         if ( s_HTTP_DEBUG )
         {
             OE_NOTICE << LC << "Using proxy: " << proxy_addr << std::endl;
@@ -1219,60 +1306,11 @@ HTTPClient::doGet(const HTTPRequest&    request,
 
     HTTPResponse response( response_code );
 
-    // read the response content type:
-    char* content_type_cp;
-
-    curl_easy_getinfo( _curl_handle, CURLINFO_CONTENT_TYPE, &content_type_cp );
+    readResponse( _curl_handle, res, part.get(), sp._headers, response );
 
-    if ( content_type_cp != NULL )
+    if (res == CURLE_GOT_NOTHING)
     {
-        response._mimeType = content_type_cp;
-    }
-
-    // read the file time:
-    response._lastModified = getCurlFileTime( _curl_handle );
-
-    if (res == CURLE_OK)
-    {
-        // check for multipart content
-        if (response._mimeType.length() > 9 &&
-            ::strstr( response._mimeType.c_str(), "multipart" ) == response._mimeType.c_str() )
-        {
-            OE_DEBUG << LC << "detected multipart data; decoding..." << std::endl;
-
-            //TODO: parse out the "wcs" -- this is WCS-specific
-            if ( !decodeMultipartStream( "wcs", part.get(), response._parts ) )
-            {
-                // error decoding an invalid multipart stream.
-                // should we do anything, or just leave the response empty?
-            }
-        }
-        else
-        {
-            for (Headers::iterator itr = sp._headers.begin(); itr != sp._headers.end(); ++itr)
-            {
-                part->_headers[itr->first] = itr->second;
-            }
-
-            // Write the headers to the metadata
-            response._parts.push_back( part.get() );
-        }
-    }
-
-    else if (res == CURLE_ABORTED_BY_CALLBACK || res == CURLE_OPERATION_TIMEDOUT)
-    {
-        //If we were aborted by a callback, then it was cancelled by a user
-        response._cancelled = true;
-    }
-
-    else
-    {
-        response._message = curl_easy_strerror(res);
-
-        if (res == CURLE_GOT_NOTHING)
-        {
-            OE_DEBUG << LC << "CURLE_GOT_NOTHING for " << url << std::endl;
-        }
+        OE_DEBUG << LC << "CURLE_GOT_NOTHING for " << url << std::endl;
     }
 
     response._duration_s = OE_STOP_TIMER(get_duration);
@@ -1355,8 +1393,449 @@ HTTPClient::doGet(const HTTPRequest&    request,
     return response;
 }
 
+
+/****************************************************************************/
+
+/**
+ * Runs the asynchronous requests. One thread drives a curl "multi" handle
+ * that multiplexes every transfer in flight over a small set of (HTTP/2 where
+ * the server supports it) connections. Finished transfers go to a pool of
+ * completion threads that build the response and call the handler, so a
+ * slow decode never holds up the network.
+ */
+class HTTPClient::AsyncEngine : public OpenThreads::Thread
+{
+public:
+    // One request, from submission to completion.
+    struct Transfer : public osg::Referenced
+    {
+        Transfer(const HTTPRequest& request) :
+            _request     ( request ),
+            _part        ( new HTTPResponse::Part() ),
+            _stream      ( &_part->_stream ),
+            _headers     ( 0L ),
+            _handle      ( 0L ),
+            _result      ( CURLE_OK ),
+            _responseCode( 0L ),
+            _start       ( 0 ) { }
+
+        HTTPRequest                        _request;
+        osg::ref_ptr<HTTPResponseHandler>  _handler;
+        osg::ref_ptr<const osgDB::Options> _options;
+        osg::ref_ptr<ProgressCallback>     _progress;
+        osg::ref_ptr<HTTPResponse::Part>   _part;
+        StreamObject                       _stream;
+        struct curl_slist*                 _headers;
+        CURL*                              _handle;
+        CURLcode                           _result;
+        long                               _responseCode;
+        osg::Timer_t                       _start;
+    };
+
+    // Finishes a transfer on one of the completion threads.
+    struct Completion : public osg::Operation
+    {
+        Completion(AsyncEngine* engine, Transfer* transfer) :
+            osg::Operation("osgEarth::HTTPClient completion", false),
+            _engine  ( engine ),
+            _transfer( transfer ) { }
+
+        void operator()(osg::Object*) { _engine->complete(_transfer.get()); }
+
+        AsyncEngine*           _engine;
+        osg::ref_ptr<Transfer> _transfer;
+    };
+
+    AsyncEngine() :
+        _multi          ( curl_multi_init() ),
+        _started        ( false ),
+        _done           ( false ),
+        _simResponseCode( -1L )
+    {
+        long maxConnections = 8L;
+        const char* maxConnectionsEnv = ::getenv(OSGEARTH_ENV_HTTP_MAX_CONNECTIONS);
+        if (maxConnectionsEnv)
+            maxConnections = osg::maximum(osgEarth::as<long>(std::string(maxConnectionsEnv), 8L), 1L);
+
+#if LIBCURL_VERSION_NUM >= 0x072B00
+        curl_multi_setopt(_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x071E00
+        curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, maxConnections);
+#endif
+
+        // same testing hooks as the blocking client:
+        const char* simCode = ::getenv("OSGEARTH_SIMULATE_HTTP_RESPONSE_CODE");
+        if (simCode)
+            _simResponseCode = osgEarth::as<long>(std::string(simCode), 404L);
+
+        if (::getenv("OSGEARTH_HTTP_DISABLE"))
+            _simResponseCode = 503L;
+    }
+
+    ~AsyncEngine()
+    {
+        if (_started)
+        {
+            _done = true;
+            _wake.set();
+#if LIBCURL_VERSION_NUM >= 0x074400
+            curl_multi_wakeup(_multi);
+#endif
+            join();
+
+            _completions->releaseAllOperations();
+            for (unsigned i = 0; i < _completionThreads.size(); ++i)
+            {
+                _completionThreads[i]->setDone(true);
+                _completionThreads[i]->join();
+            }
+        }
+
+        // abandon anything still in flight; its futures will report that.
+        for (ActiveTransfers::iterator i = _active.begin(); i != _active.end(); ++i)
+        {
+            curl_multi_remove_handle(_multi, i->first);
+            curl_easy_cleanup(i->first);
+            if (i->second->_headers)
+                curl_slist_free_all(i->second->_headers);
+        }
+
+        for (unsigned i = 0; i < _idleHandles.size(); ++i)
+            curl_easy_cleanup(_idleHandles[i]);
+
+        curl_multi_cleanup(_multi);
+    }
+
+    //! Queues a transfer; it starts on the next pass of the event loop.
+    void submit(Transfer* transfer)
+    {
+        Threading::ScopedMutexLock lock(_mutex);
+
+        if (!_started)
+        {
+            unsigned numThreads = 2u;
+            const char* numThreadsEnv = ::getenv(OSGEARTH_ENV_HTTP_ASYNC_THREADS);
+            if (numThreadsEnv)
+                numThreads = osg::maximum(osgEarth::as<unsigned>(std::string(numThreadsEnv), 2u), 1u);
+
+            _completions = new osg::OperationQueue();
+            for (unsigned i = 0; i < numThreads; ++i)
+            {
+                osg::OperationThread* thread = new osg::OperationThread();
+                thread->setOperationQueue(_completions.get());
+                thread->start();
+                _completionThreads.push_back(thread);
+            }
+
+            start();
+            _started = true;
+        }
+
+        _pending.push_back(transfer);
+        _wake.set();
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+        curl_multi_wakeup(_multi);
+#endif
+    }
+
+    void run()
+    {
+        std::vector< osg::ref_ptr<Transfer> > incoming;
+
+        while (!_done)
+        {
+            {
+                Threading::ScopedMutexLock lock(_mutex);
+                incoming.swap(_pending);
+            }
+
+            for (unsigned i = 0; i < incoming.size(); ++i)
+                begin(incoming[i].get());
+            incoming.clear();
+
+            if (_active.empty())
+            {
+                // nothing in flight; sleep until someone submits a request.
+                _wake.waitAndReset();
+                continue;
+            }
+
+            int running = 0;
+            {
+                OE_TRACE_SCOPE("http.perform");
+                curl_multi_perform(_multi, &running);
+            }
+            OE_TRACE_COUNTER("http", "active", running);
+
+            int remaining = 0;
+            CURLMsg* msg;
+            while ((msg = curl_multi_info_read(_multi, &remaining)) != 0L)
+            {
+                if (msg->msg == CURLMSG_DONE)
+                    finish(msg->easy_handle, msg->data.result);
+            }
+
+            if (!_active.empty())
+            {
+                // wait for socket activity. Older versions of curl can't be
+                // woken up by submit(), so they poll for new requests instead.
+#if LIBCURL_VERSION_NUM >= 0x074400
+                curl_multi_poll(_multi, 0L, 0, 1000, 0L);
+#else
+                curl_multi_wait(_multi, 0L, 0, 10, 0L);
+#endif
+            }
+        }
+    }
+
+private:
+    typedef std::map<CURL*, osg::ref_ptr<Transfer> > ActiveTransfers;
+
+    CURL* acquireHandle()
+    {
+        Threading::ScopedMutexLock lock(_handlesMutex);
+        if (_idleHandles.empty())
+            return curl_easy_init();
+        CURL* handle = _idleHandles.back();
+        _idleHandles.pop_back();
+        return handle;
+    }
+
+    void releaseHandle(CURL* handle)
+    {
+        // reset keeps the handle's connection and DNS caches alive
+        curl_easy_reset(handle);
+        Threading::ScopedMutexLock lock(_handlesMutex);
+        _idleHandles.push_back(handle);
+    }
+
+    // Starts a transfer (event loop thread).
+    void begin(Transfer* transfer)
+    {
+        transfer->_handle = acquireHandle();
+        transfer->_start = osg::Timer::instance()->tick();
+
+        if (_simResponseCode >= 0)
+        {
+            transfer->_responseCode = _simResponseCode;
+            transfer->_result = _simResponseCode == 408 ? CURLE_OPERATION_TIMEDOUT : CURLE_COULDNT_CONNECT;
+            _completions->add(new Completion(this, transfer));
+            return;
+        }
+
+        CURL* handle = transfer->_handle;
+        setDefaultOptions(handle);
+
+        std::string url = transfer->_request.getURL();
+
+        osg::ref_ptr< URLRewriter > rewriter = getURLRewriter();
+        if ( rewriter.valid() )
+        {
+            url = rewriter->rewrite( url );
+        }
+
+        std::string proxy_addr;
+        std::string proxy_auth;
+        getProxy( transfer->_options.get(), proxy_addr, proxy_auth );
+        if ( !proxy_addr.empty() )
+        {
+            curl_easy_setopt( handle, CURLOPT_PROXY, proxy_addr.c_str() );
+            if ( !proxy_auth.empty() )
+                curl_easy_setopt( handle, CURLOPT_PROXYUSERPWD, proxy_auth.c_str() );
+        }
+
+        const osgDB::Options* options = transfer->_options.get();
+        const osgDB::AuthenticationMap* authenticationMap = (options && options->getAuthenticationMap()) ?
+            options->getAuthenticationMap() :
+            osgDB::Registry::instance()->getAuthenticationMap();
+
+        const osgDB::AuthenticationDetails* details = authenticationMap ?
+            authenticationMap->getAuthenticationDetails( url ) :
+            0;
+
+        if ( details )
+        {
+            std::string password = details->username + ":" + details->password;
+            curl_easy_setopt( handle, CURLOPT_USERPWD, password.c_str() );
+#if LIBCURL_VERSION_NUM >= 0x070a07
+            curl_easy_setopt( handle, CURLOPT_HTTPAUTH, details->httpAuthentication );
+#endif
+        }
+
+        for (Headers::const_iterator i = transfer->_request.getHeaders().begin(); i != transfer->_request.getHeaders().end(); ++i)
+        {
+            std::string header = i->first + ": " + i->second;
+            transfer->_headers = curl_slist_append( transfer->_headers, header.c_str() );
+        }
+
+        // Disable the default Pragma: no-cache that curl adds by default.
+        transfer->_headers = curl_slist_append( transfer->_headers, "Pragma: " );
+        curl_easy_setopt( handle, CURLOPT_HTTPHEADER, transfer->_headers );
+
+        curl_easy_setopt( handle, CURLOPT_URL, url.c_str() );
+        curl_easy_setopt( handle, CURLOPT_WRITEDATA, (void*)&transfer->_stream );
+        curl_easy_setopt( handle, CURLOPT_HEADERDATA, (void*)&transfer->_stream );
+        curl_easy_setopt( handle, CURLOPT_PROGRESSDATA, (void*)transfer->_progress.get() );
+        curl_easy_setopt( handle, CURLOPT_SSL_VERIFYPEER, (void*)0 );
+
+#if LIBCURL_VERSION_NUM >= 0x072F00
+        curl_easy_setopt( handle, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS );
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072B00
+        // wait for a connection that can multiplex rather than opening another one
+        curl_easy_setopt( handle, CURLOPT_PIPEWAIT, 1L );
+#endif
+
+        osg::ref_ptr< CurlConfigHandler > curlConfigHandler = getCurlConfigHandler();
+        if (curlConfigHandler.valid())
+        {
+            curlConfigHandler->onGet(handle);
+        }
+
+        _active[handle] = transfer;
+        curl_multi_add_handle(_multi, handle);
+    }
+
+    // Hands a finished transfer to the completion threads (event loop thread).
+    void finish(CURL* handle, CURLcode result)
+    {
+        curl_multi_remove_handle(_multi, handle);
+
+        ActiveTransfers::iterator i = _active.find(handle);
+        if (i == _active.end())
+            return;
+
+        osg::ref_ptr<Transfer> transfer = i->second;
+        _active.erase(i);
+
+        transfer->_result = result;
+        curl_easy_getinfo( handle, CURLINFO_RESPONSE_CODE, &transfer->_responseCode );
+
+        _completions->add(new Completion(this, transfer.get()));
+    }
+
+    // Builds the response and calls the handler (completion thread).
+    void complete(Transfer* transfer)
+    {
+        OE_TRACE_SCOPE("http.complete");
+
+        HTTPResponse response( transfer->_responseCode );
+        readResponse( transfer->_handle, transfer->_result, transfer->_part.get(), transfer->_stream._headers, response );
+        response._duration_s = osg::Timer::instance()->delta_s(transfer->_start, osg::Timer::instance()->tick());
+
+        if ( transfer->_headers )
+        {
+            curl_slist_free_all( transfer->_headers );
+            transfer->_headers = 0L;
+        }
+
+        releaseHandle( transfer->_handle );
+        transfer->_handle = 0L;
+
+        if ( s_HTTP_DEBUG )
+        {
+            OE_NOTICE << LC
+                << "GET(" << response.getCode() << ") " << response.getMimeType() << ": \""
+                << transfer->_request.getURL() << "\" (async) t="
+                << std::setprecision(4) << response.getDuration() << "s" << std::endl;
+        }
+
+        if ( transfer->_handler.valid() )
+        {
+            transfer->_handler->onResponse( transfer->_request, response );
+        }
+    }
+
+    CURLM*                                           _multi;
+    Threading::Mutex                                 _mutex;
+    std::vector< osg::ref_ptr<Transfer> >            _pending;
+    ActiveTransfers                                  _active;
+    Threading::Event                                 _wake;
+    bool                                             _started;
+    volatile bool                                    _done;
+    long                                             _simResponseCode;
+    Threading::Mutex                                 _handlesMutex;
+    std::vector<CURL*>                               _idleHandles;
+    osg::ref_ptr<osg::OperationQueue>                _completions;
+    std::vector< osg::ref_ptr<osg::OperationThread> > _completionThreads;
+};
+
+HTTPClient::AsyncEngine&
+HTTPClient::getAsyncEngine()
+{
+    static AsyncEngine s_engine;
+    return s_engine;
+}
+
 #endif // USE_WININET
 
+namespace
+{
+    // Decodes the response to an asynchronous read and resolves its future.
+    struct ResolveReadResult : public HTTPResponseHandler
+    {
+        typedef ReadResult (*Decoder)(const HTTPRequest&, const HTTPResponse&, const osgDB::Options*, ProgressCallback*);
+
+        ResolveReadResult(Decoder decoder, const osgDB::Options* options, ProgressCallback* progress) :
+            _decoder(decoder), _options(options), _progress(progress) { }
+
+        void onResponse(const HTTPRequest& request, const HTTPResponse& response)
+        {
+            _promise.resolve(new ReadResultObject(_decoder(request, response, _options.get(), _progress.get())));
+        }
+
+        Decoder                             _decoder;
+        osg::ref_ptr<const osgDB::Options>  _options;
+        osg::ref_ptr<ProgressCallback>      _progress;
+        Threading::Promise<ReadResultObject> _promise;
+    };
+}
+
+void
+HTTPClient::getAsync(const HTTPRequest&    request,
+                     HTTPResponseHandler*  handler,
+                     const osgDB::Options* options,
+                     ProgressCallback*     progress)
+{
+#ifdef OSGEARTH_USE_WININET_FOR_HTTP
+    // WinInet has no multiplexing interface; run the request in place.
+    osg::ref_ptr<HTTPResponseHandler> handlerRef = handler;
+    HTTPResponse response = get(request, options, progress);
+    if (handler)
+        handler->onResponse(request, response);
+#else
+    osg::ref_ptr<AsyncEngine::Transfer> transfer = new AsyncEngine::Transfer(request);
+    transfer->_handler = handler;
+    transfer->_options = options;
+    transfer->_progress = progress;
+    getAsyncEngine().submit(transfer.get());
+#endif
+}
+
+Threading::Future<ReadResultObject>
+HTTPClient::readImageAsync(const HTTPRequest&    request,
+                           const osgDB::Options* options,
+                           ProgressCallback*     progress)
+{
+    osg::ref_ptr<ResolveReadResult> handler = new ResolveReadResult(&HTTPClient::decodeImage, options, progress);
+    Threading::Future<ReadResultObject> result = handler->_promise.getFuture();
+    getAsync(request, handler.get(), options, progress);
+    return result;
+}
+
+Threading::Future<ReadResultObject>
+HTTPClient::readStringAsync(const HTTPRequest&    request,
+                            const osgDB::Options* options,
+                            ProgressCallback*     progress)
+{
+    osg::ref_ptr<ResolveReadResult> handler = new ResolveReadResult(&HTTPClient::decodeString, options, progress);
+    Threading::Future<ReadResultObject> result = handler->_promise.getFuture();
+    getAsync(request, handler.get(), options, progress);
+    return result;
+}
+
 bool
 HTTPClient::doDownload(const std::string& url, const std::string& filename)
 {
@@ -1442,10 +1921,19 @@ HTTPClient::doReadImage(const HTTPRequest&    request,
 {
     initialize();
 
-    ReadResult result;
-
     HTTPResponse response = this->doGet(request, options, callback);
 
+    return decodeImage(request, response, options, callback);
+}
+
+ReadResult
+HTTPClient::decodeImage(const HTTPRequest&    request,
+                        const HTTPResponse&   response,
+                        const osgDB::Options* options,
+                        ProgressCallback*     callback)
+{
+    ReadResult result;
+
     if (response.isOK())
     {
         osgDB::ReaderWriter* reader = getReader(request.getURL(), response);
@@ -1488,6 +1976,7 @@ HTTPClient::doReadImage(const HTTPRequest&    request,
     else
     {
         result = ReadResult(
+            response.isTimedOut() ? ReadResult::RESULT_TIMEOUT :
             response.isCancelled() ? ReadResult::RESULT_CANCELED :
             response.getCode() == HTTPResponse::NOT_FOUND ? ReadResult::RESULT_NOT_FOUND :
             response.getCode() == HTTPResponse::NOT_MODIFIED ? ReadResult::RESULT_NOT_MODIFIED :
@@ -1576,6 +2065,7 @@ HTTPClient::doReadNode(const HTTPRequest&    request,
     else
     {
         result = ReadResult(
+            response.isTimedOut() ? ReadResult::RESULT_TIMEOUT :
             response.isCancelled() ? ReadResult::RESULT_CANCELED :
             response.getCode() == HTTPResponse::NOT_FOUND ? ReadResult::RESULT_NOT_FOUND :
             response.getCode() == HTTPResponse::NOT_MODIFIED ? ReadResult::RESULT_NOT_MODIFIED :
@@ -1660,6 +2150,7 @@ HTTPClient::doReadObject(const HTTPRequest&    request,
     else
     {
         result = ReadResult(
+            response.isTimedOut() ? ReadResult::RESULT_TIMEOUT :
             response.isCancelled() ? ReadResult::RESULT_CANCELED :
             response.getCode() == HTTPResponse::NOT_FOUND ? ReadResult::RESULT_NOT_FOUND :
             response.getCode() == HTTPResponse::NOT_MODIFIED ? ReadResult::RESULT_NOT_MODIFIED :
@@ -1701,9 +2192,19 @@ HTTPClient::doReadString(const HTTPRequest&    request,
 {
     initialize();
 
+    HTTPResponse response = this->doGet( request, options, callback );
+
+    return decodeString( request, response, options, callback );
+}
+
+ReadResult
+HTTPClient::decodeString(const HTTPRequest&    request,
+                         const HTTPResponse&   response,
+                         const osgDB::Options* options,
+                         ProgressCallback*     callback )
+{
     ReadResult result;
 
-    HTTPResponse response = this->doGet( request, options, callback );
     if ( response.isOK() && response.getNumParts() > 0 )
     {
         result = ReadResult( new StringObject(response.getPartAsString(0)) );
@@ -1711,6 +2212,7 @@ HTTPClient::doReadString(const HTTPRequest&    request,
     else
     {
         result = ReadResult(
+            response.isTimedOut() ? ReadResult::RESULT_TIMEOUT :
             response.isCancelled() ? ReadResult::RESULT_CANCELED :
             response.getCode() == HTTPResponse::NOT_FOUND ? ReadResult::RESULT_NOT_FOUND :
             response.getCode() == HTTPResponse::NOT_MODIFIED ? ReadResult::RESULT_NOT_MODIFIED :
@@ -493,6 +493,65 @@ HeightFieldUtils::resampleHeightField(osg::HeightField*      input,
     return output;
 }
 
+bool
+HeightFieldUtils::downsampleIntoQuadrant(osg::HeightField*       target,
+                                         const osg::HeightField* source,
+                                         unsigned                quadrant)
+{
+    if ( !target || !source || quadrant > 3u ||
+         target->getNumColumns() != source->getNumColumns() ||
+         target->getNumRows()    != source->getNumRows() )
+    {
+        return false;
+    }
+
+    // posts per quadrant; with an odd count the middle row and column
+    // are shared by neighboring quadrants.
+    unsigned numCols = source->getNumColumns(), numRows = source->getNumRows();
+    unsigned halfCols = (numCols+1)/2, halfRows = (numRows+1)/2;
+    unsigned coff = quadrant == 0 || quadrant == 2 ? 0 : numCols-halfCols;
+    unsigned roff = quadrant == 2 || quadrant == 3 ? 0 : numRows-halfRows;
+
+    // 3x3 tent filter; weights are (1 2 1) x (1 2 1).
+    static const float weights[3] = { 1.0f, 2.0f, 1.0f };
+
+    for(unsigned r=0; r<halfRows; ++r)
+    {
+        unsigned sr = osg::minimum(2*r, numRows-1);
+        bool edgeRow = sr == 0 || sr == numRows-1;
+
+        for(unsigned c=0; c<halfCols; ++c)
+        {
+            unsigned sc = osg::minimum(2*c, numCols-1);
+            float h = source->getHeight(sc, sr);
+
+            // Posts on the tile's edge are copied, so they still match the
+            // neighboring tiles' edges. Interior posts average their neighbors.
+            if ( !edgeRow && sc != 0 && sc != numCols-1 && h != NO_DATA_VALUE )
+            {
+                float sum = 0.0f, weight = 0.0f;
+                for(unsigned j=0; j<3; ++j)
+                {
+                    for(unsigned i=0; i<3; ++i)
+                    {
+                        float n = source->getHeight(sc+i-1, sr+j-1);
+                        if ( n != NO_DATA_VALUE )
+                        {
+                            sum    += weights[i] * weights[j] * n;
+                            weight += weights[i] * weights[j];
+                        }
+                    }
+                }
+                h = sum / weight;
+            }
+
+            target->setHeight( coff+c, roff+r, h );
+        }
+    }
+
+    return true;
+}
+
 
 osg::HeightField*
 HeightFieldUtils::createReferenceHeightField(const GeoExtent& ex,
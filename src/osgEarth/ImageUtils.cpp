@@ -24,6 +24,14 @@
 #include <osgDB/Registry>
 
 #include <osg/ValueObject>
+#include <OpenThreads/Atomic>
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OE_IMAGEUTILS_SSE2
+#endif
 
 #define LC "[ImageUtils] "
 
@@ -39,6 +47,414 @@
 
 using namespace osgEarth;
 
+//------------------------------------------------------------------------
+
+// Format-specialized kernels for the most common image layouts. Each one
+// produces the same values as the generic PixelReader/PixelWriter path
+// (8-bit channels convert as c/255 and back with truncation, which round
+// trips exactly), just without the per-pixel function pointers.
+
+namespace
+{
+    // read by every image operation, from any thread
+    OpenThreads::Atomic s_kernelsEnabled( 1u );
+
+    enum KernelFormat
+    {
+        KERNEL_NONE,
+        KERNEL_RGB8,
+        KERNEL_RGBA8,
+        KERNEL_R32F
+    };
+
+    KernelFormat getKernelFormat(const osg::Image* image)
+    {
+        if ( s_kernelsEnabled == 0u || !image || !image->data() )
+            return KERNEL_NONE;
+
+        GLenum pf = image->getPixelFormat();
+
+        if ( image->getDataType() == GL_UNSIGNED_BYTE && ImageUtils::isNormalized(image) )
+        {
+            if ( pf == GL_RGBA ) return KERNEL_RGBA8;
+            if ( pf == GL_RGB )  return KERNEL_RGB8;
+        }
+        else if ( image->getDataType() == GL_FLOAT && (pf == GL_RED || pf == GL_LUMINANCE) )
+        {
+            return KERNEL_R32F;
+        }
+
+        return KERNEL_NONE;
+    }
+
+#ifdef OE_IMAGEUTILS_SSE2
+    // One 8-bit color in an SSE register, one channel per lane.
+    typedef __m128 Color8;
+
+    inline Color8 unpack8(int v)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i i32 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+        return _mm_div_ps(_mm_cvtepi32_ps(i32), _mm_set1_ps(255.0f));
+    }
+
+    inline int pack8(const Color8& c)
+    {
+        __m128i i32 = _mm_cvttps_epi32(_mm_mul_ps(c, _mm_set1_ps(255.0f)));
+        __m128i i16 = _mm_packs_epi32(i32, i32);
+        return _mm_cvtsi128_si32(_mm_packus_epi16(i16, i16));
+    }
+
+    inline Color8 scale(const Color8& c, float s) { return _mm_mul_ps(c, _mm_set1_ps(s)); }
+
+    inline Color8 add(const Color8& a, const Color8& b) { return _mm_add_ps(a, b); }
+
+    inline float alpha(const Color8& c) { return _mm_cvtss_f32(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3,3,3,3))); }
+
+    inline Color8 withAlpha(const Color8& c, float a)
+    {
+        const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+        return _mm_or_ps(_mm_andnot_ps(mask, c), _mm_and_ps(mask, _mm_set1_ps(a)));
+    }
+
+    inline Color8 premultiply(const Color8& c)
+    {
+        return _mm_mul_ps(c, withAlpha(_mm_set1_ps(alpha(c)), 1.0f));
+    }
+
+    inline osg::Vec4f toVec4(const Color8& c)
+    {
+        float f[4];
+        _mm_storeu_ps(f, c);
+        return osg::Vec4f(f[0], f[1], f[2], f[3]);
+    }
+
+    inline Color8 toColor8(const osg::Vec4f& c) { return _mm_set_ps(c.a(), c.b(), c.g(), c.r()); }
+#else
+    typedef osg::Vec4f Color8;
+
+    inline Color8 unpack8(int v)
+    {
+        unsigned char b[4];
+        ::memcpy(b, &v, 4);
+        return Color8(b[0]/255.0f, b[1]/255.0f, b[2]/255.0f, b[3]/255.0f);
+    }
+
+    inline int pack8(const Color8& c)
+    {
+        unsigned char b[4];
+        for(unsigned i=0; i<4; ++i)
+            b[i] = (unsigned char)(c[i]*255.0f);
+        int v;
+        ::memcpy(&v, b, 4);
+        return v;
+    }
+
+    inline Color8 scale(const Color8& c, float s) { return c * s; }
+
+    inline Color8 add(const Color8& a, const Color8& b) { return a + b; }
+
+    inline float alpha(const Color8& c) { return c.a(); }
+
+    inline Color8 withAlpha(const Color8& c, float a) { return Color8(c.r(), c.g(), c.b(), a); }
+
+    inline Color8 premultiply(const Color8& c) { return Color8(c.r()*c.a(), c.g()*c.a(), c.b()*c.a(), c.a()); }
+
+    inline osg::Vec4f toVec4(const Color8& c) { return c; }
+
+    inline Color8 toColor8(const osg::Vec4f& c) { return c; }
+#endif
+
+    inline float scale(float c, float s) { return c * s; }
+
+    inline float add(float a, float b) { return a + b; }
+
+    // Pixel layouts the kernels are templated on.
+    struct RGBA8
+    {
+        typedef Color8 Value;
+        enum { SIZE = 4 };
+        static inline Value load(const unsigned char* p) { int v; ::memcpy(&v, p, 4); return unpack8(v); }
+        static inline void store(const Value& c, unsigned char* p) { int v = pack8(c); ::memcpy(p, &v, 4); }
+        static inline osg::Vec4f toVec4(const Value& c) { return ::toVec4(c); }
+        static inline Value fromVec4(const osg::Vec4f& c) { return toColor8(c); }
+    };
+
+    struct RGB8
+    {
+        typedef Color8 Value;
+        enum { SIZE = 3 };
+        static inline Value load(const unsigned char* p) { unsigned char b[4] = { p[0], p[1], p[2], 0xFF }; int v; ::memcpy(&v, b, 4); return unpack8(v); }
+        static inline void store(const Value& c, unsigned char* p) { int v = pack8(c); ::memcpy(p, &v, 3); }
+        static inline osg::Vec4f toVec4(const Value& c) { return ::toVec4(c); }
+        static inline Value fromVec4(const osg::Vec4f& c) { return toColor8(c); }
+    };
+
+    struct R32F
+    {
+        typedef float Value;
+        enum { SIZE = 4 };
+        static inline Value load(const unsigned char* p) { float v; ::memcpy(&v, p, 4); return v; }
+        static inline void store(const Value& c, unsigned char* p) { ::memcpy(p, &c, 4); }
+        static inline osg::Vec4f toVec4(const Value& c) { return osg::Vec4f(c, c, c, 1.0f); }
+        static inline Value fromVec4(const osg::Vec4f& c) { return c.r(); }
+    };
+
+    // src over dest at opacity "a", same math as the MixImage pixel visitor.
+    template<typename SRC, typename DEST>
+    void mixKernel(const osg::Image* src, osg::Image* dest, float a)
+    {
+        const bool srcHasAlpha  = ImageUtils::hasAlphaChannel(src);
+        const bool destHasAlpha = ImageUtils::hasAlphaChannel(dest);
+
+        ImageUtils::PixelReader read(src);
+        ImageUtils::PixelWriter write(dest);
+
+        for(int r=0; r<src->r(); ++r)
+        {
+            for(int t=0; t<src->t(); ++t)
+            {
+                const unsigned char* sp = read.data(0, t, r);
+                unsigned char* dp = write.data(0, t, r);
+
+                for(int s=0; s<src->s(); ++s, sp += SRC::SIZE, dp += DEST::SIZE)
+                {
+                    Color8 cs = SRC::load(sp);
+                    Color8 cd = DEST::load(dp);
+                    float sa = srcHasAlpha ? a * alpha(cs) : a;
+                    float da = destHasAlpha ? alpha(cd) : 1.0f;
+                    Color8 c = add(scale(cd, 1.0f-sa), scale(cs, sa));
+                    DEST::store(withAlpha(c, osg::maximum(sa, da)), dp);
+                }
+            }
+        }
+    }
+
+    // Single-channel float images have no alpha, so this is a plain lerp.
+    void mixKernelR32F(const osg::Image* src, osg::Image* dest, float a)
+    {
+        const float b = 1.0f - a;
+
+        ImageUtils::PixelReader read(src);
+        ImageUtils::PixelWriter write(dest);
+
+        for(int r=0; r<src->r(); ++r)
+        {
+            for(int t=0; t<src->t(); ++t)
+            {
+                const float* sp = (const float*)read.data(0, t, r);
+                float* dp = (float*)write.data(0, t, r);
+                int s = 0;
+
+#ifdef OE_IMAGEUTILS_SSE2
+                const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b);
+                for( ; s+4 <= src->s(); s += 4)
+                {
+                    __m128 vs = _mm_loadu_ps(sp + s);
+                    __m128 vd = _mm_loadu_ps(dp + s);
+                    _mm_storeu_ps(dp + s, _mm_add_ps(_mm_mul_ps(vd, vb), _mm_mul_ps(vs, va)));
+                }
+#endif
+                for( ; s < src->s(); ++s)
+                {
+                    dp[s] = dp[s]*b + sp[s]*a;
+                }
+            }
+        }
+    }
+
+    void premultiplyKernelRGBA8(osg::Image* image)
+    {
+        ImageUtils::PixelWriter write(image);
+
+        for(int r=0; r<image->r(); ++r)
+        {
+            for(int t=0; t<image->t(); ++t)
+            {
+                unsigned char* p = write.data(0, t, r);
+                for(int s=0; s<image->s(); ++s, p += 4)
+                {
+                    RGBA8::store(premultiply(RGBA8::load(p)), p);
+                }
+            }
+        }
+    }
+
+    // Source coordinate of an output row or column in resizeImage.
+    inline float resizeCoord(unsigned out, unsigned outSize, unsigned inSize)
+    {
+        float ratio = (float)out/(float)outSize;
+        float in = ratio * (float)inSize;
+        if ( in >= (int)inSize ) in = inSize-1;
+        else if ( in < 0 ) in = 0.0f;
+        return in;
+    }
+
+    // Nearest source index for a coordinate from resizeCoord.
+    inline int resizeNearest(float in, unsigned inSize)
+    {
+        return (in-(int)in) <= (ceil(in)-in) ?
+            (int)in :
+            osg::minimum( 1+(int)in, (int)inSize-1 );
+    }
+
+    // Bilinear footprint along one axis in resizeImage. The weights are the
+    // distances to the far sample; an axis with one sample has min == max.
+    struct ResizeSpan
+    {
+        int   min, max;
+        float w1, w2;
+
+        void set(float in, unsigned inSize)
+        {
+            min = osg::maximum((int)floor(in), 0);
+            max = osg::maximum(osg::minimum((int)ceil(in), (int)inSize-1), 0);
+            if (min > max) min = max;
+            w1 = (float)((double)max - in);
+            w2 = (float)(in - (double)min);
+        }
+    };
+
+    template<typename F>
+    void resizeKernel(const osg::Image* input, unsigned out_s, unsigned out_t, osg::Image* output, unsigned mipmapLevel, bool bilinear)
+    {
+        const unsigned in_s = input->s(), in_t = input->t();
+
+        ImageUtils::PixelReader read(input);
+        ImageUtils::PixelWriter write(output);
+
+        // the column footprints are the same for every row.
+        std::vector<ResizeSpan> cols(out_s);
+        std::vector<int> nearestCols(out_s);
+        for(unsigned c=0; c<out_s; ++c)
+        {
+            float in = resizeCoord(c, out_s, in_s);
+            cols[c].set(in, in_s);
+            nearestCols[c] = resizeNearest(in, in_s);
+        }
+
+        for(int layer=0; layer<input->r(); ++layer)
+        {
+            for(unsigned output_row=0; output_row < out_t; ++output_row)
+            {
+                float input_row = resizeCoord(output_row, out_t, in_t);
+                unsigned char* out = write.data(0, output_row, layer, mipmapLevel);
+
+                if ( !bilinear )
+                {
+                    const unsigned char* in = read.data(0, resizeNearest(input_row, in_t), layer);
+                    for(unsigned c=0; c<out_s; ++c, out += F::SIZE)
+                    {
+                        ::memcpy(out, in + nearestCols[c]*F::SIZE, F::SIZE);
+                    }
+                    continue;
+                }
+
+                ResizeSpan row;
+                row.set(input_row, in_t);
+                const unsigned char* lower = read.data(0, row.min, layer);
+                const unsigned char* upper = read.data(0, row.max, layer);
+
+                for(unsigned c=0; c<out_s; ++c, out += F::SIZE)
+                {
+                    const ResizeSpan& col = cols[c];
+                    typename F::Value color;
+
+                    if ( col.min == col.max && row.min == row.max )
+                    {
+                        color = F::load(upper + col.max*F::SIZE);
+                    }
+                    else if ( col.min == col.max )
+                    {
+                        color = add(
+                            scale(F::load(lower + col.min*F::SIZE), row.w1),
+                            scale(F::load(upper + col.min*F::SIZE), row.w2));
+                    }
+                    else if ( row.min == row.max )
+                    {
+                        color = add(
+                            scale(F::load(lower + col.min*F::SIZE), col.w1),
+                            scale(F::load(lower + col.max*F::SIZE), col.w2));
+                    }
+                    else
+                    {
+                        typename F::Value r1 = add(
+                            scale(F::load(lower + col.min*F::SIZE), col.w1),
+                            scale(F::load(lower + col.max*F::SIZE), col.w2));
+                        typename F::Value r2 = add(
+                            scale(F::load(upper + col.min*F::SIZE), col.w1),
+                            scale(F::load(upper + col.max*F::SIZE), col.w2));
+                        color = add(scale(r1, row.w1), scale(r2, row.w2));
+                    }
+
+                    F::store(color, out);
+                }
+            }
+        }
+    }
+
+    // Direct pixel access with the PixelReader/PixelWriter call syntax,
+    // for algorithms that are templated on their accessors.
+    template<typename F>
+    struct KernelPixels
+    {
+        unsigned char* _data;
+        unsigned _rowMult;
+
+        KernelPixels(const osg::Image* image) :
+            _data(const_cast<unsigned char*>(image->data())),
+            _rowMult(image->getRowSizeInBytes()) { }
+
+        osg::Vec4f operator()(int s, int t) const
+        {
+            return F::toVec4(F::load(_data + t*_rowMult + s*F::SIZE));
+        }
+
+        void operator()(const osg::Vec4f& c, int s, int t) const
+        {
+            F::store(F::fromVec4(c), _data + t*_rowMult + s*F::SIZE);
+        }
+    };
+
+    // Copies 8-bit channels between layouts. "map" holds the source channel
+    // for each destination channel, or -1 for an opaque (255) channel.
+    void swizzleKernel8(const osg::Image* src, osg::Image* dest, const int* map)
+    {
+        const unsigned srcSize = src->getPixelSizeInBits()/8;
+        const unsigned destSize = dest->getPixelSizeInBits()/8;
+
+        ImageUtils::PixelReader read(src);
+        ImageUtils::PixelWriter write(dest);
+
+        for(int r=0; r<src->r(); ++r)
+        {
+            for(int t=0; t<src->t(); ++t)
+            {
+                const unsigned char* sp = read.data(0, t, r);
+                unsigned char* dp = write.data(0, t, r);
+                for(int s=0; s<src->s(); ++s, sp += srcSize, dp += destSize)
+                {
+                    for(unsigned i=0; i<destSize; ++i)
+                        dp[i] = map[i] >= 0 ? sp[map[i]] : 0xFF;
+                }
+            }
+        }
+    }
+}
+
+void
+ImageUtils::setKernelsEnabled(bool value)
+{
+    s_kernelsEnabled.exchange( value ? 1u : 0u );
+}
+
+bool
+ImageUtils::getKernelsEnabled()
+{
+    return s_kernelsEnabled != 0u;
+}
+
+//------------------------------------------------------------------------
 
 osg::Image*
 ImageUtils::cloneImage( const osg::Image* input )
@@ -242,10 +658,26 @@ ImageUtils::resizeImage(const osg::Image* input,
         output->setInternalTextureFormat( input->getInternalTextureFormat() );
     }
 
+    KernelFormat kernel = getKernelFormat(input);
+    if ( kernel != getKernelFormat(output.get()) || input->getPixelFormat() != output->getPixelFormat() )
+        kernel = KERNEL_NONE;
+
     if ( in_s == out_s && in_t == out_t && mipmapLevel == 0 && input->getInternalTextureFormat() == output->getInternalTextureFormat() )
     {
         memcpy( output->data(), input->data(), input->getTotalSizeInBytes() );
     }
+    else if ( kernel == KERNEL_RGBA8 )
+    {
+        resizeKernel<RGBA8>( input, out_s, out_t, output.get(), mipmapLevel, bilinear );
+    }
+    else if ( kernel == KERNEL_RGB8 )
+    {
+        resizeKernel<RGB8>( input, out_s, out_t, output.get(), mipmapLevel, bilinear );
+    }
+    else if ( kernel == KERNEL_R32F )
+    {
+        resizeKernel<R32F>( input, out_s, out_t, output.get(), mipmapLevel, bilinear );
+    }
     else
     {
         PixelReader read( input );
@@ -254,17 +686,11 @@ ImageUtils::resizeImage(const osg::Image* input,
         for( unsigned int output_row=0; output_row < out_t; output_row++ )
         {
             // get an appropriate input row
-            float output_row_ratio = (float)output_row/(float)out_t;
-            float input_row = output_row_ratio * (float)in_t;
-            if ( input_row >= input->t() ) input_row = in_t-1;
-            else if ( input_row < 0 ) input_row = 0;
+            float input_row = resizeCoord( output_row, out_t, in_t );
 
             for( unsigned int output_col = 0; output_col < out_s; output_col++ )
             {
-                float output_col_ratio = (float)output_col/(float)out_s;
-                float input_col =  output_col_ratio * (float)in_s;
-                if ( input_col >= (int)in_s ) input_col = in_s-1;
-                else if ( input_col < 0 ) input_col = 0.0f;                
+                float input_col = resizeCoord( output_col, out_s, in_s );
 
                 osg::Vec4 color;
 
@@ -312,13 +738,8 @@ ImageUtils::resizeImage(const osg::Image* input,
                     else
                     {
                         // nearest neighbor:
-                        int col = (input_col-(int)input_col) <= (ceil(input_col)-input_col) ?
-                            (int)input_col :
-                            osg::minimum( 1+(int)input_col, (int)in_s-1 );
-
-                        int row = (input_row-(int)input_row) <= (ceil(input_row)-input_row) ?
-                            (int)input_row :
-                            osg::minimum( 1+(int)input_row, (int)in_t-1 );
+                        int col = resizeNearest( input_col, in_s );
+                        int row = resizeNearest( input_row, in_t );
 
                         color = read(col, row, layer); // read pixel from mip level 0.
 
@@ -367,124 +788,160 @@ ImageUtils::flattenImage(osg::Image*                             input,
     return true;
 }
 
-bool
-ImageUtils::bicubicUpsample(const osg::Image* source,
-                            osg::Image* target,
-                            unsigned quadrant,
-                            unsigned stride)
+namespace
 {
-    const int border = 1; // don't change this.
-
-    int width = ((source->s() - 2*border)/2)+1 + 2*border;
-    int height = ((source->t() - 2*border)/2)+1 + 2*border;
+    template<typename SOURCE_READER, typename TARGET_READER, typename TARGET_WRITER>
+    void bicubicUpsampleImpl(const osg::Image* source,
+                             osg::Image* target,
+                             unsigned quadrant,
+                             unsigned stride,
+                             SOURCE_READER& readSource,
+                             TARGET_READER& readTarget,
+                             TARGET_WRITER& writeTarget)
+    {
+        const int border = 1; // don't change this.
 
-    int s_off = quadrant == 0 || quadrant == 2 ? 0 : source->s()-width;
-    int t_off = quadrant == 2 || quadrant == 3 ? 0 : source->t()-height;
+        int width = ((source->s() - 2*border)/2)+1 + 2*border;
+        int height = ((source->t() - 2*border)/2)+1 + 2*border;
 
-    ImageUtils::PixelReader readSource(source);
-    ImageUtils::PixelWriter writeTarget(target);
-    ImageUtils::PixelReader readTarget(target);
+        int s_off = quadrant == 0 || quadrant == 2 ? 0 : source->s()-width;
+        int t_off = quadrant == 2 || quadrant == 3 ? 0 : source->t()-height;
 
-    // copy the main box, which is all odd-numbered cells when there is a border size = 1.
-    for (int t = 1; t<height-1; ++t)
-    {
-        for (int s = 1; s<width-1; ++s)
+        // copy the main box, which is all odd-numbered cells when there is a border size = 1.
+        for (int t = 1; t<height-1; ++t)
         {
-            osg::Vec4 value = readSource(s_off+s, t_off+t);
-            writeTarget(value, (s-1)*2+1, (t-1)*2+1);
+            for (int s = 1; s<width-1; ++s)
+            {
+                osg::Vec4 value = readSource(s_off+s, t_off+t);
+                writeTarget(value, (s-1)*2+1, (t-1)*2+1);
+            }
         }
-    }
 
-    // copy the corner border cells.
-    writeTarget(readSource(s_off, t_off), 0, 0); // upper left.
-    writeTarget(readSource(s_off + width - 1, t_off), target->s()-1, 0);
-    writeTarget(readSource(s_off, t_off + height - 1), 0, target->t()-1);
-    writeTarget(readSource(s_off + width - 1, t_off + height - 1), target->s() - 1, target->t() - 1);
-
-    // copy the border intermediate cells.
-    for (int s=1; s<width-1; ++s) // top/bottom:
-    {
-        writeTarget(readSource(s_off+s, t_off), (s-1)*2+1, 0);
-        writeTarget(readSource(s_off+s, t_off + height - 1), (s-1)*2+1, target->t()-1);
-    }
-    for (int t = 1; t < height-1; ++t) // left/right:
-    {
-        writeTarget(readSource(s_off, t_off+t), 0, (t-1)*2+1);
-        writeTarget(readSource(s_off + width - 1, t_off + t), target->s()-1, (t-1)*2+1);
-    }
+        // copy the corner border cells.
+        writeTarget(readSource(s_off, t_off), 0, 0); // upper left.
+        writeTarget(readSource(s_off + width - 1, t_off), target->s()-1, 0);
+        writeTarget(readSource(s_off, t_off + height - 1), 0, target->t()-1);
+        writeTarget(readSource(s_off + width - 1, t_off + height - 1), target->s() - 1, target->t() - 1);
 
-    // now interpolate the missing columns, including the border cells.
-    for (int s = 2; s<target->s()-2; s += 2)
-    {
-        for (int t = 0; t < target->t(); )
+        // copy the border intermediate cells.
+        for (int s=1; s<width-1; ++s) // top/bottom:
+        {
+            writeTarget(readSource(s_off+s, t_off), (s-1)*2+1, 0);
+            writeTarget(readSource(s_off+s, t_off + height - 1), (s-1)*2+1, target->t()-1);
+        }
+        for (int t = 1; t < height-1; ++t) // left/right:
         {
-            int offset = (s-1) % stride; // the minus1 accounts for the border
-            int s0 = osg::maximum(s - offset, 0);
-            int s1 = osg::minimum(s0 + (int)stride, target->s()-1);
-            double mu = (double)offset / (double)(s1-s0);
-            osg::Vec4 p1 = readTarget(s0, t);
-            osg::Vec4 p2 = readTarget(s1, t);
-            double mu2 = (1.0 - cos(mu*osg::PI))*0.5;
-            osg::Vec4 v = (p1*(1.0-mu2)) + (p2*mu2);
-            writeTarget(v, s, t);
+            writeTarget(readSource(s_off, t_off+t), 0, (t-1)*2+1);
+            writeTarget(readSource(s_off + width - 1, t_off + t), target->s()-1, (t-1)*2+1);
+        }
 
-            if (t == 0 || t == target->t()-2) t+=1; else t+=2;
+        // now interpolate the missing columns, including the border cells.
+        for (int s = 2; s<target->s()-2; s += 2)
+        {
+            for (int t = 0; t < target->t(); )
+            {
+                int offset = (s-1) % stride; // the minus1 accounts for the border
+                int s0 = osg::maximum(s - offset, 0);
+                int s1 = osg::minimum(s0 + (int)stride, target->s()-1);
+                double mu = (double)offset / (double)(s1-s0);
+                osg::Vec4 p1 = readTarget(s0, t);
+                osg::Vec4 p2 = readTarget(s1, t);
+                double mu2 = (1.0 - cos(mu*osg::PI))*0.5;
+                osg::Vec4 v = (p1*(1.0-mu2)) + (p2*mu2);
+                writeTarget(v, s, t);
+
+                if (t == 0 || t == target->t()-2) t+=1; else t+=2;
+            }
         }
-    }
 
-    // next interpolate the odd numbered rows
-    for (int s = 0; s < target->s();)
-    {
-        for (int t = 2; t<target->t()-2; t += 2)
+        // next interpolate the odd numbered rows
+        for (int s = 0; s < target->s();)
         {
-            int offset = (t-1) % stride; // the minus1 accounts for the border
-            int t0 = osg::maximum(t - offset, 0);
-            int t1 = osg::minimum(t0 + (int)stride, target->t()-1);
-            double mu = (double)offset / double(t1-t0);
+            for (int t = 2; t<target->t()-2; t += 2)
+            {
+                int offset = (t-1) % stride; // the minus1 accounts for the border
+                int t0 = osg::maximum(t - offset, 0);
+                int t1 = osg::minimum(t0 + (int)stride, target->t()-1);
+                double mu = (double)offset / double(t1-t0);
+
+                osg::Vec4 p1 = readTarget(s, t0);
+                osg::Vec4 p2 = readTarget(s, t1);
+                double mu2 = (1.0 - cos(mu*osg::PI))*0.5;
+                osg::Vec4 v = (p1*(1.0-mu2)) + (p2*mu2);
+                writeTarget(v, s, t);
+            }
 
-            osg::Vec4 p1 = readTarget(s, t0);
-            osg::Vec4 p2 = readTarget(s, t1);
-            double mu2 = (1.0 - cos(mu*osg::PI))*0.5;
-            osg::Vec4 v = (p1*(1.0-mu2)) + (p2*mu2);
-            writeTarget(v, s, t);
+            if (s == 0 || s == target->s()-2) s+=1; else s+=2;
         }
 
-        if (s == 0 || s == target->s()-2) s+=1; else s+=2;
-    }
-
-    // then interpolate the centers
-    for (int s = 2; s<target->s()-2; s += 2)
-    {
-        for (int t = 2; t<target->t()-2; t += 2)
+        // then interpolate the centers
+        for (int s = 2; s<target->s()-2; s += 2)
         {
-            int s_offset = (s-1) % stride;
-            int s0 = osg::maximum(s - s_offset, 0);
-            int s1 = osg::minimum(s0 + (int)stride, target->s()-1);
+            for (int t = 2; t<target->t()-2; t += 2)
+            {
+                int s_offset = (s-1) % stride;
+                int s0 = osg::maximum(s - s_offset, 0);
+                int s1 = osg::minimum(s0 + (int)stride, target->s()-1);
 
-            int t_offset = (t-1) % stride;
-            int t0 = osg::maximum(t - t_offset, 0);
-            int t1 = osg::minimum(t0 + (int)stride, target->t()-1);
+                int t_offset = (t-1) % stride;
+                int t0 = osg::maximum(t - t_offset, 0);
+                int t1 = osg::minimum(t0 + (int)stride, target->t()-1);
 
-            double mu, mu2;
+                double mu, mu2;
 
-            osg::Vec4 p1 = readTarget(s0, t);
-            osg::Vec4 p2 = readTarget(s1, t);
-            mu = (double)s_offset / (double)(s1-s0);
-            mu2 = (1.0 - cos(mu*osg::PI))*0.5;
-            osg::Vec4 v1 = (p1*(1.0-mu2)) + (p2*mu2);
-            
-            osg::Vec4 p3 = readTarget(s, t0);
-            osg::Vec4 p4 = readTarget(s, t1);
-            mu = (double)t_offset / (double)(t1-t0);
-            mu2 = (1.0 - cos(mu*osg::PI))*0.5;
-            osg::Vec4 v2 = (p3*(1.0-mu2)) + (p4*mu2);
+                osg::Vec4 p1 = readTarget(s0, t);
+                osg::Vec4 p2 = readTarget(s1, t);
+                mu = (double)s_offset / (double)(s1-s0);
+                mu2 = (1.0 - cos(mu*osg::PI))*0.5;
+                osg::Vec4 v1 = (p1*(1.0-mu2)) + (p2*mu2);
 
-            osg::Vec4 v = (v1+v2)*0.5;
+                osg::Vec4 p3 = readTarget(s, t0);
+                osg::Vec4 p4 = readTarget(s, t1);
+                mu = (double)t_offset / (double)(t1-t0);
+                mu2 = (1.0 - cos(mu*osg::PI))*0.5;
+                osg::Vec4 v2 = (p3*(1.0-mu2)) + (p4*mu2);
 
-            writeTarget(v, s, t);
+                osg::Vec4 v = (v1+v2)*0.5;
+
+                writeTarget(v, s, t);
+            }
         }
     }
-    
+}
+
+bool
+ImageUtils::bicubicUpsample(const osg::Image* source,
+                            osg::Image* target,
+                            unsigned quadrant,
+                            unsigned stride)
+{
+    KernelFormat kernel = getKernelFormat(source);
+    if ( kernel != getKernelFormat(target) || source->getPixelFormat() != target->getPixelFormat() )
+        kernel = KERNEL_NONE;
+
+    if ( kernel == KERNEL_RGBA8 )
+    {
+        KernelPixels<RGBA8> readSource(source), target_rw(target);
+        bicubicUpsampleImpl(source, target, quadrant, stride, readSource, target_rw, target_rw);
+    }
+    else if ( kernel == KERNEL_RGB8 )
+    {
+        KernelPixels<RGB8> readSource(source), target_rw(target);
+        bicubicUpsampleImpl(source, target, quadrant, stride, readSource, target_rw, target_rw);
+    }
+    else if ( kernel == KERNEL_R32F )
+    {
+        KernelPixels<R32F> readSource(source), target_rw(target);
+        bicubicUpsampleImpl(source, target, quadrant, stride, readSource, target_rw, target_rw);
+    }
+    else
+    {
+        ImageUtils::PixelReader readSource(source);
+        ImageUtils::PixelWriter writeTarget(target);
+        ImageUtils::PixelReader readTarget(target);
+        bicubicUpsampleImpl(source, target, quadrant, stride, readSource, readTarget, writeTarget);
+    }
+
     return true;
 }
 
@@ -703,8 +1160,39 @@ ImageUtils::mix(osg::Image* dest, const osg::Image* src, float a)
         return false;
     }
     
+    a = osg::clampBetween( a, 0.0f, 1.0f );
+
+    KernelFormat srcKernel = getKernelFormat(src);
+    KernelFormat destKernel = getKernelFormat(dest);
+
+    if ( srcKernel == KERNEL_R32F && destKernel == KERNEL_R32F )
+    {
+        mixKernelR32F( src, dest, a );
+        return true;
+    }
+    else if ( srcKernel == KERNEL_RGBA8 && destKernel == KERNEL_RGBA8 )
+    {
+        mixKernel<RGBA8, RGBA8>( src, dest, a );
+        return true;
+    }
+    else if ( srcKernel == KERNEL_RGB8 && destKernel == KERNEL_RGBA8 )
+    {
+        mixKernel<RGB8, RGBA8>( src, dest, a );
+        return true;
+    }
+    else if ( srcKernel == KERNEL_RGBA8 && destKernel == KERNEL_RGB8 )
+    {
+        mixKernel<RGBA8, RGB8>( src, dest, a );
+        return true;
+    }
+    else if ( srcKernel == KERNEL_RGB8 && destKernel == KERNEL_RGB8 )
+    {
+        mixKernel<RGB8, RGB8>( src, dest, a );
+        return true;
+    }
+
     PixelVisitor<MixImage> mixer;
-    mixer._a = osg::clampBetween( a, 0.0f, 1.0f );
+    mixer._a = a;
     mixer._srcHasAlpha = hasAlphaChannel(src); //src->getPixelSizeInBits() == 32;
     mixer._destHasAlpha = hasAlphaChannel(dest); //dest->getPixelSizeInBits() == 32;
 
@@ -992,6 +1480,95 @@ ImageUtils::upSampleNN(const osg::Image* src, int quadrant)
     return dst;
 }
 
+namespace
+{
+    // Averages 2x2 blocks of 8-bit channels, rounding to nearest.
+    void downsampleBytes(const osg::Image* src, osg::Image* dst, int soff, int toff, unsigned bytesPerPixel)
+    {
+        int halfS = src->s()/2, halfT = src->t()/2;
+
+        for(int t=0; t<halfT; ++t)
+        {
+            const unsigned char* r0 = src->data(0, 2*t);
+            const unsigned char* r1 = src->data(0, 2*t+1);
+            unsigned char* out = dst->data(soff, toff+t);
+            int s = 0;
+
+#ifdef OE_IMAGEUTILS_SSE2
+            if ( bytesPerPixel == 4u )
+            {
+                // four source pixels per row make two target pixels.
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i two = _mm_set1_epi16(2);
+                for( ; s+2 <= halfS; s += 2)
+                {
+                    __m128i a = _mm_loadu_si128((const __m128i*)(r0 + 8*s));
+                    __m128i b = _mm_loadu_si128((const __m128i*)(r1 + 8*s));
+                    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                    __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+                    _mm_storel_epi64((__m128i*)(out + 4*s), _mm_packus_epi16(sum, sum));
+                }
+            }
+#endif
+
+            for( ; s<halfS; ++s)
+            {
+                const unsigned char* a = r0 + 2*s*bytesPerPixel;
+                const unsigned char* b = r1 + 2*s*bytesPerPixel;
+                unsigned char* c = out + s*bytesPerPixel;
+                for(unsigned i=0; i<bytesPerPixel; ++i)
+                {
+                    c[i] = (unsigned char)((a[i] + a[i+bytesPerPixel] + b[i] + b[i+bytesPerPixel] + 2u) >> 2);
+                }
+            }
+        }
+    }
+}
+
+bool
+ImageUtils::downsampleIntoQuadrant(osg::Image* target, const osg::Image* source, unsigned quadrant)
+{
+    if ( !target || !source || !target->data() || !source->data() ||
+         quadrant > 3u ||
+         !sameFormat(target, source) ||
+         target->s() != source->s() || target->t() != source->t() ||
+         source->r() != 1 || (source->s() & 1) || (source->t() & 1) ||
+         isCompressed(source) )
+    {
+        return false;
+    }
+
+    int halfS = source->s()/2, halfT = source->t()/2;
+    int soff = quadrant == 0 || quadrant == 2 ? 0 : halfS;
+    int toff = quadrant == 2 || quadrant == 3 ? 0 : halfT;
+
+    if ( source->getDataType() == GL_UNSIGNED_BYTE )
+    {
+        downsampleBytes(source, target, soff, toff, source->getPixelSizeInBits()/8u);
+    }
+    else
+    {
+        PixelReader read(source);
+        PixelWriter write(target);
+        for(int t=0; t<halfT; ++t)
+        {
+            for(int s=0; s<halfS; ++s)
+            {
+                osg::Vec4 c =
+                    read(2*s, 2*t) + read(2*s+1, 2*t) +
+                    read(2*s, 2*t+1) + read(2*s+1, 2*t+1);
+                write(c * 0.25f, soff+s, toff+t);
+            }
+        }
+    }
+
+    target->dirty();
+    return true;
+}
+
 bool
 ImageUtils::isSingleColorImage(const osg::Image* image, float threshold)
 {
@@ -1209,6 +1786,35 @@ ImageUtils::convert(const osg::Image* image, GLenum pixelFormat, GLenum dataType
     else
         result->setInternalTextureFormat( pixelFormat );
 
+    // 8-bit to RGB8/RGBA8 is a straight channel copy, since 8-bit values
+    // round trip exactly through the generic path.
+    KernelFormat kernel = getKernelFormat(result);
+    if ( (kernel == KERNEL_RGB8 || kernel == KERNEL_RGBA8) &&
+         image->getDataType() == GL_UNSIGNED_BYTE &&
+         isNormalized(image) )
+    {
+        // source channel for each of R, G, B, A (-1 = opaque)
+        static const int fromRGBA[4]      = {  0,  1,  2,  3 };
+        static const int fromRGB[4]       = {  0,  1,  2, -1 };
+        static const int fromBGRA[4]      = {  2,  1,  0,  3 };
+        static const int fromLuminance[4] = {  0,  0,  0, -1 };
+        static const int fromLumAlpha[4]  = {  0,  0,  0,  1 };
+
+        const int* map =
+            image->getPixelFormat() == GL_RGBA ? fromRGBA :
+            image->getPixelFormat() == GL_RGB  ? fromRGB :
+            image->getPixelFormat() == GL_BGRA ? fromBGRA :
+            image->getPixelFormat() == GL_LUMINANCE || image->getPixelFormat() == GL_RED ? fromLuminance :
+            image->getPixelFormat() == GL_LUMINANCE_ALPHA ? fromLumAlpha :
+            0L;
+
+        if ( map )
+        {
+            swizzleKernel8( image, result, map );
+            return result;
+        }
+    }
+
     PixelVisitor<CopyImage>().accept( image, result );
 
     return result;
@@ -1401,6 +2007,18 @@ ImageUtils::convertToPremultipliedAlpha(osg::Image* image)
     if ( !PixelReader::supports(image) || !PixelWriter::supports(image) )
         return false;
 
+    KernelFormat kernel = getKernelFormat(image);
+
+    // no alpha channel, so premultiplying changes nothing
+    if ( kernel == KERNEL_RGB8 || kernel == KERNEL_R32F )
+        return true;
+
+    if ( kernel == KERNEL_RGBA8 )
+    {
+        premultiplyKernelRGBA8(image);
+        return true;
+    }
+
     PixelReader read(image);
     PixelWriter write(image);
     for(int r=0; r<image->r(); ++r) {
@@ -17,6 +17,11 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/MemCache>
+#include <osgEarth/StringUtils>
+#include <osg/Image>
+#include <osg/Shape>
+#include <OpenThreads/Atomic>
+#include <cstdlib>
 
 using namespace osgEarth;
 
@@ -114,6 +119,307 @@ namespace
 
         MemCacheLRU _lru;
     };
+
+    /**
+     * Estimated memory held by a cached record.
+     */
+    unsigned estimateSize(const Config& conf)
+    {
+        unsigned bytes = sizeof(Config) + conf.key().size() + conf.value().size() + conf.referrer().size();
+        for (ConfigSet::const_iterator i = conf.children().begin(); i != conf.children().end(); ++i)
+            bytes += estimateSize(*i);
+        return bytes;
+    }
+
+    unsigned estimateSize(const std::string& key, const osg::Object* object, const Config& meta)
+    {
+        unsigned bytes = sizeof(osg::Object) + estimateSize(meta) + key.size();
+
+        const osg::Image* image = dynamic_cast<const osg::Image*>(object);
+        if ( image )
+        {
+            return bytes + sizeof(osg::Image) + image->getTotalSizeInBytesIncludingMipmaps();
+        }
+
+        const osg::HeightField* hf = dynamic_cast<const osg::HeightField*>(object);
+        if ( hf )
+        {
+            return bytes + sizeof(osg::HeightField) + hf->getNumColumns()*hf->getNumRows()*sizeof(float);
+        }
+
+        const StringObject* so = dynamic_cast<const StringObject*>(object);
+        if ( so )
+        {
+            return bytes + sizeof(StringObject) + so->getString().size();
+        }
+
+        return bytes;
+    }
+
+    /**
+     * Cache bin split into lock-striped shards, each capped by memory and
+     * evicting with the CLOCK (second chance) policy: a read only sets the
+     * record's reference bit, and the clock hand skips (and clears) recently
+     * referenced records when it has to make room.
+     */
+    struct ShardedMemCacheBin : public CacheBin
+    {
+        struct Record
+        {
+            Record() : _bytes(0u), _referenced(false), _used(false) { }
+            std::string                     _key;
+            osg::ref_ptr<const osg::Object> _object;
+            Config                          _meta;
+            unsigned                        _bytes;
+            bool                            _referenced;
+            bool                            _used;
+        };
+
+        struct Shard
+        {
+            Shard() : _bytes(0u), _hand(0u) { }
+            Threading::Mutex                _mutex;
+            std::map<std::string, unsigned> _index;    // key => position in _ring
+            std::vector<Record>             _ring;     // the clock
+            std::vector<unsigned>           _free;     // unused positions in _ring
+            unsigned                        _bytes;
+            unsigned                        _hand;
+        };
+
+        ShardedMemCacheBin( const std::string& id, unsigned maxBytes, unsigned numShards )
+            : CacheBin( id ),
+              _maxBytes( maxBytes )
+        {
+            _shards.resize( osg::maximum(numShards, 1u) );
+            for(unsigned i=0; i<_shards.size(); ++i)
+                _shards[i] = new Shard();
+            _maxShardBytes = osg::maximum(_maxBytes / (unsigned)_shards.size(), 1u);
+        }
+
+        virtual ~ShardedMemCacheBin()
+        {
+            for(unsigned i=0; i<_shards.size(); ++i)
+                delete _shards[i];
+        }
+
+        Shard& getShard(const std::string& key)
+        {
+            // FNV-1a
+            unsigned h = 2166136261u;
+            for(std::string::const_iterator c = key.begin(); c != key.end(); ++c)
+            {
+                h ^= (unsigned char)*c;
+                h *= 16777619u;
+            }
+            return *_shards[h % _shards.size()];
+        }
+
+        ReadResult readObject(const std::string& key, const osgDB::Options*)
+        {
+            osg::ref_ptr<const osg::Object> object;
+            Config meta;
+            {
+                Shard& shard = getShard(key);
+                Threading::ScopedMutexLock lock(shard._mutex);
+                std::map<std::string, unsigned>::const_iterator i = shard._index.find(key);
+                if ( i != shard._index.end() )
+                {
+                    Record& rec = shard._ring[i->second];
+                    rec._referenced = true;
+                    object = rec._object.get();
+                    meta = rec._meta;
+                }
+            }
+
+            if ( object.valid() )
+            {
+                ++_hits;
+
+                // clone required since the cache is in memory
+                return ReadResult( osg::clone(object.get(), osg::CopyOp::DEEP_COPY_ALL), meta );
+            }
+            else
+            {
+                ++_misses;
+                return ReadResult();
+            }
+        }
+
+        ReadResult readImage(const std::string& key, const osgDB::Options* readOptions)
+        {
+            return readObject(key, readOptions);
+        }
+
+        ReadResult readString(const std::string& key, const osgDB::Options* readOptions)
+        {
+            return readObject(key, readOptions);
+        }
+
+        bool write( const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
+        {
+            if ( !object )
+                return false;
+
+            unsigned bytes = estimateSize(key, object, meta);
+
+            // a record that could never fit is not cached, so don't bother cloning it.
+            osg::ref_ptr<const osg::Object> cloned;
+            if ( bytes <= _maxShardBytes )
+                cloned = osg::clone(object, osg::CopyOp::DEEP_COPY_ALL);
+
+            Shard& shard = getShard(key);
+            Threading::ScopedMutexLock lock(shard._mutex);
+
+            // the old record goes either way, so a rejected write never
+            // leaves a stale value behind.
+            std::map<std::string, unsigned>::iterator i = shard._index.find(key);
+            if ( i != shard._index.end() )
+            {
+                erase(shard, i->second);
+                shard._index.erase(i);
+            }
+
+            if ( !cloned.valid() )
+                return false;
+
+            while( shard._bytes + bytes > _maxShardBytes && !shard._index.empty() )
+            {
+                evictOne(shard);
+            }
+
+            unsigned pos;
+            if ( !shard._free.empty() )
+            {
+                pos = shard._free.back();
+                shard._free.pop_back();
+            }
+            else
+            {
+                pos = shard._ring.size();
+                shard._ring.push_back( Record() );
+            }
+
+            Record& rec = shard._ring[pos];
+            rec._key        = key;
+            rec._object     = cloned.get();
+            rec._meta       = meta;
+            rec._bytes      = bytes;
+            rec._referenced = false;
+            rec._used       = true;
+            shard._index[key] = pos;
+            shard._bytes += bytes;
+            return true;
+        }
+
+        // Caller holds the shard mutex and removes the index entry.
+        void erase(Shard& shard, unsigned pos)
+        {
+            Record& rec = shard._ring[pos];
+            shard._bytes -= rec._bytes;
+            rec = Record();
+            shard._free.push_back(pos);
+        }
+
+        // Caller holds the shard mutex; the shard must not be empty.
+        void evictOne(Shard& shard)
+        {
+            for(;;)
+            {
+                if ( shard._hand >= shard._ring.size() )
+                    shard._hand = 0u;
+
+                Record& rec = shard._ring[shard._hand++];
+                if ( !rec._used )
+                    continue;
+
+                if ( rec._referenced )
+                {
+                    rec._referenced = false; // second chance
+                    continue;
+                }
+
+                shard._index.erase(rec._key);
+                erase(shard, shard._hand-1);
+                ++_evictions;
+                return;
+            }
+        }
+
+        bool remove(const std::string& key)
+        {
+            Shard& shard = getShard(key);
+            Threading::ScopedMutexLock lock(shard._mutex);
+            std::map<std::string, unsigned>::iterator i = shard._index.find(key);
+            if ( i != shard._index.end() )
+            {
+                erase(shard, i->second);
+                shard._index.erase(i);
+            }
+            return true;
+        }
+
+        bool touch(const std::string& key)
+        {
+            Shard& shard = getShard(key);
+            Threading::ScopedMutexLock lock(shard._mutex);
+            std::map<std::string, unsigned>::const_iterator i = shard._index.find(key);
+            if ( i == shard._index.end() )
+                return false;
+            shard._ring[i->second]._referenced = true;
+            return true;
+        }
+
+        RecordStatus getRecordStatus( const std::string& key )
+        {
+            // ignore minTime; MemCache does not support expiration
+            Shard& shard = getShard(key);
+            Threading::ScopedMutexLock lock(shard._mutex);
+            return shard._index.find(key) != shard._index.end() ? STATUS_OK : STATUS_NOT_FOUND;
+        }
+
+        bool purge()
+        {
+            for(unsigned i=0; i<_shards.size(); ++i)
+            {
+                Shard& shard = *_shards[i];
+                Threading::ScopedMutexLock lock(shard._mutex);
+                shard._index.clear();
+                shard._ring.clear();
+                shard._free.clear();
+                shard._bytes = 0u;
+                shard._hand = 0u;
+            }
+            return true;
+        }
+
+        std::string getHashedKey(const std::string& key) const
+        {
+            return key;
+        }
+
+        void getStats(MemCacheBinStats& out)
+        {
+            out = MemCacheBinStats();
+            for(unsigned i=0; i<_shards.size(); ++i)
+            {
+                Shard& shard = *_shards[i];
+                Threading::ScopedMutexLock lock(shard._mutex);
+                out._entries += shard._index.size();
+                out._bytes += shard._bytes;
+            }
+            out._maxBytes  = _maxBytes;
+            out._hits      = _hits;
+            out._misses    = _misses;
+            out._evictions = _evictions;
+        }
+
+        std::vector<Shard*> _shards;
+        unsigned            _maxBytes;
+        unsigned            _maxShardBytes;
+        OpenThreads::Atomic _hits;
+        OpenThreads::Atomic _misses;
+        OpenThreads::Atomic _evictions;
+    };
     
 
     static Threading::Mutex s_defaultBinMutex;
@@ -122,15 +428,38 @@ namespace
 //------------------------------------------------------------------------
 
 MemCache::MemCache( unsigned maxBinSize ) :
-_maxBinSize( osg::maximum(maxBinSize, 1u) )
+_maxBinSize( osg::maximum(maxBinSize, 1u) ),
+_maxBinBytes( 0u ),
+_numShards( 16u )
 {
     //nop
 }
 
+void
+MemCache::setMaxBinBytesFromEnvironment()
+{
+    char const* l2maxMB = ::getenv( OSGEARTH_ENV_L2_CACHE_MAX_MB );
+    if ( l2maxMB )
+    {
+        // capped so the byte count fits in an unsigned
+        unsigned maxMB = as<unsigned>( std::string(l2maxMB), 0u );
+        setMaxBinBytes( osg::minimum(maxMB, 4095u) * 1048576u );
+    }
+}
+
+CacheBin*
+MemCache::createBin( const std::string& binID )
+{
+    if ( _maxBinBytes > 0u )
+        return new ShardedMemCacheBin(binID, _maxBinBytes, _numShards);
+    else
+        return new MemCacheBin(binID, _maxBinSize);
+}
+
 CacheBin*
 MemCache::addBin( const std::string& binID )
 {
-    return _bins.getOrCreate( binID, new MemCacheBin(binID, _maxBinSize) );
+    return _bins.getOrCreate( binID, createBin(binID) );
 }
 
 CacheBin*
@@ -151,18 +480,50 @@ MemCache::getOrCreateDefaultBin()
         // double check
         if ( !_defaultBin.valid() )
         {
-            _defaultBin = new MemCacheBin("__default", _maxBinSize);
+            _defaultBin = createBin("__default");
         }
     }
 
     return _defaultBin.get();
 }
 
+bool
+MemCache::getStats(const std::string& binID, MemCacheBinStats& out)
+{
+    CacheBin* bin = getBin(binID);
+
+    ShardedMemCacheBin* sharded = dynamic_cast<ShardedMemCacheBin*>(bin);
+    if ( sharded )
+    {
+        sharded->getStats(out);
+        return true;
+    }
+
+    MemCacheBin* lru = dynamic_cast<MemCacheBin*>(bin);
+    if ( lru )
+    {
+        CacheStats stats = lru->_lru.getStats();
+        out = MemCacheBinStats();
+        out._entries    = stats._entries;
+        out._maxEntries = stats._maxEntries;
+        out._hits       = (unsigned)(stats._hitRatio * (float)stats._queries + 0.5f);
+        out._misses     = stats._queries - out._hits;
+        return true;
+    }
+
+    return false;
+}
 
 void
 MemCache::dumpStats(const std::string& binID)
 {
-    MemCacheBin* bin = static_cast<MemCacheBin*>(getBin(binID));
-    CacheStats stats = bin->_lru.getStats();
-    OE_INFO << LC << "hit ratio = " << stats._hitRatio << std::endl;
+    MemCacheBinStats stats;
+    if ( getStats(binID, stats) )
+    {
+        OE_INFO << LC << "hit ratio = " << stats.hitRatio()
+            << ", entries = " << stats._entries
+            << ", bytes = " << stats._bytes
+            << ", evictions = " << stats._evictions
+            << std::endl;
+    }
 }
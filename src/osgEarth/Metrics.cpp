@@ -20,28 +20,64 @@
 #include <osgEarth/ThreadingUtils>
 #include <osgEarth/Memory>
 #include <osgViewer/Viewer>
+#include <OpenThreads/Thread>
 #include <cstdarg>
+#include <iomanip>
+#include <sstream>
 
 using namespace osgEarth;
 
 #define LC "[Metrics] "
 
+#if defined(OSGEARTH_CXX11)
+#  define OE_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#  define OE_THREAD_LOCAL __declspec(thread)
+#else
+#  define OE_THREAD_LOCAL __thread
+#endif
+
 namespace
 {
     static osg::ref_ptr< MetricsBackend > s_metrics_backend;
     static bool s_metrics_debug = false;
 
+    // Interned event names; ID 0 is the empty name.
+    struct NameTable
+    {
+        NameTable() { _names.push_back(std::string()); }
+        OpenThreads::Mutex               _mutex;
+        std::map<std::string, unsigned>  _ids;
+        std::vector<std::string>         _names;
+    };
+
+    NameTable& getNameTable()
+    {
+        static NameTable s_names;
+        return s_names;
+    }
+
+    // The calling thread's ring buffer in the most recently used
+    // TraceMetricsBackend, identified by its generation.
+    OE_THREAD_LOCAL void*    t_ring = 0L;
+    OE_THREAD_LOCAL unsigned t_ringGeneration = 0u;
+    OpenThreads::Atomic      s_ringGeneration;
+
     class MetricsStartup
     {
     public:
         MetricsStartup()
         {
-            const char* metricsFile = ::getenv("OSGEARTH_METRICS_FILE");
+            const char* metricsFile = ::getenv(OSGEARTH_ENV_METRICS_FILE);
             if (metricsFile)
             {
-                Metrics::setMetricsBackend(new ChromeMetricsBackend(std::string(metricsFile)));
+                const char* backend = ::getenv(OSGEARTH_ENV_METRICS_BACKEND);
+                if (backend && std::string(backend) == "chrome")
+                    Metrics::setMetricsBackend(new ChromeMetricsBackend(std::string(metricsFile)));
+                else
+                    Metrics::setMetricsBackend(new TraceMetricsBackend(std::string(metricsFile)));
             }
-            const char* metricsVerbose = ::getenv("OSGEARTH_METRICS_DEBUG");
+            const char* metricsVerbose = ::getenv(OSGEARTH_ENV_METRICS_DEBUG);
             if (metricsVerbose)
             {
                 s_metrics_debug = true;
@@ -170,6 +206,30 @@ void Metrics::counter(const std::string& graph,const std::string& name0, double
     }
 }
 
+unsigned Metrics::intern(const char* name)
+{
+    if (!name || !*name)
+        return 0u;
+
+    NameTable& table = getNameTable();
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(table._mutex);
+    std::map<std::string, unsigned>::const_iterator i = table._ids.find(name);
+    if (i != table._ids.end())
+        return i->second;
+
+    unsigned id = table._names.size();
+    table._names.push_back(name);
+    table._ids[table._names.back()] = id;
+    return id;
+}
+
+std::string Metrics::getName(unsigned id)
+{
+    NameTable& table = getNameTable();
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(table._mutex);
+    return id < table._names.size() ? table._names[id] : std::string();
+}
+
 MetricsBackend* Metrics::getMetricsBackend()
 {
     return s_metrics_backend.get();
@@ -309,6 +369,23 @@ int Metrics::run(osgViewer::Viewer& viewer)
 
 
 
+void MetricsBackend::beginTrace(unsigned nameID)
+{
+    begin(Metrics::getName(nameID));
+}
+
+void MetricsBackend::endTrace(unsigned nameID)
+{
+    end(Metrics::getName(nameID));
+}
+
+void MetricsBackend::counterTrace(unsigned graphID, unsigned nameID, double value)
+{
+    counter(Metrics::getName(graphID), Metrics::getName(nameID), value, "", 0.0, "", 0.0);
+}
+
+
+
 ChromeMetricsBackend::ChromeMetricsBackend(const std::string& filename):
 _firstEvent(true)
 {
@@ -454,6 +531,311 @@ void ChromeMetricsBackend::counter(const std::string& graph,
 
 
 
+namespace
+{
+    enum
+    {
+        TRACE_BEGIN,
+        TRACE_END,
+        TRACE_COUNTER
+    };
+
+    void writeEscaped(std::ostream& out, const std::string& value)
+    {
+        for (std::string::const_iterator c = value.begin(); c != value.end(); ++c)
+        {
+            if (*c == '"' || *c == '\\')
+                out << '\\' << *c;
+            else if ((unsigned char)*c >= 0x20)
+                out << *c;
+        }
+    }
+}
+
+struct TraceMetricsBackend::Event
+{
+    osg::Timer_t  _time;
+    double        _value;
+    unsigned      _name;
+    unsigned      _series;
+    unsigned char _type;
+    bool          _hasArgs;
+};
+
+// Single-producer, single-consumer queue of events: the owning thread
+// advances _head, the writer thread advances _tail.
+struct TraceMetricsBackend::Ring
+{
+    Ring(unsigned capacity, unsigned tid) :
+        _events( capacity ),
+        _mask  ( capacity-1u ),
+        _tid   ( tid ),
+        _next  ( 0u ) { }
+
+    std::vector<Event>       _events;
+    std::vector<std::string> _args;     // parallel to _events; allocated on first use
+    unsigned                 _mask;
+    unsigned                 _tid;
+    unsigned                 _next;     // owner's copy of _head
+    OpenThreads::Atomic      _head;
+    OpenThreads::Atomic      _tail;
+};
+
+class TraceMetricsBackend::Writer : public OpenThreads::Thread
+{
+public:
+    Writer(TraceMetricsBackend* backend, unsigned intervalMs) :
+        _backend   ( backend ),
+        _intervalMs( intervalMs ),
+        _done      ( false ) { }
+
+    void run()
+    {
+        while (!_done)
+        {
+            _wake.wait(_intervalMs);
+            _wake.reset();
+            _backend->flush();
+        }
+    }
+
+    void stop()
+    {
+        _done = true;
+        _wake.set();
+        join();
+    }
+
+private:
+    TraceMetricsBackend* _backend;
+    unsigned             _intervalMs;
+    volatile bool        _done;
+    Threading::Event     _wake;
+};
+
+TraceMetricsBackend::TraceMetricsBackend(const std::string& filename,
+                                         unsigned eventsPerThread,
+                                         unsigned flushIntervalMs) :
+_capacity  ( 16u ),
+_firstEvent( true ),
+_writer    ( 0L )
+{
+    while (_capacity < eventsPerThread && _capacity < (1u << 24))
+        _capacity <<= 1;
+
+    _generation = ++s_ringGeneration;
+    _startTime = osg::Timer::instance()->tick();
+
+    _file.open(filename.c_str(), std::ios::out);
+    if (!_file.is_open())
+    {
+        OE_WARN << LC << "Failed to open trace file \"" << filename << "\"" << std::endl;
+        return;
+    }
+    _file << "[";
+
+    _writer = new Writer(this, osg::maximum(flushIntervalMs, 1u));
+    _writer->start();
+}
+
+TraceMetricsBackend::~TraceMetricsBackend()
+{
+    if (_writer)
+    {
+        _writer->stop();
+        delete _writer;
+        _writer = 0L;
+    }
+
+    if (_file.is_open())
+    {
+        flush();
+        _file << "]";
+        _file.close();
+    }
+
+    if (_dropped > 0u)
+    {
+        OE_WARN << LC << "Dropped " << (unsigned)_dropped << " trace events; "
+            << "increase the buffer size or the flush rate" << std::endl;
+    }
+
+    for (unsigned i = 0; i < _rings.size(); ++i)
+        delete _rings[i];
+}
+
+TraceMetricsBackend::Ring*
+TraceMetricsBackend::getRing()
+{
+    if (t_ringGeneration == _generation)
+        return static_cast<Ring*>(t_ring);
+
+    unsigned tid = Threading::getCurrentThreadId();
+
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_ringsMutex);
+    Ring*& ring = _ringsByThread[tid];
+    if (!ring)
+    {
+        ring = new Ring(_capacity, tid);
+        _rings.push_back(ring);
+    }
+    t_ring = ring;
+    t_ringGeneration = _generation;
+    return ring;
+}
+
+void
+TraceMetricsBackend::record(unsigned char type, unsigned name, unsigned series, double value, const Config* args)
+{
+    Ring* ring = getRing();
+
+    unsigned slot = ring->_next;
+    if (slot - (unsigned)ring->_tail > ring->_mask)
+    {
+        ++_dropped;
+        return;
+    }
+
+    Event& event = ring->_events[slot & ring->_mask];
+    event._time    = osg::Timer::instance()->tick();
+    event._value   = value;
+    event._name    = name;
+    event._series  = series;
+    event._type    = type;
+    event._hasArgs = args && !args->empty();
+
+    if (event._hasArgs)
+    {
+        if (ring->_args.empty())
+            ring->_args.resize(ring->_events.size());
+
+        std::stringstream buf;
+        for (ConfigSet::const_iterator i = args->children().begin(); i != args->children().end(); ++i)
+        {
+            if (i != args->children().begin())
+                buf << ",";
+            buf << "\"";
+            writeEscaped(buf, i->key());
+            buf << "\":\"";
+            writeEscaped(buf, i->value());
+            buf << "\"";
+        }
+        ring->_args[slot & ring->_mask] = buf.str();
+    }
+
+    // publishes the event to the writer
+    ring->_next = slot + 1u;
+    ++ring->_head;
+}
+
+void TraceMetricsBackend::begin(const std::string& name, const Config& args)
+{
+    record(TRACE_BEGIN, Metrics::intern(name.c_str()), 0u, 0.0, &args);
+}
+
+void TraceMetricsBackend::end(const std::string& name, const Config& args)
+{
+    record(TRACE_END, Metrics::intern(name.c_str()), 0u, 0.0, &args);
+}
+
+void TraceMetricsBackend::counter(const std::string& graph,
+                                  const std::string& name0, double value0,
+                                  const std::string& name1, double value1,
+                                  const std::string& name2, double value2)
+{
+    unsigned graphID = Metrics::intern(graph.c_str());
+    if (!name0.empty())
+        record(TRACE_COUNTER, graphID, Metrics::intern(name0.c_str()), value0, 0L);
+    if (!name1.empty())
+        record(TRACE_COUNTER, graphID, Metrics::intern(name1.c_str()), value1, 0L);
+    if (!name2.empty())
+        record(TRACE_COUNTER, graphID, Metrics::intern(name2.c_str()), value2, 0L);
+}
+
+void TraceMetricsBackend::beginTrace(unsigned nameID)
+{
+    record(TRACE_BEGIN, nameID, 0u, 0.0, 0L);
+}
+
+void TraceMetricsBackend::endTrace(unsigned nameID)
+{
+    record(TRACE_END, nameID, 0u, 0.0, 0L);
+}
+
+void TraceMetricsBackend::counterTrace(unsigned graphID, unsigned nameID, double value)
+{
+    record(TRACE_COUNTER, graphID, nameID, value, 0L);
+}
+
+unsigned TraceMetricsBackend::getNumDroppedEvents() const
+{
+    return _dropped;
+}
+
+void TraceMetricsBackend::flush()
+{
+    std::vector<Ring*> rings;
+    {
+        OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_ringsMutex);
+        rings = _rings;
+    }
+
+    OpenThreads::ScopedLock< OpenThreads::Mutex > lk(_flushMutex);
+    if (!_file.is_open())
+        return;
+
+    for (unsigned r = 0; r < rings.size(); ++r)
+    {
+        Ring* ring = rings[r];
+        unsigned head = ring->_head;
+        for (unsigned tail = ring->_tail; tail != head; ++tail)
+        {
+            unsigned slot = tail & ring->_mask;
+            const Event& event = ring->_events[slot];
+            write(event, event._hasArgs ? &ring->_args[slot] : 0L, ring->_tid);
+
+            // releases the slot to the owning thread
+            ++ring->_tail;
+        }
+    }
+
+    _file.flush();
+}
+
+void TraceMetricsBackend::write(const Event& event, const std::string* args, unsigned tid)
+{
+    unsigned last = osg::maximum(event._name, event._series);
+    while (_names.size() <= last)
+        _names.push_back(Metrics::getName(_names.size()));
+
+    if (_firstEvent)
+        _firstEvent = false;
+    else
+        _file << ",\n";
+
+    _file << "{\"ph\":\"" << (event._type == TRACE_BEGIN ? "B" : event._type == TRACE_END ? "E" : "C") << "\","
+        << "\"pid\":0,\"tid\":" << tid << ","
+        << "\"ts\":" << std::fixed << std::setprecision(3) << osg::Timer::instance()->delta_u(_startTime, event._time) << ","
+        << "\"name\":\"";
+    writeEscaped(_file, _names[event._name]);
+    _file << "\"";
+
+    if (event._type == TRACE_COUNTER)
+    {
+        _file << ",\"args\":{\"";
+        writeEscaped(_file, _names[event._series]);
+        _file << "\":" << std::setprecision(6) << event._value << "}";
+    }
+    else if (args)
+    {
+        _file << ",\"args\":{" << *args << "}";
+    }
+
+    _file << "}";
+}
+
+
+
 ScopedMetric::ScopedMetric(const std::string& name) :
 _name(name)
 {
@@ -506,7 +506,7 @@ Profile::isEquivalentTo( const Profile* rhs ) const
 bool
 Profile::isHorizEquivalentTo( const Profile* rhs ) const
 {
-    return rhs && getHorizSignature() == rhs->getHorizSignature();
+    return rhs && (rhs == this || getHorizSignature() == rhs->getHorizSignature());
 }
 
 void
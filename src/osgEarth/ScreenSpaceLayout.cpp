@@ -20,6 +20,7 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarth/ScreenSpaceLayout>
+#include <osgEarth/DeclutterGrid>
 #include <osgEarth/Utils>
 #include <osgEarth/VirtualProgram>
 #include <osgEarth/Extension>
@@ -128,8 +129,6 @@ namespace
 
     typedef std::map<const osg::Drawable*, DrawableInfo> DrawableMemory;
 
-    typedef std::pair<const osg::Node*, osg::BoundingBox> RenderLeafBox;
-
     // Data structure stored one-per-View.
     struct PerCamInfo
     {
@@ -141,7 +140,10 @@ namespace
         // re-usable structures (to avoid unnecessary re-allocation)
         osgUtil::RenderBin::RenderLeafList _passed;
         osgUtil::RenderBin::RenderLeafList _failed;
-        std::vector<RenderLeafBox>         _used;
+        DeclutterGrid                      _used;
+
+        // decisions from the previous pass, in sorted leaf order
+        std::vector<DeclutterRecord>       _layout;
 
         // time stamp of the previous pass, for calculating animation speed
         osg::Timer_t _lastTimeStamp;
@@ -174,6 +176,7 @@ ScreenSpaceLayoutOptions::fromConfig( const Config& conf )
     conf.get( "snap_to_pixel",       _snapToPixel );
     conf.get( "max_objects",         _maxObjects );
     conf.get( "render_order",        _renderBinNumber );
+    conf.get( "reuse_tolerance",     _reuseTolerance );
 }
 
 Config
@@ -189,6 +192,7 @@ ScreenSpaceLayoutOptions::getConfig() const
     conf.set( "snap_to_pixel",       _snapToPixel );
     conf.set( "max_objects",         _maxObjects );
     conf.set( "render_order",        _renderBinNumber );
+    conf.set( "reuse_tolerance",     _reuseTolerance );
     return conf;
 }
 
@@ -305,12 +309,12 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
         // Reset the local re-usable containers
         local._passed.clear();          // drawables that pass occlusion test
         local._failed.clear();          // drawables that fail occlusion test
-        local._used.clear();            // list of occupied bounding boxes in screen space
 
         // compute a window matrix so we can do window-space culling. If this is an RTT camera
         // with a reference camera attachment, we actually want to declutter in the window-space
         // of the reference camera. (e.g., for picking).
         const osg::Viewport* vp = cam->getViewport();
+        const osg::Viewport* refVP = vp;
 
         osg::Matrix windowMatrix = vp->computeWindowMatrix();
 
@@ -327,7 +331,7 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
             //cam->getView()->findSlaveIndexForCamera(cam) < cam->getView()->getNumSlaves())
         {
             osg::Camera* parentCam = cam->getView()->getCamera();
-            const osg::Viewport* refVP = parentCam->getViewport();
+            refVP = parentCam->getViewport();
             refCamScale.set( vp->width() / refVP->width(), vp->height() / refVP->height(), 1.0 );
             refCamScaleMat.makeScale( refCamScale );
             refWindowMatrix = refVP->computeWindowMatrix();
@@ -351,11 +355,20 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
         bool camChanged = camVPW != local._lastCamVPW;
         local._lastCamVPW = camVPW;
 
+        // list of occupied bounding boxes in screen space
+        local._used.reset( refVP );
+
+        // Decisions from the previous pass hold as long as the leaves leading up
+        // to them are the same ones, in the same places, as when they were made.
+        float reuseTolerance = *options.reuseTolerance();
+        bool reusing = reuseTolerance > 0.0f;
+        unsigned k = 0;
+
         // Go through each leaf and test for visibility.
         // Enforce the "max objects" limit along the way.
         for(osgUtil::RenderBin::RenderLeafList::iterator i = leaves.begin();
             i != leaves.end() && local._passed.size() < limit;
-            ++i )
+            ++i, ++k )
         {
             bool visible = true;
 
@@ -464,7 +477,17 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
                 // A max priority => never occlude.
                 float priority = layoutData ? layoutData->_priority : 0.0f;
 
-                if ( priority == FLT_MAX )
+                reusing =
+                    reusing &&
+                    k < local._layout.size() &&
+                    local._layout[k].matches(drawable, drawableParent, priority, box, reuseTolerance);
+
+                if ( reusing )
+                {
+                    visible = local._layout[k]._visible;
+                }
+
+                else if ( priority == FLT_MAX )
                 {
                     visible = true;
                 }
@@ -478,25 +501,21 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
                 else
                 {
                     // weed out any drawables that are obscured by closer drawables.
-                    // TODO: think about a more efficient algorithm - right now we are just using
-                    // brute force to compare all bbox's
-                    for( std::vector<RenderLeafBox>::const_iterator j = local._used.begin(); j != local._used.end(); ++j )
-                    {
-                        // only need a 2D test since we're in clip space
-                        bool isClear =
-                            box.xMin() > j->second.xMax() ||
-                            box.xMax() < j->second.xMin() ||
-                            box.yMin() > j->second.yMax() ||
-                            box.yMax() < j->second.yMin();
-
-                        // if there's an overlap (and the conflict isn't from the same drawable
-                        // parent, which is acceptable), then the leaf is culled.
-                        if ( !isClear && drawableParent != j->first )
-                        {
-                            visible = false;
-                            break;
-                        }
-                    }
+                    visible = local._used.isClear( drawableParent, box );
+                }
+
+                // remember a fresh decision for the next pass.
+                if ( !reusing )
+                {
+                    if ( k == local._layout.size() )
+                        local._layout.push_back( DeclutterRecord() );
+
+                    DeclutterRecord& record = local._layout[k];
+                    record._drawable = drawable;
+                    record._parent   = drawableParent;
+                    record._priority = priority;
+                    record._box      = box;
+                    record._visible  = visible;
                 }
             }
 
@@ -505,7 +524,7 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
                 // passed the test, so add the leaf's bbox to the "used" list, and add the leaf
                 // to the final draw list.
                 if (drawableParent)
-                    local._used.push_back( std::make_pair(drawableParent, box) );
+                    local._used.insert( drawableParent, box );
 
                 local._passed.push_back( leaf );
             }
@@ -546,6 +565,8 @@ struct /*internal*/ DeclutterSort : public osgUtil::RenderBin::SortCallback
         // are in the cull list.
         if ( s_declutteringEnabledGlobally )
         {
+            local._layout.resize( k );
+
             leaves.clear();
             for( osgUtil::RenderBin::RenderLeafList::const_iterator i=local._passed.begin(); i != local._passed.end(); ++i )
             {
@@ -23,9 +23,18 @@
 #include <osgEarth/LocalTangentPlane>
 #include <ogr_spatialref.h>
 #include <cpl_conv.h>
+#include <gdal_version.h>
+#include <OpenThreads/Atomic>
+#include <cfloat>
+#include <complex>
 
 #define LC "[SpatialReference] "
 
+// Most OGR transform handles an SRS keeps for one thread, and most threads
+// it keeps handles for; past either, handles not in use are freed.
+#define MAX_TRANSFORM_HANDLES_PER_THREAD 16u
+#define MAX_TRANSFORM_HANDLE_THREADS     32u
+
 using namespace osgEarth;
 
 //------------------------------------------------------------------------
@@ -74,6 +83,217 @@ namespace
             points[i].set( osg::RadiansToDegrees(lon), osg::RadiansToDegrees(lat), alt );
         }
     }
+
+    //....................................................................
+    // Closed-form kernels for the projections SpatialReference can compute
+    // without OGR. They work in place on the same x/y arrays OCTTransform
+    // takes (geodetic coordinates in degrees) and return false as soon as a
+    // point falls outside the projection's domain, in which case the caller
+    // starts over with OGR so that errors are reported the same way.
+
+    OpenThreads::Atomic s_nativeTransformsEnabled( 1u );
+
+    // Transverse Mercator is only computed natively this far from the
+    // central meridian; past that PROJ.4's series drifts away from ours.
+    const double MAX_TM_LONGITUDE = osg::DegreesToRadians(10.0);
+
+    inline bool isFinite(double v)
+    {
+        return fabs(v) <= DBL_MAX;
+    }
+
+    inline double asinh_(double x)
+    {
+        double y = fabs(x);
+        y = log(y + sqrt(y*y + 1.0));
+        return x < 0.0 ? -y : y;
+    }
+
+    inline double atanh_(double x)
+    {
+        return 0.5 * log((1.0 + x) / (1.0 - x));
+    }
+
+    // Same as PROJ.4's adjlon: wraps a longitude (radians) into [-pi, pi].
+    inline double adjlon(double lon)
+    {
+        if (fabs(lon) <= 3.14159265359)
+            return lon;
+        lon += osg::PI;
+        lon -= 2.0*osg::PI * floor(lon / (2.0*osg::PI));
+        return lon - osg::PI;
+    }
+
+    // Tangent of the conformal latitude from the tangent of the geodetic
+    // latitude, and its inverse by Newton's method (Karney, 2011).
+    inline double taupf(double tau, double e)
+    {
+        double tau1 = sqrt(1.0 + tau*tau);
+        double sig = sinh(e * atanh_(e * tau / tau1));
+        return sqrt(1.0 + sig*sig) * tau - sig * tau1;
+    }
+
+    inline double tauf(double taup, double e)
+    {
+        double e2m = 1.0 - e*e;
+        double tau = taup / e2m;
+        double stol = 1e-14 * osg::maximum(1.0, fabs(taup));
+        for (int i = 0; i < 5; ++i)
+        {
+            double taupa = taupf(tau, e);
+            double dtau = (taup - taupa) * (1.0 + e2m*tau*tau) /
+                (e2m * sqrt(1.0 + tau*tau) * sqrt(1.0 + taupa*taupa));
+            tau += dtau;
+            if (fabs(dtau) < stol)
+                break;
+        }
+        return tau;
+    }
+
+    inline double eccentricity(double a, double b)
+    {
+        double f = (a - b) / a;
+        return sqrt(f * (2.0 - f));
+    }
+
+    // Normal aspect Mercator, spherical or ellipsoidal, with lat_ts = 0.
+    struct Mercator
+    {
+        double _e, _ak0, _lon0, _x0, _y0;
+
+        Mercator(double a, double b, double lon0, double k0, double x0, double y0) :
+            _e(eccentricity(a, b)), _ak0(a*k0), _lon0(osg::DegreesToRadians(lon0)), _x0(x0), _y0(y0) { }
+
+        bool forward(double* x, double* y, unsigned count) const
+        {
+            for (unsigned i = 0; i < count; ++i)
+            {
+                double lam = osg::DegreesToRadians(x[i]);
+                double phi = osg::DegreesToRadians(y[i]);
+                if (!(fabs(phi) < osg::PI_2) || !(fabs(lam) <= 10.0))
+                    return false;
+
+                x[i] = _x0 + _ak0 * adjlon(lam - _lon0);
+                y[i] = _y0 + _ak0 * asinh_(taupf(tan(phi), _e));
+            }
+            return true;
+        }
+
+        bool inverse(double* x, double* y, unsigned count) const
+        {
+            for (unsigned i = 0; i < count; ++i)
+            {
+                double lam = (x[i] - _x0) / _ak0;
+                double phi = atan(tauf(sinh((y[i] - _y0) / _ak0), _e));
+                if (!isFinite(lam) || !isFinite(phi))
+                    return false;
+
+                x[i] = osg::RadiansToDegrees(adjlon(lam + _lon0));
+                y[i] = osg::RadiansToDegrees(phi);
+            }
+            return true;
+        }
+    };
+
+    // Transverse Mercator with lat_0 = 0 (UTM included), using Krueger's
+    // series to sixth order in the third flattening (Karney, 2011).
+    struct TransverseMercator
+    {
+        double _e, _ak0, _lon0, _x0, _y0;
+        double _alpha[7], _beta[7];
+
+        TransverseMercator(double a, double b, double lon0, double k0, double x0, double y0) :
+            _e(eccentricity(a, b)), _lon0(osg::DegreesToRadians(lon0)), _x0(x0), _y0(y0)
+        {
+            double f = (a - b) / a;
+            double n = f / (2.0 - f);
+            double n2 = n*n, n3 = n2*n, n4 = n3*n, n5 = n4*n, n6 = n5*n;
+
+            // rectifying radius, scaled:
+            _ak0 = k0 * a / (1.0 + n) * (1.0 + n2/4.0 + n4/64.0 + n6/256.0);
+
+            _alpha[0] = _beta[0] = 0.0;
+
+            _alpha[1] = n/2.0 - 2.0*n2/3.0 + 5.0*n3/16.0 + 41.0*n4/180.0 - 127.0*n5/288.0 + 7891.0*n6/37800.0;
+            _alpha[2] = 13.0*n2/48.0 - 3.0*n3/5.0 + 557.0*n4/1440.0 + 281.0*n5/630.0 - 1983433.0*n6/1935360.0;
+            _alpha[3] = 61.0*n3/240.0 - 103.0*n4/140.0 + 15061.0*n5/26880.0 + 167603.0*n6/181440.0;
+            _alpha[4] = 49561.0*n4/161280.0 - 179.0*n5/168.0 + 6601661.0*n6/7257600.0;
+            _alpha[5] = 34729.0*n5/80640.0 - 3418889.0*n6/1995840.0;
+            _alpha[6] = 212378941.0*n6/319334400.0;
+
+            _beta[1] = n/2.0 - 2.0*n2/3.0 + 37.0*n3/96.0 - n4/360.0 - 81.0*n5/512.0 + 96199.0*n6/604800.0;
+            _beta[2] = n2/48.0 + n3/15.0 - 437.0*n4/1440.0 + 46.0*n5/105.0 - 1118711.0*n6/3870720.0;
+            _beta[3] = 17.0*n3/480.0 - 37.0*n4/840.0 - 209.0*n5/4480.0 + 5569.0*n6/90720.0;
+            _beta[4] = 4397.0*n4/161280.0 - 11.0*n5/504.0 - 830251.0*n6/7257600.0;
+            _beta[5] = 4583.0*n5/161280.0 - 108847.0*n6/3991680.0;
+            _beta[6] = 20648693.0*n6/638668800.0;
+        }
+
+        // sum of coef[j] * sin(2j * (xi + i*eta)) for j = 1..6
+        static std::complex<double> series(const double* coef, double xi, double eta)
+        {
+            std::complex<double> z2(2.0*xi, 2.0*eta);
+            std::complex<double> s1 = std::sin(z2), c1 = std::cos(z2);
+            std::complex<double> sj = s1, cj = c1;
+            std::complex<double> sum = coef[1] * s1;
+            for (int j = 2; j <= 6; ++j)
+            {
+                std::complex<double> sn = sj*c1 + cj*s1;
+                cj = cj*c1 - sj*s1;
+                sj = sn;
+                sum += coef[j] * sj;
+            }
+            return sum;
+        }
+
+        bool forward(double* x, double* y, unsigned count) const
+        {
+            for (unsigned i = 0; i < count; ++i)
+            {
+                double lam = osg::DegreesToRadians(x[i]);
+                double phi = osg::DegreesToRadians(y[i]);
+                if (!(fabs(phi) <= osg::PI_2) || !(fabs(lam) <= 10.0))
+                    return false;
+
+                lam = adjlon(lam - _lon0);
+                if (fabs(lam) > MAX_TM_LONGITUDE)
+                    return false;
+
+                double taup = taupf(tan(phi), _e);
+                double xip = atan2(taup, cos(lam));
+                double etap = atanh_(sin(lam) / sqrt(1.0 + taup*taup));
+
+                std::complex<double> s = series(_alpha, xip, etap);
+                x[i] = _x0 + _ak0 * (etap + s.imag());
+                y[i] = _y0 + _ak0 * (xip + s.real());
+            }
+            return true;
+        }
+
+        bool inverse(double* x, double* y, unsigned count) const
+        {
+            for (unsigned i = 0; i < count; ++i)
+            {
+                double xi = (y[i] - _y0) / _ak0;
+                double eta = (x[i] - _x0) / _ak0;
+
+                std::complex<double> s = series(_beta, xi, eta);
+                double xip = xi - s.real();
+                double etap = eta - s.imag();
+
+                double sinhEtap = sinh(etap), cosXip = cos(xip);
+                double r = sqrt(sinhEtap*sinhEtap + cosXip*cosXip);
+                double lam = atan2(sinhEtap, cosXip);
+                double phi = r > 0.0 ? atan(tauf(sin(xip) / r, _e)) : (xip < 0.0 ? -osg::PI_2 : osg::PI_2);
+                if (!isFinite(phi) || !(fabs(lam) <= MAX_TM_LONGITUDE))
+                    return false;
+
+                x[i] = osg::RadiansToDegrees(adjlon(lam + _lon0));
+                y[i] = osg::RadiansToDegrees(phi);
+            }
+            return true;
+        }
+    };
 }
 
 //------------------------------------------------------------------------
@@ -403,9 +623,9 @@ SpatialReference::~SpatialReference()
             OE_DEBUG << LC << "Destroying [unitialized SRS]" << std::endl;
         }
 
-        for (TransformHandleCache::iterator itr = _transformHandleCache.begin(); itr != _transformHandleCache.end(); ++itr)
+        for (ThreadTransformHandleCache::iterator t = _transformHandleCache.begin(); t != _transformHandleCache.end(); ++t)
         {
-            OCTDestroyCoordinateTransformation(itr->second);
+            destroyTransformHandles(t->second.handles);
         }
 
         if ( _owns_handle )
@@ -1029,7 +1249,19 @@ SpatialReference::transform(std::vector<osg::Vec3d>& points,
         y[i] = points[i].y();
     }
 
-    success = inputSRS->transformXYPointArrays( x, y, count, outputSRS );
+    // try the closed-form kernels first, and fall back on OGR if they
+    // can't handle this SRS pair or one of the points.
+    success = inputSRS->transformXYNative( x, y, count, outputSRS );
+    if ( !success )
+    {
+        for( unsigned i=0; i<count; i++ )
+        {
+            x[i] = points[i].x();
+            y[i] = points[i].y();
+        }
+
+        success = inputSRS->transformXYPointArrays( x, y, count, outputSRS );
+    }
 
     if ( success )
     {
@@ -1092,25 +1324,62 @@ SpatialReference::transformXYPointArrays(double*  x,
                                          unsigned count,
                                          const SpatialReference* out_srs) const
 {  
-    // Transform the X and Y values inside an exclusive GDAL/OGR lock
-    GDAL_SCOPED_LOCK;
-
     //OE_INFO << LC << "Attempt transfrom from \n"
     //    << "    " << getHorizInitString() << "\n"
     //    << " -> " << out_srs->getHorizInitString() << std::endl;
 
+    // OGR transform handles are not thread-safe, so each thread gets its own.
+    unsigned threadId = Threading::getCurrentThreadId();
+    const std::string& outWKT = out_srs->getWKT();
+
     void* xform_handle = NULL;
-    TransformHandleCache::const_iterator itr = _transformHandleCache.find(out_srs->getWKT());
-    if (itr != _transformHandleCache.end())
+    bool cached = false;
     {
-        //OE_DEBUG << LC << "using cached transform handle" << std::endl;
-        xform_handle = itr->second;
+        Threading::ScopedMutexLock lock(_transformHandleCacheMutex);
+        ThreadTransformHandles& mine = _transformHandleCache[threadId];
+        TransformHandleCache::const_iterator itr = mine.handles.find(outWKT);
+        if (itr != mine.handles.end())
+        {
+            //OE_DEBUG << LC << "using cached transform handle" << std::endl;
+            xform_handle = itr->second;
+            mine.busy = true;
+            cached = true;
+        }
     }
-    else
+
+    if (!cached)
     {
         OE_DEBUG << LC << "allocating new OCT Transform" << std::endl;
-        xform_handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle);
-        const_cast<SpatialReference*>(this)->_transformHandleCache[out_srs->getWKT()] = xform_handle;
+        {
+            GDAL_SCOPED_LOCK;
+            xform_handle = OCTNewCoordinateTransformation( _handle, out_srs->_handle);
+        }
+
+        Threading::ScopedMutexLock lock(_transformHandleCacheMutex);
+
+        // Keep the cache bounded. This thread's own handles are safe to
+        // free since it's not using any; other threads' only when idle
+        // (threads that have exited stay idle forever).
+        ThreadTransformHandles& mine = _transformHandleCache[threadId];
+        if (mine.handles.size() >= MAX_TRANSFORM_HANDLES_PER_THREAD)
+        {
+            destroyTransformHandles(mine.handles);
+        }
+        mine.handles[outWKT] = xform_handle;
+        mine.busy = true;
+
+        if (_transformHandleCache.size() > MAX_TRANSFORM_HANDLE_THREADS)
+        {
+            for (ThreadTransformHandleCache::iterator t = _transformHandleCache.begin(); t != _transformHandleCache.end(); )
+            {
+                if (t->first != threadId && !t->second.busy)
+                {
+                    destroyTransformHandles(t->second.handles);
+                    _transformHandleCache.erase(t++);
+                }
+                else ++t;
+            }
+        }
     }
 
     if ( !xform_handle )
@@ -1125,10 +1394,94 @@ SpatialReference::transformXYPointArrays(double*  x,
 
         OE_WARN << LC << "ERROR:  " << CPLGetLastErrorMsg() << std::endl;
 
+        Threading::ScopedMutexLock lock(_transformHandleCacheMutex);
+        _transformHandleCache[threadId].busy = false;
+        return false;
+    }
+
+    bool ok;
+    {
+#if GDAL_VERSION_NUM < 2000000
+        // Older GDALs share PROJ.4 state between transforms.
+        GDAL_SCOPED_LOCK;
+#endif
+        ok = OCTTransform( xform_handle, count, x, y, 0L ) > 0;
+    }
+
+    Threading::ScopedMutexLock lock(_transformHandleCacheMutex);
+    _transformHandleCache[threadId].busy = false;
+    return ok;
+}
+
+void
+SpatialReference::destroyTransformHandles(TransformHandleCache& handles)
+{
+    for (TransformHandleCache::iterator itr = handles.begin(); itr != handles.end(); ++itr)
+    {
+        if (itr->second)
+            OCTDestroyCoordinateTransformation(itr->second);
+    }
+    handles.clear();
+}
+
+
+bool
+SpatialReference::transformXYNative(double*  x,
+                                    double*  y,
+                                    unsigned count,
+                                    const SpatialReference* out_srs) const
+{
+    if ( s_nativeTransformsEnabled == 0u )
         return false;
+
+    if ( !_initialized )
+        const_cast<SpatialReference*>(this)->init();
+
+    if ( !out_srs->_initialized )
+        const_cast<SpatialReference*>(out_srs)->init();
+
+    const NativeProjection& in = _native;
+    const NativeProjection& out = out_srs->_native;
+
+    if ( in.type == NativeProjection::NONE || out.type == NativeProjection::NONE )
+        return false;
+
+    // unproject to geodetic...
+    if ( in.type == NativeProjection::MERCATOR )
+    {
+        if ( !Mercator(in.a, in.b, in.lon0, in.k0, in.x0, in.y0).inverse(x, y, count) )
+            return false;
+    }
+    else if ( in.type == NativeProjection::TRANSVERSE_MERCATOR )
+    {
+        if ( !TransverseMercator(in.a, in.b, in.lon0, in.k0, in.x0, in.y0).inverse(x, y, count) )
+            return false;
+    }
+
+    // ...and project into the output SRS.
+    if ( out.type == NativeProjection::MERCATOR )
+    {
+        return Mercator(out.a, out.b, out.lon0, out.k0, out.x0, out.y0).forward(x, y, count);
     }
+    else if ( out.type == NativeProjection::TRANSVERSE_MERCATOR )
+    {
+        return TransverseMercator(out.a, out.b, out.lon0, out.k0, out.x0, out.y0).forward(x, y, count);
+    }
+
+    return true;
+}
+
 
-    return OCTTransform( xform_handle, count, x, y, 0L ) > 0;
+void
+SpatialReference::setNativeTransformsEnabled(bool value)
+{
+    s_nativeTransformsEnabled.exchange( value ? 1u : 0u );
+}
+
+bool
+SpatialReference::getNativeTransformsEnabled()
+{
+    return s_nativeTransformsEnabled != 0u;
 }
 
 
@@ -1534,6 +1887,9 @@ SpatialReference::_init()
         CPLFree( wktbuf );
     }
 
+    // See whether we can transform without OGR:
+    initNativeProjection( unitMultiplier );
+
     // Build a 'normalized' initialization key.
     if ( !_proj4.empty() )
     {
@@ -1556,6 +1912,121 @@ SpatialReference::_init()
     _initialized = true;
 }
 
+void
+SpatialReference::initNativeProjection(double unitsToBase)
+{
+    _native = NativeProjection();
+
+    if ( _is_geocentric || _proj4.empty() )
+        return;
+
+    // Break the PROJ.4 string into its parameters. Anything we don't
+    // recognize (prime meridians, axis orders, grid shifts...) means OGR.
+    std::map<std::string, std::string> params;
+    StringVector tokens;
+    StringTokenizer( toLower(_proj4), tokens, " \t", "", false, true );
+    for( StringVector::const_iterator i = tokens.begin(); i != tokens.end(); ++i )
+    {
+        if ( i->length() < 2 || (*i)[0] != '+' )
+            return;
+        std::string::size_type eq = i->find('=');
+        if ( eq == std::string::npos )
+            params[i->substr(1)] = "";
+        else
+            params[i->substr(1, eq-1)] = i->substr(eq+1);
+    }
+
+    static const char* known[] = {
+        "proj", "datum", "ellps", "a", "b", "towgs84", "nadgrids", "units", "no_defs", "wktext", "type",
+        "lat_0", "lat_ts", "lon_0", "k", "k_0", "x_0", "y_0", "zone", "south", 0L };
+
+    for( std::map<std::string, std::string>::const_iterator i = params.begin(); i != params.end(); ++i )
+    {
+        bool ok = false;
+        for( const char** k = known; *k && !ok; ++k )
+            ok = (i->first == *k);
+        if ( !ok )
+            return;
+    }
+
+    // The geodetic coordinates must pass straight through without a datum
+    // shift: either the SRS sits on WGS84 or it uses the null grid, as the
+    // spherical mercator profile does.
+    double a = _ellipsoid->getRadiusEquator();
+    double b = _ellipsoid->getRadiusPolar();
+    bool nullGrid = params.count("nadgrids") && params["nadgrids"] == "@null";
+    if ( params.count("nadgrids") && !nullGrid )
+        return;
+    if ( params.count("datum") && params["datum"] != "wgs84" )
+        return;
+    if ( !nullGrid )
+    {
+        if ( !osg::equivalent(a, 6378137.0, 1e-6) || !osg::equivalent(b, 6356752.314245, 1e-3) )
+            return;
+
+        StringVector towgs84;
+        StringTokenizer( params["towgs84"], towgs84, ",", "", false, true );
+        for( StringVector::const_iterator i = towgs84.begin(); i != towgs84.end(); ++i )
+            if ( as<double>(*i, 1.0) != 0.0 )
+                return;
+    }
+
+    if ( params.count("lat_0") && as<double>(params["lat_0"], 1.0) != 0.0 )
+        return;
+    if ( params.count("lat_ts") && as<double>(params["lat_ts"], 1.0) != 0.0 )
+        return;
+
+    NativeProjection native;
+    native.a = a;
+    native.b = b;
+    native.lon0 = as<double>(params["lon_0"], 0.0);
+    native.k0 = params.count("k_0") ? as<double>(params["k_0"], 1.0) : as<double>(params["k"], 1.0);
+    native.x0 = as<double>(params["x_0"], 0.0);
+    native.y0 = as<double>(params["y_0"], 0.0);
+
+    const std::string& proj = params["proj"];
+
+    if ( proj == "longlat" || proj == "latlong" || proj == "lonlat" || proj == "latlon" )
+    {
+        if ( !_is_geographic || !osg::equivalent(unitsToBase, osg::PI/180.0, 1e-12) )
+            return;
+        if ( native.lon0 != 0.0 || native.k0 != 1.0 || native.x0 != 0.0 || native.y0 != 0.0 || params.count("zone") )
+            return;
+
+        native.type = NativeProjection::GEODETIC;
+    }
+    else
+    {
+        if ( _is_geographic || unitsToBase != 1.0 )
+            return;
+        if ( params.count("units") && params["units"] != "m" )
+            return;
+
+        if ( proj == "merc" )
+        {
+            native.type = NativeProjection::MERCATOR;
+        }
+        else if ( proj == "tmerc" )
+        {
+            native.type = NativeProjection::TRANSVERSE_MERCATOR;
+        }
+        else if ( proj == "utm" )
+        {
+            int zone = as<int>(params["zone"], 0);
+            if ( zone < 1 || zone > 60 )
+                return;
+
+            native.type = NativeProjection::TRANSVERSE_MERCATOR;
+            native.lon0 = zone * 6.0 - 183.0;
+            native.k0 = 0.9996;
+            native.x0 = 500000.0;
+            native.y0 = params.count("south") ? 10000000.0 : 0.0;
+        }
+    }
+
+    _native = native;
+}
+
 bool
 SpatialReference::guessBounds(Bounds& bounds) const
 {
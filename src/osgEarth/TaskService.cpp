@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarth/TaskService>
+#include <osgEarth/StringUtils>
+#include <stdlib.h>
 
 using namespace osgEarth;
 using namespace OpenThreads;
@@ -196,8 +198,296 @@ TaskRequestQueue::setDone()
 
 //------------------------------------------------------------------------
 
+WorkStealingTaskQueue::WorkStealingTaskQueue(unsigned numSlots, unsigned int maxSize) :
+osg::Referenced( true ),
+_slots( MAX_SLOTS, (Slot*)0L ),
+_numAllocated( 0u ),
+_done( false ),
+_draining( false ),
+_maxSize( maxSize ),
+_stamp( 0 )
+{
+    setNumSlots( numSlots );
+}
+
+WorkStealingTaskQueue::~WorkStealingTaskQueue()
+{
+    for(unsigned i=0; i<_numAllocated; ++i)
+        delete _slots[i];
+}
+
+void
+WorkStealingTaskQueue::setNumSlots( unsigned numSlots )
+{
+    numSlots = osg::clampBetween( numSlots, 1u, (unsigned)MAX_SLOTS );
+
+    ScopedLock<Mutex> lock( _resizeMutex );
+
+    // publish each new slot before raising the count that exposes it.
+    while( _numAllocated < numSlots )
+    {
+        _slots[_numAllocated] = new Slot();
+        ++_numAllocated;
+    }
+
+    unsigned oldNumSlots = _numSlots;
+    _numSlots.exchange( numSlots );
+
+    // Move requests out of the slots that no longer have an owner, so they
+    // are run by an owner in priority/FIFO order. A request that an add()
+    // in flight drops into a retired slot is still reached by trySteal(),
+    // which scans every allocated slot.
+    for(unsigned i=numSlots; i<oldNumSlots; ++i)
+    {
+        Slot& from = *_slots[i];
+        TaskRequestPriorityMap moved;
+        {
+            ScopedLock<Mutex> fromLock( from._mutex );
+            moved.swap( from._requests );
+            from._size.exchange( 0u );
+        }
+
+        Slot& to = *_slots[i % numSlots];
+        ScopedLock<Mutex> toLock( to._mutex );
+        for(TaskRequestPriorityMap::iterator r = moved.begin(); r != moved.end(); ++r)
+        {
+            to._requests.insert( *r );
+            ++to._size;
+        }
+    }
+}
+
+void
+WorkStealingTaskQueue::push( Slot& slot, TaskRequest* request )
+{
+    ScopedLock<Mutex> lock( slot._mutex );
+    slot._requests.insert( std::make_pair(request->getPriority(), osg::ref_ptr<TaskRequest>(request)) );
+    ++slot._size;
+    ++_numRequests;
+}
+
+bool
+WorkStealingTaskQueue::pop( Slot& slot, osg::ref_ptr<TaskRequest>& out )
+{
+    // Caller holds the slot's mutex. Lowest priority value first; the
+    // multimap keeps requests of equal priority in the order they came.
+    if ( slot._requests.empty() )
+        return false;
+
+    out = slot._requests.begin()->second;
+    slot._requests.erase( slot._requests.begin() );
+    --slot._size;
+    --_numRequests;
+    return true;
+}
+
+bool
+WorkStealingTaskQueue::trySteal( unsigned thief, bool blocking, osg::ref_ptr<TaskRequest>& out )
+{
+    unsigned numSlots = _numAllocated;
+    for(unsigned i=1; i<numSlots; ++i)
+    {
+        Slot& victim = *_slots[(thief+i) % numSlots];
+
+        if ( (unsigned)victim._size == 0u )
+            continue;
+
+        if ( blocking )
+            victim._mutex.lock();
+        else if ( victim._mutex.trylock() != 0 )
+            continue;
+
+        bool stolen = pop( victim, out );
+        victim._mutex.unlock();
+
+        if ( stolen )
+        {
+            ++_slots[thief]->_steals;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+WorkStealingTaskQueue::add( TaskRequest* request )
+{
+    // A PoisonPill tells the workers to exit once all queued work is done.
+    if ( dynamic_cast<PoisonPill*>(request) )
+    {
+        setDraining();
+        return;
+    }
+
+    request->setState( TaskRequest::STATE_PENDING );
+
+    // install a progress callback if one isn't already installed
+    if ( !request->getProgressCallback() )
+        request->setProgressCallback( new ProgressCallback() );
+
+    // Requests spawned by one of our own workers stay on that worker's slot;
+    // everything else is spread round-robin.
+    unsigned slot;
+    bool fromWorker = false;
+    TaskThread* thread = dynamic_cast<TaskThread*>( OpenThreads::Thread::CurrentThread() );
+    if ( thread && thread->getWorkStealingQueue() == this )
+    {
+        slot = thread->getSlot() % (unsigned)_numSlots;
+        fromWorker = true;
+    }
+    else
+    {
+        slot = (++_nextSlot) % (unsigned)_numSlots;
+    }
+
+    // Bounded queue: block outside submitters until there is room. Workers
+    // are never blocked here, since they may be the ones that have to drain it.
+    if ( _maxSize > 0 && !fromWorker )
+    {
+        while( (unsigned)_numRequests >= _maxSize && !_done )
+        {
+            ScopedLock<Mutex> lock( _idleMutex );
+            ++_numBlockedAdders;
+            if ( (unsigned)_numRequests >= _maxSize && !_done )
+                _notFull.wait( &_idleMutex, 100 );
+            --_numBlockedAdders;
+        }
+    }
+
+    push( *_slots[slot], request );
+
+    // only touch the shared mutex when somebody is actually asleep.
+    if ( (unsigned)_numSleepers > 0u )
+    {
+        ScopedLock<Mutex> lock( _idleMutex );
+        _notEmpty.signal();
+    }
+}
+
+bool
+WorkStealingTaskQueue::get( unsigned slotIndex, volatile bool& done, osg::ref_ptr<TaskRequest>& out )
+{
+    unsigned ownSlot = slotIndex;
+
+    while( !_done && !done )
+    {
+        // the slot count can change under us (setNumSlots).
+        slotIndex = ownSlot % (unsigned)_numSlots;
+        Slot& slot = *_slots[slotIndex];
+
+        bool found = false;
+        {
+            ScopedLock<Mutex> lock( slot._mutex );
+            found = pop( slot, out );
+        }
+
+        // Steal opportunistically first (skipping busy slots), then
+        // make one blocking pass before going to sleep.
+        if ( !found )
+            found = trySteal( slotIndex, false, out ) || trySteal( slotIndex, true, out );
+
+        if ( found )
+        {
+            ++slot._tasksRun;
+
+            if ( (unsigned)_numBlockedAdders > 0u )
+            {
+                ScopedLock<Mutex> lock( _idleMutex );
+                _notFull.signal();
+            }
+            return true;
+        }
+
+        if ( _draining )
+        {
+            if ( (unsigned)_numRequests == 0u )
+                return false;
+
+            // a request is being pushed right now; try again
+            OpenThreads::Thread::YieldCurrentThread();
+            continue;
+        }
+
+        // Nothing to do. The sleeper count is raised before re-checking the
+        // request count so that add() cannot miss us; the timed wait lets
+        // us notice "done" even without a signal.
+        ScopedLock<Mutex> lock( _idleMutex );
+        ++_numSleepers;
+        if ( (unsigned)_numRequests == 0u && !_done && !done && !_draining )
+            _notEmpty.wait( &_idleMutex, 100 );
+        --_numSleepers;
+    }
+
+    return false;
+}
+
+void
+WorkStealingTaskQueue::clear()
+{
+    for(unsigned i=0; i<_numAllocated; ++i)
+    {
+        Slot& slot = *_slots[i];
+        ScopedLock<Mutex> lock( slot._mutex );
+        osg::ref_ptr<TaskRequest> request;
+        while( pop(slot, request) );
+    }
+}
+
+void
+WorkStealingTaskQueue::cancel()
+{
+    for(unsigned i=0; i<_numAllocated; ++i)
+    {
+        Slot& slot = *_slots[i];
+        ScopedLock<Mutex> lock( slot._mutex );
+        osg::ref_ptr<TaskRequest> request;
+        while( pop(slot, request) )
+            request->cancel();
+    }
+}
+
+void
+WorkStealingTaskQueue::setDone()
+{
+    ScopedLock<Mutex> lock( _idleMutex );
+    _done = true;
+    _notEmpty.broadcast();
+    _notFull.broadcast();
+}
+
+void
+WorkStealingTaskQueue::setDraining()
+{
+    ScopedLock<Mutex> lock( _idleMutex );
+    _draining = true;
+    _notEmpty.broadcast();
+}
+
+void
+WorkStealingTaskQueue::getStats( std::vector<SlotStats>& out ) const
+{
+    out.resize( _numSlots );
+    for(unsigned i=0; i<out.size(); ++i)
+    {
+        out[i]._queueDepth = _slots[i]->_size;
+        out[i]._tasksRun   = _slots[i]->_tasksRun;
+        out[i]._steals     = _slots[i]->_steals;
+    }
+}
+
+//------------------------------------------------------------------------
+
 TaskThread::TaskThread( TaskRequestQueue* queue ) :
 _queue( queue ),
+_slot( 0u ),
+_done( false )
+{
+    //nop
+}
+
+TaskThread::TaskThread( WorkStealingTaskQueue* queue, unsigned slot ) :
+_wsQueue( queue ),
+_slot( slot ),
 _done( false )
 {
     //nop
@@ -208,7 +498,16 @@ TaskThread::run()
 {
     while( !_done )
     {
-        _request = _queue->get();
+        if ( _wsQueue.valid() )
+        {
+            // returns false on shutdown or once drained after a PoisonPill.
+            if ( !_wsQueue->get(_slot, _done, _request) )
+                break;
+        }
+        else
+        {
+            _request = _queue->get();
+        }
 
         if ( _done )
             break;
@@ -281,27 +580,84 @@ TaskThread::cancel()
 
 //------------------------------------------------------------------------
 
-TaskService::TaskService( const std::string& name, int numThreads, unsigned int maxSize ):
+TaskService::TaskService( const std::string& name, int numThreads, unsigned int maxSize, Scheduler scheduler ):
 osg::Referenced( true ),
+_scheduler( scheduler ),
+_numThreads( 0 ),
 _lastRemoveFinishedThreadsStamp(0),
-_name(name),
-_numThreads( 0 )
+_name(name)
 {
-    _queue = new TaskRequestQueue( maxSize );
+    if ( _scheduler == SCHEDULER_DEFAULT )
+    {
+        _scheduler = SCHEDULER_PRIORITY_QUEUE;
+
+        const char* value = ::getenv(OSGEARTH_ENV_TASK_SCHEDULER);
+        if ( value && ciEquals(value, "work_stealing") )
+            _scheduler = SCHEDULER_WORK_STEALING;
+    }
+
+    if ( _scheduler == SCHEDULER_WORK_STEALING )
+    {
+        // one slot per thread; setNumThreads keeps the two in step.
+        _wsQueue = new WorkStealingTaskQueue( osg::maximum(numThreads, 1), maxSize );
+    }
+    else
+    {
+        _queue = new TaskRequestQueue( maxSize );
+    }
+
     setNumThreads( numThreads );
 }
 
 unsigned int
 TaskService::getNumRequests() const
 {
-    return _queue->getNumRequests();
+    return _wsQueue.valid() ? _wsQueue->getNumRequests() : _queue->getNumRequests();
 }
 
 void
 TaskService::add( TaskRequest* request )
 {   
     //OE_INFO << LC << "TS [" << _name << "] adding request [" << request->getName() << "]" << std::endl;
-    _queue->add( request );
+    if ( _wsQueue.valid() )
+        _wsQueue->add( request );
+    else
+        _queue->add( request );
+}
+
+bool
+TaskService::getThreadStats( std::vector<ThreadStats>& out ) const
+{
+    out.clear();
+    if ( !_wsQueue.valid() )
+        return false;
+
+    _wsQueue->getStats( out );
+    return true;
+}
+
+TaskThread*
+TaskService::createThread()
+{
+    if ( !_wsQueue.valid() )
+        return new TaskThread( _queue.get() );
+
+    // bind the new thread to the slot with the fewest live workers.
+    std::vector<unsigned> workers( _wsQueue->getNumSlots(), 0u );
+    for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
+    {
+        if ( !(*i)->getDone() )
+            workers[(*i)->getSlot() % workers.size()]++;
+    }
+
+    unsigned slot = 0u;
+    for(unsigned s=1; s<workers.size(); ++s)
+    {
+        if ( workers[s] < workers[slot] )
+            slot = s;
+    }
+
+    return new TaskThread( _wsQueue.get(), slot );
 }
 
 void TaskService::waitforThreadsToComplete()
@@ -327,7 +683,10 @@ bool TaskService::areThreadsRunning()
 
 TaskService::~TaskService()
 {
-    _queue->setDone();
+    if ( _wsQueue.valid() )
+        _wsQueue->setDone();
+    else
+        _queue->setDone();
 
     for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
     {
@@ -344,13 +703,17 @@ TaskService::~TaskService()
 int
 TaskService::getStamp() const
 {
-    return _queue->getStamp();
+    return _wsQueue.valid() ? _wsQueue->getStamp() : _queue->getStamp();
 }
 
 void
 TaskService::setStamp( int stamp )
 {
-    _queue->setStamp( stamp );
+    if ( _wsQueue.valid() )
+        _wsQueue->setStamp( stamp );
+    else
+        _queue->setStamp( stamp );
+
     //Remove finished threads every 60 frames
     if (stamp - _lastRemoveFinishedThreadsStamp > 60)
     {
@@ -371,6 +734,12 @@ TaskService::setNumThreads(int numThreads )
     if ( _numThreads != numThreads )
     {
         _numThreads = osg::maximum(1, numThreads);
+
+        // resize the slots first, so new threads get their own slot and
+        // work waiting in dropped slots moves to slots that keep an owner.
+        if ( _wsQueue.valid() )
+            _wsQueue->setNumSlots( _numThreads );
+
         adjustThreadCount();
     }
 }
@@ -393,7 +762,7 @@ TaskService::adjustThreadCount()
         //We need to add some threads
         for (int i = 0; i < diff; ++i)
         {
-            TaskThread* thread = new TaskThread( _queue.get() );
+            TaskThread* thread = createThread();
             _threads.push_back( thread );
             thread->start();
         }       
@@ -403,14 +772,18 @@ TaskService::adjustThreadCount()
         diff = osg::absolute( diff );
         OE_DEBUG << LC << "Removing " << diff << " threads from TaskService " << std::endl;
         int numRemoved = 0;
-        //We need to remove some threads
-        for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
+        //We need to remove some threads. With work stealing, retire the
+        //threads whose slots were dropped first.
+        for(int pass = _wsQueue.valid() ? 0 : 1; pass < 2 && numRemoved < diff; ++pass)
         {
-            if (!(*i)->getDone())
+            for( TaskThreads::iterator i = _threads.begin(); i != _threads.end(); i++ )
             {
-                (*i)->setDone( true );
-                numRemoved++;
-                if (numRemoved == diff) break;
+                if (!(*i)->getDone() && (pass == 1 || (*i)->getSlot() >= _wsQueue->getNumSlots()))
+                {
+                    (*i)->setDone( true );
+                    numRemoved++;
+                    if (numRemoved == diff) break;
+                }
             }
         }
     }  
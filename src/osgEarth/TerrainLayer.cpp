@@ -304,6 +304,9 @@ TerrainLayer::open()
         if ( l2CacheSize > 0 )
         {
             _memCache = new MemCache( l2CacheSize );
+
+            // Optionally cap the L2 bins by memory instead of record count.
+            _memCache->setMaxBinBytesFromEnvironment();
         }
 
         // create the unique cache ID for the cache bin.
@@ -22,6 +22,7 @@
 #include <osgEarth/Metrics>
 
 #include <osg/Texture2D>
+#include <OpenThreads/Atomic>
 
 #define LC "[TerrainTileModelFactory] "
 
@@ -37,6 +38,12 @@ _heightFieldCache( true, 128 )
 
     // Create an empty texture that we can use as a placeholder
     _emptyTexture = new osg::Texture2D(ImageUtils::createEmptyImage());
+
+    if (_options.layerFetchThreads().get() > 0u)
+    {
+        _fetchService = new TaskService("TerrainTileModelFactory", _options.layerFetchThreads().get());
+        OE_INFO << LC << "Fetching tile layers on " << _options.layerFetchThreads().get() << " threads" << std::endl;
+    }
 }
 
 TerrainTileModel*
@@ -51,6 +58,12 @@ TerrainTileModelFactory::createTileModel(const Map*                       map,
         key,
         map->getDataModelRevision() );
 
+    if (_fetchService.valid())
+    {
+        createTileModelParallel(model.get(), map, key, filter, requirements, progress);
+        return model.release();
+    }
+
     // assemble all the components:
     addColorLayers(model.get(), map, requirements, key, filter, progress);
 
@@ -67,6 +80,147 @@ TerrainTileModelFactory::createTileModel(const Map*                       map,
     return model.release();
 }
 
+namespace
+{
+    /**
+     * Progress callback for one concurrent layer fetch. The tile's own
+     * callback is not thread-safe, so the pool threads never touch it: the
+     * calling thread polls it while it waits and passes a cancelation down,
+     * and folds each fetch's cancelation and stats back up after the join.
+     */
+    class LayerFetchProgress : public ProgressCallback
+    {
+    public:
+        LayerFetchProgress(const ProgressCallback* parent)
+        {
+            if (parent)
+                collectStats() = parent->collectStats();
+        }
+
+        void cancel()
+        {
+            _canceledFlag.exchange(1);
+        }
+
+        bool isCanceled()
+        {
+            return _canceledFlag != 0;
+        }
+
+    private:
+        OpenThreads::Atomic _canceledFlag;
+    };
+}
+
+//! Task that fetches one color layer on the factory's fetch pool.
+struct TerrainTileModelFactory::FetchColorLayer
+{
+    const TerrainTileModelFactory* _factory;
+    ColorLayerFetch*               _fetch;
+    const TileKey*                 _key;
+
+    void execute()
+    {
+        ProgressCallback* progress = _fetch->_progress.get();
+        if (progress && progress->isCanceled())
+            return;
+
+        _factory->fetchColorLayer(*_fetch, *_key, progress);
+    }
+};
+
+void
+TerrainTileModelFactory::createTileModelParallel(TerrainTileModel*                model,
+                                                 const Map*                       map,
+                                                 const TileKey&                   key,
+                                                 const CreateTileModelFilter&     filter,
+                                                 const TerrainEngineRequirements* requirements,
+                                                 ProgressCallback*                progress)
+{
+    OE_START_TIMER(fetch_image_layers);
+
+    ColorLayerFetches fetches;
+    gatherColorLayers(map, key, filter, fetches);
+
+    int numTasks = 0;
+    for (ColorLayerFetches::const_iterator i = fetches.begin(); i != fetches.end(); ++i)
+    {
+        if (i->_fetch)
+            ++numTasks;
+    }
+
+    // Dispatch the image layers to the pool. The fetch vector is fully built
+    // at this point so the addresses handed to the tasks stay valid.
+    Threading::MultiEvent done(numTasks);
+
+    for (ColorLayerFetches::iterator i = fetches.begin(); i != fetches.end(); ++i)
+    {
+        if (i->_fetch)
+        {
+            i->_progress = new LayerFetchProgress(progress);
+
+            ParallelTask<FetchColorLayer>* task = new ParallelTask<FetchColorLayer>(&done);
+            task->_factory = this;
+            task->_fetch = &(*i);
+            task->_key = &key;
+            _fetchService->add(task);
+        }
+    }
+
+    // Meanwhile, do the rest of the work on this thread:
+    addPatchLayers(model, map, key, filter, progress);
+
+    if ( requirements == 0L || requirements->elevationTexturesRequired() )
+    {
+        unsigned border = requirements->elevationBorderRequired() ? 1u : 0u;
+
+        addElevation( model, map, key, filter, border, progress );
+    }
+
+    if (numTasks > 0)
+    {
+        // Poll the tile's callback while we wait, and pass a cancelation on
+        // to the fetches still in flight.
+        bool canceled = false;
+        while (!done.wait(10u))
+        {
+            if (!canceled && progress && progress->isCanceled())
+            {
+                canceled = true;
+                for (ColorLayerFetches::iterator i = fetches.begin(); i != fetches.end(); ++i)
+                {
+                    if (i->_progress.valid())
+                        i->_progress->cancel();
+                }
+            }
+        }
+    }
+
+    if (progress)
+    {
+        // fold the per-layer results back into the tile's callback:
+        for (ColorLayerFetches::const_iterator i = fetches.begin(); i != fetches.end(); ++i)
+        {
+            if (i->_progress.valid())
+            {
+                // a recoverable failure in any layer means the tile must
+                // be tried again later, same as in the serial path.
+                if (i->_progress->isCanceled())
+                    progress->cancel();
+
+                ProgressCallback::Stats& stats = i->_progress->stats();
+                for (ProgressCallback::Stats::const_iterator s = stats.begin(); s != stats.end(); ++s)
+                    progress->stats()[s->first] += s->second;
+            }
+        }
+    }
+
+    assembleColorLayers(model, requirements, key, fetches);
+
+    if (progress)
+        progress->stats()["fetch_imagery_time"] += OE_STOP_TIMER(fetch_image_layers);
+}
+
 void
 TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
                                         const Map* map,
@@ -77,11 +231,32 @@ TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
 {
     OE_START_TIMER(fetch_image_layers);
 
-    int order = 0;
+    ColorLayerFetches fetches;
+    gatherColorLayers(map, key, filter, fetches);
 
+    for (ColorLayerFetches::iterator i = fetches.begin(); i != fetches.end(); ++i)
+    {
+        if (i->_fetch)
+            fetchColorLayer(*i, key, progress);
+    }
+
+    assembleColorLayers(model, reqs, key, fetches);
+
+    if (progress)
+        progress->stats()["fetch_imagery_time"] += OE_STOP_TIMER(fetch_image_layers);
+}
+
+void
+TerrainTileModelFactory::gatherColorLayers(const Map*                   map,
+                                           const TileKey&               key,
+                                           const CreateTileModelFilter& filter,
+                                           ColorLayerFetches&           fetches) const
+{
     LayerVector layers;
     map->getLayers(layers);
 
+    fetches.reserve(layers.size());
+
     for (LayerVector::const_iterator i = layers.begin(); i != layers.end(); ++i)
     {
         Layer* layer = i->get();
@@ -95,33 +270,56 @@ TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
         if (!filter.accept(layer))
             continue;
 
-        ImageLayer* imageLayer = dynamic_cast<ImageLayer*>(layer);
-        if (imageLayer)
+        fetches.push_back(ColorLayerFetch());
+        ColorLayerFetch& fetch = fetches.back();
+        fetch._layer = layer;
+        fetch._imageLayer = dynamic_cast<ImageLayer*>(layer);
+        fetch._fetch =
+            fetch._imageLayer &&
+            fetch._imageLayer->isKeyInLegalRange(key) &&
+            fetch._imageLayer->mayHaveData(key);
+    }
+}
+
+void
+TerrainTileModelFactory::fetchColorLayer(ColorLayerFetch&  fetch,
+                                         const TileKey&    key,
+                                         ProgressCallback* progress) const
+{
+    ImageLayer* imageLayer = fetch._imageLayer;
+
+    if (imageLayer->useCreateTexture())
+    {
+        fetch._texture = imageLayer->createTexture( key, progress, fetch._matrix );
+    }
+
+    else
+    {
+        GeoImage geoImage = imageLayer->createImage( key, progress );
+
+        if ( geoImage.valid() )
         {
-            osg::Texture* tex = 0L;
-            osg::Matrixf textureMatrix;
+            if ( imageLayer->isCoverage() )
+                fetch._texture = createCoverageTexture(geoImage.getImage(), imageLayer);
+            else
+                fetch._texture = createImageTexture(geoImage.getImage(), imageLayer);
+        }
+    }
+}
 
-            if (imageLayer->isKeyInLegalRange(key) && imageLayer->mayHaveData(key))
-            {
-                if (imageLayer->useCreateTexture())
-                {
-                    tex = imageLayer->createTexture( key, progress, textureMatrix );
-                }
+void
+TerrainTileModelFactory::assembleColorLayers(TerrainTileModel*                model,
+                                             const TerrainEngineRequirements* reqs,
+                                             const TileKey&                   key,
+                                             ColorLayerFetches&               fetches) const
+{
+    for (ColorLayerFetches::iterator i = fetches.begin(); i != fetches.end(); ++i)
+    {
+        ImageLayer* imageLayer = i->_imageLayer;
+        if (imageLayer)
+        {
+            osg::Texture* tex = i->_texture.get();
 
-                else
-                {
-                    GeoImage geoImage = imageLayer->createImage( key, progress );
-           
-                    if ( geoImage.valid() )
-                    {
-                        if ( imageLayer->isCoverage() )
-                            tex = createCoverageTexture(geoImage.getImage(), imageLayer);
-                        else
-                            tex = createImageTexture(geoImage.getImage(), imageLayer);
-                    }
-                }
-            }
-        
             // if this is the first LOD, and the engine requires that the first LOD
             // be populated, make an empty texture if we didn't get one.
             if (tex == 0L &&
@@ -140,7 +338,7 @@ TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
                 layerModel->setImageLayer(imageLayer);
 
                 layerModel->setTexture(tex);
-                layerModel->setMatrix(new osg::RefMatrixf(textureMatrix));
+                layerModel->setMatrix(new osg::RefMatrixf(i->_matrix));
 
                 model->colorLayers().push_back(layerModel);
 
@@ -159,13 +357,10 @@ TerrainTileModelFactory::addColorLayers(TerrainTileModel* model,
         else // non-image kind of TILE layer:
         {
             TerrainTileColorLayerModel* colorModel = new TerrainTileColorLayerModel();
-            colorModel->setLayer(layer);
+            colorModel->setLayer(i->_layer.get());
             model->colorLayers().push_back(colorModel);
         }
     }
-
-    if (progress)
-        progress->stats()["fetch_imagery_time"] += OE_STOP_TIMER(fetch_image_layers);
 }
 
 
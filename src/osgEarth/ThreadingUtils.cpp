@@ -134,6 +134,14 @@ bool MultiEvent::wait()
     return true;
 }
 
+bool MultiEvent::wait(unsigned timeout_ms)
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_m);
+    if (_set > 0)
+        _cond.wait(&_m, timeout_ms);
+    return _set == 0;
+}
+
 bool MultiEvent::waitAndReset()
 {
     OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_m);
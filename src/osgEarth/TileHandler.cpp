@@ -20,7 +20,14 @@
 * along with this program.  If not, see <http://www.gnu.org/licenses/>
 */
 #include <osgEarth/TileHandler>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/HeightFieldUtils>
+#include <osg/Image>
+#include <osg/Shape>
+#include <algorithm>
+#include <cstring>
 
+#define LC "[TileHandler] "
 
 using namespace osgEarth;
 
@@ -38,3 +45,74 @@ std::string TileHandler::getProcessString() const
 {
     return "";
 }
+
+//........................................................................
+
+osg::ref_ptr<osg::Object> PyramidTileHandler::createParentTile(const TileKey& key, osg::Object* children[4])
+{
+    // the first child decides what kind of tile to make.
+    osg::Image* firstImage = 0L;
+    osg::HeightField* firstHF = 0L;
+    for (unsigned i = 0; i < 4 && !firstImage && !firstHF; ++i)
+    {
+        firstImage = dynamic_cast<osg::Image*>(children[i]);
+        firstHF = dynamic_cast<osg::HeightField*>(children[i]);
+    }
+
+    if (firstImage)
+    {
+        osg::ref_ptr<osg::Image> parent = new osg::Image();
+        parent->allocateImage(
+            firstImage->s(), firstImage->t(), 1,
+            firstImage->getPixelFormat(), firstImage->getDataType(), firstImage->getPacking());
+        parent->setInternalTextureFormat(firstImage->getInternalTextureFormat());
+        ImageUtils::markAsUnNormalized(parent.get(), ImageUtils::isUnNormalized(firstImage));
+
+        // quadrants without a child stay transparent.
+        ::memset(parent->data(), 0, parent->getTotalSizeInBytes());
+
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            osg::Image* child = dynamic_cast<osg::Image*>(children[q]);
+            if (child && !ImageUtils::downsampleIntoQuadrant(parent.get(), child, q))
+            {
+                OE_WARN << LC << "Tile " << key.createChildKey(q).str() << " doesn't match its siblings; skipping it" << std::endl;
+            }
+        }
+        return parent.get();
+    }
+
+    if (firstHF)
+    {
+        osg::ref_ptr<osg::HeightField> parent = new osg::HeightField();
+        parent->allocate(firstHF->getNumColumns(), firstHF->getNumRows());
+        parent->setBorderWidth(firstHF->getBorderWidth());
+
+        const GeoExtent& ex = key.getExtent();
+        parent->setOrigin(osg::Vec3d(ex.xMin(), ex.yMin(), 0.0));
+        parent->setXInterval(ex.width() / (double)osg::maximum(parent->getNumColumns()-1, 1u));
+        parent->setYInterval(ex.height() / (double)osg::maximum(parent->getNumRows()-1, 1u));
+
+        // quadrants without a child have no data.
+        osg::FloatArray* heights = parent->getFloatArray();
+        std::fill(heights->begin(), heights->end(), NO_DATA_VALUE);
+
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            osg::HeightField* child = dynamic_cast<osg::HeightField*>(children[q]);
+            if (child && !HeightFieldUtils::downsampleIntoQuadrant(parent.get(), child, q))
+            {
+                OE_WARN << LC << "Tile " << key.createChildKey(q).str() << " doesn't match its siblings; skipping it" << std::endl;
+            }
+        }
+        return parent.get();
+    }
+
+    return 0L;
+}
+
+bool PyramidTileHandler::handleTile(const TileKey& key, const TileVisitor& tv)
+{
+    osg::ref_ptr<osg::Object> tile = createTile(key);
+    return tile.valid();
+}
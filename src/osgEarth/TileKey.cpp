@@ -45,18 +45,14 @@ TileKey::TileKey(unsigned int lod, unsigned int tile_x, unsigned int tile_y, con
         double ymin = ymax - height;
 
         _extent = GeoExtent( _profile->getSRS(), xmin, ymin, xmax, ymax );
-
-        _key = Stringify() << _lod << "/" << _x << "/" << _y;
     }
     else
     {
         _extent = GeoExtent::INVALID;
-        _key = "invalid";
     }
 }
 
 TileKey::TileKey( const TileKey& rhs ) :
-_key( rhs._key ),
 _lod(rhs._lod),
 _x(rhs._x),
 _y(rhs._y),
@@ -66,6 +62,57 @@ _extent( rhs._extent )
     //NOP
 }
 
+std::string
+TileKey::str() const
+{
+    if ( !valid() )
+        return "invalid";
+
+    return Stringify() << _lod << "/" << _x << "/" << _y;
+}
+
+namespace
+{
+    // spreads the low 29 bits of v out to the even bits of the result.
+    inline unsigned long long spreadBits(unsigned v)
+    {
+        unsigned long long x = v & 0x1FFFFFFFu;
+        x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+        x = (x | (x <<  8)) & 0x00FF00FF00FF00FFULL;
+        x = (x | (x <<  4)) & 0x0F0F0F0F0F0F0F0FULL;
+        x = (x | (x <<  2)) & 0x3333333333333333ULL;
+        x = (x | (x <<  1)) & 0x5555555555555555ULL;
+        return x;
+    }
+}
+
+unsigned long long
+TileKey::getCode() const
+{
+    return
+        ((unsigned long long)(_lod & 0x3Fu) << 58) |
+        spreadBits(_x) |
+        (spreadBits(_y) << 1);
+}
+
+std::size_t
+TileKey::hash() const
+{
+    // invalid keys are all equal, whatever their indices
+    if ( !valid() )
+        return 0u;
+
+    // mix in the whole indices (not just the packed bits) and finish with
+    // the MurmurHash3 64-bit finalizer.
+    unsigned long long h = getCode() ^ ((unsigned long long)(_x >> 29) << 32) ^ ((unsigned long long)(_y >> 29) << 40);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return (std::size_t)h;
+}
+
 const Profile*
 TileKey::getProfile() const
 {
@@ -268,6 +268,9 @@ TileSource::open(const Mode&           openMode,
         if ( l2CacheSize > 0 )
         {
             _memCache = new MemCache( l2CacheSize );
+
+            // Optionally cap the L2 bins by memory instead of record count.
+            _memCache->setMaxBinBytesFromEnvironment();
         }
 
         // Initialize the underlying data store
@@ -19,6 +19,7 @@
 #include <osgEarth/TileVisitor>
 #include <osgEarth/CacheEstimator>
 #include <osgEarth/FileUtils>
+#include <fstream>
 
 #if OSG_VERSION_GREATER_OR_EQUAL(3,5,10)
 #include <osg/os_utils>
@@ -283,6 +284,365 @@ bool MultithreadedTileVisitor::handleTile( const TileKey& key )
 
 /*****************************************************************************************/
 
+/**
+ * A TaskRequest that builds (or reads back) one subtree of a pyramid.
+ */
+class PyramidTileVisitor::SubtreeTask : public TaskRequest
+{
+public:
+    SubtreeTask( PyramidTileVisitor* visitor, const TileKey& key, Threading::MultiEvent* done ):
+      _visitor( visitor ),
+      _key( key ),
+      _done( done ),
+      _count( 0 ),
+      _resumed( false )
+      {
+      }
+
+      virtual void operator()(ProgressCallback* progress )
+      {
+          std::map<TileKey, unsigned int>::const_iterator i = _visitor->_checkpoint.find( _key );
+          if (i != _visitor->_checkpoint.end())
+          {
+              _tile = _visitor->_handler->readTile( _key );
+              _visitor->incrementProgress( i->second );
+              _resumed = true;
+          }
+          else
+          {
+              _tile = _visitor->buildTile( _key, _count );
+          }
+          _done->notify();
+      }
+
+      PyramidTileVisitor* _visitor;
+      TileKey _key;
+      Threading::MultiEvent* _done;
+      osg::ref_ptr<osg::Object> _tile;
+      unsigned int _count;
+      bool _resumed;
+};
+
+PyramidTileVisitor::PyramidTileVisitor():
+_numThreads( OpenThreads::GetNumberOfProcessors() ),
+_subtreeLevels( 6 ),
+_subtreeLevel( 0 ),
+_batchLevel( 0 )
+{
+    // see MultithreadedTileVisitor
+    osgDB::ObjectWrapper* wrapper = osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper( "osg::Image" );
+}
+
+PyramidTileVisitor::PyramidTileVisitor( TileHandler* handler ):
+TileVisitor( handler ),
+_numThreads( OpenThreads::GetNumberOfProcessors() ),
+_subtreeLevels( 6 ),
+_subtreeLevel( 0 ),
+_batchLevel( 0 )
+{
+    // see MultithreadedTileVisitor
+    osgDB::ObjectWrapper* wrapper = osgDB::Registry::instance()->getObjectWrapperManager()->findWrapper( "osg::Image" );
+}
+
+unsigned int PyramidTileVisitor::getNumThreads() const
+{
+    return _numThreads;
+}
+
+void PyramidTileVisitor::setNumThreads( unsigned int numThreads )
+{
+    _numThreads = numThreads;
+}
+
+unsigned int PyramidTileVisitor::getSubtreeLevels() const
+{
+    return _subtreeLevels;
+}
+
+void PyramidTileVisitor::setSubtreeLevels( unsigned int levels )
+{
+    _subtreeLevels = osg::maximum( levels, 1u );
+}
+
+const std::string& PyramidTileVisitor::getCheckpointFile() const
+{
+    return _checkpointFile;
+}
+
+void PyramidTileVisitor::setCheckpointFile( const std::string& filename )
+{
+    _checkpointFile = filename;
+}
+
+void PyramidTileVisitor::run( const Profile* mapProfile )
+{
+    _handler = dynamic_cast<PyramidTileHandler*>( _tileHandler.get() );
+    if (!_handler.valid())
+    {
+        OE_WARN << "[PyramidTileVisitor] The tile handler can't build pyramids; visiting every level instead" << std::endl;
+        TileVisitor::run( mapProfile );
+        return;
+    }
+
+    if (_maxLevel > 30)
+    {
+        OE_WARN << "[PyramidTileVisitor] Set a max level to build a pyramid" << std::endl;
+        return;
+    }
+
+    _profile = mapProfile;
+
+    resetProgress();
+    estimate();
+    readCheckpoint();
+
+    // Subtrees hang from this level, down to the max level.
+    _subtreeLevel = _maxLevel+1 > _subtreeLevels ? _maxLevel+1 - _subtreeLevels : 0;
+
+    // Each key at the batch level hands its subtrees to the threads all at
+    // once; aim for a few per thread. Their roots wait in memory until the
+    // whole batch is done and the tiles above them can be built.
+    _batchLevel = _subtreeLevel;
+    for (unsigned int n = 1; n < 2*_numThreads && _batchLevel > 0; n *= 4)
+    {
+        --_batchLevel;
+    }
+
+    if (_numThreads > 1)
+    {
+        _taskService = new TaskService( "PyramidTileVisitor", _numThreads );
+    }
+
+    std::vector<TileKey> keys;
+    mapProfile->getRootKeys(keys);
+
+    for (unsigned int i = 0; i < keys.size(); ++i)
+    {
+        osg::ref_ptr<osg::Object> tile = buildUpperTile( keys[i], 0L );
+    }
+
+    if (_taskService.valid())
+    {
+        _taskService->add( new PoisonPill() );
+        while (_taskService->areThreadsRunning())
+        {
+            OpenThreads::Thread::microSleep(10000);
+        }
+        _taskService = 0L;
+    }
+
+    _handler->flush();
+    _handler = 0L;
+}
+
+bool PyramidTileVisitor::isVisible( const TileKey& key )
+{
+    return
+        !(_progress.valid() && _progress->isCanceled()) &&
+        intersects( key.getExtent() ) &&
+        _handler->hasData( key );
+}
+
+osg::ref_ptr<osg::Object> PyramidTileVisitor::buildTile( const TileKey& key, unsigned int& count )
+{
+    if (!isVisible(key))
+        return 0L;
+
+    if (key.getLevelOfDetail() >= _maxLevel)
+    {
+        osg::ref_ptr<osg::Object> tile = _handler->createTile( key );
+        if (tile.valid() && key.getLevelOfDetail() >= _minLevel)
+        {
+            incrementProgress(1);
+            ++count;
+        }
+        return tile;
+    }
+
+    // depth first, so only four tiles per level are alive at once.
+    osg::ref_ptr<osg::Object> children[4];
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        children[i] = buildTile( key.createChildKey(i), count );
+    }
+
+    return createParentTile( key, children, count );
+}
+
+osg::ref_ptr<osg::Object> PyramidTileVisitor::createParentTile( const TileKey& key, osg::ref_ptr<osg::Object> children[4], unsigned int& count )
+{
+    // nobody needs tiles above the min level.
+    if (key.getLevelOfDetail() < _minLevel)
+        return 0L;
+
+    if (!children[0].valid() && !children[1].valid() && !children[2].valid() && !children[3].valid())
+        return 0L;
+
+    osg::Object* raw[4] = { children[0].get(), children[1].get(), children[2].get(), children[3].get() };
+    osg::ref_ptr<osg::Object> tile = _handler->createParentTile( key, raw );
+    if (tile.valid() && _handler->storeParentTile( key, tile.get() ))
+    {
+        incrementProgress(1);
+        ++count;
+    }
+    return tile;
+}
+
+osg::ref_ptr<osg::Object> PyramidTileVisitor::buildUpperTile( const TileKey& key, const TileMap* subtrees )
+{
+    if (!isVisible(key))
+        return 0L;
+
+    unsigned int lod = key.getLevelOfDetail();
+
+    if (lod == _subtreeLevel)
+    {
+        if (subtrees)
+        {
+            TileMap::const_iterator i = subtrees->find( key );
+            if (i != subtrees->end())
+                return i->second;
+            return 0L;
+        }
+        return buildSubtree( key );
+    }
+
+    if (lod == _batchLevel && !subtrees && _taskService.valid())
+    {
+        return buildSubtrees( key );
+    }
+
+    osg::ref_ptr<osg::Object> children[4];
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        children[i] = buildUpperTile( key.createChildKey(i), subtrees );
+    }
+
+    unsigned int count = 0;
+    return createParentTile( key, children, count );
+}
+
+osg::ref_ptr<osg::Object> PyramidTileVisitor::buildSubtree( const TileKey& key )
+{
+    std::map<TileKey, unsigned int>::const_iterator i = _checkpoint.find( key );
+    if (i != _checkpoint.end())
+    {
+        incrementProgress( i->second );
+        return _handler->readTile( key );
+    }
+
+    unsigned int count = 0;
+    osg::ref_ptr<osg::Object> tile = buildTile( key, count );
+
+    if (!(_progress.valid() && _progress->isCanceled()))
+    {
+        _handler->flush();
+        writeCheckpoint( key, count );
+    }
+
+    return tile;
+}
+
+osg::ref_ptr<osg::Object> PyramidTileVisitor::buildSubtrees( const TileKey& key )
+{
+    std::vector<TileKey> keys;
+    collectSubtrees( key, keys );
+
+    Threading::MultiEvent done( keys.size() );
+    std::vector< osg::ref_ptr<SubtreeTask> > tasks;
+    for (unsigned int i = 0; i < keys.size(); ++i)
+    {
+        tasks.push_back( new SubtreeTask(this, keys[i], &done) );
+        _taskService->add( tasks.back().get() );
+    }
+
+    if (!tasks.empty())
+    {
+        done.wait();
+    }
+
+    bool canceled = _progress.valid() && _progress->isCanceled();
+    if (!canceled)
+    {
+        _handler->flush();
+    }
+
+    TileMap subtrees;
+    for (unsigned int i = 0; i < tasks.size(); ++i)
+    {
+        subtrees[ tasks[i]->_key ] = tasks[i]->_tile.get();
+        if (!tasks[i]->_resumed && !canceled)
+        {
+            writeCheckpoint( tasks[i]->_key, tasks[i]->_count );
+        }
+    }
+    tasks.clear();
+
+    // the tiles between the subtrees and this key.
+    return buildUpperTile( key, &subtrees );
+}
+
+void PyramidTileVisitor::collectSubtrees( const TileKey& key, std::vector<TileKey>& out )
+{
+    if (!isVisible(key))
+        return;
+
+    if (key.getLevelOfDetail() == _subtreeLevel)
+    {
+        out.push_back( key );
+        return;
+    }
+
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        collectSubtrees( key.createChildKey(i), out );
+    }
+}
+
+void PyramidTileVisitor::readCheckpoint()
+{
+    _checkpoint.clear();
+    if (_checkpointFile.empty())
+        return;
+
+    std::ifstream in( _checkpointFile.c_str(), std::ios::in );
+
+    std::string line;
+    while( getline(in, line) )
+    {
+        std::vector< std::string > parts;
+        StringTokenizer(line, parts, "," );
+
+        if (parts.size() >= 4)
+        {
+            TileKey key(
+                as<unsigned int>(parts[0], 0u),
+                as<unsigned int>(parts[1], 0u),
+                as<unsigned int>(parts[2], 0u),
+                _profile.get() );
+
+            _checkpoint[key] = as<unsigned int>(parts[3], 0u);
+        }
+    }
+
+    if (!_checkpoint.empty())
+    {
+        OE_NOTICE << "[PyramidTileVisitor] Resuming; " << _checkpoint.size() << " subtrees are already done" << std::endl;
+    }
+}
+
+void PyramidTileVisitor::writeCheckpoint( const TileKey& key, unsigned int count )
+{
+    if (_checkpointFile.empty())
+        return;
+
+    // one line per subtree: lod, x, y, tiles stored
+    std::ofstream out( _checkpointFile.c_str(), std::ios::app );
+    out << key.getLevelOfDetail() << ", " << key.getTileX() << ", " << key.getTileY() << ", " << count << std::endl;
+}
+
+/*****************************************************************************************/
+
 TaskList::TaskList(const Profile* profile):
 _profile( profile )
 {
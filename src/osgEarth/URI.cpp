@@ -19,6 +19,7 @@
 #include <osgEarth/URI>
 #include <osgEarth/Cache>
 #include <osgEarth/Registry>
+#include <OpenThreads/Atomic>
 #include <osgEarth/FileUtils>
 #include <osgEarth/Progress>
 #include <osgDB/FileNameUtils>
@@ -354,17 +355,12 @@ namespace
 
     struct ReadObject
     {
+        const char* name() const { return "object"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_OBJECTS) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readObject(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP( const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP( const HTTPRequest& req, const URI& uri, const osgDB::Options* opt, ProgressCallback* p )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
             return HTTPClient::readObject(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -374,17 +370,12 @@ namespace
 
     struct ReadNode
     {
+        const char* name() const { return "node"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const { return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_NODES) != 0); }
         ReadResult fromCallback( URIReadCallback* cb, const std::string& uri, const osgDB::Options* opt ) { return cb->readNode(uri, opt); }
         ReadResult fromCache( CacheBin* bin, const std::string& key ) { return bin->readObject(key, 0L); }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP( const HTTPRequest& req, const URI& uri, const osgDB::Options* opt, ProgressCallback* p )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
             return HTTPClient::readNode(req, opt, p);
         }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
@@ -394,6 +385,7 @@ namespace
 
     struct ReadImage
     {
+        const char* name() const { return "image"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const {
             return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_IMAGES) != 0);
         }
@@ -407,18 +399,16 @@ namespace
             if ( r.getImage() ) r.getImage()->setFileName( key );
             return r;
         }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified ) {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
+        ReadResult fromHTTP( const HTTPRequest& req, const URI& uri, const osgDB::Options* opt, ProgressCallback* p ) {
             ReadResult r = HTTPClient::readImage(req, opt, p);
             if ( r.getImage() ) r.getImage()->setFileName( uri.full() );
             return r;
         }
+        ReadResult fromHTTPResponse( const HTTPRequest& req, const HTTPResponse& res, const URI& uri, const osgDB::Options* opt, ProgressCallback* p ) {
+            ReadResult r = HTTPClient::decodeImage(req, res, opt, p);
+            if ( r.getImage() ) r.getImage()->setFileName( uri.full() );
+            return r;
+        }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
             ReadResult r = ReadResult(osgDB::readRefImageFile(uri, opt));
             if ( r.getImage() ) r.getImage()->setFileName( uri );
@@ -428,6 +418,7 @@ namespace
 
     struct ReadString
     {
+        const char* name() const { return "string"; }
         bool callbackRequestsCaching( URIReadCallback* cb ) const {
             return !cb || ((cb->cachingSupport() & URIReadCallback::CACHE_STRINGS) != 0);
         }
@@ -437,235 +428,592 @@ namespace
         ReadResult fromCache( CacheBin* bin, const std::string& key) { 
             return bin->readString(key, 0L);
         }
-        ReadResult fromHTTP(const URI& uri, const osgDB::Options* opt, ProgressCallback* p, TimeStamp lastModified )
+        ReadResult fromHTTP( const HTTPRequest& req, const URI& uri, const osgDB::Options* opt, ProgressCallback* p )
         {
-            HTTPRequest req(uri.full());
-            req.getHeaders() = uri.context().getHeaders();
-            if (lastModified > 0)
-            {
-                req.setLastModified(lastModified);
-            }
             return HTTPClient::readString(req, opt, p);
         }
+        ReadResult fromHTTPResponse( const HTTPRequest& req, const HTTPResponse& res, const URI& uri, const osgDB::Options* opt, ProgressCallback* p )
+        {
+            return HTTPClient::decodeString(req, res, opt, p);
+        }
         ReadResult fromFile( const std::string& uri, const osgDB::Options* opt ) {
             return readStringFile(uri, opt);
         }
     };
 
     //--------------------------------------------------------------------
-    // MASTER read template function. I templatized this so we wouldn't
-    // have 4 95%-identical code paths to maintain...
+    // State behind URIReadSharing: the table of fetches in flight, the
+    // negative cache, and the counters.
 
-    template<typename READ_FUNCTOR>
-    ReadResult doRead(
-        const URI&            inputURI,
-        const osgDB::Options* dbOptions,
-        ProgressCallback*     progress)
+    struct InFlight : public osg::Referenced
     {
-        //osg::Timer_t startTime = osg::Timer::instance()->tick();
+        InFlight(const CacheBin* bin) : _bin(bin) { }
+        Threading::Event _done;
+        ReadResult       _result;
+        const CacheBin*  _bin;
+    };
 
-        ReadResult result;
+    struct Failure
+    {
+        Failure() : _code(ReadResult::RESULT_NOT_FOUND), _expires(0.0) { }
+        Failure(ReadResult::Code code, double expires) : _code(code), _expires(expires) { }
+        ReadResult::Code _code;
+        double           _expires;
+    };
 
-        if (osgEarth::Registry::instance()->isBlacklisted(inputURI.full()))
+    struct Sharing
+    {
+        Sharing() :
+            _failures( true, 4096u ),
+            _ttl     ( 30.0 )
         {
-            return result;
+            const char* ttl = ::getenv(OSGEARTH_ENV_URI_NEGATIVE_CACHE_TTL);
+            if ( ttl )
+                _ttl = osg::maximum(as<double>(ttl, 30.0), 0.0);
+
+            const char* size = ::getenv(OSGEARTH_ENV_URI_NEGATIVE_CACHE_SIZE);
+            if ( size )
+                _failures.setMaxSize(osg::maximum(as<unsigned>(size, 4096u), 1u));
         }
 
-        if ( !inputURI.empty() )
+        // True if a read of "key" failed recently (and hasn't expired).
+        bool recall(const std::string& key, ReadResult::Code& code)
         {
-            // establish our IO options:
-            osg::ref_ptr<const osgDB::Options> localOptions = dbOptions ? dbOptions : Registry::instance()->getDefaultOptions();
+            if ( _ttl <= 0.0 )
+                return false;
 
-            // if we have an option string, incorporate it.
-            if ( inputURI.optionString().isSet() )
+            LRUCache<std::string, Failure>::Record rec;
+            if ( !_failures.get(key, rec) )
+                return false;
+
+            if ( rec.value()._expires < osg::Timer::instance()->time_s() )
             {
-                osgDB::Options* newLocalOptions = Registry::cloneOrCreateOptions(localOptions.get());
-                newLocalOptions->setOptionString(
-                    inputURI.optionString().get() + " " + localOptions->getOptionString());
-                localOptions = newLocalOptions;
+                _failures.erase(key);
+                return false;
             }
 
-            READ_FUNCTOR reader;
+            code = rec.value()._code;
+            ++_negativeHits;
+            return true;
+        }
 
-            URI uri = inputURI;
+        // True if failures with this code go into the negative cache.
+        bool remembers(ReadResult::Code code) const
+        {
+            return _ttl > 0.0 && (code == ReadResult::RESULT_NOT_FOUND || code == ReadResult::RESULT_TIMEOUT);
+        }
 
-            bool gotResultFromCallback = false;
+        // Remembers a failed read if it's the kind worth remembering.
+        void remember(const std::string& key, ReadResult::Code code)
+        {
+            if ( remembers(code) )
+            {
+                _failures.insert(key, Failure(code, osg::Timer::instance()->time_s() + _ttl));
+                ++_negativeInserts;
+            }
+        }
 
-            // check if there's an alias map, and if so, attempt to resolve the alias:
-            URIAliasMap* aliasMap = URIAliasMap::from( localOptions.get() );
-            if ( aliasMap )
+        // Joins the fetch in flight for "key", or starts one (leader = true).
+        InFlight* join(const std::string& key, const CacheBin* bin, bool& leader)
+        {
+            Threading::ScopedMutexLock lock(_inFlightMutex);
+            osg::ref_ptr<InFlight>& flight = _inFlight[key];
+            leader = !flight.valid();
+            if ( leader )
             {
-                uri = aliasMap->resolve(inputURI.full(), inputURI.context());
+                flight = new InFlight(bin);
+                ++_fetches;
             }
+            else
+            {
+                ++_coalesced;
+            }
+            return flight.get();
+        }
 
-            // check if there's a URI cache in the options.
-            URIResultCache* memCache = URIResultCache::from( localOptions.get() );
-            if ( memCache )
+        // Publishes the leader's result to everyone waiting on it.
+        void land(const std::string& key, InFlight* flight, const ReadResult& result)
+        {
             {
-                URIResultCache::Record rec;
-                if ( memCache->get(uri, rec) )
-                {
-                    result = rec.value();
-                }
+                Threading::ScopedMutexLock lock(_inFlightMutex);
+                _inFlight.erase(key);
             }
+            flight->_result = result;
+            flight->_done.set();
+        }
 
-            if ( result.empty() )
+        Threading::Mutex                                  _inFlightMutex;
+        std::map< std::string, osg::ref_ptr<InFlight> >   _inFlight;
+        LRUCache<std::string, Failure>                    _failures;
+        double                                            _ttl;
+        osg::ref_ptr<URIReadSharing::Fetcher>             _fetcher;
+        OpenThreads::Atomic                               _fetches;
+        OpenThreads::Atomic                               _coalesced;
+        OpenThreads::Atomic                               _negativeHits;
+        OpenThreads::Atomic                               _negativeInserts;
+    };
+
+    Sharing s_sharing;
+
+    //--------------------------------------------------------------------
+    // MASTER read template. I templatized this so we wouldn't have 4
+    // 95%-identical code paths to maintain...
+    //
+    // The read is split around the network fetch so the asynchronous reads
+    // can hand that step to HTTPClient::getAsync: start() does everything up
+    // to the fetch and returns true if one is needed; the caller then passes
+    // the server's result to fetched(); and finish() wraps up and returns
+    // the final result.
+
+    template<typename READ_FUNCTOR>
+    class ReadOperation
+    {
+    public:
+        ReadOperation(const URI& inputURI, const osgDB::Options* dbOptions, ProgressCallback* progress) :
+            _inputURI             ( inputURI ),
+            _uri                  ( inputURI ),
+            _dbOptions            ( dbOptions ),
+            _progress             ( progress ),
+            _memCache             ( 0L ),
+            _blacklisted          ( false ),
+            _shared               ( false ),
+            _named                ( false ),
+            _recalled             ( false ),
+            _lookup               ( false ),
+            _remote               ( false ),
+            _gotResultFromCallback( false ) { }
+
+        bool start()
+        {
+            //osg::Timer_t startTime = osg::Timer::instance()->tick();
+
+            if (osgEarth::Registry::instance()->isBlacklisted(_inputURI.full()))
+            {
+                _blacklisted = true;
+                return false;
+            }
+
+            if ( !_inputURI.empty() )
             {
-                // see if there's a read callback installed.
-                URIReadCallback* cb = Registry::instance()->getURIReadCallback();
+                // establish our IO options:
+                _localOptions = _dbOptions ? _dbOptions : Registry::instance()->getDefaultOptions();
 
-                // for a local URI, bypass all the caching logic
-                if ( !uri.isRemote() )
+                // if we have an option string, incorporate it.
+                if ( _inputURI.optionString().isSet() )
                 {
-                    // try to use the callback if it's set. Callback ignores the caching policy.
-                    if ( cb )
-                    {
-                        // if this returns "not implemented" we fill fall back
-                        result = reader.fromCallback( cb, uri.full(), localOptions.get() );
+                    osgDB::Options* newLocalOptions = Registry::cloneOrCreateOptions(_localOptions.get());
+                    newLocalOptions->setOptionString(
+                        _inputURI.optionString().get() + " " + _localOptions->getOptionString());
+                    _localOptions = newLocalOptions;
+                }
 
-                        if ( result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
-                        {
-                            // "not implemented" is the only excuse to fall back.
-                            gotResultFromCallback = true;
-                        }
-                    }
+                // check if there's an alias map, and if so, attempt to resolve the alias:
+                URIAliasMap* aliasMap = URIAliasMap::from( _localOptions.get() );
+                if ( aliasMap )
+                {
+                    _uri = aliasMap->resolve(_inputURI.full(), _inputURI.context());
+                }
 
-                    if ( !gotResultFromCallback )
+                // check if there's a URI cache in the options.
+                _memCache = URIResultCache::from( _localOptions.get() );
+                if ( _memCache )
+                {
+                    URIResultCache::Record rec;
+                    if ( _memCache->get(_uri, rec) )
                     {
-                        // no callback, just read from a local file.
-                        result = reader.fromFile( uri.full(), localOptions.get() );
+                        _result = rec.value();
                     }
                 }
 
-                // remote URI, consider caching:
-                else
+                if ( _result.empty() )
                 {
-                    bool callbackCachingOK = !cb || reader.callbackRequestsCaching(cb);
+                    _lookup = true;
 
-                    optional<CachePolicy> cp;
-                    osg::ref_ptr<CacheBin> bin;
+                    // see if there's a read callback installed.
+                    URIReadCallback* cb = Registry::instance()->getURIReadCallback();
 
-                    CacheSettings* cacheSettings = CacheSettings::get(localOptions.get());
-                    if (cacheSettings)
+                    // for a local URI, bypass all the caching logic
+                    if ( !_uri.isRemote() )
                     {
-                        cp = cacheSettings->cachePolicy();
-                        if (cp->isCacheEnabled() && callbackCachingOK)
+                        // try to use the callback if it's set. Callback ignores the caching policy.
+                        if ( cb )
                         {
-                            bin = cacheSettings->getCacheBin();
+                            // if this returns "not implemented" we fill fall back
+                            _result = _reader.fromCallback( cb, _uri.full(), _localOptions.get() );
+
+                            if ( _result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
+                            {
+                                // "not implemented" is the only excuse to fall back.
+                                _gotResultFromCallback = true;
+                            }
                         }
-                    }
 
-                    bool expired = false;
-                    // first try to go to the cache if there is one:
-                    if ( bin && cp->isCacheReadable() )
-                    {
-                        result = reader.fromCache( bin.get(), uri.cacheKey() );
-                        if ( result.succeeded() )
+                        if ( !_gotResultFromCallback )
                         {
-                            expired = cp->isExpired(result.lastModifiedTime());
-                            result.setIsFromCache(true);
+                            // no callback, just read from a local file.
+                            _result = _reader.fromFile( _uri.full(), _localOptions.get() );
                         }
                     }
 
-                    // If it's not cached, or it is cached but is expired then try to hit the server.
-                    if ( result.empty() || expired )
+                    // remote URI, consider caching:
+                    else
                     {
-                        // Need to do this to support nested PLODs and Proxynodes.
-                        osg::ref_ptr<osgDB::Options> remoteOptions =
-                            Registry::instance()->cloneOrCreateOptions( localOptions.get() );
-                        remoteOptions->getDatabasePathList().push_front( osgDB::getFilePath(uri.full()) );
+                        bool callbackCachingOK = !cb || _reader.callbackRequestsCaching(cb);
 
-                        // Store the existing object from the cache if there is one.
-                        osg::ref_ptr< osg::Object > object = result.getObject();
-
-                        // try to use the callback if it's set. Callback ignores the caching policy.
-                        if ( cb )
+                        CacheSettings* cacheSettings = CacheSettings::get(_localOptions.get());
+                        if (cacheSettings)
                         {
-                            result = reader.fromCallback( cb, uri.full(), remoteOptions.get() );
+                            _cp = cacheSettings->cachePolicy();
+                            if (_cp->isCacheEnabled() && callbackCachingOK)
+                            {
+                                _bin = cacheSettings->getCacheBin();
+                            }
+                        }
 
-                            if ( result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
+                        bool expired = false;
+                        // first try to go to the cache if there is one:
+                        if ( _bin && _cp->isCacheReadable() )
+                        {
+                            _result = _reader.fromCache( _bin.get(), _uri.cacheKey() );
+                            if ( _result.succeeded() )
                             {
-                                // "not implemented" is the only excuse for falling back
-                                gotResultFromCallback = true;
+                                expired = _cp->isExpired(_result.lastModifiedTime());
+                                _result.setIsFromCache(true);
                             }
                         }
 
-                        if ( !gotResultFromCallback )
+                        // If it's not cached, or it is cached but is expired then try to hit the server.
+                        if ( _result.empty() || expired )
                         {
-                            // still no data, go to the source:
-                            if ( (result.empty() || expired) && cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
+                            // Need to do this to support nested PLODs and Proxynodes.
+                            _remoteOptions = Registry::instance()->cloneOrCreateOptions( _localOptions.get() );
+                            _remoteOptions->getDatabasePathList().push_front( osgDB::getFilePath(_uri.full()) );
+
+                            // try to use the callback if it's set. Callback ignores the caching policy.
+                            if ( cb )
                             {
-                                ReadResult remoteResult = reader.fromHTTP( uri, remoteOptions.get(), progress, result.lastModifiedTime() );
-                                if (remoteResult.code() == ReadResult::RESULT_NOT_MODIFIED)
-                                {
-                                    OE_DEBUG << LC << uri.full() << " not modified, using cached result" << std::endl;
-                                    // Touch the cached item to update it's last modified timestamp so it doesn't expire again immediately.
-                                    if (bin)
-                                        bin->touch( uri.cacheKey() );
-                                }
-                                else
+                                _result = _reader.fromCallback( cb, _uri.full(), _remoteOptions.get() );
+
+                                if ( _result.code() != ReadResult::RESULT_NOT_IMPLEMENTED )
                                 {
-                                    OE_DEBUG << LC << "Got remote result for " << uri.full() << std::endl;
-                                    result = remoteResult;
+                                    // "not implemented" is the only excuse for falling back
+                                    _gotResultFromCallback = true;
                                 }
                             }
 
-                            // Check for cancelation before a cache write
-                            if (progress && progress->isCanceled())
+                            if ( !_gotResultFromCallback )
                             {
-                                return 0L;
-                            }
+                                _remote = true;
 
-                            // write the result to the cache if possible:
-                            if ( result.succeeded() && !result.isFromCache() && bin && cp->isCacheWriteable() && bin )
-                            {
-                                OE_DEBUG << LC << "Writing " << uri.cacheKey() << " to cache" << std::endl;
-                                bin->write( uri.cacheKey(), result.getObject(), result.metadata(), remoteOptions.get() );
+                                // still no data, go to the source:
+                                if ( (_result.empty() || expired) && _cp->usage() != CachePolicy::USAGE_CACHE_ONLY )
+                                {
+                                    return true;
+                                }
                             }
                         }
                     }
                 }
+            }
+
+            return false;
+        }
+
+        HTTPRequest request() const
+        {
+            HTTPRequest req(_uri.full());
+            req.getHeaders() = _uri.context().getHeaders();
+            if (_result.lastModifiedTime() > 0)
+            {
+                req.setLastModified(_result.lastModifiedTime());
+            }
+            return req;
+        }
+
+        ReadResult fetch()
+        {
+            osg::ref_ptr<URIReadSharing::Fetcher> fetcher = URIReadSharing::getFetcher();
+            if ( fetcher.valid() )
+                return fetcher->fetch( _uri, _progress );
+
+            return _reader.fromHTTP( request(), _uri, _remoteOptions.get(), _progress );
+        }
+
+        // Identifies the resource, for the negative cache.
+        std::string resourceKey() const
+        {
+            std::string key = _uri.full();
+            const Headers& headers = _uri.context().getHeaders();
+            for (Headers::const_iterator i = headers.begin(); i != headers.end(); ++i)
+                key += "\n" + i->first + ": " + i->second;
+            return key;
+        }
+
+        // Identifies this fetch exactly, for the in-flight table.
+        std::string fetchKey() const
+        {
+            std::stringstream buf;
+            buf << _reader.name() << " " << _result.lastModifiedTime() << " " << resourceKey();
+            return buf.str();
+        }
+
+        // Checks the negative cache; on a hit, fails the way HTTPClient
+        // would, without going to the server.
+        bool recall(ReadResult& out)
+        {
+            ReadResult::Code code;
+            if ( !s_sharing.recall(resourceKey(), code) )
+                return false;
+
+            OE_DEBUG << LC << _uri.full() << " failed recently; not retrying yet" << std::endl;
+            out = ReadResult(code);
+            if ( _progress && HTTPClient::isRecoverable(code) )
+                _progress->cancel();
+            _recalled = true;
+            return true;
+        }
+
+        // Records a fetch result in the negative cache if it failed.
+        const ReadResult& remember(const ReadResult& result)
+        {
+            s_sharing.remember(resourceKey(), result.code());
+            return result;
+        }
+
+        // Fetches the resource, sharing the work with any other thread
+        // fetching the same thing at the same time.
+        ReadResult fetchShared()
+        {
+            ReadResult result;
+            if ( recall(result) )
+                return result;
+
+            std::string key = fetchKey();
+            for(;;)
+            {
+                bool leader;
+                osg::ref_ptr<InFlight> flight = s_sharing.join(key, _bin.get(), leader);
+                if ( leader )
+                {
+                    result = remember(fetch());
+
+                    // name the object before anyone else can see it; after
+                    // landing, it's shared with the other threads.
+                    if ( result.getObject() )
+                        result.getObject()->setName( _uri.base() );
+                    _named = true;
+
+                    s_sharing.land(key, flight.get(), result);
+                    return result;
+                }
 
-                // Check for cancelation before a potential cache write
-                if (progress && progress->isCanceled())
+                while ( !flight->_done.wait(100u) )
                 {
-                    return 0L;
+                    if ( _progress && _progress->isCanceled() )
+                        return ReadResult(ReadResult::RESULT_CANCELED);
                 }
 
-                if (result.getObject() && !gotResultFromCallback)
+                // the leader's cancelation is not ours; try again
+                if ( flight->_result.code() == ReadResult::RESULT_CANCELED )
+                    continue;
+
+                // fail the way the leader did
+                if ( _progress && HTTPClient::isRecoverable(flight->_result.code()) )
+                    _progress->cancel();
+
+                // the leader already named it, and wrote it to this cache bin.
+                _shared = flight->_bin == _bin.get();
+                _named = true;
+                return flight->_result;
+            }
+        }
+
+        ReadResult decode(const HTTPRequest& req, const HTTPResponse& response)
+        {
+            return _reader.fromHTTPResponse( req, response, _uri, _remoteOptions.get(), _progress );
+        }
+
+        const osgDB::Options* remoteOptions() const { return _remoteOptions.get(); }
+
+        void fetched(const ReadResult& remoteResult)
+        {
+            if (remoteResult.code() == ReadResult::RESULT_NOT_MODIFIED)
+            {
+                OE_DEBUG << LC << _uri.full() << " not modified, using cached result" << std::endl;
+                // Touch the cached item to update it's last modified timestamp so it doesn't expire again immediately.
+                if (_bin)
+                    _bin->touch( _uri.cacheKey() );
+            }
+            else
+            {
+                OE_DEBUG << LC << "Got remote result for " << _uri.full() << std::endl;
+                _result = remoteResult;
+            }
+        }
+
+        ReadResult finish()
+        {
+            if ( _blacklisted )
+            {
+                return _result;
+            }
+
+            if ( !_inputURI.empty() )
+            {
+                if ( _lookup )
                 {
-                    result.getObject()->setName( uri.base() );
+                    if ( _remote )
+                    {
+                        // Check for cancelation before a cache write
+                        if (_progress && _progress->isCanceled())
+                        {
+                            return 0L;
+                        }
+
+                        // write the result to the cache if possible:
+                        if ( _result.succeeded() && !_result.isFromCache() && !_shared && _bin && _cp->isCacheWriteable() )
+                        {
+                            OE_DEBUG << LC << "Writing " << _uri.cacheKey() << " to cache" << std::endl;
+                            _bin->write( _uri.cacheKey(), _result.getObject(), _result.metadata(), _remoteOptions.get() );
+                        }
+                    }
 
-                    if ( memCache )
+                    // Check for cancelation before a potential cache write
+                    if (_progress && _progress->isCanceled())
                     {
-                        memCache->insert( uri, result );
+                        return 0L;
                     }
-                }
 
-                // If the request failed with an unrecoverable error,
-                // blacklist so we don't waste time on it again
-                if (result.failed())
-                {
-                    osgEarth::Registry::instance()->blacklist(inputURI.full());
+                    if (_result.getObject() && !_gotResultFromCallback)
+                    {
+                        if ( !_named )
+                            _result.getObject()->setName( _uri.base() );
+
+                        if ( _memCache )
+                        {
+                            _memCache->insert( _uri, _result );
+                        }
+                    }
+
+                    // If the request failed with an unrecoverable error,
+                    // blacklist so we don't waste time on it again. (Failures that
+                    // go into the negative cache are only remembered until they expire.)
+                    if (_result.failed() &&
+                        !_recalled &&
+                        !HTTPClient::isRecoverable(_result.code()) &&
+                        !s_sharing.remembers(_result.code()))
+                    {
+                        osgEarth::Registry::instance()->blacklist(_inputURI.full());
+                    }
                 }
+
+                OE_TEST << LC
+                    << _uri.base() << ": "
+                    << (_result.succeeded() ? "OK" : "FAILED")
+                    //<< "; policy=" << cp->usageString()
+                    << (_result.isFromCache() && _result.succeeded() ? "; (from cache)" : "")
+                    << std::endl;
             }
 
-            OE_TEST << LC
-                << uri.base() << ": "
-                << (result.succeeded() ? "OK" : "FAILED")
-                //<< "; policy=" << cp->usageString()
-                << (result.isFromCache() && result.succeeded() ? "; (from cache)" : "")
-                << std::endl;
+            // post-process if there's a post-URI callback.
+            URIPostReadCallback* post = URIPostReadCallback::from(_dbOptions);
+            if ( post )
+            {
+                (*post)(_result);
+            }
+
+            return _result;
         }
 
-        // post-process if there's a post-URI callback.
-        URIPostReadCallback* post = URIPostReadCallback::from(dbOptions);
-        if ( post )
+    private:
+        READ_FUNCTOR                       _reader;
+        URI                                _inputURI;
+        URI                                _uri;
+        const osgDB::Options*              _dbOptions;
+        ProgressCallback*                  _progress;
+        osg::ref_ptr<const osgDB::Options> _localOptions;
+        osg::ref_ptr<osgDB::Options>       _remoteOptions;
+        URIResultCache*                    _memCache;
+        optional<CachePolicy>              _cp;
+        osg::ref_ptr<CacheBin>             _bin;
+        ReadResult                         _result;
+        bool                               _blacklisted;
+        bool                               _shared;
+        bool                               _named;
+        bool                               _recalled;
+        bool                               _lookup;
+        bool                               _remote;
+        bool                               _gotResultFromCallback;
+    };
+
+    template<typename READ_FUNCTOR>
+    ReadResult doRead(
+        const URI&            inputURI,
+        const osgDB::Options* dbOptions,
+        ProgressCallback*     progress)
+    {
+        ReadOperation<READ_FUNCTOR> op( inputURI, dbOptions, progress );
+        if ( op.start() )
+        {
+            op.fetched( op.fetchShared() );
+        }
+        return op.finish();
+    }
+
+    // Finishes an asynchronous read when the HTTP response arrives.
+    template<typename READ_FUNCTOR>
+    struct AsyncRead : public HTTPResponseHandler
+    {
+        AsyncRead(const URI& inputURI, const osgDB::Options* dbOptions, ProgressCallback* progress) :
+            _dbOptions( dbOptions ),
+            _progress ( progress ),
+            _op       ( inputURI, dbOptions, progress ) { }
+
+        void onResponse(const HTTPRequest& request, const HTTPResponse& response)
         {
-            (*post)(result);
+            _op.fetched( _op.remember(_op.decode(request, response)) );
+            _promise.resolve( new ReadResultObject(_op.finish()) );
         }
 
-        return result;
+        // keep these alive while the request is in flight:
+        osg::ref_ptr<const osgDB::Options>   _dbOptions;
+        osg::ref_ptr<ProgressCallback>       _progress;
+        ReadOperation<READ_FUNCTOR>          _op;
+        Threading::Promise<ReadResultObject> _promise;
+    };
+
+    template<typename READ_FUNCTOR>
+    Threading::Future<ReadResultObject> doReadAsync(
+        const URI&            inputURI,
+        const osgDB::Options* dbOptions,
+        ProgressCallback*     progress)
+    {
+        osg::ref_ptr< AsyncRead<READ_FUNCTOR> > handler = new AsyncRead<READ_FUNCTOR>( inputURI, dbOptions, progress );
+        Threading::Future<ReadResultObject> future = handler->_promise.getFuture();
+
+        ReadResult failure;
+        if ( !handler->_op.start() )
+        {
+            handler->_promise.resolve( new ReadResultObject(handler->_op.finish()) );
+        }
+        else if ( handler->_op.recall(failure) )
+        {
+            handler->_op.fetched( failure );
+            handler->_promise.resolve( new ReadResultObject(handler->_op.finish()) );
+        }
+        else if ( URIReadSharing::getFetcher() )
+        {
+            ++s_sharing._fetches;
+            handler->_op.fetched( handler->_op.remember(handler->_op.fetch()) );
+            handler->_promise.resolve( new ReadResultObject(handler->_op.finish()) );
+        }
+        else
+        {
+            ++s_sharing._fetches;
+            HTTPClient::getAsync( handler->_op.request(), handler.get(), handler->_op.remoteOptions(), progress );
+        }
+
+        return future;
     }
 }
 
@@ -697,6 +1045,84 @@ URI::readString(const osgDB::Options* dbOptions,
     return doRead<ReadString>( *this, dbOptions, progress );
 }
 
+Threading::Future<ReadResultObject>
+URI::readImageAsync(const osgDB::Options* dbOptions,
+                    ProgressCallback*     progress ) const
+{
+    return doReadAsync<ReadImage>( *this, dbOptions, progress );
+}
+
+Threading::Future<ReadResultObject>
+URI::readStringAsync(const osgDB::Options* dbOptions,
+                     ProgressCallback*     progress ) const
+{
+    return doReadAsync<ReadString>( *this, dbOptions, progress );
+}
+
+
+//------------------------------------------------------------------------
+
+URIReadSharing::Stats
+URIReadSharing::getStats()
+{
+    Stats stats;
+    stats.fetches = s_sharing._fetches;
+    stats.coalesced = s_sharing._coalesced;
+    stats.negativeHits = s_sharing._negativeHits;
+    stats.negativeInserts = s_sharing._negativeInserts;
+    return stats;
+}
+
+void
+URIReadSharing::resetStats()
+{
+    s_sharing._fetches.exchange(0u);
+    s_sharing._coalesced.exchange(0u);
+    s_sharing._negativeHits.exchange(0u);
+    s_sharing._negativeInserts.exchange(0u);
+}
+
+void
+URIReadSharing::setNegativeCacheTTL(double seconds)
+{
+    s_sharing._ttl = osg::maximum(seconds, 0.0);
+}
+
+double
+URIReadSharing::getNegativeCacheTTL()
+{
+    return s_sharing._ttl;
+}
+
+void
+URIReadSharing::setNegativeCacheMaxEntries(unsigned value)
+{
+    s_sharing._failures.setMaxSize(osg::maximum(value, 1u));
+}
+
+unsigned
+URIReadSharing::getNegativeCacheMaxEntries()
+{
+    return s_sharing._failures.getMaxSize();
+}
+
+void
+URIReadSharing::clearNegativeCache()
+{
+    s_sharing._failures.clear();
+}
+
+void
+URIReadSharing::setFetcher(Fetcher* fetcher)
+{
+    s_sharing._fetcher = fetcher;
+}
+
+URIReadSharing::Fetcher*
+URIReadSharing::getFetcher()
+{
+    return s_sharing._fetcher.get();
+}
 
 //------------------------------------------------------------------------
 
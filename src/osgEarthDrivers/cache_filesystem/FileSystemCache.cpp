@@ -27,7 +27,13 @@
 #include <osgEarth/Registry>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <OpenThreads/Thread>
+#include <OpenThreads/Condition>
 #include <fstream>
+#include <algorithm>
+#include <deque>
+#include <cstdio>
+#include <ctime>
 #include <sys/stat.h>
 
 using namespace osgEarth;
@@ -41,8 +47,133 @@ using namespace osgEarth::Threading;
 #define OSG_FORMAT "osgb"
 #define OSG_EXT   ".osgb"
 
+#define OSGEARTH_ENV_CACHE_MAX_SIZE_MB "OSGEARTH_CACHE_MAX_SIZE_MB"
+
+// Name of the usage index file in the cache root folder
+#define INDEX_FILE_NAME "osgearth_cacheindex.txt"
+
+// Maximum number of queued writes before writers fall back to writing synchronously
+#define MAX_QUEUED_WRITES 4096
+
+// Number of index changes between saves of the index file
+#define INDEX_SAVE_PERIOD 1024
+
 namespace
 {
+    class FileSystemCacheBin;
+
+    /**
+     * Tracks the size and last access time of every record in the cache
+     * so we can prune the least recently used records when the cache
+     * exceeds its maximum size. The index persists in the root folder,
+     * and loads (or, if it's missing, rebuilds) on a background thread;
+     * the cache isn't pruned until it has loaded.
+     */
+    class CacheIndex : public osg::Referenced
+    {
+    public:
+        CacheIndex( const std::string& rootPath, unsigned maxSizeMB );
+
+        /** Records a new or rewritten file along with its size on disk. */
+        void insert( const std::string& path, unsigned long long bytes );
+
+        /** Marks a file as recently used. */
+        void touch( const std::string& path );
+
+        /** Forgets a file. */
+        void remove( const std::string& path );
+
+        /** Forgets all files under a folder. */
+        void removeFolder( const std::string& folder );
+
+        /** Deletes the least recently used files if the cache is over its maximum size. */
+        void prune();
+
+        /** Whether the index has finished loading. */
+        bool isLoaded() const { return _loaded != 0; }
+
+        /** Writes the index to disk. */
+        bool save();
+
+    protected:
+        virtual ~CacheIndex();
+
+        struct Loader : public OpenThreads::Thread
+        {
+            Loader( CacheIndex* index ) : _index(index) { }
+            void run() { _index->load(); }
+            CacheIndex* _index;
+        };
+
+        void load();
+
+        std::string relativePath( const std::string& path ) const;
+
+        struct Record
+        {
+            unsigned long long _bytes;
+            TimeStamp          _lastAccess;
+        };
+        typedef std::map<std::string, Record> Records;
+
+        struct LessAccess
+        {
+            bool operator()(const std::pair<TimeStamp, Records::iterator>& lhs,
+                            const std::pair<TimeStamp, Records::iterator>& rhs) const
+            {
+                return lhs.first < rhs.first;
+            }
+        };
+
+        std::string        _rootPath;
+        std::string        _indexPath;
+        unsigned long long _maxBytes;
+        unsigned long long _totalBytes;
+        Records            _records;
+        unsigned           _changes;
+        OpenThreads::Atomic _loaded;
+        Loader*            _loader;
+        Threading::Mutex   _mutex;
+        Threading::Mutex   _pruneMutex;
+    };
+
+    /**
+     * Queue of pending cache writes, flushed to disk by one or more
+     * background threads.
+     */
+    class WriteQueue : public osg::Referenced
+    {
+    public:
+        WriteQueue( unsigned numThreads );
+
+        /** Queues a flush of a bin's pending record. Returns false if the
+         *  queue is full or stopping, in which case the caller must flush. */
+        bool push( FileSystemCacheBin* bin, const std::string& key );
+
+        /** Flushes all queued writes and shuts down the threads. */
+        void stop();
+
+    protected:
+        virtual ~WriteQueue();
+
+        struct Worker : public OpenThreads::Thread
+        {
+            Worker( WriteQueue* queue ) : _queue(queue) { }
+            void run() { _queue->run(); }
+            WriteQueue* _queue;
+        };
+
+        void run();
+
+        typedef std::pair< osg::ref_ptr<FileSystemCacheBin>, std::string > Job;
+
+        std::deque<Job>         _jobs;
+        std::vector<Worker*>    _workers;
+        Threading::Mutex        _mutex;
+        OpenThreads::Condition  _cond;
+        bool                    _done;
+    };
+
     /** 
      * Cache that stores data in the local file system.
      */
@@ -68,9 +199,14 @@ namespace
 
     protected:
 
+        virtual ~FileSystemCache();
+
         void init();
 
-        std::string _rootPath;
+        std::string                _rootPath;
+        FileSystemCacheOptions     _options;
+        osg::ref_ptr<WriteQueue>   _writeQueue;
+        osg::ref_ptr<CacheIndex>   _index;
     };
 
     /** 
@@ -80,7 +216,7 @@ namespace
     class FileSystemCacheBin : public CacheBin
     {
     public:
-        FileSystemCacheBin( const std::string& name, const std::string& rootPath );
+        FileSystemCacheBin( const std::string& name, const std::string& rootPath, WriteQueue* writeQueue, CacheIndex* index );
 
     public: // CacheBin interface
 
@@ -106,6 +242,10 @@ namespace
 
         bool writeMetadata( const Config& meta );
 
+    public:
+        /** Writes the pending record for a key to disk (called by the WriteQueue) */
+        bool flush(const std::string& key);
+
     protected:
         bool purgeDirectory( const std::string& dir );
 
@@ -115,6 +255,20 @@ namespace
 
         const osgDB::Options* mergeOptions(const osgDB::Options* in);
 
+        bool readPending(const std::string& key, ReadResult& out);
+
+        bool writeToDisk(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* dbo);
+
+        // A write that has not reached the disk yet
+        struct PendingWrite
+        {
+            osg::ref_ptr<const osg::Object>    _object;
+            Config                             _meta;
+            osg::ref_ptr<const osgDB::Options> _dbo;
+            TimeStamp                          _time;
+        };
+        typedef std::map<std::string, PendingWrite> PendingWrites;
+
         bool                              _ok;
         bool                              _binPathExists;
         std::string                       _metaPath;       // full path to the bin's metadata file
@@ -124,8 +278,18 @@ namespace
         osg::ref_ptr<osgDB::Options>      _zlibOptions;
         mutable Threading::ReadWriteMutex _mutex;
         bool                              _debug;
+        osg::observer_ptr<WriteQueue>     _writeQueue;
+        osg::ref_ptr<CacheIndex>          _index;
+        PendingWrites                     _pending;
+        Threading::Mutex                  _pendingMutex;
     };
 
+    unsigned long long fileSize( const std::string& path )
+    {
+        struct stat s;
+        return ::stat(path.c_str(), &s) == 0 ? (unsigned long long)s.st_size : 0ull;
+    }
+
     void writeMeta( const std::string& fullPath, const Config& meta )
     {
         std::ofstream outmeta( fullPath.c_str() );
@@ -163,33 +327,385 @@ namespace
 
 namespace
 {
-    FileSystemCache::FileSystemCache( const CacheOptions& options ) :
-    Cache( options )
+    CacheIndex::CacheIndex( const std::string& rootPath, unsigned maxSizeMB ) :
+    _rootPath  ( rootPath ),
+    _maxBytes  ( (unsigned long long)maxSizeMB * 1048576ull ),
+    _totalBytes( 0 ),
+    _changes   ( 0 ),
+    _loader    ( 0L )
+    {
+        _indexPath = osgDB::concatPaths( rootPath, INDEX_FILE_NAME );
+
+        // load off the calling thread, since rebuilding a missing
+        // index means scanning the whole cache folder.
+        _loader = new Loader( this );
+        _loader->start();
+    }
+
+    CacheIndex::~CacheIndex()
+    {
+        _loader->join();
+        delete _loader;
+    }
+
+    std::string
+    CacheIndex::relativePath( const std::string& path ) const
+    {
+        if ( path.length() > _rootPath.length() && path.compare(0, _rootPath.length(), _rootPath) == 0 )
+        {
+            std::string::size_type start = _rootPath.length();
+            while ( start < path.length() && (path[start] == '/' || path[start] == '\\') )
+                ++start;
+            return osgDB::convertFileNameToNativeStyle( path.substr(start) );
+        }
+        return osgDB::convertFileNameToNativeStyle( path );
+    }
+
+    void
+    CacheIndex::insert( const std::string& path, unsigned long long bytes )
     {
-        FileSystemCacheOptions fsco( options );
+        Threading::ScopedMutexLock lock( _mutex );
+        Record& rec = _records[relativePath(path)];
+        if ( rec._lastAccess != 0 )
+            _totalBytes -= rec._bytes;
+        rec._bytes = bytes;
+        rec._lastAccess = ::time(0L);
+        _totalBytes += bytes;
+        ++_changes;
+    }
+
+    void
+    CacheIndex::touch( const std::string& path )
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        Records::iterator i = _records.find( relativePath(path) );
+        if ( i != _records.end() )
+        {
+            i->second._lastAccess = ::time(0L);
+            ++_changes;
+        }
+    }
 
+    void
+    CacheIndex::remove( const std::string& path )
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        Records::iterator i = _records.find( relativePath(path) );
+        if ( i != _records.end() )
+        {
+            _totalBytes -= i->second._bytes;
+            _records.erase( i );
+            ++_changes;
+        }
+    }
+
+    void
+    CacheIndex::removeFolder( const std::string& folder )
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+
+        // concatenating an empty name appends the native path separator
+        std::string prefix = osgDB::concatPaths( relativePath(folder), std::string() );
+        Records::iterator i = _records.lower_bound( prefix );
+        while ( i != _records.end() && i->first.compare(0, prefix.length(), prefix) == 0 )
+        {
+            _totalBytes -= i->second._bytes;
+            _records.erase( i++ );
+            ++_changes;
+        }
+    }
+
+    void
+    CacheIndex::load()
+    {
+        // Read the index file if there is one; otherwise rebuild it by
+        // scanning the cache folder (one time only).
+        Records loaded;
+        std::ifstream in( _indexPath.c_str() );
+        if ( in.is_open() )
+        {
+            std::string line;
+            while ( std::getline(in, line) )
+            {
+                std::istringstream buf( line );
+                Record rec;
+                std::string path;
+                if ( buf >> rec._lastAccess >> rec._bytes && std::getline(buf >> std::ws, path) && !path.empty() )
+                {
+                    loaded[path] = rec;
+                }
+            }
+        }
+        else
+        {
+            OE_INFO << LC << "Building usage index for \"" << _rootPath << "\"" << std::endl;
+
+            CollectFilesVisitor files;
+            files.traverse( _rootPath );
+            for( std::vector<std::string>::const_iterator f = files.filenames.begin(); f != files.filenames.end(); ++f )
+            {
+                if ( osgDB::getFileExtensionIncludingDot(*f) == OSG_EXT )
+                {
+                    std::string base = osgDB::getNameLessExtension(*f);
+                    Record rec;
+                    rec._bytes = fileSize(*f) + fileSize(base + ".meta");
+                    rec._lastAccess = osgEarth::getLastModifiedTime(*f);
+                    loaded[relativePath(*f)] = rec;
+                }
+            }
+            ++_changes;
+        }
+
+        Threading::ScopedMutexLock lock( _mutex );
+
+        // records touched since startup take precedence over the loaded ones.
+        for( Records::const_iterator i = loaded.begin(); i != loaded.end(); ++i )
+        {
+            if ( _records.find(i->first) == _records.end() )
+            {
+                _records.insert( *i );
+                _totalBytes += i->second._bytes;
+            }
+        }
+        _loaded.exchange( 1 );
+    }
+
+    void
+    CacheIndex::prune()
+    {
+        if ( _maxBytes == 0 )
+            return;
+
+        // the sizes aren't known until the index has loaded.
+        if ( !isLoaded() )
+            return;
+
+        // only one thread prunes at a time; others just move on.
+        if ( _pruneMutex.trylock() != 0 )
+            return;
+
+        std::vector<std::string> victims;
+        bool doSave = false;
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            if ( _totalBytes > _maxBytes )
+            {
+                // prune down to a low-water mark so we don't prune on every write.
+                unsigned long long target = _maxBytes - _maxBytes/10;
+
+                std::vector< std::pair<TimeStamp, Records::iterator> > lru;
+                lru.reserve( _records.size() );
+                for( Records::iterator i = _records.begin(); i != _records.end(); ++i )
+                    lru.push_back( std::make_pair(i->second._lastAccess, i) );
+
+                std::sort( lru.begin(), lru.end(), LessAccess() );
+
+                for( unsigned k = 0; k < lru.size() && _totalBytes > target; ++k )
+                {
+                    Records::iterator i = lru[k].second;
+                    _totalBytes -= i->second._bytes;
+                    victims.push_back( osgDB::concatPaths(_rootPath, i->first) );
+                    _records.erase( i );
+                }
+                ++_changes;
+            }
+            doSave = _changes >= INDEX_SAVE_PERIOD || !victims.empty();
+        }
+
+        for( std::vector<std::string>::const_iterator v = victims.begin(); v != victims.end(); ++v )
+        {
+            ::unlink( v->c_str() );
+            ::unlink( (osgDB::getNameLessExtension(*v) + ".meta").c_str() );
+        }
+
+        if ( !victims.empty() )
+        {
+            OE_DEBUG << LC << "Pruned " << victims.size() << " records from \"" << _rootPath << "\"" << std::endl;
+        }
+
+        if ( doSave )
+        {
+            this->save();
+        }
+
+        _pruneMutex.unlock();
+    }
+
+    bool
+    CacheIndex::save()
+    {
+        // write to a temporary file, then swap it in so a crash
+        // never leaves a truncated index behind.
+        std::string temp = _indexPath + ".tmp";
+
+        // a partial index would hide the unscanned records from later runs.
+        if ( !isLoaded() )
+            return false;
+
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            if ( _changes == 0 )
+                return true;
+
+            std::ofstream out( temp.c_str() );
+            if ( !out.is_open() )
+                return false;
+
+            for( Records::const_iterator i = _records.begin(); i != _records.end(); ++i )
+            {
+                out << i->second._lastAccess << " " << i->second._bytes << " " << i->first << "\n";
+            }
+            out.close();
+            if ( out.fail() )
+                return false;
+
+            _changes = 0;
+        }
+
+        ::unlink( _indexPath.c_str() );
+        return ::rename( temp.c_str(), _indexPath.c_str() ) == 0;
+    }
+
+    //------------------------------------------------------------------------
+
+    WriteQueue::WriteQueue( unsigned numThreads ) :
+    _done( false )
+    {
+        for( unsigned i = 0; i < numThreads; ++i )
+        {
+            Worker* worker = new Worker( this );
+            worker->start();
+            _workers.push_back( worker );
+        }
+    }
+
+    WriteQueue::~WriteQueue()
+    {
+        stop();
+    }
+
+    bool
+    WriteQueue::push( FileSystemCacheBin* bin, const std::string& key )
+    {
+        Threading::ScopedMutexLock lock( _mutex );
+        if ( _done || _jobs.size() >= MAX_QUEUED_WRITES )
+            return false;
+
+        _jobs.push_back( Job(bin, key) );
+        _cond.signal();
+        return true;
+    }
+
+    void
+    WriteQueue::stop()
+    {
+        {
+            Threading::ScopedMutexLock lock( _mutex );
+            if ( _done )
+                return;
+            _done = true;
+            _cond.broadcast();
+        }
+
+        // workers exit once the queue is empty, so this flushes everything.
+        for( std::vector<Worker*>::iterator i = _workers.begin(); i != _workers.end(); ++i )
+        {
+            (*i)->join();
+            delete *i;
+        }
+        _workers.clear();
+    }
+
+    void
+    WriteQueue::run()
+    {
+        for(;;)
+        {
+            Job job;
+            {
+                Threading::ScopedMutexLock lock( _mutex );
+                while ( _jobs.empty() && !_done )
+                    _cond.wait( &_mutex );
+
+                if ( _jobs.empty() )
+                    return;
+
+                job = _jobs.front();
+                _jobs.pop_front();
+            }
+
+            job.first->flush( job.second );
+        }
+    }
+
+    //------------------------------------------------------------------------
+
+    FileSystemCache::FileSystemCache( const CacheOptions& options ) :
+    Cache   ( options ),
+    _options( options )
+    {
         // read the root path from ENV is necessary:
-        if ( !fsco.rootPath().isSet())
+        if ( !_options.rootPath().isSet())
         {           
             const char* cachePath = ::getenv(OSGEARTH_ENV_CACHE_PATH);
             if ( cachePath )
-                fsco.rootPath() = cachePath;
+                _options.rootPath() = cachePath;
+        }
+
+        const char* maxsize = ::getenv(OSGEARTH_ENV_CACHE_MAX_SIZE_MB);
+        if ( maxsize )
+        {
+            unsigned mb = as<unsigned>(std::string(maxsize), 0u);
+            if ( mb > 0 )
+            {
+                _options.maxSizeMB() = mb;
+
+                OE_INFO << LC << "Set max cache size from environment: "
+                    << (_options.maxSizeMB().value()) << " MB"
+                    << std::endl;
+            }
+            else
+            {
+                OE_WARN << LC 
+                    << "Env var \"" OSGEARTH_ENV_CACHE_MAX_SIZE_MB "\" set to an invalid value"
+                    << std::endl;
+            }
         }
 
-        _rootPath = URI( *fsco.rootPath(), options.referrer() ).full();
+        _rootPath = URI( *_options.rootPath(), options.referrer() ).full();
         init();
     }
 
+    FileSystemCache::~FileSystemCache()
+    {
+        // flush all pending writes before going away.
+        if ( _writeQueue.valid() )
+            _writeQueue->stop();
+
+        if ( _index.valid() )
+            _index->save();
+    }
+
     void
     FileSystemCache::init()
     {
         OE_INFO << LC << "Opened a filesystem cache at \"" << _rootPath << "\"\n";
+
+        if ( _options.threads().get() > 0u )
+        {
+            _writeQueue = new WriteQueue( _options.threads().get() );
+        }
+
+        if ( _options.maxSizeMB().get() > 0u )
+        {
+            _index = new CacheIndex( _rootPath, _options.maxSizeMB().get() );
+        }
     }
 
     CacheBin*
     FileSystemCache::addBin( const std::string& name )
     {
-        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath ) );
+        return _bins.getOrCreate( name, new FileSystemCacheBin( name, _rootPath, _writeQueue.get(), _index.get() ) );
     }
 
     CacheBin*
@@ -201,7 +717,7 @@ namespace
             Threading::ScopedMutexLock lock( s_defaultBinMutex );
             if ( !_defaultBin.valid() ) // double-check
             {
-                _defaultBin = new FileSystemCacheBin( "__default", _rootPath );
+                _defaultBin = new FileSystemCacheBin( "__default", _rootPath, _writeQueue.get(), _index.get() );
             }
         }
         return _defaultBin.get();
@@ -270,10 +786,14 @@ namespace
     }
 
     FileSystemCacheBin::FileSystemCacheBin(const std::string&   binID,
-                                           const std::string&   rootPath) :
+                                           const std::string&   rootPath,
+                                           WriteQueue*          writeQueue,
+                                           CacheIndex*          index) :
     CacheBin            ( binID ),
     _binPathExists      ( false ),
-    _ok( true )
+    _ok( true ),
+    _writeQueue         ( writeQueue ),
+    _index              ( index )
     {
         _binPath = osgDB::concatPaths( rootPath, binID );
         _metaPath = osgDB::concatPaths( _binPath, "osgearth_cacheinfo.json" );
@@ -321,9 +841,48 @@ namespace
         }
     }
 
+    bool
+    FileSystemCacheBin::readPending(const std::string& key, ReadResult& out)
+    {
+        osg::ref_ptr<const osg::Object> object;
+        Config meta;
+        TimeStamp time;
+        {
+            Threading::ScopedMutexLock lock(_pendingMutex);
+            PendingWrites::const_iterator i = _pending.find(key);
+            if ( i == _pending.end() )
+                return false;
+
+            // removed, but not yet cleaned up by the write queue:
+            if ( !i->second._object.valid() )
+            {
+                out = ReadResult(ReadResult::RESULT_NOT_FOUND);
+                return true;
+            }
+
+            object = i->second._object.get();
+            meta = i->second._meta;
+            time = i->second._time;
+        }
+
+        // clone required since the caller may modify the result
+        out = ReadResult( osg::clone(object.get(), osg::CopyOp::DEEP_COPY_ALL), meta );
+        out.setLastModifiedTime(time);
+
+        if (_debug)
+            OE_NOTICE << LC << "Read \"" << key << "\" from pending writes in cache bin [" << getID() << "]" << std::endl;
+
+        return true;
+    }
+
     ReadResult
     FileSystemCacheBin::readImage(const std::string& key, const osgDB::Options* readOptions)
     {
+        // data that hasn't reached the disk yet:
+        ReadResult pending;
+        if ( readPending(key, pending) )
+            return pending.getImage() ? pending : ReadResult();
+
         if ( !binValidForReading() ) 
             return ReadResult(ReadResult::RESULT_NOT_FOUND);
 
@@ -355,6 +914,9 @@ namespace
             ReadResult rr( r.getImage(), meta );
             rr.setLastModifiedTime(timeStamp);
 
+            if ( _index.valid() )
+                _index->touch( path );
+
             if (_debug)
                 OE_NOTICE << LC << "Read image \"" << key << "\" from cache bin [" << getID() << "] path=" << fileURI.full() << "." << OSG_EXT << std::endl;
 
@@ -365,6 +927,11 @@ namespace
     ReadResult
     FileSystemCacheBin::readObject(const std::string& key, const osgDB::Options* readOptions)
     {
+        // data that hasn't reached the disk yet:
+        ReadResult pending;
+        if ( readPending(key, pending) )
+            return pending;
+
         if ( !binValidForReading() ) 
             return ReadResult(ReadResult::RESULT_NOT_FOUND);
 
@@ -396,6 +963,9 @@ namespace
             ReadResult rr( r.getObject(), meta );
             rr.setLastModifiedTime(timeStamp);
 
+            if ( _index.valid() )
+                _index->touch( path );
+
             if (_debug)
                 OE_NOTICE << LC << "Read object \"" << key << "\" from cache bin [" << getID() << "] path=" << fileURI.full() << "." << OSG_EXT << std::endl;
 
@@ -433,6 +1003,97 @@ namespace
         if ( !binValidForWriting() || !object ) 
             return false;
 
+        osg::ref_ptr<WriteQueue> writeQueue;
+        if ( !_writeQueue.lock(writeQueue) )
+        {
+            return writeToDisk(key, object, meta, writeOptions);
+        }
+
+        // Write-behind: stash a copy of the object (the caller is free to modify
+        // the original) and let the write queue encode it and put it on disk.
+        osg::ref_ptr<const osg::Object> cloned = osg::clone(object, osg::CopyOp::DEEP_COPY_ALL);
+        if ( !cloned.valid() )
+        {
+            return writeToDisk(key, object, meta, writeOptions);
+        }
+
+        bool alreadyQueued;
+        {
+            Threading::ScopedMutexLock lock(_pendingMutex);
+            alreadyQueued = _pending.find(key) != _pending.end();
+            PendingWrite& pw = _pending[key];
+            pw._object = cloned.get();
+            pw._meta   = meta;
+            pw._dbo    = writeOptions;
+            pw._time   = ::time(0L);
+        }
+
+        // Every pending record has exactly one queued (or running) flush,
+        // which will pick up the latest data.
+        if ( alreadyQueued || writeQueue->push(this, key) )
+            return true;
+
+        // queue is full; flush it ourselves.
+        return flush(key);
+    }
+
+    bool
+    FileSystemCacheBin::flush(const std::string& key)
+    {
+        for(;;)
+        {
+            PendingWrite pw;
+            {
+                Threading::ScopedMutexLock lock(_pendingMutex);
+                PendingWrites::iterator i = _pending.find(key);
+                if ( i == _pending.end() )
+                    return false;
+
+                // removed before we got to it:
+                if ( !i->second._object.valid() )
+                {
+                    _pending.erase(i);
+                    return false;
+                }
+
+                pw = i->second;
+            }
+
+            bool ok = writeToDisk(key, pw._object.get(), pw._meta, pw._dbo.get());
+
+            {
+                Threading::ScopedMutexLock lock(_pendingMutex);
+                PendingWrites::iterator i = _pending.find(key);
+                if ( i == _pending.end() )
+                    return ok;
+
+                if ( i->second._object == pw._object )
+                {
+                    _pending.erase(i);
+                    return ok;
+                }
+
+                if ( !i->second._object.valid() )
+                {
+                    // removed while we were writing; don't resurrect it.
+                    _pending.erase(i);
+                    std::string path = URI(key, _metaPath).full();
+                    if ( _index.valid() )
+                        _index->remove( path + OSG_EXT );
+                    ScopedWriteLock fileLock(_mutex);
+                    ::unlink( (path + OSG_EXT).c_str() );
+                    ::unlink( (path + ".meta").c_str() );
+                    return false;
+                }
+
+                // rewritten while we were writing; go around again.
+            }
+        }
+    }
+
+    bool
+    FileSystemCacheBin::writeToDisk(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* writeOptions)
+    {
         // convert the key into a legal filename:
         URI fileURI( key, _metaPath );
         
@@ -478,6 +1139,12 @@ namespace
 
         if ( objWriteOK )
         {
+            if ( _index.valid() )
+            {
+                _index->insert( fileURI.full() + OSG_EXT, fileSize(fileURI.full() + OSG_EXT) + fileSize(fileURI.full() + ".meta") );
+                _index->prune();
+            }
+
             if (_debug)
                 OE_NOTICE << LC << "Wrote \"" << key << "\" to cache bin [" << getID() << "] path=" << fileURI.full() << "." << OSG_EXT << std::endl;
         }
@@ -493,6 +1160,13 @@ namespace
     CacheBin::RecordStatus
     FileSystemCacheBin::getRecordStatus(const std::string& key)
     {
+        {
+            Threading::ScopedMutexLock lock(_pendingMutex);
+            PendingWrites::const_iterator i = _pending.find(key);
+            if ( i != _pending.end() )
+                return i->second._object.valid() ? STATUS_OK : STATUS_NOT_FOUND;
+        }
+
         if ( !binValidForReading() ) 
             return STATUS_NOT_FOUND;
 
@@ -507,21 +1181,49 @@ namespace
     bool
     FileSystemCacheBin::remove(const std::string& key)
     {
-        if ( !binValidForReading() ) return false;
+        // Leave a tombstone for the write queue to clean up
+        bool wasPending = false;
+        {
+            Threading::ScopedMutexLock lock(_pendingMutex);
+            PendingWrites::iterator i = _pending.find(key);
+            if ( i != _pending.end() )
+            {
+                wasPending = i->second._object.valid();
+                i->second._object = 0L;
+            }
+        }
+
+        if ( !binValidForReading() ) return wasPending;
         URI fileURI( key, _metaPath );
         std::string path( fileURI.full() + OSG_EXT );
 
+        if ( _index.valid() )
+            _index->remove( path );
+
         ScopedWriteLock lock(_mutex);
-        return ::unlink( path.c_str() ) == 0;
+        return (::unlink( path.c_str() ) == 0) || wasPending;
     }
 
     bool
     FileSystemCacheBin::touch(const std::string& key)
     {
+        {
+            Threading::ScopedMutexLock lock(_pendingMutex);
+            PendingWrites::iterator i = _pending.find(key);
+            if ( i != _pending.end() )
+            {
+                i->second._time = ::time(0L);
+                return i->second._object.valid();
+            }
+        }
+
         if ( !binValidForReading() ) return false;
         URI fileURI( key, _metaPath );
         std::string path( fileURI.full() + OSG_EXT );
 
+        if ( _index.valid() )
+            _index->touch( path );
+
         ScopedWriteLock lock(_mutex);
         return osgEarth::touchFile( path );
     }
@@ -572,11 +1274,22 @@ namespace
     bool
     FileSystemCacheBin::clear()
     {
+        {
+            // Leave tombstones for the write queue to clean up
+            Threading::ScopedMutexLock lock(_pendingMutex);
+            for( PendingWrites::iterator i = _pending.begin(); i != _pending.end(); ++i )
+                i->second._object = 0L;
+        }
+
         if ( !binValidForReading() )
             return false;
 
         ScopedWriteLock lock(_mutex);
         std::string binDir = osgDB::getFilePath( _metaPath );
+
+        if ( _index.valid() )
+            _index->removeFolder( binDir );
+
         return purgeDirectory( binDir );
     }
 
@@ -0,0 +1,522 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include "PackCache"
+#include <osgEarth/Cache>
+#include <osgEarth/CachePack>
+#include <osgEarth/StringUtils>
+#include <osgEarth/URI>
+#include <osg/Image>
+#include <osg/Shape>
+#include <osgDB/Registry>
+#include <osgDB/FileNameUtils>
+#include <cstring>
+#include <streambuf>
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+#undef  LC
+#define LC "[PackCache] "
+
+namespace
+{
+    /**
+     * A file mapped into memory. Pages are mapped copy-on-write, so a caller
+     * that modifies an image we handed out gets a private copy of the page
+     * and the file itself is never touched.
+     */
+    class MappedFile : public osg::Referenced
+    {
+    public:
+        MappedFile() : _data(0L), _size(0u)
+#ifdef _WIN32
+            , _file(INVALID_HANDLE_VALUE), _mapping(0L)
+#endif
+        { }
+
+        bool open(const std::string& path)
+        {
+#ifdef _WIN32
+            _file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0L, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0L);
+            if (_file == INVALID_HANDLE_VALUE)
+                return false;
+
+            LARGE_INTEGER size;
+            if (!::GetFileSizeEx(_file, &size) || size.QuadPart == 0)
+                return false;
+
+            _mapping = ::CreateFileMappingA(_file, 0L, PAGE_WRITECOPY, 0, 0, 0L);
+            if (!_mapping)
+                return false;
+
+            _data = static_cast<char*>(::MapViewOfFile(_mapping, FILE_MAP_COPY, 0, 0, 0));
+            if (!_data)
+                return false;
+
+            _size = (size_t)size.QuadPart;
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+
+            struct stat s;
+            if (::fstat(fd, &s) != 0 || s.st_size == 0)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            void* data = ::mmap(0L, (size_t)s.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (data == MAP_FAILED)
+                return false;
+
+            _data = static_cast<char*>(data);
+            _size = (size_t)s.st_size;
+#endif
+            return true;
+        }
+
+        char* data() const { return _data; }
+
+        size_t size() const { return _size; }
+
+        //! Whether [offset, offset+length) lies within the file
+        bool contains(unsigned long long offset, unsigned long long length) const
+        {
+            return offset <= _size && length <= _size - offset;
+        }
+
+    protected:
+        virtual ~MappedFile()
+        {
+#ifdef _WIN32
+            if (_data) ::UnmapViewOfFile(_data);
+            if (_mapping) ::CloseHandle(_mapping);
+            if (_file != INVALID_HANDLE_VALUE) ::CloseHandle(_file);
+#else
+            if (_data) ::munmap(_data, _size);
+#endif
+        }
+
+        char*  _data;
+        size_t _size;
+#ifdef _WIN32
+        HANDLE _file;
+        HANDLE _mapping;
+#endif
+    };
+
+    /**
+     * Image that points directly into a mapped file, and keeps the
+     * mapping alive for as long as the image exists.
+     */
+    class MappedImage : public osg::Image
+    {
+    public:
+        MappedImage(MappedFile* file) : _file(file) { }
+
+    protected:
+        virtual ~MappedImage() { }
+
+        osg::ref_ptr<MappedFile> _file;
+    };
+
+    /**
+     * Read-only stream over a block of memory, for deserializing
+     * osgb payloads without copying them first.
+     */
+    class MemoryBuffer : public std::streambuf
+    {
+    public:
+        MemoryBuffer(char* data, size_t length)
+        {
+            setg(data, data, data + length);
+        }
+
+    protected:
+        virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+        {
+            char* target =
+                dir == std::ios_base::beg ? eback() + off :
+                dir == std::ios_base::cur ? gptr() + off :
+                egptr() + off;
+
+            if (target < eback() || target > egptr())
+                return pos_type(off_type(-1));
+
+            setg(eback(), target, egptr());
+            return pos_type(off_type(target - eback()));
+        }
+
+        virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which)
+        {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    /**
+     * One bin within a pack file. Read-only.
+     */
+    class PackCacheBin : public CacheBin
+    {
+    public:
+        PackCacheBin(const std::string& binID, MappedFile* file, const CachePack::Bin* bin) :
+            CacheBin(binID),
+            _file(file),
+            _bin(bin),
+            _records(0L)
+        {
+            _rw = osgDB::Registry::instance()->getReaderWriterForExtension("osgb");
+            if (_bin)
+            {
+                _records = reinterpret_cast<const CachePack::Record*>(_file->data() + _bin->recordsOffset);
+            }
+        }
+
+    public: // CacheBin interface
+
+        ReadResult readObject(const std::string& key, const osgDB::Options* dbo)
+        {
+            return read(key, dbo, false);
+        }
+
+        ReadResult readImage(const std::string& key, const osgDB::Options* dbo)
+        {
+            return read(key, dbo, true);
+        }
+
+        ReadResult readString(const std::string& key, const osgDB::Options* dbo)
+        {
+            ReadResult r = read(key, dbo, false);
+            if (r.succeeded() && !r.get<StringObject>())
+                return ReadResult();
+            return r;
+        }
+
+        bool write(const std::string& key, const osg::Object* object, const Config& meta, const osgDB::Options* dbo)
+        {
+            // read-only.
+            return false;
+        }
+
+        bool remove(const std::string& key)
+        {
+            return false;
+        }
+
+        bool touch(const std::string& key)
+        {
+            return false;
+        }
+
+        RecordStatus getRecordStatus(const std::string& key)
+        {
+            return find(key) ? STATUS_OK : STATUS_NOT_FOUND;
+        }
+
+        Config readMetadata()
+        {
+            Config conf;
+            if (_bin && _bin->metaLength > 0 && _file->contains(_bin->metaOffset, _bin->metaLength))
+            {
+                conf.fromJSON(std::string(_file->data() + _bin->metaOffset, _bin->metaLength));
+            }
+            return conf;
+        }
+
+    protected:
+
+        //! Binary search for a record
+        const CachePack::Record* find(const std::string& key) const
+        {
+            if (!_records)
+                return 0L;
+
+            unsigned long long hash = CachePack::hashKey(key.data(), key.length());
+
+            // lower bound on the hash:
+            unsigned lo = 0, hi = _bin->numRecords;
+            while (lo < hi)
+            {
+                unsigned mid = lo + (hi - lo) / 2;
+                if (_records[mid].hash < hash)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+
+            // then resolve hash collisions by comparing the keys:
+            for (unsigned i = lo; i < _bin->numRecords && _records[i].hash == hash; ++i)
+            {
+                const CachePack::Record& rec = _records[i];
+                if (rec.keyLength == key.length() &&
+                    _file->contains(rec.keyOffset, rec.keyLength) &&
+                    ::memcmp(_file->data() + rec.keyOffset, key.data(), key.length()) == 0)
+                {
+                    return &rec;
+                }
+            }
+
+            return 0L;
+        }
+
+        ReadResult read(const std::string& key, const osgDB::Options* dbo, bool asImage)
+        {
+            const CachePack::Record* rec = find(key);
+            if (!rec)
+                return ReadResult(ReadResult::RESULT_NOT_FOUND);
+
+            if (!_file->contains(rec->dataOffset, rec->dataLength))
+            {
+                OE_WARN << LC << "Corrupt record \"" << key << "\" in bin [" << getID() << "]" << std::endl;
+                return ReadResult();
+            }
+
+            char* data = _file->data() + rec->dataOffset;
+            osg::ref_ptr<osg::Object> object;
+
+            switch (rec->type)
+            {
+            case CachePack::PAYLOAD_IMAGE:
+                {
+                    // the size in 64 bits, so huge dimensions can't wrap around
+                    unsigned long long bytes = rec->s <= 0 || rec->t <= 0 || rec->r <= 0 ? 0ull :
+                        (unsigned long long)osg::Image::computeRowWidthInBytes(rec->s, rec->pixelFormat, rec->dataType, rec->packing) *
+                        (unsigned long long)rec->t * (unsigned long long)rec->r;
+                    if (bytes == 0ull || rec->dataLength < bytes)
+                    {
+                        OE_WARN << LC << "Corrupt image \"" << key << "\" in bin [" << getID() << "]" << std::endl;
+                        return ReadResult();
+                    }
+
+                    // zero-copy: point the image at the mapped pixels.
+                    osg::ref_ptr<osg::Image> image = new MappedImage(_file.get());
+                    image->setImage(
+                        rec->s, rec->t, rec->r,
+                        rec->internalFormat, rec->pixelFormat, rec->dataType,
+                        reinterpret_cast<unsigned char*>(data),
+                        osg::Image::NO_DELETE,
+                        rec->packing);
+                    object = image.get();
+                }
+                break;
+
+            case CachePack::PAYLOAD_HEIGHTFIELD:
+                {
+                    CachePack::HeightFieldHeader hfh;
+                    if (rec->dataLength < sizeof(hfh))
+                    {
+                        OE_WARN << LC << "Corrupt heightfield \"" << key << "\" in bin [" << getID() << "]" << std::endl;
+                        return ReadResult();
+                    }
+                    ::memcpy(&hfh, data, sizeof(hfh));
+                    unsigned long long samples = (unsigned long long)hfh.columns * hfh.rows;
+                    if (rec->dataLength < sizeof(hfh) + samples * sizeof(float))
+                    {
+                        OE_WARN << LC << "Corrupt heightfield \"" << key << "\" in bin [" << getID() << "]" << std::endl;
+                        return ReadResult();
+                    }
+
+                    osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+                    hf->allocate(hfh.columns, hfh.rows);
+                    hf->setOrigin(osg::Vec3d(hfh.originX, hfh.originY, hfh.originZ));
+                    hf->setXInterval(hfh.xInterval);
+                    hf->setYInterval(hfh.yInterval);
+                    hf->setSkirtHeight(hfh.skirtHeight);
+                    hf->setBorderWidth(hfh.borderWidth);
+                    if (samples > 0)
+                        ::memcpy(&hf->getFloatArray()->front(), data + sizeof(hfh), samples * sizeof(float));
+                    object = hf.get();
+                }
+                break;
+
+            case CachePack::PAYLOAD_STRING:
+                object = new StringObject(std::string(data, rec->dataLength));
+                break;
+
+            case CachePack::PAYLOAD_OSGB:
+                if (_rw.valid())
+                {
+                    MemoryBuffer buf(data, rec->dataLength);
+                    std::istream in(&buf);
+                    osgDB::ReaderWriter::ReadResult r = asImage ?
+                        _rw->readImage(in, dbo) :
+                        _rw->readObject(in, dbo);
+                    if (r.success())
+                        object = r.getObject();
+                }
+                break;
+            }
+
+            if (!object.valid())
+                return ReadResult();
+
+            Config meta;
+            if (rec->metaLength > 0 && _file->contains(rec->metaOffset, rec->metaLength))
+            {
+                meta.fromJSON(std::string(_file->data() + rec->metaOffset, rec->metaLength));
+            }
+
+            ReadResult rr(object.get(), meta);
+            rr.setLastModifiedTime((TimeStamp)rec->timestamp);
+            return rr;
+        }
+
+        osg::ref_ptr<MappedFile>          _file;
+        const CachePack::Bin*             _bin;
+        const CachePack::Record*          _records;
+        osg::ref_ptr<osgDB::ReaderWriter> _rw;
+    };
+
+    /**
+     * Read-only cache backed by a single memory-mapped pack file.
+     */
+    class PackCache : public Cache
+    {
+    public:
+        PackCache() { } // unused
+        PackCache( const PackCache& rhs, const osg::CopyOp& op ) { } // unused
+        META_Object( osgEarth, PackCache );
+
+        PackCache( const CacheOptions& options ) :
+            Cache( options )
+        {
+            PackCacheOptions pco( options );
+
+            // read the path from ENV if necessary:
+            if ( !pco.path().isSet() )
+            {
+                const char* cachePath = ::getenv(OSGEARTH_ENV_CACHE_PATH);
+                if ( cachePath )
+                    pco.path() = cachePath;
+            }
+
+            _path = URI( pco.path().get(), options.referrer() ).full();
+            _ok = open();
+        }
+
+    public: // Cache interface
+
+        CacheBin* addBin( const std::string& name )
+        {
+            BinTable::const_iterator i = _binTable.find(name);
+            if ( i == _binTable.end() )
+            {
+                OE_INFO << LC << "Bin [" << name << "] not found in \"" << _path << "\"" << std::endl;
+            }
+            const CachePack::Bin* bin = i != _binTable.end() ? i->second : 0L;
+            return _bins.getOrCreate( name, new PackCacheBin(name, _file.get(), bin) );
+        }
+
+        CacheBin* getOrCreateDefaultBin()
+        {
+            return addBin( "__default" );
+        }
+
+    protected:
+
+        bool open()
+        {
+            _file = new MappedFile();
+            if ( !_file->open(_path) )
+            {
+                OE_WARN << LC << "Failed to map \"" << _path << "\"" << std::endl;
+                return false;
+            }
+
+            const CachePack::Header* header = reinterpret_cast<const CachePack::Header*>(_file->data());
+            if ( _file->size() < sizeof(CachePack::Header) ||
+                 ::memcmp(header->magic, CachePack::MAGIC, sizeof(header->magic)) != 0 )
+            {
+                OE_WARN << LC << "\"" << _path << "\" is not a cache pack" << std::endl;
+                return false;
+            }
+
+            if ( header->byteOrder != CachePack::BYTE_ORDER_MARK || header->version != CachePack::VERSION )
+            {
+                OE_WARN << LC << "\"" << _path << "\" was written by an incompatible platform or version" << std::endl;
+                return false;
+            }
+
+            if ( !_file->contains(header->binsOffset, (unsigned long long)header->numBins * sizeof(CachePack::Bin)) )
+            {
+                OE_WARN << LC << "\"" << _path << "\" is corrupt" << std::endl;
+                return false;
+            }
+
+            const CachePack::Bin* bins = reinterpret_cast<const CachePack::Bin*>(_file->data() + header->binsOffset);
+            for( unsigned i = 0; i < header->numBins; ++i )
+            {
+                const CachePack::Bin& bin = bins[i];
+                if ( !_file->contains(bin.nameOffset, bin.nameLength) ||
+                     !_file->contains(bin.recordsOffset, (unsigned long long)bin.numRecords * sizeof(CachePack::Record)) )
+                {
+                    OE_WARN << LC << "\"" << _path << "\" is corrupt" << std::endl;
+                    return false;
+                }
+                _binTable[std::string(_file->data() + bin.nameOffset, bin.nameLength)] = &bin;
+            }
+
+            OE_INFO << LC << "Opened a cache pack at \"" << _path << "\" with " << header->numBins << " bins" << std::endl;
+            return true;
+        }
+
+        typedef std::map<std::string, const CachePack::Bin*> BinTable;
+
+        std::string              _path;
+        osg::ref_ptr<MappedFile> _file;
+        BinTable                 _binTable;
+    };
+}
+
+//------------------------------------------------------------------------
+
+class PackCacheDriver : public CacheDriver
+{
+public:
+    PackCacheDriver()
+    {
+        supportsExtension( "osgearth_cache_pack", "Memory-mapped cache pack for osgEarth" );
+    }
+
+    virtual const char* className() const
+    {
+        return "Memory-mapped cache pack for osgEarth";
+    }
+
+    virtual ReadResult readObject(const std::string& file_name, const Options* options) const
+    {
+        if ( !acceptsExtension(osgDB::getLowerCaseFileExtension( file_name )))
+            return ReadResult::FILE_NOT_HANDLED;
+
+        return ReadResult( new PackCache( getCacheOptions(options) ) );
+    }
+};
+
+REGISTER_OSGPLUGIN(osgearth_cache_pack, PackCacheDriver)
@@ -20,6 +20,7 @@
 #include "SurfaceNode"
 #include <osgEarth/TerrainEngineNode>
 #include <osgEarth/Terrain>
+#include <osgEarth/Metrics>
 #include <osg/NodeVisitor>
 
 using namespace osgEarth::Drivers::RexTerrainEngine;
@@ -42,6 +43,8 @@ _enableCancel(true)
 void
 LoadTileData::invoke(ProgressCallback* progress)
 {
+    OE_TRACE_SCOPE("rex.load");
+
     osg::ref_ptr<TileNode> tilenode;
     if (!_tilenode.lock(tilenode))
         return;
@@ -74,6 +77,8 @@ LoadTileData::invoke(ProgressCallback* progress)
 void
 LoadTileData::apply(const osg::FrameStamp* stamp)
 {
+    OE_TRACE_SCOPE("rex.apply");
+
     osg::ref_ptr<EngineContext> context;
     if (!_context.lock(context))
         return;
@@ -117,6 +122,16 @@ LoadTileData::apply(const osg::FrameStamp* stamp)
     }
 }
 
+bool
+LoadTileData::isObsolete(const osg::FrameStamp* stamp) const
+{
+    osg::ref_ptr<TileNode> tilenode;
+    if ( !_tilenode.lock(tilenode) )
+        return true;
+
+    return tilenode->isDormant( stamp );
+}
+
 namespace
 {
     // Fake attribute that compiles everything in the TerrainTileModel
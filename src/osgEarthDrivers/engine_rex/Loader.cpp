@@ -43,6 +43,7 @@ Loader::Request::Request()
     _loadCount = 0;
     _priority = 0;
     _lastFrameSubmitted = 0;
+    _lastFrameVisited = 0;
     _lastTick = 0;
 }
 
@@ -220,6 +221,8 @@ namespace
 PagerLoader::PagerLoader(TerrainEngineNode* engine) :
 _checkpoint    ( (osg::Timer_t)0 ),
 _mergesPerFrame( 0 ),
+_mergeBudget   ( 0.0 ),
+_eventTraversal( false ),
 _frameNumber   ( 0 ),
 _numLODs       ( 20u )
 {
@@ -235,6 +238,7 @@ _numLODs       ( 20u )
     {
         _priorityScales[i] = 1.0f;
         _priorityOffsets[i] = 0.0f;
+        _mergeCosts[i] = 0.0f;
     }
 }
 
@@ -248,9 +252,24 @@ void
 PagerLoader::setMergesPerFrame(int value)
 {
     _mergesPerFrame = osg::maximum(value, 0);
-    ADJUST_EVENT_TRAV_COUNT(this, +1);
+    if ( !_eventTraversal )
+    {
+        ADJUST_EVENT_TRAV_COUNT(this, +1);
+        _eventTraversal = true;
+    }
     OE_INFO << LC << "Merges per frame = " << _mergesPerFrame << std::endl;
-    
+}
+
+void
+PagerLoader::setMergeBudget(double value)
+{
+    _mergeBudget = osg::maximum(value, 0.0);
+    if ( !_eventTraversal )
+    {
+        ADJUST_EVENT_TRAV_COUNT(this, +1);
+        _eventTraversal = true;
+    }
+    OE_INFO << LC << "Merge budget = " << _mergeBudget << " ms" << std::endl;
 }
 
 void
@@ -270,6 +289,14 @@ PagerLoader::setLODPriorityOffset(unsigned lod, float offset)
 bool
 PagerLoader::load(Loader::Request* request, float priority, osg::NodeVisitor& nv)
 {
+    // note that the tile is on screen, so the merge scheduler can favor it.
+    // This leaves the submission timestamp alone: a MERGING request keeps
+    // the one it had when it finished loading.
+    if ( request && nv.getFrameStamp() )
+    {
+        request->setLastFrameVisited( nv.getFrameStamp()->getFrameNumber() );
+    }
+
     // check that the request is not already completed but unmerged:
     if ( request && !request->isMerging() && !request->isFinished() && nv.getDatabaseRequestHandler() )
     {
@@ -339,6 +366,90 @@ PagerLoader::clear()
     _checkpoint = osg::Timer::instance()->tick();
 }
 
+void
+PagerLoader::mergeRequests()
+{
+    const osg::Timer* timer = osg::Timer::instance();
+    const osg::Timer_t start = timer->tick();
+    const osg::FrameStamp* fs = getFrameStamp();
+    const unsigned fn = fs ? fs->getFrameNumber() : 0u;
+
+    MergeStats stats;
+    stats._budgetMs = _mergeBudget;
+
+    // The queue is sorted by priority. The first pass merges requests whose tiles
+    // the cull visited last frame; the second pass spends whatever budget remains
+    // on requests whose tiles are off screen but not yet dormant.
+    bool full = false;
+    for(int pass = 0; pass < 2 && !full; ++pass)
+    {
+        for(MergeQueue::iterator i = _mergeQueue.begin(); i != _mergeQueue.end(); )
+        {
+            Request* req = i->get();
+
+            // Discard requests made before the last clear() and requests
+            // whose tiles went dormant while waiting to merge.
+            if ( req->_lastTick < _checkpoint || req->isObsolete(fs) )
+            {
+                req->setState(Request::FINISHED);
+                _mergeQueue.erase( i++ );
+                ++stats._dropped;
+                continue;
+            }
+
+            // off screen; wait for the second pass.
+            if ( pass == 0 && fn - req->getLastFrameVisited() > 1u )
+            {
+                ++i;
+                continue;
+            }
+
+            unsigned lod = osg::minimum(req->getTileKey().getLOD(), 63u);
+
+            // Always merge at least one request per frame so the queue cannot stall.
+            if ( stats._merged > 0u )
+            {
+                if ( _mergesPerFrame > 0 && stats._merged >= (unsigned)_mergesPerFrame )
+                {
+                    full = true;
+                    break;
+                }
+
+                // Stop if the predicted cost of this merge would exceed the budget.
+                if ( _mergeBudget > 0.0 && timer->delta_m(start, timer->tick()) + _mergeCosts[lod] > _mergeBudget )
+                {
+                    full = true;
+                    break;
+                }
+            }
+
+            osg::Timer_t t0 = timer->tick();
+            req->apply( fs );
+            float cost = (float)timer->delta_m(t0, timer->tick());
+
+            req->setState(Request::FINISHED);
+            _mergeQueue.erase( i++ );
+            ++stats._merged;
+
+            // running average of the merge cost at this LOD:
+            _mergeCosts[lod] = _mergeCosts[lod] > 0.0f ? 0.8f*_mergeCosts[lod] + 0.2f*cost : cost;
+        }
+    }
+
+    stats._deferred = _mergeQueue.size();
+    stats._timeMs = timer->delta_m(start, timer->tick());
+    _mergeStats = stats;
+
+    if ( Metrics::enabled() )
+    {
+        Metrics::counter("RexStats",
+            "Merged", stats._merged,
+            "Deferred", stats._deferred,
+            "Dropped", stats._dropped);
+        Metrics::counter("RexStats", "Merge ms", stats._timeMs);
+    }
+}
+
 void
 PagerLoader::traverse(osg::NodeVisitor& nv)
 {
@@ -352,28 +463,13 @@ PagerLoader::traverse(osg::NodeVisitor& nv)
 
         // process pending merges.
         {
-            METRIC_BEGIN("loader.merge");
-            int count;
-            for(count=0; count < _mergesPerFrame && !_mergeQueue.empty(); ++count)
-            {
-                Request* req = _mergeQueue.begin()->get();
-                if ( req && req->_lastTick >= _checkpoint )
-                {
-                    OE_START_TIMER(req_apply);
-                    req->apply( getFrameStamp() );
-                    double s = OE_STOP_TIMER(req_apply);
-
-                    req->setState(Request::FINISHED);
-                }
-
-                _mergeQueue.erase( _mergeQueue.begin() );
-            }
-            METRIC_END("loader.merge");
+            OE_TRACE_METRIC_SCOPE("loader.merge");
+            mergeRequests();
         }
 
         // cull finished requests.
         {
-            METRIC_SCOPED("loader.cull");
+            OE_TRACE_METRIC_SCOPE("loader.cull");
 
             Threading::ScopedMutexLock lock( _requestsMutex );
 
@@ -444,7 +540,7 @@ PagerLoader::addChild(osg::Node* node)
             // and running (i.e. has not been canceled along the way)
             if (req->_lastTick >= _checkpoint && req->isRunning())
             {
-                if ( _mergesPerFrame > 0 )
+                if ( _mergesPerFrame > 0 || _mergeBudget > 0.0 )
                 {
                     _mergeQueue.insert( req );
                     req->setState( Request::MERGING );
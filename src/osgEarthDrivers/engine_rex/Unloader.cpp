@@ -80,7 +80,7 @@ UnloaderGroup::unloadChildren(const std::vector<TileKey>& keys)
 {
     _mutex.lock();
     for(std::vector<TileKey>::const_iterator i = keys.begin(); i != keys.end(); ++i)
-        _parentKeys.insert(*i);
+        _parentKeys[*i] = true;
     _mutex.unlock();
 }
 
@@ -95,10 +95,10 @@ UnloaderGroup::traverse(osg::NodeVisitor& nv)
 
             unsigned unloaded=0, notFound=0, notDormant=0;
             Threading::ScopedMutexLock lock( _mutex );
-            for(std::set<TileKey>::const_iterator parentKey = _parentKeys.begin(); parentKey != _parentKeys.end(); ++parentKey)
+            for(hash_map<TileKey, bool, TileKey::Hash>::const_iterator parentKey = _parentKeys.begin(); parentKey != _parentKeys.end(); ++parentKey)
             {
                 osg::ref_ptr<TileNode> parentNode;
-                if ( _tiles->get(*parentKey, parentNode) )
+                if ( _tiles->get(parentKey->first, parentNode) )
                 {
                     // re-check for dormancy in case something has changed
                     if ( parentNode->areSubTilesDormant(nv.getFrameStamp()) )
@@ -35,6 +35,7 @@
 #include <osgDB/ImageOptions>
 
 #include <sstream>
+#include <map>
 #include <stdlib.h>
 #include <memory.h>
 
@@ -681,6 +682,19 @@ GeoExtent getGeoExtent(std::string& filename)
 
 
 
+namespace
+{
+    // Holds the global GDAL mutex only if asked to, so that a thread
+    // reading its own dataset can skip it.
+    struct OptionalGDALLock
+    {
+        OptionalGDALLock(bool lock) : _locked(lock) { if (_locked) getGDALMutex().lock(); }
+        ~OptionalGDALLock() { if (_locked) getGDALMutex().unlock(); }
+        bool _locked;
+    };
+}
+
+
 class GDALTileSource : public TileSource
 {
 public:
@@ -688,6 +702,8 @@ public:
       TileSource( options ),
       _srcDS(NULL),
       _warpedDS(NULL),
+      _warpPolar(false),
+      _concurrent(false),
       _options(options),
       _maxDataLevel(30),
       _linearUnits(1.0)
@@ -698,6 +714,16 @@ public:
     {
         GDAL_SCOPED_LOCK;
 
+        // Close the per-thread datasets
+        for (ThreadDatasets::iterator i = _threadDatasets.begin(); i != _threadDatasets.end(); ++i)
+        {
+            if (i->second._warped && i->second._warped != i->second._src)
+                GDALClose(i->second._warped);
+            if (i->second._src)
+                GDALClose(i->second._src);
+        }
+        _threadDatasets.clear();
+
         // Close the _warpedDS dataset if :
         // - it exists
         // - and is different from _srcDS
@@ -846,6 +872,7 @@ public:
                         if (_srcDS)
                         {
                             OE_INFO << LC << INDENT << "Read VRT from cache!" << std::endl;
+                            _openString = result.getString();
                         }
                     }
                 }
@@ -861,6 +888,13 @@ public:
 
                     if (_srcDS)
                     {
+                        // The VRT only exists in memory, so keep its XML around to open more copies.
+                        char** vrtXML = _srcDS->GetMetadata("xml:VRT");
+                        if (vrtXML && vrtXML[0])
+                        {
+                            _openString = vrtXML[0];
+                        }
+
                         //Cache the VRT so we don't have to build it next time.
                         if (_cacheBin)
                         {
@@ -906,6 +940,7 @@ public:
 
                 if (_srcDS)
                 {
+                    _openString = files[0];
 
                     char **subDatasets = _srcDS->GetMetadata( "SUBDATASETS");
                     int numSubDatasets = CSLCount( subDatasets );
@@ -920,6 +955,7 @@ public:
                         char *pszSubdatasetName = CPLStrdup( CSLFetchNameValue( subDatasets, buf.str().c_str() ) );
                         GDALClose( _srcDS );
                         _srcDS = (GDALDataset*)GDALOpen( pszSubdatasetName, GA_ReadOnly ) ;
+                        _openString = pszSubdatasetName;
                         CPLFree( pszSubdatasetName );
                     }
                 }
@@ -1050,27 +1086,10 @@ public:
 
         if ( requiresReprojection || (profile && !profile->getSRS()->isEquivalentTo( src_srs.get() )) )
         {
-            if ( profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar()) )
-            {
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    profile->getSRS()->getWKT().c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    NULL);
-            }
-            else
-            {
-                std::string destWKT = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
-                _warpedDS = (GDALDataset*)GDALAutoCreateWarpedVRT(
-                    _srcDS,
-                    src_srs->getWKT().c_str(),
-                    destWKT.c_str(),
-                    GRA_NearestNeighbour,
-                    5.0,
-                    0);
-            }
+            _warpPolar = profile && profile->getSRS()->isGeographic() && (src_srs->isNorthPolar() || src_srs->isSouthPolar());
+            _warpSrcWKT = src_srs->getWKT();
+            _warpDestWKT = profile ? profile->getSRS()->getWKT() : src_srs->getWKT();
+            _warpedDS = createWarpedDataset( _srcDS );
 
             if ( _warpedDS )
             {
@@ -1249,17 +1268,105 @@ public:
         setProfile( profile );
         OE_DEBUG << LC << INDENT << "Set Profile to " << (profile ? profile->toString() : "NULL") <<  std::endl;
 
+        if ( _options.concurrentReads() == true )
+        {
+#if GDAL_VERSION_2_0_OR_NEWER
+            // An external dataset can't be re-opened, so it stays serialized.
+            _concurrent = !_openString.empty();
+            if ( !_concurrent )
+            {
+                OE_WARN << LC << "Concurrent reads are not available for this dataset; reads will be serialized" << std::endl;
+            }
+#else
+            OE_WARN << LC << "Concurrent reads require GDAL 2.0 or newer; reads will be serialized" << std::endl;
+#endif
+        }
+
         return STATUS_OK;
     }
 
+    /**
+    * Creates the warping VRT (if any) that initialize() set up for the
+    * source dataset. Returns the source itself if no warp is needed.
+    * Call with the GDAL lock held.
+    */
+    GDALDataset* createWarpedDataset(GDALDataset* src)
+    {
+        if ( _warpSrcWKT.empty() )
+        {
+            return src;
+        }
+        else if ( _warpPolar )
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRTforPolarStereographic(
+                src,
+                _warpSrcWKT.c_str(),
+                _warpDestWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                NULL);
+        }
+        else
+        {
+            return (GDALDataset*)GDALAutoCreateWarpedVRT(
+                src,
+                _warpSrcWKT.c_str(),
+                _warpDestWKT.c_str(),
+                GRA_NearestNeighbour,
+                5.0,
+                0);
+        }
+    }
+
+    /**
+    * Gets the dataset the calling thread should read from. With concurrent
+    * reads on, that's the thread's own copy (opened on first use), which it
+    * may read without the GDAL lock. Otherwise it's the shared _warpedDS,
+    * which must only be read under the GDAL lock.
+    */
+    GDALDataset* getDataset()
+    {
+        if ( !_concurrent )
+            return _warpedDS;
+
+        unsigned id = Threading::getCurrentThreadId();
+        {
+            Threading::ScopedMutexLock lock( _threadDatasetsMutex );
+            ThreadDatasets::const_iterator i = _threadDatasets.find( id );
+            if ( i != _threadDatasets.end() )
+                return i->second._warped ? i->second._warped : _warpedDS;
+        }
+
+        // Opening goes through GDAL's driver manager and OGR, so it's serialized.
+        ThreadDataset data;
+        {
+            GDAL_SCOPED_LOCK;
+            data._src = (GDALDataset*)GDALOpen( _openString.c_str(), GA_ReadOnly );
+            data._warped = data._src ? createWarpedDataset( data._src ) : 0L;
+            if ( data._src && !data._warped )
+            {
+                GDALClose( data._src );
+                data._src = 0L;
+            }
+        }
+
+        if ( !data._warped )
+        {
+            OE_WARN << LC << "Failed to open a dataset for thread " << id << "; its reads will be serialized" << std::endl;
+        }
+
+        // Remember failures too, so we don't try again on every tile.
+        Threading::ScopedMutexLock lock( _threadDatasetsMutex );
+        _threadDatasets[id] = data;
+        return data._warped ? data._warped : _warpedDS;
+    }
+
 
     /**
     * Finds a raster band based on color interpretation
     */
     static GDALRasterBand* findBandByColorInterp(GDALDataset *ds, GDALColorInterp colorInterp)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetColorInterpretation() == colorInterp) return ds->GetRasterBand(i);
@@ -1269,8 +1376,6 @@ public:
 
     static GDALRasterBand* findBandByDataType(GDALDataset *ds, GDALDataType dataType)
     {
-        GDAL_SCOPED_LOCK;
-
         for (int i = 1; i <= ds->GetRasterCount(); ++i)
         {
             if (ds->GetRasterBand(i)->GetRasterDataType() == dataType) return ds->GetRasterBand(i);
@@ -1447,7 +1552,10 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        // Read from this thread's own dataset if it has one; otherwise
+        // everything from here on happens under the GDAL lock.
+        GDALDataset* ds = getDataset();
+        OptionalGDALLock lock( ds == _warpedDS );
 
         int tileSize = getPixelsPerTile(); //_options.tileSize().value();
 
@@ -1512,8 +1620,8 @@ public:
         int height = (int)(src_max_y - src_min_y);
 
 
-        int rasterWidth = _warpedDS->GetRasterXSize();
-        int rasterHeight = _warpedDS->GetRasterYSize();
+        int rasterWidth = ds->GetRasterXSize();
+        int rasterHeight = ds->GetRasterYSize();
         if (off_x + width > rasterWidth || off_y + height > rasterHeight)
         {
             OE_WARN << LC << "Read window outside of bounds of dataset.  Source Dimensions=" << rasterWidth << "x" << rasterHeight << " Read Window=" << off_x << ", " << off_y << " " << width << "x" << height << std::endl;
@@ -1547,44 +1655,44 @@ public:
 
 
 
-        GDALRasterBand* bandRed = findBandByColorInterp(_warpedDS, GCI_RedBand);
-        GDALRasterBand* bandGreen = findBandByColorInterp(_warpedDS, GCI_GreenBand);
-        GDALRasterBand* bandBlue = findBandByColorInterp(_warpedDS, GCI_BlueBand);
-        GDALRasterBand* bandAlpha = findBandByColorInterp(_warpedDS, GCI_AlphaBand);
+        GDALRasterBand* bandRed = findBandByColorInterp(ds, GCI_RedBand);
+        GDALRasterBand* bandGreen = findBandByColorInterp(ds, GCI_GreenBand);
+        GDALRasterBand* bandBlue = findBandByColorInterp(ds, GCI_BlueBand);
+        GDALRasterBand* bandAlpha = findBandByColorInterp(ds, GCI_AlphaBand);
 
-        GDALRasterBand* bandGray = findBandByColorInterp(_warpedDS, GCI_GrayIndex);
+        GDALRasterBand* bandGray = findBandByColorInterp(ds, GCI_GrayIndex);
 
-        GDALRasterBand* bandPalette = findBandByColorInterp(_warpedDS, GCI_PaletteIndex);
+        GDALRasterBand* bandPalette = findBandByColorInterp(ds, GCI_PaletteIndex);
 
         if (!bandRed && !bandGreen && !bandBlue && !bandAlpha && !bandGray && !bandPalette)
         {
             OE_DEBUG << LC << "Could not determine bands based on color interpretation, using band count" << std::endl;
             //We couldn't find any valid bands based on the color interp, so just make an educated guess based on the number of bands in the file
             //RGB = 3 bands
-            if (_warpedDS->GetRasterCount() == 3)
+            if (ds->GetRasterCount() == 3)
             {
-                bandRed   = _warpedDS->GetRasterBand( 1 );
-                bandGreen = _warpedDS->GetRasterBand( 2 );
-                bandBlue  = _warpedDS->GetRasterBand( 3 );
+                bandRed   = ds->GetRasterBand( 1 );
+                bandGreen = ds->GetRasterBand( 2 );
+                bandBlue  = ds->GetRasterBand( 3 );
             }
             //RGBA = 4 bands
-            else if (_warpedDS->GetRasterCount() == 4)
+            else if (ds->GetRasterCount() == 4)
             {
-                bandRed   = _warpedDS->GetRasterBand( 1 );
-                bandGreen = _warpedDS->GetRasterBand( 2 );
-                bandBlue  = _warpedDS->GetRasterBand( 3 );
-                bandAlpha = _warpedDS->GetRasterBand( 4 );
+                bandRed   = ds->GetRasterBand( 1 );
+                bandGreen = ds->GetRasterBand( 2 );
+                bandBlue  = ds->GetRasterBand( 3 );
+                bandAlpha = ds->GetRasterBand( 4 );
             }
             //Gray = 1 band
-            else if (_warpedDS->GetRasterCount() == 1)
+            else if (ds->GetRasterCount() == 1)
             {
-                bandGray = _warpedDS->GetRasterBand( 1 );
+                bandGray = ds->GetRasterBand( 1 );
             }
             //Gray + alpha = 2 bands
-            else if (_warpedDS->GetRasterCount() == 2)
+            else if (ds->GetRasterCount() == 2)
             {
-                bandGray  = _warpedDS->GetRasterBand( 1 );
-                bandAlpha = _warpedDS->GetRasterBand( 2 );
+                bandGray  = ds->GetRasterBand( 1 );
+                bandAlpha = ds->GetRasterBand( 2 );
             }
         }
 
@@ -1632,10 +1740,10 @@ public:
                     *(image->data(dst_col, dst_row) + 0) = r;
                     *(image->data(dst_col, dst_row) + 1) = g;
                     *(image->data(dst_col, dst_row) + 2) = b;
-                    if (!isValidValue(r, bandRed) ||
-                        !isValidValue(g, bandGreen) ||
-                        !isValidValue(b, bandBlue) ||
-                        (bandAlpha && !isValidValue(a, bandAlpha)))
+                    if (!isValidValue_noLock(r, bandRed) ||
+                        !isValidValue_noLock(g, bandGreen) ||
+                        !isValidValue_noLock(b, bandBlue) ||
+                        (bandAlpha && !isValidValue_noLock(a, bandAlpha)))
                     {
                         a = 0.0f;
                     }
@@ -1777,8 +1885,8 @@ public:
                         *(image->data(dst_col, dst_row) + 0) = g;
                         *(image->data(dst_col, dst_row) + 1) = g;
                         *(image->data(dst_col, dst_row) + 2) = g;
-                        if (!isValidValue(g, bandGray) ||
-                            (bandAlpha && !isValidValue(a, bandAlpha)))
+                        if (!isValidValue_noLock(g, bandGray) ||
+                            (bandAlpha && !isValidValue_noLock(a, bandAlpha)))
                         {
                             a = 0.0f;
                         }
@@ -1841,7 +1949,7 @@ public:
                         osg::Vec4ub color;
                         osg::Vec4f pixel;
                         if (getPalleteIndexColor(bandPalette, p, color) &&
-                            isValidValue((float)color.r(), bandPalette)) // need this?
+                            isValidValue_noLock((float)color.r(), bandPalette)) // need this?
                         {
                             pixel.r() = (float)color.r();
                         }
@@ -1859,7 +1967,7 @@ public:
                         {
                             color.a() = 0.0f;
                         }
-                        else if (!isValidValue((float)color.r(), bandPalette)) // is this applicable for palettized data?
+                        else if (!isValidValue_noLock((float)color.r(), bandPalette)) // is this applicable for palettized data?
                         {
                             color.a() = 0.0f;
                         }
@@ -1912,16 +2020,35 @@ public:
         return true;
     }
 
-    bool isValidValue(float v, GDALRasterBand* band)
+
+    // Reads single pixels straight from a band.
+    struct BandReader
     {
-        GDAL_SCOPED_LOCK;
-        return isValidValue_noLock( v, band );
-    }
+        BandReader(GDALTileSource* source, GDALRasterBand* band) : _source(source), _band(band) { }
+        void operator()(int col, int row, float& value) {
+            _source->rasterIO(_band, GF_Read, col, row, 1, 1, &value, 1, 1, GDT_Float32, 0, 0);
+        }
+        GDALTileSource* _source;
+        GDALRasterBand* _band;
+    };
 
+    // Reads pixels from a window of a band that was read into memory.
+    struct WindowReader
+    {
+        WindowReader(const std::vector<float>& data, int x, int y, int width) : _data(data), _x(x), _y(y), _width(width) { }
+        void operator()(int col, int row, float& value) {
+            value = _data[(row - _y) * _width + (col - _x)];
+        }
+        const std::vector<float>& _data;
+        int _x, _y, _width;
+    };
 
-    float getInterpolatedValue(GDALRasterBand *band, double x, double y, bool applyOffset=true)
+    /**
+    * Gets the (fractional) pixel location to sample for a map coordinate.
+    * Returns false if the location is outside the dataset.
+    */
+    bool getSampleLocation(double x, double y, bool applyOffset, double& c, double& r)
     {
-        double r, c;
         geoToPixel( x, y, c, r );
 
 
@@ -1953,38 +2080,65 @@ public:
             }
         }
 
-        float result = 0.0f;
-
         //If the location is outside of the pixel values of the dataset, just return 0
         if (c < 0 || r < 0 || c > _warpedDS->GetRasterXSize()-1 || r > _warpedDS->GetRasterYSize()-1)
-            return NO_DATA_VALUE;
+            return false;
 
+        return true;
+    }
+
+    /**
+    * Gets the range of pixels that interpolate() reads for a sample location.
+    */
+    void getSamplePixels(double c, double r, int& colMin, int& colMax, int& rowMin, int& rowMax)
+    {
         if ( _options.interpolation() == INTERP_NEAREST )
         {
-            rasterIO(band, GF_Read, (int)osg::round(c), (int)osg::round(r), 1, 1, &result, 1, 1, GDT_Float32, 0, 0);
-            if (!isValidValue(result, band))
-            {
-                return NO_DATA_VALUE;
-            }
+            colMin = colMax = (int)osg::round(c);
+            rowMin = rowMax = (int)osg::round(r);
         }
         else
         {
-            int rowMin = osg::maximum((int)floor(r), 0);
-            int rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(_warpedDS->GetRasterYSize()-1)), 0);
-            int colMin = osg::maximum((int)floor(c), 0);
-            int colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(_warpedDS->GetRasterXSize()-1)), 0);
+            rowMin = osg::maximum((int)floor(r), 0);
+            rowMax = osg::maximum(osg::minimum((int)ceil(r), (int)(_warpedDS->GetRasterYSize()-1)), 0);
+            colMin = osg::maximum((int)floor(c), 0);
+            colMax = osg::maximum(osg::minimum((int)ceil(c), (int)(_warpedDS->GetRasterXSize()-1)), 0);
 
             if (rowMin > rowMax) rowMin = rowMax;
             if (colMin > colMax) colMin = colMax;
+        }
+    }
 
+    /**
+    * Interpolates a value at a pixel location, reading pixels with the
+    * READER functor (see BandReader and WindowReader).
+    */
+    template<typename READER>
+    float interpolate(READER& read, GDALRasterBand* band, double c, double r)
+    {
+        float result = 0.0f;
+
+        int colMin, colMax, rowMin, rowMax;
+        getSamplePixels(c, r, colMin, colMax, rowMin, rowMax);
+
+        if ( _options.interpolation() == INTERP_NEAREST )
+        {
+            read(colMin, rowMin, result);
+            if (!isValidValue_noLock(result, band))
+            {
+                return NO_DATA_VALUE;
+            }
+        }
+        else
+        {
             float urHeight, llHeight, ulHeight, lrHeight;
 
-            rasterIO(band, GF_Read, colMin, rowMin, 1, 1, &llHeight, 1, 1, GDT_Float32, 0, 0);
-            rasterIO(band, GF_Read, colMin, rowMax, 1, 1, &ulHeight, 1, 1, GDT_Float32, 0, 0);
-            rasterIO(band, GF_Read, colMax, rowMin, 1, 1, &lrHeight, 1, 1, GDT_Float32, 0, 0);
-            rasterIO(band, GF_Read, colMax, rowMax, 1, 1, &urHeight, 1, 1, GDT_Float32, 0, 0);
+            read(colMin, rowMin, llHeight);
+            read(colMin, rowMax, ulHeight);
+            read(colMax, rowMin, lrHeight);
+            read(colMax, rowMax, urHeight);
 
-            if ((!isValidValue(urHeight, band)) || (!isValidValue(llHeight, band)) ||(!isValidValue(ulHeight, band)) || (!isValidValue(lrHeight, band)))
+            if ((!isValidValue_noLock(urHeight, band)) || (!isValidValue_noLock(llHeight, band)) ||(!isValidValue_noLock(ulHeight, band)) || (!isValidValue_noLock(lrHeight, band)))
             {
                 return NO_DATA_VALUE;
             }
@@ -2037,6 +2191,86 @@ public:
         return result;
     }
 
+    float getInterpolatedValue(GDALRasterBand *band, double x, double y, bool applyOffset=true)
+    {
+        double r, c;
+        if (!getSampleLocation(x, y, applyOffset, c, r))
+            return NO_DATA_VALUE;
+
+        BandReader read(this, band);
+        return interpolate(read, band, c, r);
+    }
+
+    /**
+    * Samples a tileSize x tileSize grid of interpolated values into a heightfield.
+    * Reads the window of pixels under the grid with one RasterIO and interpolates
+    * in memory; the values are the same as calling getInterpolatedValue for each
+    * post. Returns false if the window is too large or could not be read.
+    */
+    bool sampleWindow(GDALRasterBand* band, double xmin, double ymin, double xmax, double ymax, int tileSize, osg::HeightField* hf)
+    {
+        double dx = (xmax - xmin) / (tileSize-1);
+        double dy = (ymax - ymin) / (tileSize-1);
+
+        // find the pixels the samples will touch:
+        bool inside = false;
+        int winColMin = 0, winColMax = 0, winRowMin = 0, winRowMax = 0;
+        for (int r = 0; r < tileSize; ++r)
+        {
+            double geoY = ymin + (dy * (double)r);
+            for (int c = 0; c < tileSize; ++c)
+            {
+                double geoX = xmin + (dx * (double)c);
+                double pc, pr;
+                if (getSampleLocation(geoX, geoY, true, pc, pr))
+                {
+                    int colMin, colMax, rowMin, rowMax;
+                    getSamplePixels(pc, pr, colMin, colMax, rowMin, rowMax);
+                    winColMin = inside ? osg::minimum(winColMin, colMin) : colMin;
+                    winColMax = inside ? osg::maximum(winColMax, colMax) : colMax;
+                    winRowMin = inside ? osg::minimum(winRowMin, rowMin) : rowMin;
+                    winRowMax = inside ? osg::maximum(winRowMax, rowMax) : rowMax;
+                    inside = true;
+                }
+            }
+        }
+
+        int winWidth = winColMax - winColMin + 1;
+        int winHeight = winRowMax - winRowMin + 1;
+        std::vector<float> window;
+
+        // (if no samples fall inside the dataset there's nothing to read)
+        if (inside)
+        {
+            // When the tile is much coarser than the data, the samples are sparse
+            // and reading the whole window costs more than reading them one by one.
+            if ((double)winWidth * (double)winHeight > 16.0 * (double)tileSize * (double)tileSize)
+                return false;
+
+            window.resize(winWidth * winHeight);
+            if (!rasterIO(band, GF_Read, winColMin, winRowMin, winWidth, winHeight, &window[0], winWidth, winHeight, GDT_Float32, 0, 0))
+                return false;
+        }
+
+        WindowReader read(window, winColMin, winRowMin, winWidth);
+
+        for (int r = 0; r < tileSize; ++r)
+        {
+            double geoY = ymin + (dy * (double)r);
+            for (int c = 0; c < tileSize; ++c)
+            {
+                double geoX = xmin + (dx * (double)c);
+                double pc, pr;
+                float h = getSampleLocation(geoX, geoY, true, pc, pr) ?
+                    interpolate(read, band, pc, pr) :
+                    NO_DATA_VALUE;
+                hf->setHeight(c, r, h * _linearUnits);
+            }
+        }
+
+        return true;
+    }
+
     osg::HeightField* createHeightField( const TileKey&        key,
                                          ProgressCallback*     progress)
     {
@@ -2046,7 +2280,8 @@ public:
             return NULL;
         }
 
-        GDAL_SCOPED_LOCK;
+        GDALDataset* ds = getDataset();
+        OptionalGDALLock lock( ds == _warpedDS );
 
         int tileSize = getPixelsPerTile();
 
@@ -2061,11 +2296,11 @@ public:
             key.getExtent().getBounds(xmin, ymin, xmax, ymax);
 
             // Try to find a FLOAT band
-            GDALRasterBand* band = findBandByDataType(_warpedDS, GDT_Float32);
+            GDALRasterBand* band = findBandByDataType(ds, GDT_Float32);
             if (band == NULL)
             {
                 // Just get first band
-                band = _warpedDS->GetRasterBand(1);
+                band = ds->GetRasterBand(1);
             }
 
             if (_options.interpolation() == INTERP_NEAREST)
@@ -2084,9 +2319,9 @@ public:
                 int iNumRows = iRowMax - iRowMin + 1;
 
                 int iWinColMin = max(0, iColMin);
-                int iWinColMax = min(_warpedDS->GetRasterXSize()-1, iColMax);
+                int iWinColMax = min(ds->GetRasterXSize()-1, iColMax);
                 int iWinRowMin = max(0, iRowMin);
-                int iWinRowMax = min(_warpedDS->GetRasterYSize()-1, iRowMax);
+                int iWinRowMax = min(ds->GetRasterYSize()-1, iRowMax);
                 int iNumWinCols = iWinColMax - iWinColMin + 1;
                 int iNumWinRows = iWinRowMax - iWinRowMin + 1;
 
@@ -2110,7 +2345,7 @@ public:
                     }
                 }
             }
-            else
+            else if (!_options.windowedReads().get() || !sampleWindow(band, xmin, ymin, xmax, ymax, tileSize, hf.get()))
             {
                 double dx = (xmax - xmin) / (tileSize-1);
                 double dy = (ymax - ymin) / (tileSize-1);
@@ -2145,6 +2380,25 @@ private:
 
     GDALDataset* _srcDS;
     GDALDataset* _warpedDS;
+
+    // how to open another copy of the datasets, for concurrent reads
+    std::string  _openString;
+    std::string  _warpSrcWKT;
+    std::string  _warpDestWKT;
+    bool         _warpPolar;
+
+    struct ThreadDataset
+    {
+        ThreadDataset() : _src(0L), _warped(0L) { }
+        GDALDataset* _src;
+        GDALDataset* _warped;
+    };
+    typedef std::map<unsigned, ThreadDataset> ThreadDatasets;
+
+    bool             _concurrent;
+    ThreadDatasets   _threadDatasets;
+    Threading::Mutex _threadDatasetsMutex;
+
     double       _geotransform[6];
     double       _invtransform[6];
     double       _linearUnits;
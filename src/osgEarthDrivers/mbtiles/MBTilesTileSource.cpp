@@ -25,6 +25,7 @@
 #include <osgEarth/Registry>
 #include <osgEarth/ImageUtils>
 #include <osgDB/FileUtils>
+#include <OpenThreads/Thread>
 
 #include <sstream>
 #include <iomanip>
@@ -53,21 +54,91 @@ namespace
         }
         return rw;
     }
+
+    // Most encoded tiles to hold for the writer before storeImage() blocks.
+    const unsigned MAX_QUEUED_TILES = 1024u;
+
+    // Most tiles to insert in one transaction.
+    const unsigned MAX_TILES_PER_TRANSACTION = 1024u;
+
+    // How long a connection waits for another one's lock (ms).
+    const int BUSY_TIMEOUT_MS = 10000;
+
+    const char* SELECT_TILE_SQL = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
+    const char* INSERT_TILE_SQL = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
 }
 
 //......................................................................
 
+class MBTilesTileSource::Writer : public OpenThreads::Thread
+{
+public:
+    Writer(MBTilesTileSource* source) : _source(source) { }
+    void run() { _source->runWriter(); }
+private:
+    MBTilesTileSource* _source;
+};
+
+//......................................................................
+
 MBTilesTileSource::MBTilesTileSource(const TileSourceOptions& options) :
 TileSource( options ),
 _options  ( options ),
 _database ( NULL ),
 _minLevel ( 0 ),
 _maxLevel ( 20 ),
-_forceRGB ( false )
+_forceRGB ( false ),
+_writer   ( 0L ),
+_insertTile( 0L ),
+_writing  ( false ),
+_writerDone( false ),
+_writeFailed( false )
 {
     //nop
 }
 
+MBTilesTileSource::~MBTilesTileSource()
+{
+    if ( _writer )
+    {
+        // let the writer drain the queue, then exit.
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+            _writerDone = true;
+            _writeCond.broadcast();
+        }
+        _writer->join();
+        delete _writer;
+        _writer = 0L;
+    }
+
+    for(std::vector<ReadConnection*>::iterator i = _readConnections.begin(); i != _readConnections.end(); ++i)
+    {
+        sqlite3_finalize( (*i)->_selectTile );
+        sqlite3_close( (*i)->_db );
+        delete *i;
+    }
+    _readConnections.clear();
+    _idleReadConnections.clear();
+
+    if ( _insertTile )
+    {
+        sqlite3_finalize( _insertTile );
+        _insertTile = 0L;
+    }
+
+    if ( _database )
+    {
+        // back to a rollback journal, so the finished file doesn't
+        // depend on WAL support (or a writable folder) to be read.
+        if ( (MODE_WRITE & (int)getMode()) != 0 )
+            sqlite3_exec( _database, "PRAGMA journal_mode=DELETE", 0L, 0L, 0L );
+
+        sqlite3_close( _database );
+        _database = NULL;
+    }
+}
+
 Status
 MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
 {
@@ -120,6 +191,17 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
             << "Database \"" << fullFilename << "\": " << sqlite3_errmsg(_database) );
     }
 
+    _fullFilename = fullFilename;
+    sqlite3_busy_timeout( _database, BUSY_TIMEOUT_MS );
+
+    if ( readWrite )
+    {
+        // Write-ahead logging lets the read connections keep reading
+        // while the writer commits, and makes commits cheaper.
+        sqlite3_exec( _database, "PRAGMA journal_mode=WAL", 0L, 0L, 0L );
+        sqlite3_exec( _database, "PRAGMA synchronous=NORMAL", 0L, 0L, 0L );
+    }
+
     // New database setup:
     if ( isNewDatabase )
     {
@@ -285,6 +367,19 @@ MBTilesTileSource::initialize(const osgDB::Options* dbOptions)
     unsigned char *data = _emptyImage->data(0,0);
     memset(data, 0, 4 * size * size);
 
+    // start the writer:
+    if ( readWrite )
+    {
+        if ( SQLITE_OK != sqlite3_prepare_v2(_database, INSERT_TILE_SQL, -1, &_insertTile, 0L) )
+        {
+            return Status::Error( Status::ResourceUnavailable, Stringify()
+                << "Failed to prepare SQL: " << INSERT_TILE_SQL << "; " << sqlite3_errmsg(_database) );
+        }
+
+        _writer = new Writer(this);
+        _writer->start();
+    }
+
     return STATUS_OK;
 }
 
@@ -303,8 +398,6 @@ osg::Image*
 MBTilesTileSource::createImage(const TileKey&    key,
                                ProgressCallback* progress)
 {
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
-
     int z = key.getLevelOfDetail();
     int x = key.getTileX();
     int y = key.getTileY();
@@ -324,66 +417,122 @@ MBTilesTileSource::createImage(const TileKey&    key,
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
 
-    //Get the image
-    sqlite3_stmt* select = NULL;
-    std::string query = "SELECT tile_data from tiles where zoom_level = ? AND tile_column = ? AND tile_row = ?";
-    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &select, 0L );
-    if ( rc != SQLITE_OK )
+    // the tile may still be waiting for the writer.
+    if ( _writer )
     {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
-        return NULL;
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+        while ( _unwritten.find(TileID(z, x, y)) != _unwritten.end() )
+        {
+            _writeCond.wait( &_writeMutex );
+        }
     }
 
-    bool valid = true;
+    ReadConnection* conn = acquireReadConnection();
+    if ( !conn )
+    {
+        return NULL;
+    }
 
+    //Get the image
+    sqlite3_stmt* select = conn->_selectTile;
     sqlite3_bind_int( select, 1, z );
     sqlite3_bind_int( select, 2, x );
     sqlite3_bind_int( select, 3, y );
 
-    osg::Image* result = NULL;
-    rc = sqlite3_step( select );
+    bool valid = true;
+    std::string dataBuffer;
+
+    int rc = sqlite3_step( select );
     if ( rc == SQLITE_ROW)
     {
         // the pointer returned from _blob gets freed internally by sqlite, supposedly
         const char* data = (const char*)sqlite3_column_blob( select, 0 );
         int dataLen = sqlite3_column_bytes( select, 0 );
+        if ( data )
+            dataBuffer.assign( data, dataLen );
+    }
+    else
+    {
+        OE_DEBUG << LC << "SQL QUERY failed for " << SELECT_TILE_SQL << ": " << std::endl;
+        valid = false;
+    }
+
+    // done with the connection; decode without holding it.
+    sqlite3_reset( select );
+    releaseReadConnection( conn );
 
-        std::string dataBuffer( data, dataLen );
+    if ( !valid )
+    {
+        return NULL;
+    }
 
-        // decompress if necessary:
-        if ( _compressor.valid() )
+    // decompress if necessary:
+    if ( _compressor.valid() )
+    {
+        std::istringstream inputStream(dataBuffer);
+        std::string value;
+        if ( !_compressor->decompress(inputStream, value) )
         {
-            std::istringstream inputStream(dataBuffer);
-            std::string value;
-            if ( !_compressor->decompress(inputStream, value) )
-            {
-                if ( _options.filename().isSet() )
-                    OE_WARN << LC << "Decompression failed: " << _options.filename()->base() << std::endl;
-                else
-                    OE_WARN << LC << "Decompression failed" << std::endl;
-                valid = false;
-            }
+            if ( _options.filename().isSet() )
+                OE_WARN << LC << "Decompression failed: " << _options.filename()->base() << std::endl;
             else
-            {
-                dataBuffer = value;
-            }
+                OE_WARN << LC << "Decompression failed" << std::endl;
+            return NULL;
         }
+        dataBuffer = value;
+    }
+
+    // decode the raw image data:
+    std::istringstream inputStream(dataBuffer);
+    return ImageUtils::readStream(inputStream, _dbOptions.get());
+}
 
-        // decode the raw image data:
-        if ( valid )
+MBTilesTileSource::ReadConnection*
+MBTilesTileSource::acquireReadConnection()
+{
+    {
+        Threading::ScopedMutexLock lock(_readPoolMutex);
+        if ( !_idleReadConnections.empty() )
         {
-            std::istringstream inputStream(dataBuffer);
-            result = ImageUtils::readStream(inputStream, _dbOptions.get());
+            ReadConnection* conn = _idleReadConnections.back();
+            _idleReadConnections.pop_back();
+            return conn;
         }
     }
-    else
+
+    // none idle; open another.
+    sqlite3* db = 0L;
+    if ( SQLITE_OK != sqlite3_open_v2(_fullFilename.c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, 0L) )
     {
-        OE_DEBUG << LC << "SQL QUERY failed for " << query << ": " << std::endl;
-        valid = false;
+        OE_WARN << LC << "Failed to open \"" << _fullFilename << "\" for reading: " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close( db );
+        return 0L;
     }
 
-    sqlite3_finalize( select );
-    return result;
+    sqlite3_busy_timeout( db, BUSY_TIMEOUT_MS );
+
+    sqlite3_stmt* select = 0L;
+    if ( SQLITE_OK != sqlite3_prepare_v2(db, SELECT_TILE_SQL, -1, &select, 0L) )
+    {
+        OE_WARN << LC << "Failed to prepare SQL: " << SELECT_TILE_SQL << "; " << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close( db );
+        return 0L;
+    }
+
+    ReadConnection* conn = new ReadConnection();
+    conn->_db = db;
+    conn->_selectTile = select;
+
+    Threading::ScopedMutexLock lock(_readPoolMutex);
+    _readConnections.push_back( conn );
+    return conn;
+}
+
+void
+MBTilesTileSource::releaseReadConnection(ReadConnection* conn)
+{
+    Threading::ScopedMutexLock lock(_readPoolMutex);
+    _idleReadConnections.push_back( conn );
 }
 
 bool
@@ -391,10 +540,14 @@ MBTilesTileSource::storeImage(const TileKey&    key,
                               osg::Image*       image,
                               ProgressCallback* progress)
 {
-    if ( (getMode() & MODE_WRITE) == 0 )
+    if ( (getMode() & MODE_WRITE) == 0 || !_writer )
         return false;
 
-    Threading::ScopedMutexLock exclusiveLock(_mutex);
+    {
+        OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+        if ( _writeFailed )
+            return false;
+    }
 
     // encode the data stream:
     std::stringstream buf;
@@ -438,43 +591,150 @@ MBTilesTileSource::storeImage(const TileKey&    key,
     key.getProfile()->getNumTiles(key.getLevelOfDetail(), numCols, numRows);
     y  = numRows - y - 1;
 
-    // Prep the insert statement:
-    sqlite3_stmt* insert = NULL;
-    std::string query = "INSERT OR REPLACE INTO tiles (zoom_level, tile_column, tile_row, tile_data) VALUES (?, ?, ?, ?)";
-    int rc = sqlite3_prepare_v2( _database, query.c_str(), -1, &insert, 0L );
-    if ( rc != SQLITE_OK )
+    // queue it for the writer, waiting for room if necessary.
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+    while ( _writeQueue.size() >= MAX_QUEUED_TILES && !_writeFailed )
     {
-        OE_WARN << LC << "Failed to prepare SQL: " << query << "; " << sqlite3_errmsg(_database) << std::endl;
+        _writeCond.wait( &_writeMutex );
+    }
+
+    if ( _writeFailed )
         return false;
+
+    ++_unwritten[TileID(z, x, y)];
+
+    _writeQueue.push_back( PendingTile() );
+    PendingTile& tile = _writeQueue.back();
+    tile.z = z;
+    tile.x = x;
+    tile.y = y;
+    tile.data.swap( value );
+    _writeCond.broadcast();
+
+    return true;
+}
+
+void
+MBTilesTileSource::flush()
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+    while ( !_writeQueue.empty() || _writing )
+    {
+        _writeCond.wait( &_writeMutex );
     }
+}
 
-    // bind parameters:
-    sqlite3_bind_int( insert, 1, z );
-    sqlite3_bind_int( insert, 2, x );
-    sqlite3_bind_int( insert, 3, y );
+bool
+MBTilesTileSource::hasWriteError() const
+{
+    OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+    return _writeFailed;
+}
 
-    // bind the data blob:
-    sqlite3_bind_blob( insert, 4, value.c_str(), value.length(), SQLITE_STATIC );
+void
+MBTilesTileSource::runWriter()
+{
+    std::vector<PendingTile> batch;
 
-    // run the sql.
-    bool ok = true;
-    int tries = 0;
-    do {
-        rc = sqlite3_step(insert);
+    for(;;)
+    {
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+            while ( _writeQueue.empty() && !_writerDone )
+            {
+                _writeCond.wait( &_writeMutex );
+            }
+
+            if ( _writeQueue.empty() )
+                return;
+
+            // take everything waiting (up to a limit) as one transaction.
+            unsigned count = osg::minimum( (unsigned)_writeQueue.size(), MAX_TILES_PER_TRANSACTION );
+            batch.resize( count );
+            for(unsigned i=0; i<count; ++i)
+            {
+                PendingTile& tile = _writeQueue.front();
+                batch[i].z = tile.z;
+                batch[i].x = tile.x;
+                batch[i].y = tile.y;
+                batch[i].data.swap( tile.data );
+                _writeQueue.pop_front();
+            }
+            _writing = true;
+            _writeCond.broadcast(); // room in the queue
+        }
+
+        bool ok = writeTiles( batch );
+
+        {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_writeMutex);
+            for(std::vector<PendingTile>::const_iterator tile = batch.begin(); tile != batch.end(); ++tile)
+            {
+                std::map<TileID, unsigned>::iterator i = _unwritten.find(TileID(tile->z, tile->x, tile->y));
+                if ( i != _unwritten.end() && --i->second == 0u )
+                    _unwritten.erase( i );
+            }
+            if ( !ok )
+                _writeFailed = true;
+            _writing = false;
+            _writeCond.broadcast();
+        }
+
+        batch.clear();
+    }
+}
+
+bool
+MBTilesTileSource::writeTiles(std::vector<PendingTile>& tiles)
+{
+    Threading::ScopedMutexLock exclusiveLock(_mutex);
+
+    // one transaction for the batch; autocommitting each INSERT
+    // would sync the journal once per tile.
+    char* errorMsg = 0L;
+    if ( SQLITE_OK != sqlite3_exec(_database, "BEGIN", 0L, 0L, &errorMsg) )
+    {
+        OE_WARN << LC << "Failed to begin transaction: " << (errorMsg ? errorMsg : "") << std::endl;
+        sqlite3_free( errorMsg );
+        return false;
     }
-    while (++tries < 100 && (rc == SQLITE_BUSY || rc == SQLITE_LOCKED));
 
-    if (SQLITE_OK != rc && SQLITE_DONE != rc)
+    bool ok = true;
+
+    for(std::vector<PendingTile>::const_iterator tile = tiles.begin(); tile != tiles.end(); ++tile)
     {
+        // bind parameters:
+        sqlite3_bind_int( _insertTile, 1, tile->z );
+        sqlite3_bind_int( _insertTile, 2, tile->x );
+        sqlite3_bind_int( _insertTile, 3, tile->y );
+
+        // bind the data blob:
+        sqlite3_bind_blob( _insertTile, 4, tile->data.c_str(), tile->data.length(), SQLITE_STATIC );
+
+        // run the sql.
+        int rc = sqlite3_step( _insertTile );
+        if (SQLITE_OK != rc && SQLITE_DONE != rc)
+        {
 #if SQLITE_VERSION_NUMBER >= 3007015
-        OE_WARN << LC << "Failed query: " << query << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(_database) << std::endl;
+            OE_WARN << LC << "Failed query: " << INSERT_TILE_SQL << "(" << rc << ")" << sqlite3_errstr(rc) << "; " << sqlite3_errmsg(_database) << std::endl;
 #else
-        OE_WARN << LC << "Failed query: " << query << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(_database) << std::endl;
+            OE_WARN << LC << "Failed query: " << INSERT_TILE_SQL << "(" << rc << ")" << rc << "; " << sqlite3_errmsg(_database) << std::endl;
 #endif
-        ok = false;
+            ok = false;
+        }
+
+        sqlite3_reset( _insertTile );
     }
 
-    sqlite3_finalize( insert );
+    sqlite3_clear_bindings( _insertTile );
+
+    if ( SQLITE_OK != sqlite3_exec(_database, "COMMIT", 0L, 0L, &errorMsg) )
+    {
+        OE_WARN << LC << "Failed to commit " << tiles.size() << " tiles: " << (errorMsg ? errorMsg : "") << std::endl;
+        sqlite3_free( errorMsg );
+        sqlite3_exec( _database, "ROLLBACK", 0L, 0L, 0L );
+        return false;
+    }
 
     return ok;
 }
@@ -18,9 +18,7 @@
  */
 #include "DuktapeEngine"
 #include "JSGeometry"
-#include <osgEarth/JsonUtils>
 #include <osgEarth/StringUtils>
-#include <osgEarthFeatures/GeometryUtils>
 #include <sstream>
 
 #undef  LC
@@ -54,28 +52,139 @@ namespace
         return 0;
     }
 
-    static duk_ret_t oe_duk_save_feature(duk_context* ctx)
+    // Hidden (internal) property keys. Duktape never exposes keys
+    // starting with 0xFF to scripts.
+    const char* FEATURE_PTR   = "\xFF" "ptr";
+    const char* PROPERTIES    = "\xFF" "properties";
+    const char* GEOMETRY      = "\xFF" "geometry";
+
+    // Most compiled scripts to keep in each context.
+    const unsigned MAX_COMPILED = 256u;
+
+    // The native Feature behind a script feature object, or NULL if the
+    // object has been detached from it.
+    Feature* getFeature(duk_context* ctx, duk_idx_t index)
     {
-        // stack: [ptr]
+        Feature* feature = 0L;
+        if ( duk_is_object(ctx, index) )
+        {
+            duk_get_prop_string(ctx, index, FEATURE_PTR);
+            feature = reinterpret_cast<Feature*>(duk_get_pointer(ctx, -1));
+            duk_pop(ctx);
+        }
+        return feature;
+    }
 
-        // pull the feature ptr from argument #0
-        Feature* feature = reinterpret_cast<Feature*>(duk_require_pointer(ctx, 0));
+    // Pushes an object holding the feature's attributes. The complete
+    // profile reports unset values as null, like Feature::getGeoJSON().
+    void pushProperties(duk_context* ctx, Feature const* feature, bool complete)
+    {
+        duk_idx_t props_i = duk_push_object(ctx);
+        const AttributeTable& attrs = feature->getAttrs();
+        for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+        {
+            if ( complete && !a->second.second.set )
+            {
+                duk_push_null(ctx);
+            }
+            else
+            {
+                AttributeType type = a->second.first;
+                switch(type) {
+                case ATTRTYPE_DOUBLE: duk_push_number (ctx, a->second.getDouble()); break;
+                case ATTRTYPE_INT:    duk_push_int    (ctx, a->second.getInt()); break;
+                case ATTRTYPE_BOOL:   duk_push_boolean(ctx, a->second.getBool()); break;
+                case ATTRTYPE_STRING:
+                default:              duk_push_string (ctx, a->second.getString().c_str()); break;
+                }
+            }
+            duk_put_prop_string(ctx, props_i, a->first.c_str());
+        }
+    }
 
-        // Fetch the feature data:
-        duk_push_global_object(ctx);                    
-        // [ptr, global]
+    // feature.properties getter: builds the properties from the native
+    // Feature on first access. (magic = 1 for the complete profile)
+    static duk_ret_t oe_duk_get_properties(duk_context* ctx)
+    {
+        duk_push_this(ctx);                                      // [this]
+        if ( duk_has_prop_string(ctx, -1, PROPERTIES) )
+        {
+            duk_get_prop_string(ctx, -1, PROPERTIES);            // [this, props]
+            return 1;
+        }
+
+        Feature* feature = getFeature(ctx, -1);
+        if ( !feature )
+            return 0;
+
+        pushProperties(ctx, feature, duk_get_current_magic(ctx) != 0); // [this, props]
+        duk_dup_top(ctx);                                        // [this, props, props]
+        duk_put_prop_string(ctx, -3, PROPERTIES);                // [this, props]
+        return 1;
+    }
+
+    static duk_ret_t oe_duk_set_properties(duk_context* ctx)
+    {
+        duk_push_this(ctx);                                      // [value, this]
+        duk_dup(ctx, 0);                                         // [value, this, value]
+        duk_put_prop_string(ctx, -2, PROPERTIES);                // [value, this]
+        return 0;
+    }
+
+    // feature.geometry getter: builds the GeoJSON geometry from the
+    // native Feature on first access.
+    static duk_ret_t oe_duk_get_geometry(duk_context* ctx)
+    {
+        duk_push_this(ctx);                                      // [this]
+        if ( duk_has_prop_string(ctx, -1, GEOMETRY) )
+        {
+            duk_get_prop_string(ctx, -1, GEOMETRY);              // [this, geom]
+            return 1;
+        }
 
-        if ( !duk_get_prop_string(ctx, -1, "feature") || !duk_is_object(ctx, -1))
+        Feature* feature = getFeature(ctx, -1);
+        if ( !feature )
             return 0;
 
-         // [ptr, global, feature]
+        if ( GeometryAPI::push(ctx, feature->getGeometry()) )    // [this, geom]
+            GeometryAPI::bind(ctx, -1);
+        else
+            duk_push_undefined(ctx);                             // [this, undefined]
+
+        duk_dup_top(ctx);                                        // [this, geom, geom]
+        duk_put_prop_string(ctx, -3, GEOMETRY);                  // [this, geom]
+        return 1;
+    }
+
+    static duk_ret_t oe_duk_set_geometry(duk_context* ctx)
+    {
+        duk_push_this(ctx);                                      // [value, this]
+        duk_dup(ctx, 0);                                         // [value, this, value]
+        duk_put_prop_string(ctx, -2, GEOMETRY);                  // [value, this]
+        return 0;
+    }
+
+    // feature.attributes getter: an alias for feature.properties.
+    static duk_ret_t oe_duk_get_attributes(duk_context* ctx)
+    {
+        duk_push_this(ctx);                                      // [this]
+        duk_get_prop_string(ctx, -1, "properties");              // [this, props]
+        return 1;
+    }
+
+    // Writes a script feature object's properties and geometry back to
+    // the native Feature. Anything the script never touched is unchanged
+    // and skipped.
+    void saveFeature(duk_context* ctx, Feature* feature, duk_idx_t index)
+    {
+        index = duk_normalize_index(ctx, index);
 
-        if ( duk_get_prop_string(ctx, -1, "properties") && duk_is_object(ctx, -1) )
+        if ( duk_get_prop_string(ctx, index, PROPERTIES) && duk_is_object(ctx, -1) )
         {
-            // [ptr, global, feature, props]
+            // [props]
             duk_enum(ctx, -1, 0);                       
         
-            // [ptr, global, feature, props, enum]
+            // [props, enum]
             while( duk_next(ctx, -1, 1/*get_value=true*/) )
             {
                 std::string key( duk_get_string(ctx, -2) );
@@ -98,108 +207,159 @@ namespace
                  duk_pop_2(ctx);
             }
 
-            duk_pop_2(ctx);
-            // [ptr, global, feature]
-        }
-        else
-        {   // [ptr, global, feature, undefined]
             duk_pop(ctx);
-            // [ptr, global, feature]
+            // [props]
         }
+        duk_pop(ctx); // []
 
         // save the geometry, if set:
-        if ( duk_get_prop_string(ctx, -1, "geometry") )
+        if ( duk_get_prop_string(ctx, index, GEOMETRY) )
         {
+            // [geometry]
             if (duk_is_object(ctx, -1))
             {
-                // [ptr, global, feature, geometry]
-                std::string json( duk_json_encode(ctx, -1) ); // [ptr, global, feature, json]
-                Geometry* newGeom = GeometryUtils::geometryFromGeoJSON(json);
+                Geometry* newGeom = GeometryAPI::read(ctx, -1);
                 if ( newGeom )
                 {
                     feature->setGeometry( newGeom );
                 }
-                duk_pop(ctx); // [ptr, global, feature]
             }
             else
             {
                 feature->setGeometry(0L);
             }
         }
-        else
+        duk_pop(ctx); // []
+    }
+
+    // feature.save()
+    static duk_ret_t oe_duk_save(duk_context* ctx)
+    {
+        duk_push_this(ctx);                                      // [this]
+        Feature* feature = getFeature(ctx, -1);
+        if ( feature )
+            saveFeature(ctx, feature, -1);
+        return 0;
+    }
+
+    // oe_duk_save_feature(ptr): saves the global "feature" object
+    // to the native Feature (kept for scripts that call it directly).
+    static duk_ret_t oe_duk_save_feature(duk_context* ctx)
+    {
+        // stack: [ptr]
+
+        // pull the feature ptr from argument #0
+        Feature* feature = reinterpret_cast<Feature*>(duk_require_pointer(ctx, 0));
+
+        // Fetch the feature data:
+        duk_push_global_object(ctx);                    
+        // [ptr, global]
+
+        if ( duk_get_prop_string(ctx, -1, "feature") && duk_is_object(ctx, -1) )
         {
-            // [ptr, global, feature, undefined]
+            // [ptr, global, feature]
+            saveFeature(ctx, feature, -1);
         }
-        
-        // [ptr, global, feature]
+
         duk_pop_2(ctx);     // [ptr] (as we found it)
         return 0;           // no return values.
     }
+
+    // Defines a lazy property on the object at obj_i using the getter
+    // and (optional) setter functions stored in the stash at stash_i.
+    void defineAccessor(duk_context* ctx, duk_idx_t obj_i, duk_idx_t stash_i,
+                        const char* name, const char* getter, const char* setter, bool enumerable)
+    {
+        duk_uint_t flags =
+            DUK_DEFPROP_HAVE_GETTER | DUK_DEFPROP_SET_CONFIGURABLE |
+            (enumerable ? DUK_DEFPROP_SET_ENUMERABLE : DUK_DEFPROP_CLEAR_ENUMERABLE);
+
+        duk_push_string(ctx, name);                              // [name]
+        duk_get_prop_string(ctx, stash_i, getter);               // [name, getter]
+        if ( setter )
+        {
+            duk_get_prop_string(ctx, stash_i, setter);           // [name, getter, setter]
+            flags |= DUK_DEFPROP_HAVE_SETTER;
+        }
+        duk_def_prop(ctx, obj_i, flags);                         // []
+    }
 }
 
 //............................................................................
 
 namespace
 {
-    // Create a "feature" object in the global namespace.
+    // Create a "feature" object in the global namespace. Its "properties"
+    // and "geometry" are read from the native Feature only if the script
+    // asks for them.
     void setFeature(duk_context* ctx, Feature const* feature, bool complete)
     {
-        duk_push_global_object(ctx);                             // [global]
+        duk_push_global_stash(ctx);                              // [stash]
+        duk_idx_t stash_i = duk_get_top_index(ctx);
+
+        // Detach the previous feature object from its native Feature,
+        // which may not outlive it; the script can still hold a reference.
+        if ( duk_get_prop_string(ctx, stash_i, "feature") )      // [stash, prev]
+        {
+            duk_push_pointer(ctx, 0L);
+            duk_put_prop_string(ctx, -2, FEATURE_PTR);
+        }
+        duk_pop(ctx);                                            // [stash]
+
+        duk_idx_t feature_i = duk_push_object(ctx);              // [stash, feature]
 
         // Complete profile: properties, geometry, and API bindings.
         if ( complete )
         {
-            std::string geojson = feature->getGeoJSON();
-            duk_push_string(ctx, geojson.c_str());               // [global, json]
-            duk_json_decode(ctx, -1);                            // [global, feature]
-            duk_push_pointer(ctx, (void*)feature);               // [global, feature, ptr]
-            duk_put_prop_string(ctx, -2, "__ptr");               // [global, feature]
-            duk_put_prop_string(ctx, -2, "feature");             // [global]
+            duk_push_string(ctx, "Feature");
+            duk_put_prop_string(ctx, feature_i, "type");
 
-            // add the save() function and the "attributes" alias.
-            duk_eval_string_noresult(ctx,
-                "feature.save = function() {"
-                "    oe_duk_save_feature(this.__ptr);"
-                "} ");
+            duk_push_uint(ctx, (unsigned int)feature->getFID());
+            duk_put_prop_string(ctx, feature_i, "id");
 
-            duk_eval_string_noresult(ctx,
-                "Object.defineProperty(feature, 'attributes', {get:function() {return feature.properties;}});");
+            defineAccessor(ctx, feature_i, stash_i, "geometry", "get_geometry", "set_geometry", true);
+            defineAccessor(ctx, feature_i, stash_i, "properties", "get_properties_full", "set_properties", true);
 
-            GeometryAPI::bindToFeature(ctx);
+            duk_push_pointer(ctx, (void*)feature);
+            duk_put_prop_string(ctx, feature_i, "__ptr");
+
+            // add the save() function and the "attributes" alias.
+            duk_get_prop_string(ctx, stash_i, "save");
+            duk_put_prop_string(ctx, feature_i, "save");
+
+            defineAccessor(ctx, feature_i, stash_i, "attributes", "get_attributes", 0L, false);
         }
 
         // Minimal profile: ID and properties only. MUCH faster!
         else
         {
-            duk_idx_t feature_i = duk_push_object(ctx);
-            {
-                duk_push_int(ctx, feature->getFID());
-                duk_put_prop_string(ctx, feature_i, "id");
+            duk_push_int(ctx, feature->getFID());
+            duk_put_prop_string(ctx, feature_i, "id");
 
-                duk_idx_t props_i = duk_push_object(ctx);
-                {
-                    const AttributeTable& attrs = feature->getAttrs();
-                    for(AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
-                    {
-                        AttributeType type = a->second.first;
-                        switch(type) {
-                        case ATTRTYPE_DOUBLE: duk_push_number (ctx, a->second.getDouble()); break;
-                        case ATTRTYPE_INT:    duk_push_int    (ctx, a->second.getInt()); break;
-                        case ATTRTYPE_BOOL:   duk_push_boolean(ctx, a->second.getBool()); break;
-                        case ATTRTYPE_STRING:
-                        default:              duk_push_string (ctx, a->second.getString().c_str()); break;
-                        }
-                        duk_put_prop_string(ctx, props_i, a->first.c_str());
-                    }
-                }
-                duk_put_prop_string(ctx, feature_i, "properties");
-            }
-            duk_put_prop_string(ctx, -2, "feature");
+            defineAccessor(ctx, feature_i, stash_i, "properties", "get_properties", "set_properties", true);
         }
 
-        duk_pop(ctx); 
+        duk_push_pointer(ctx, (void*)feature);
+        duk_put_prop_string(ctx, feature_i, FEATURE_PTR);
+
+        duk_dup(ctx, feature_i);                                 // [stash, feature, feature]
+        duk_put_prop_string(ctx, stash_i, "feature");            // [stash, feature]
+
+        duk_push_global_object(ctx);                             // [stash, feature, global]
+        duk_swap_top(ctx, -2);                                   // [stash, global, feature]
+        duk_put_prop_string(ctx, -2, "feature");                 // [stash, global]
+
+        duk_pop_2(ctx);                                          // []
+    }
+
+    // Stores a Duktape/C function in the object at obj_i.
+    void putFunction(duk_context* ctx, duk_idx_t obj_i, const char* name,
+                     duk_c_function func, duk_idx_t nargs, duk_int_t magic =0)
+    {
+        duk_push_c_function(ctx, func, nargs);
+        duk_set_magic(ctx, -1, magic);
+        duk_put_prop_string(ctx, obj_i, name);
     }
-    
 }
 
 //............................................................................
@@ -207,6 +367,7 @@ namespace
 DuktapeEngine::Context::Context()
 {
     _ctx = 0L;
+    _numCompiled = 0u;
 }
 
 void
@@ -246,7 +407,96 @@ DuktapeEngine::Context::initialize(const ScriptEngineOptions& options, bool comp
         }
 
         duk_pop(_ctx); // []
+
+        // Private state, out of the scripts' reach: the functions shared
+        // by all feature objects, and the compiled script cache.
+        duk_push_global_stash(_ctx);                   // [stash]
+        duk_idx_t stash_i = duk_get_top_index(_ctx);
+        putFunction(_ctx, stash_i, "get_properties", oe_duk_get_properties, 0, 0);
+        putFunction(_ctx, stash_i, "get_properties_full", oe_duk_get_properties, 0, 1);
+        putFunction(_ctx, stash_i, "set_properties", oe_duk_set_properties, 1);
+        putFunction(_ctx, stash_i, "get_geometry", oe_duk_get_geometry, 0);
+        putFunction(_ctx, stash_i, "set_geometry", oe_duk_set_geometry, 1);
+        putFunction(_ctx, stash_i, "get_attributes", oe_duk_get_attributes, 0);
+        putFunction(_ctx, stash_i, "save", oe_duk_save, 0);
+        duk_pop(_ctx); // []
+    }
+}
+
+bool
+DuktapeEngine::Context::pushCompiled(const std::string& code)
+{
+    duk_push_global_stash(_ctx);                               // [stash]
+
+    if ( duk_get_prop_string(_ctx, -1, "compiled") )           // [stash, compiled]
+    {
+        if ( duk_get_prop_string(_ctx, -1, code.c_str()) )     // [stash, compiled, func]
+        {
+            duk_remove(_ctx, -2);
+            duk_remove(_ctx, -2);                              // [func]
+            return true;
+        }
+        duk_pop(_ctx);                                         // [stash, compiled]
+    }
+
+    // start over when the cache is full (or doesn't exist yet). The cache
+    // has no prototype, so no code string can match an inherited property.
+    if ( !duk_is_object(_ctx, -1) || _numCompiled >= MAX_COMPILED )
+    {
+        duk_pop(_ctx);                                         // [stash]
+        duk_push_object(_ctx);                                 // [stash, compiled]
+        duk_push_undefined(_ctx);
+        duk_set_prototype(_ctx, -2);
+        duk_dup_top(_ctx);                                     // [stash, compiled, compiled]
+        duk_put_prop_string(_ctx, -3, "compiled");             // [stash, compiled]
+        _numCompiled = 0u;
+    }
+
+    // compile as eval code, so the call returns the completion value just
+    // like duk_peval_string does.
+    bool ok = (duk_pcompile_string(_ctx, DUK_COMPILE_EVAL, code.c_str()) == 0); // [stash, compiled, func]
+    if ( ok )
+    {
+        duk_dup_top(_ctx);                                     // [stash, compiled, func, func]
+        duk_put_prop_string(_ctx, -3, code.c_str());           // [stash, compiled, func]
+        ++_numCompiled;
     }
+
+    duk_remove(_ctx, -2);
+    duk_remove(_ctx, -2);                                      // [func] or [error]
+    return ok;
+}
+
+ScriptResult
+DuktapeEngine::Context::call(Feature const* feature, bool complete)
+{
+    // stack: [func]
+
+	if ( feature && feature != _feature.get() )
+    {
+		// encode the feature in the global object and push a native pointer:
+		setFeature(_ctx, feature, complete);
+	}
+
+    // remember the feature so we don't re-create it if not necessary
+    _feature = feature;
+
+    // run the script. On error, the top of stack will hold the error
+    // message instead of the return value.
+    std::string resultString;
+
+    duk_push_global_object(_ctx);                              // [func, global] ('this')
+    bool ok = (duk_pcall_method(_ctx, 0) == 0);                // [ "result" ]
+    const char* resultVal = duk_to_string(_ctx, -1);
+    if ( resultVal )
+        resultString = resultVal;
+
+    // pop the return value:
+    duk_pop(_ctx); // []
+
+    return ok ?
+        ScriptResult(resultString, true) :
+        ScriptResult("", false, resultString);
 }
 
 DuktapeEngine::Context::~Context()
@@ -286,41 +536,67 @@ DuktapeEngine::run(const std::string&   code,
     // brand new context every time
     Context c;
     c.initialize( _options, complete );
-    duk_context* ctx = c._ctx;
 #else
     // cache the Context on a per-thread basis
     Context& c = _contexts.get();
     c.initialize( _options, complete );
-    duk_context* ctx = c._ctx;
 #endif
 
-	if ( feature && feature != c._feature.get() )
+    if ( !c.pushCompiled(code) )
     {
-		// encode the feature in the global object and push a native pointer:
-		setFeature(ctx, feature, complete);
-	}
+        // compile error: report the message.
+        std::string message( duk_safe_to_string(c._ctx, -1) );
+        duk_pop(c._ctx);
+        OE_DEBUG << LC << "Error: source =" << std::endl << code << std::endl;
+        return ScriptResult("", false, message);
+    }
 
-    // remember the feature so we don't re-create it if not necessary
-    c._feature = feature;
+    ScriptResult result = c.call(feature, complete); // []
+    if ( !result.success() )
+    {
+        OE_DEBUG << LC << "Error: source =" << std::endl << code << std::endl;
+    }
+    return result;
+}
 
-    // run the script. On error, the top of stack will hold the error
-    // message instead of the return value.
-    std::string resultString;
+void
+DuktapeEngine::run(const std::string&   code,
+                   const FeatureList&   features,
+                   std::vector<ScriptResult>& results,
+                   FilterContext const* context)
+{
+    if (code.empty())
+    {
+        results.insert(results.end(), features.size(), ScriptResult(EMPTY_STRING, false, "Script is empty."));
+        return;
+    }
 
-    bool ok = (duk_peval_string(ctx, code.c_str()) == 0); // [ "result" ]
-    const char* resultVal = duk_to_string(ctx, -1);
-    if ( resultVal )
-        resultString = resultVal;
+    bool complete = (getProfile() == "full");
 
-    if ( !ok )
+#ifdef MAXIMUM_ISOLATION
+    Context c;
+    c.initialize( _options, complete );
+#else
+    Context& c = _contexts.get();
+    c.initialize( _options, complete );
+#endif
+
+    // compile once, run for each feature.
+    if ( !c.pushCompiled(code) ) // [func]
     {
+        std::string message( duk_safe_to_string(c._ctx, -1) );
+        duk_pop(c._ctx);
         OE_DEBUG << LC << "Error: source =" << std::endl << code << std::endl;
+        results.insert(results.end(), features.size(), ScriptResult("", false, message));
+        return;
     }
 
-    // pop the return value:
-    duk_pop(ctx); // []
+    results.reserve(results.size() + features.size());
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        duk_dup_top(c._ctx);                  // [func, func]
+        results.push_back( c.call(i->get(), complete) ); // [func]
+    }
 
-    return ok ?
-        ScriptResult(resultString, true) :
-        ScriptResult("", false, resultString);
+    duk_pop(c._ctx); // []
 }
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>
  */
 #include <osgEarthFeatures/AltitudeFilter>
+#include <osgEarthFeatures/ExpressionEvaluator>
 #include <osgEarth/ElevationQuery>
 #include <osgEarth/GeoData>
 
@@ -73,6 +74,9 @@ AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
     if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
         offsetExpr = *_altitude->verticalOffset();
 
+    NumericExpressionEvaluator scaleEval( scaleExpr );
+    NumericExpressionEvaluator offsetEval( offsetExpr );
+
     bool gpuClamping =
         _altitude.valid() &&
         _altitude->technique() == _altitude->TECHNIQUE_GPU;
@@ -99,11 +103,11 @@ AltitudeFilter::pushAndDontClamp( FeatureList& features, FilterContext& cx )
 
         double scaleZ = 1.0;
         if ( _altitude.valid() && _altitude->verticalScale().isSet() )
-            scaleZ = feature->eval( scaleExpr, &cx );
+            scaleZ = scaleEval.eval( feature, &cx );
 
         optional<double> offsetZ( 0.0 );
         if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
-            offsetZ = feature->eval( offsetExpr, &cx );       
+            offsetZ = offsetEval.eval( feature, &cx );       
         
         GeometryIterator gi( feature->getGeometry() );
         while( gi.hasMore() )
@@ -171,6 +175,9 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
     if ( _altitude->verticalOffset().isSet() )
         offsetExpr = *_altitude->verticalOffset();
 
+    NumericExpressionEvaluator scaleEval( scaleExpr );
+    NumericExpressionEvaluator offsetEval( offsetExpr );
+
     // whether to record the min/max height-above-terrain values.
     bool collectHATs =
         _altitude->clamping() == AltitudeSymbol::CLAMP_RELATIVE_TO_TERRAIN ||
@@ -204,11 +211,11 @@ AltitudeFilter::pushAndClamp( FeatureList& features, FilterContext& cx )
 
         double scaleZ = 1.0;
         if ( _altitude.valid() && _altitude->verticalScale().isSet() )
-            scaleZ = feature->eval( scaleExpr, &cx );
+            scaleZ = scaleEval.eval( feature, &cx );
 
         double offsetZ = 0.0;
         if ( _altitude.valid() && _altitude->verticalOffset().isSet() )
-            offsetZ = feature->eval( offsetExpr, &cx );
+            offsetZ = offsetEval.eval( feature, &cx );
 
         osgEarth::Bounds bounds = feature->getGeometry()->getBounds();
         const osg::Vec2d& center = bounds.center2d();
@@ -0,0 +1,271 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/ExpressionEvaluator>
+#include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/ScriptEngine>
+#include <osgEarthFeatures/Session>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+#define LC "[ExpressionEvaluator] "
+
+namespace
+{
+    ScriptEngine* getScriptEngine(const FilterContext* context)
+    {
+        return context && context->getSession() ? context->getSession()->getScriptEngine() : 0L;
+    }
+
+    // Runs a variable that isn't an attribute as script, like Feature::eval.
+    double runNumericScript(const NumericExpression& expr, const std::string& code, const Feature* feature, const FilterContext* context)
+    {
+        ScriptEngine* engine = getScriptEngine(context);
+        if (engine)
+        {
+            ScriptResult result = engine->run(code, feature, context);
+            if (result.success())
+                return result.asDouble();
+
+            OE_WARN << LC << "Feature Script error on '" << expr.expr() << "': " << result.message() << std::endl;
+        }
+        return 0.0;
+    }
+
+    void runStringScript(const StringExpression& expr, const std::string& code, const Feature* feature, const FilterContext* context, std::string& out)
+    {
+        out.clear();
+        ScriptEngine* engine = getScriptEngine(context);
+        if (engine)
+        {
+            ScriptResult result = engine->run(code, feature, context);
+            if (result.success())
+            {
+                out = result.asString();
+            }
+            else
+            {
+                // Couldn't execute it as code, just take it as a string literal.
+                out = code;
+                OE_DEBUG << LC << "Feature Script error on '" << expr.expr() << "': " << result.message() << std::endl;
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+
+NumericExpressionEvaluator::NumericExpressionEvaluator(const NumericExpression& expr) :
+_expr         ( expr ),
+_schema       ( 0L ),
+_constant     ( expr.variables().empty() ),
+_constantValue( 0.0 )
+{
+    _values.resize(_expr.variables().size(), 0.0);
+    if (_constant)
+        _constantValue = _expr.eval();
+}
+
+double
+NumericExpressionEvaluator::eval(const Feature* feature, const FilterContext* context)
+{
+    if (_constant)
+        return _constantValue;
+
+    // AttributeTable compares names case-insensitively, so the variable
+    // names can be looked up as they are.
+    const NumericExpression::Variables& vars = _expr.variables();
+    const AttributeTable& attrs = feature->getAttrs();
+    for (unsigned i = 0; i < vars.size(); ++i)
+    {
+        AttributeTable::const_iterator a = attrs.find(vars[i].first);
+        _values[i] = a != attrs.end() ?
+            a->second.getDouble(0.0) :
+            runNumericScript(_expr, vars[i].first, feature, context);
+    }
+
+    return _expr.eval(&_values[0]);
+}
+
+double
+NumericExpressionEvaluator::eval(const FeatureTable& table, unsigned row, const FilterContext* context)
+{
+    if (_constant)
+        return _constantValue;
+
+    if (_schema.get() != table.getSchema())
+    {
+        table.bind(_expr, _binding);
+        _schema = table.getSchema();
+    }
+
+    osg::ref_ptr<Feature> scriptFeature;
+
+    const NumericExpression::Variables& vars = _expr.variables();
+    for (unsigned i = 0; i < vars.size(); ++i)
+    {
+        if (_binding[i] >= 0 && table.hasAttr(row, _binding[i]))
+        {
+            _values[i] = table.getDouble(row, _binding[i], 0.0);
+        }
+        else
+        {
+            if (!scriptFeature.valid() && getScriptEngine(context))
+                scriptFeature = table.createFeature(row);
+
+            _values[i] = runNumericScript(_expr, vars[i].first, scriptFeature.get(), context);
+        }
+    }
+
+    return _expr.eval(&_values[0]);
+}
+
+void
+NumericExpressionEvaluator::evalAll(const FeatureList& features, std::vector<double>& out_values, const FilterContext* context)
+{
+    out_values.resize(features.size());
+    unsigned i = 0;
+    for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+        out_values[i++] = eval(f->get(), context);
+}
+
+void
+NumericExpressionEvaluator::evalAll(const FeatureTable& table, std::vector<double>& out_values, const FilterContext* context)
+{
+    out_values.resize(table.size());
+    for (unsigned row = 0; row < table.size(); ++row)
+        out_values[row] = eval(table, row, context);
+}
+
+//----------------------------------------------------------------------------
+
+StringExpressionEvaluator::StringExpressionEvaluator(const StringExpression& expr) :
+_expr  ( expr ),
+_schema( 0L )
+{
+    _values.resize(_expr.variables().size());
+    _scratch.resize(_expr.variables().size());
+}
+
+void
+StringExpressionEvaluator::resolve(const Feature* feature, const FilterContext* context)
+{
+    const StringExpression::Variables& vars = _expr.variables();
+    const AttributeTable& attrs = feature->getAttrs();
+    for (unsigned i = 0; i < vars.size(); ++i)
+    {
+        AttributeTable::const_iterator a = attrs.find(vars[i].first);
+        if (a != attrs.end() && a->second.first == ATTRTYPE_STRING && a->second.second.set)
+        {
+            // read string attributes in place
+            const std::string& value = a->second.second.stringValue;
+            _values[i] = StringExpression::StringRef(value.c_str(), value.length());
+            continue;
+        }
+
+        if (a != attrs.end())
+            _scratch[i] = a->second.getString();
+        else
+            runStringScript(_expr, vars[i].first, feature, context, _scratch[i]);
+
+        _values[i] = StringExpression::StringRef(_scratch[i].c_str(), _scratch[i].length());
+    }
+}
+
+void
+StringExpressionEvaluator::resolve(const FeatureTable& table, unsigned row, const FilterContext* context)
+{
+    if (_schema.get() != table.getSchema())
+    {
+        table.bind(_expr, _binding);
+        _schema = table.getSchema();
+    }
+
+    osg::ref_ptr<Feature> scriptFeature;
+
+    const StringExpression::Variables& vars = _expr.variables();
+    for (unsigned i = 0; i < vars.size(); ++i)
+    {
+        int col = _binding[i];
+        if (col >= 0 && !table.hasAttr(row, col))
+            col = -1; // absent from this row's feature; try it as script
+
+        if (col >= 0 && _schema->getType(col) == ATTRTYPE_STRING)
+        {
+            unsigned length;
+            const char* value = table.getCString(row, col, length);
+            _values[i] = StringExpression::StringRef(value ? value : "", length);
+            continue;
+        }
+
+        if (col >= 0)
+        {
+            _scratch[i] = table.getString(row, col);
+        }
+        else
+        {
+            if (!scriptFeature.valid() && getScriptEngine(context))
+                scriptFeature = table.createFeature(row);
+
+            runStringScript(_expr, vars[i].first, scriptFeature.get(), context, _scratch[i]);
+        }
+
+        _values[i] = StringExpression::StringRef(_scratch[i].c_str(), _scratch[i].length());
+    }
+}
+
+const std::string&
+StringExpressionEvaluator::eval(const Feature* feature, const FilterContext* context)
+{
+    resolve(feature, context);
+    _expr.eval(_values.empty() ? 0L : &_values[0], _result);
+    return _result;
+}
+
+const std::string&
+StringExpressionEvaluator::eval(const FeatureTable& table, unsigned row, const FilterContext* context)
+{
+    resolve(table, row, context);
+    _expr.eval(_values.empty() ? 0L : &_values[0], _result);
+    return _result;
+}
+
+void
+StringExpressionEvaluator::evalAll(const FeatureList& features, std::vector<std::string>& out_values, const FilterContext* context)
+{
+    out_values.resize(features.size());
+    unsigned i = 0;
+    for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+    {
+        resolve(f->get(), context);
+        _expr.eval(_values.empty() ? 0L : &_values[0], out_values[i++]);
+    }
+}
+
+void
+StringExpressionEvaluator::evalAll(const FeatureTable& table, std::vector<std::string>& out_values, const FilterContext* context)
+{
+    out_values.resize(table.size());
+    for (unsigned row = 0; row < table.size(); ++row)
+    {
+        resolve(table, row, context);
+        _expr.eval(_values.empty() ? 0L : &_values[0], out_values[row]);
+    }
+}
@@ -355,7 +355,7 @@ Feature::eval( NumericExpression& expr, FilterContext const* context ) const
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
       double val = 0.0;
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
+      AttributeTable::const_iterator ai = _attrs.find(i->first);
       if (ai != _attrs.end())
       {
         val = ai->second.getDouble(0.0);
@@ -388,7 +388,7 @@ Feature::eval(NumericExpression& expr, Session* session) const
     for( NumericExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
         double val = 0.0;
-        AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
+        AttributeTable::const_iterator ai = _attrs.find(i->first);
         if (ai != _attrs.end())
         {
             val = ai->second.getDouble(0.0);
@@ -424,7 +424,7 @@ Feature::eval( StringExpression& expr, FilterContext const* context ) const
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
       std::string val = "";
-      AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
+      AttributeTable::const_iterator ai = _attrs.find(i->first);
       if (ai != _attrs.end())
       {
         val = ai->second.getString();
@@ -460,7 +460,7 @@ Feature::eval(StringExpression& expr, Session* session) const
     for( StringExpression::Variables::const_iterator i = vars.begin(); i != vars.end(); ++i )
     {
         std::string val = "";
-        AttributeTable::const_iterator ai = _attrs.find(toLower(i->first));
+        AttributeTable::const_iterator ai = _attrs.find(i->first);
         if (ai != _attrs.end())
         {
             val = ai->second.getString();
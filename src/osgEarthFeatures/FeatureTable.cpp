@@ -0,0 +1,520 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthFeatures/FeatureTable>
+#include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/ScriptEngine>
+#include <osgEarthFeatures/Session>
+
+#include <osgEarth/Containers>
+#include <osgEarth/StringUtils>
+#include <osgEarth/ThreadingUtils>
+#include <osg/observer_ptr>
+#include <algorithm>
+#include <cstring>
+
+using namespace osgEarth;
+using namespace osgEarth::Features;
+using namespace osgEarth::Symbology;
+
+#define LC "[FeatureTable] "
+
+#define ARENA_BLOCK_SIZE 65536u
+
+namespace
+{
+    // Weak, so a schema goes away with the last table using it
+    typedef std::map<FeatureSchema, osg::observer_ptr<AttributeSchema> > SchemaRegistry;
+
+    Threading::Mutex s_schemaRegistryMutex;
+
+    SchemaRegistry& schemaRegistry()
+    {
+        static SchemaRegistry s_registry;
+        return s_registry;
+    }
+
+    // A string compared by content, for de-duplicating a column's values
+    struct StringKey
+    {
+        StringKey() : _ptr(0L), _length(0u) { }
+        StringKey(const char* ptr, unsigned length) : _ptr(ptr), _length(length) { }
+
+        bool operator==(const StringKey& rhs) const {
+            return _length == rhs._length && ::memcmp(_ptr, rhs._ptr, _length) == 0;
+        }
+
+        const char* _ptr;
+        unsigned    _length;
+    };
+
+    // FNV-1a
+    struct StringKeyHash
+    {
+        size_t operator()(const StringKey& key) const {
+            unsigned h = 2166136261u;
+            for (unsigned i = 0; i < key._length; ++i)
+                h = (h ^ (unsigned char)key._ptr[i]) * 16777619u;
+            return h;
+        }
+    };
+
+    typedef hash_map<StringKey, const char*, StringKeyHash> StringDictionary;
+}
+
+//----------------------------------------------------------------------------
+
+osg::ref_ptr<const AttributeSchema>
+AttributeSchema::intern(const FeatureSchema& schema)
+{
+    Threading::ScopedMutexLock lock(s_schemaRegistryMutex);
+
+    SchemaRegistry& registry = schemaRegistry();
+
+    osg::ref_ptr<AttributeSchema> result;
+    SchemaRegistry::iterator i = registry.find(schema);
+    if (i != registry.end() && i->second.lock(result))
+        return result.get();
+
+    // Making a new one; drop the entries of schemas that are gone.
+    for (SchemaRegistry::iterator j = registry.begin(); j != registry.end(); )
+    {
+        if (!j->second.valid())
+            registry.erase(j++);
+        else
+            ++j;
+    }
+
+    result = new AttributeSchema(schema);
+    registry[schema] = result.get();
+    return result.get();
+}
+
+AttributeSchema::AttributeSchema(const FeatureSchema& schema) :
+_schema( schema )
+{
+    for (FeatureSchema::const_iterator i = schema.begin(); i != schema.end(); ++i)
+    {
+        std::string key = toLower(i->first);
+        std::vector<Key>::iterator k = std::lower_bound(_keys.begin(), _keys.end(), Key(key, 0u));
+        if (k != _keys.end() && k->first == key)
+            continue;
+
+        _keys.insert(k, Key(key, _names.size()));
+        _names.push_back(i->first);
+        _types.push_back(i->second);
+    }
+}
+
+int
+AttributeSchema::indexOf(const std::string& name) const
+{
+    Key key(toLower(name), 0u);
+    std::vector<Key>::const_iterator k = std::lower_bound(_keys.begin(), _keys.end(), key);
+    return k != _keys.end() && k->first == key.first ? (int)k->second : -1;
+}
+
+//----------------------------------------------------------------------------
+
+FeatureTable::StringArena::~StringArena()
+{
+    for (unsigned i = 0; i < _blocks.size(); ++i)
+        delete [] _blocks[i];
+}
+
+const char*
+FeatureTable::StringArena::store(const char* str, unsigned length)
+{
+    if (_blocks.empty() || _blockUsed + length + 1u > _blockSize)
+    {
+        // strings longer than a block get a block of their own
+        _blockSize = osg::maximum(ARENA_BLOCK_SIZE, length + 1u);
+        _blocks.push_back(new char[_blockSize]);
+        _blockUsed = 0u;
+        _bytes += _blockSize;
+    }
+
+    char* ptr = _blocks.back() + _blockUsed;
+    ::memcpy(ptr, str, length);
+    ptr[length] = 0;
+    _blockUsed += length + 1u;
+    return ptr;
+}
+
+unsigned
+FeatureTable::StringArena::getMemoryUsage() const
+{
+    return _bytes;
+}
+
+//----------------------------------------------------------------------------
+
+FeatureTable::FeatureTable(const FeatureList& features, const FeatureSchema& schema)
+{
+    // Resolve the schema: add attributes it doesn't name, and type the
+    // ones it leaves unspecified from the data.
+    typedef std::map<std::string, AttributeType, CIStringComp> MergedSchema;
+    MergedSchema merged;
+    for (FeatureSchema::const_iterator i = schema.begin(); i != schema.end(); ++i)
+        merged.insert(*i);
+
+    for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+    {
+        const AttributeTable& attrs = f->get()->getAttrs();
+        for (AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+        {
+            AttributeType& type = merged[a->first];
+            if (type == ATTRTYPE_UNSPECIFIED && a->second.second.set)
+                type = a->second.first;
+        }
+    }
+
+    FeatureSchema resolved;
+    for (MergedSchema::const_iterator i = merged.begin(); i != merged.end(); ++i)
+        resolved[i->first] = i->second != ATTRTYPE_UNSPECIFIED ? i->second : ATTRTYPE_STRING;
+
+    _schema = AttributeSchema::intern(resolved);
+
+    unsigned rows = features.size();
+    _features.reserve(rows);
+    _columns.resize(_schema->size());
+    for (unsigned c = 0; c < _columns.size(); ++c)
+    {
+        Column& col = _columns[c];
+        col._type = _schema->getType(c);
+        col._state.resize(rows, STATE_ABSENT);
+        switch (col._type)
+        {
+            case ATTRTYPE_DOUBLE: col._doubles.resize(rows, 0.0); break;
+            case ATTRTYPE_INT:    col._ints.resize(rows, 0); break;
+            case ATTRTYPE_BOOL:   col._bools.resize(rows, 0); break;
+            default:              col._strings.resize(rows); break;
+        }
+    }
+
+    std::vector<StringDictionary> dictionaries(_columns.size());
+
+    for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f)
+    {
+        unsigned row = _features.size();
+        Feature* feature = f->get();
+        _features.push_back(feature);
+
+        const AttributeTable& attrs = feature->getAttrs();
+        for (AttributeTable::const_iterator a = attrs.begin(); a != attrs.end(); ++a)
+        {
+            int c = _schema->indexOf(a->first);
+            if (c < 0)
+                continue;
+
+            Column& col = _columns[c];
+            const AttributeValue& value = a->second;
+            if (!value.second.set)
+            {
+                col._state[row] = STATE_NULL;
+                continue;
+            }
+
+            col._state[row] = STATE_SET;
+            switch (col._type)
+            {
+                case ATTRTYPE_DOUBLE: col._doubles[row] = value.getDouble(); break;
+                case ATTRTYPE_INT:    col._ints[row] = value.getInt(); break;
+                case ATTRTYPE_BOOL:   col._bools[row] = value.getBool() ? 1 : 0; break;
+                default:
+                {
+                    std::string temp;
+                    const std::string& str = value.first == ATTRTYPE_STRING ? value.second.stringValue : (temp = value.getString());
+
+                    StringKey key(str.c_str(), str.length());
+                    StringDictionary& dictionary = dictionaries[c];
+                    StringDictionary::iterator d = dictionary.find(key);
+                    if (d == dictionary.end())
+                    {
+                        key._ptr = _arena.store(str.c_str(), str.length());
+                        d = dictionary.insert(std::make_pair(key, key._ptr)).first;
+                    }
+
+                    col._strings[row]._ptr = d->second;
+                    col._strings[row]._length = str.length();
+                }
+            }
+        }
+
+        feature->_attrs.clear();
+    }
+}
+
+FeatureTable::~FeatureTable()
+{
+    //nop
+}
+
+std::string
+FeatureTable::getString(unsigned row, unsigned col) const
+{
+    const Column& c = _columns[col];
+    if (c._state[row] != STATE_SET)
+        return EMPTY_STRING;
+
+    switch (c._type)
+    {
+        case ATTRTYPE_DOUBLE: return osgEarth::toString(c._doubles[row]);
+        case ATTRTYPE_INT:    return osgEarth::toString(c._ints[row]);
+        case ATTRTYPE_BOOL:   return osgEarth::toString(c._bools[row] != 0);
+        default:              return std::string(c._strings[row]._ptr, c._strings[row]._length);
+    }
+}
+
+double
+FeatureTable::getDouble(unsigned row, unsigned col, double defaultValue) const
+{
+    const Column& c = _columns[col];
+    if (c._state[row] != STATE_SET)
+        return defaultValue;
+
+    switch (c._type)
+    {
+        case ATTRTYPE_DOUBLE: return c._doubles[row];
+        case ATTRTYPE_INT:    return (double)c._ints[row];
+        case ATTRTYPE_BOOL:   return c._bools[row] ? 1.0 : 0.0;
+        default:              return osgEarth::as<double>(std::string(c._strings[row]._ptr, c._strings[row]._length), defaultValue);
+    }
+}
+
+int
+FeatureTable::getInt(unsigned row, unsigned col, int defaultValue) const
+{
+    const Column& c = _columns[col];
+    if (c._state[row] != STATE_SET)
+        return defaultValue;
+
+    switch (c._type)
+    {
+        case ATTRTYPE_DOUBLE: return (int)c._doubles[row];
+        case ATTRTYPE_INT:    return c._ints[row];
+        case ATTRTYPE_BOOL:   return c._bools[row] ? 1 : 0;
+        default:              return osgEarth::as<int>(std::string(c._strings[row]._ptr, c._strings[row]._length), defaultValue);
+    }
+}
+
+bool
+FeatureTable::getBool(unsigned row, unsigned col, bool defaultValue) const
+{
+    const Column& c = _columns[col];
+    if (c._state[row] != STATE_SET)
+        return defaultValue;
+
+    switch (c._type)
+    {
+        case ATTRTYPE_DOUBLE: return c._doubles[row] != 0.0;
+        case ATTRTYPE_INT:    return c._ints[row] != 0;
+        case ATTRTYPE_BOOL:   return c._bools[row] != 0;
+        default:              return osgEarth::as<bool>(std::string(c._strings[row]._ptr, c._strings[row]._length), defaultValue);
+    }
+}
+
+const char*
+FeatureTable::getCString(unsigned row, unsigned col, unsigned& out_length) const
+{
+    const Column& c = _columns[col];
+    if (c._state[row] != STATE_SET || c._strings.empty())
+    {
+        out_length = 0u;
+        return 0L;
+    }
+
+    out_length = c._strings[row]._length;
+    return c._strings[row]._ptr;
+}
+
+AttributeValue
+FeatureTable::getValue(unsigned row, unsigned col) const
+{
+    const Column& c = _columns[col];
+
+    AttributeValue value;
+    value.first = c._type;
+    value.second.set = c._state[row] == STATE_SET;
+    value.second.doubleValue = 0.0;
+    value.second.intValue = 0;
+    value.second.boolValue = false;
+
+    if (value.second.set)
+    {
+        switch (c._type)
+        {
+            case ATTRTYPE_DOUBLE: value.second.doubleValue = c._doubles[row]; break;
+            case ATTRTYPE_INT:    value.second.intValue = c._ints[row]; break;
+            case ATTRTYPE_BOOL:   value.second.boolValue = c._bools[row] != 0; break;
+            default:              value.second.stringValue.assign(c._strings[row]._ptr, c._strings[row]._length); break;
+        }
+    }
+    return value;
+}
+
+void
+FeatureTable::bind(const NumericExpression& expr, AttributeBinding& out_binding) const
+{
+    const NumericExpression::Variables& vars = expr.variables();
+    out_binding.resize(vars.size());
+    for (unsigned i = 0; i < vars.size(); ++i)
+        out_binding[i] = _schema->indexOf(vars[i].first);
+}
+
+void
+FeatureTable::bind(const StringExpression& expr, AttributeBinding& out_binding) const
+{
+    const StringExpression::Variables& vars = expr.variables();
+    out_binding.resize(vars.size());
+    for (unsigned i = 0; i < vars.size(); ++i)
+        out_binding[i] = _schema->indexOf(vars[i].first);
+}
+
+Feature*
+FeatureTable::createFeature(unsigned row) const
+{
+    const Feature* source = _features[row].get();
+
+    Feature* feature = new Feature(
+        const_cast<Geometry*>(source->getGeometry()),
+        source->getSRS(),
+        source->style().isSet() ? source->style().get() : Style(),
+        source->getFID());
+
+    feature->geoInterp() = source->geoInterp();
+
+    for (unsigned c = 0; c < _columns.size(); ++c)
+    {
+        if (hasAttr(row, c))
+            feature->set(_schema->getName(c), getValue(row, c));
+    }
+    return feature;
+}
+
+double
+FeatureTable::eval(NumericExpression& expr, const AttributeBinding& binding, unsigned row, const FilterContext* context) const
+{
+    osg::ref_ptr<Feature> scriptFeature;
+
+    const NumericExpression::Variables& vars = expr.variables();
+    for (unsigned i = 0; i < vars.size(); ++i)
+    {
+        double val = 0.0;
+        if (binding[i] >= 0 && hasAttr(row, binding[i]))
+        {
+            val = getDouble(row, binding[i], 0.0);
+        }
+        else if (context && context->getSession())
+        {
+            //No attr found, look for script
+            ScriptEngine* engine = context->getSession()->getScriptEngine();
+            if (engine)
+            {
+                if (!scriptFeature.valid())
+                    scriptFeature = createFeature(row);
+
+                ScriptResult result = engine->run(vars[i].first, scriptFeature.get(), context);
+                if (result.success())
+                    val = result.asDouble();
+                else {
+                    OE_WARN << LC << "Feature Script error on '" << expr.expr() << "': " << result.message() << std::endl;
+                }
+            }
+        }
+
+        expr.set(vars[i], val);
+    }
+
+    return expr.eval();
+}
+
+const std::string&
+FeatureTable::eval(StringExpression& expr, const AttributeBinding& binding, unsigned row, const FilterContext* context) const
+{
+    osg::ref_ptr<Feature> scriptFeature;
+
+    const StringExpression::Variables& vars = expr.variables();
+    for (unsigned i = 0; i < vars.size(); ++i)
+    {
+        std::string val;
+        if (binding[i] >= 0 && hasAttr(row, binding[i]))
+        {
+            val = getString(row, binding[i]);
+        }
+        else if (context && context->getSession())
+        {
+            //No attr found, look for script
+            ScriptEngine* engine = context->getSession()->getScriptEngine();
+            if (engine)
+            {
+                if (!scriptFeature.valid())
+                    scriptFeature = createFeature(row);
+
+                ScriptResult result = engine->run(vars[i].first, scriptFeature.get(), context);
+                if (result.success())
+                    val = result.asString();
+                else
+                {
+                    // Couldn't execute it as code, just take it as a string literal.
+                    val = vars[i].first;
+                    OE_DEBUG << LC << "Feature Script error on '" << expr.expr() << "': " << result.message() << std::endl;
+                }
+            }
+        }
+
+        expr.set(vars[i], val);
+    }
+
+    return expr.eval();
+}
+
+void
+FeatureTable::release(FeatureList& output)
+{
+    for (unsigned row = 0; row < _features.size(); ++row)
+    {
+        Feature* feature = _features[row].get();
+        for (unsigned c = 0; c < _columns.size(); ++c)
+        {
+            if (hasAttr(row, c))
+                feature->set(_schema->getName(c), getValue(row, c));
+        }
+        output.push_back(feature);
+    }
+
+    _features.clear();
+    _columns.clear();
+}
+
+unsigned
+FeatureTable::getMemoryUsage() const
+{
+    unsigned total = _arena.getMemoryUsage() + _features.capacity()*sizeof(osg::ref_ptr<Feature>);
+    for (unsigned c = 0; c < _columns.size(); ++c)
+    {
+        const Column& col = _columns[c];
+        total +=
+            col._doubles.capacity()*sizeof(double) +
+            col._ints.capacity()*sizeof(int) +
+            col._bools.capacity() +
+            col._strings.capacity()*sizeof(StringRef) +
+            col._state.capacity();
+    }
+    return total;
+}
@@ -66,6 +66,21 @@ ScriptEngineOptions::getConfig() const
 
 //------------------------------------------------------------------------
 
+void
+ScriptEngine::run(const std::string&         code,
+                  const FeatureList&         features,
+                  std::vector<ScriptResult>& results,
+                  FilterContext const*       context)
+{
+    results.reserve( results.size() + features.size() );
+    for(FeatureList::const_iterator i = features.begin(); i != features.end(); ++i)
+    {
+        results.push_back( run(code, i->get(), context) );
+    }
+}
+
+//------------------------------------------------------------------------
+
 #undef  LC
 #define LC "[ScriptEngineFactory] "
 #define SCRIPT_ENGINE_OPTIONS_TAG "__osgEarth::Features::ScriptEngineOptions"
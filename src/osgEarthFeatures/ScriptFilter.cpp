@@ -88,10 +88,24 @@ ScriptFilter::push( FeatureList& input, FilterContext& context )
         return context;
     }
 
-    bool ok = true;
+    // features without geometry never pass.
     for( FeatureList::iterator i = input.begin(); i != input.end(); )
     {
-        if ( push( i->get(), context ) )
+        if ( i->valid() && i->get()->getGeometry() )
+            ++i;
+        else
+            i = input.erase(i);
+    }
+
+    // evaluate the whole batch at once so the engine can prepare
+    // the expression just once.
+    std::vector<ScriptResult> results;
+    _engine->run(_expression.get(), input, results, &context);
+
+    std::vector<ScriptResult>::const_iterator r = results.begin();
+    for( FeatureList::iterator i = input.begin(); i != input.end(); )
+    {
+        if ( r != results.end() && (r++)->asBool() )
         {
             ++i;
         }
@@ -29,6 +29,7 @@ using namespace osgEarth::Symbology;
 #define LC "[Expression] "
 
 NumericExpression::NumericExpression() :
+_depth(0u),
 _value(0.0),
 _dirty(true)
 {
@@ -37,6 +38,7 @@ _dirty(true)
 
 NumericExpression::NumericExpression( const std::string& expr ) : 
 _src  ( expr ),
+_depth( 0u ),
 _value( 0.0 ),
 _dirty( true )
 {
@@ -46,6 +48,8 @@ _dirty( true )
 NumericExpression::NumericExpression( const NumericExpression& rhs ) :
 _src  ( rhs._src ),
 _rpn  ( rhs._rpn ),
+_slots( rhs._slots ),
+_depth( rhs._depth ),
 _vars ( rhs._vars ),
 _value( rhs._value ),
 _dirty( rhs._dirty )
@@ -54,6 +58,7 @@ _dirty( rhs._dirty )
 }
 
 NumericExpression::NumericExpression( double staticValue ) :
+_depth( 0u ),
 _value( staticValue ),
 _dirty( false )
 {
@@ -62,6 +67,7 @@ _dirty( false )
 }
 
 NumericExpression::NumericExpression( const Config& conf ) :
+_depth( 0u ),
 _value( 0.0 ),
 _dirty( true )
 {
@@ -264,6 +270,28 @@ NumericExpression::init()
         _rpn.push_back( s.top() );
         s.pop();
     }
+
+    // map each variable atom to its variable, and find out how deep the
+    // evaluation stack gets so run() can size it up front.
+    _slots.assign( _rpn.size(), -1 );
+    for( unsigned i=0; i<_vars.size(); ++i )
+        _slots[_vars[i].second] = i;
+
+    _depth = 0u;
+    unsigned depth = 0u;
+    for( unsigned i=0; i<_rpn.size(); ++i )
+    {
+        Op op = _rpn[i].first;
+        if ( IS_OPERATOR(_rpn[i]) || op == MIN || op == MAX )
+        {
+            if ( depth >= 2 )
+                --depth;
+        }
+        else
+        {
+            _depth = osg::maximum( _depth, ++depth );
+        }
+    }
 }
 
 void 
@@ -282,86 +310,57 @@ NumericExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stack<double> s;
+        const_cast<NumericExpression*>(this)->_value = run( 0L );
+        const_cast<NumericExpression*>(this)->_dirty = false;
+    }
 
-        for( unsigned i=0; i<_rpn.size(); ++i )
-        {
-            const Atom& a = _rpn[i];
+    return !osg::isNaN( _value ) ? _value : 0.0;
+}
 
-            if ( a.first == ADD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 + op2 );
-                }
-            }
-            else if ( a.first == SUB )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 - op2 );
-                }
-            }
-            else if ( a.first == MULT )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 * op2 );
-                }
-            }
-            else if ( a.first == DIV )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( op1 / op2 );
-                }
-            }
-            else if ( a.first == MOD )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( fmod(op1, op2) );
-                }
-            }
-            else if ( a.first == MIN )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( osg::minimum(op1, op2) );
-                }
-            }
-            else if ( a.first == MAX )
-            {
-                if ( s.size() >= 2 )
-                {
-                    double op2 = s.top(); s.pop();
-                    double op1 = s.top(); s.pop();
-                    s.push( osg::maximum(op1, op2) );
-                }
-            }
-            else // OPERAND or VARIABLE
-            {
-                s.push( a.second );
-            }
-        }
+double
+NumericExpression::eval( const double* values ) const
+{
+    double value = run( values );
+    return !osg::isNaN( value ) ? value : 0.0;
+}
 
-        const_cast<NumericExpression*>(this)->_value = s.size() > 0 ? s.top() : 0.0;
-        const_cast<NumericExpression*>(this)->_dirty = false;
+// Runs the RPN program. Variables read from "values" if there are any,
+// or from the values stored in their atoms by set().
+double
+NumericExpression::run( const double* values ) const
+{
+    double              local[32];
+    std::vector<double> heap;
+    double*             s = local;
+    if ( _depth > 32u )
+    {
+        heap.resize( _depth );
+        s = &heap[0];
     }
 
-    return !osg::isNaN( _value ) ? _value : 0.0;
+    unsigned n = 0u;
+    for( unsigned i=0; i<_rpn.size(); ++i )
+    {
+        const Atom& a = _rpn[i];
+        switch( a.first )
+        {
+        case ADD:  if ( n >= 2 ) { --n; s[n-1] = s[n-1] + s[n]; } break;
+        case SUB:  if ( n >= 2 ) { --n; s[n-1] = s[n-1] - s[n]; } break;
+        case MULT: if ( n >= 2 ) { --n; s[n-1] = s[n-1] * s[n]; } break;
+        case DIV:  if ( n >= 2 ) { --n; s[n-1] = s[n-1] / s[n]; } break;
+        case MOD:  if ( n >= 2 ) { --n; s[n-1] = fmod( s[n-1], s[n] ); } break;
+        case MIN:  if ( n >= 2 ) { --n; s[n-1] = osg::minimum( s[n-1], s[n] ); } break;
+        case MAX:  if ( n >= 2 ) { --n; s[n-1] = osg::maximum( s[n-1], s[n] ); } break;
+        case VARIABLE:
+            s[n++] = values ? values[_slots[i]] : a.second;
+            break;
+        default: // OPERAND
+            s[n++] = a.second;
+            break;
+        }
+    }
+
+    return n > 0 ? s[n-1] : 0.0;
 }
 
 //------------------------------------------------------------------------
@@ -393,6 +392,7 @@ _src( rhs._src ),
 _vars( rhs._vars ),
 _value( rhs._value ),
 _infix( rhs._infix ),
+_slots( rhs._slots ),
 _dirty( rhs._dirty ),
 _uriContext( rhs._uriContext )
 {
@@ -413,6 +413,11 @@ StringExpression::setLiteral( const std::string& expr )
     _src = "\"" + expr + "\"";
     _value = expr;
     _dirty = false;
+
+    _vars.clear();
+    _infix.clear();
+    _infix.push_back( Atom(OPERAND, expr) );
+    _slots.assign( 1u, -1 );
 }
 
 StringExpression::StringExpression( const Config& conf )
@@ -440,6 +445,9 @@ StringExpression::getConfig() const
 void
 StringExpression::init()
 {
+    _vars.clear();
+    _infix.clear();
+
     bool inQuotes = false;
     int inVar = 0;
     int startPos = 0;
@@ -520,6 +528,10 @@ StringExpression::init()
         _infix.push_back( Atom(VARIABLE,val) );
       }
     }
+
+    _slots.assign( _infix.size(), -1 );
+    for( unsigned i=0; i<_vars.size(); ++i )
+        _slots[_vars[i].second] = i;
 }
 
 void 
@@ -550,17 +562,30 @@ StringExpression::eval() const
 {
     if ( _dirty )
     {
-        std::stringstream buf;
+        std::string& value = const_cast<StringExpression*>(this)->_value;
+        value.clear();
         for( AtomVector::const_iterator i = _infix.begin(); i != _infix.end(); ++i )
-            buf << i->second;
+            value.append( i->second );
 
-        const_cast<StringExpression*>(this)->_value = buf.str();
         const_cast<StringExpression*>(this)->_dirty = false;
     }
 
     return _value;
 }
 
+void
+StringExpression::eval( const StringRef* values, std::string& out ) const
+{
+    out.clear();
+    for( unsigned i=0; i<_infix.size(); ++i )
+    {
+        if ( _slots[i] >= 0 )
+            out.append( values[_slots[i]].first, values[_slots[i]].second );
+        else
+            out.append( _infix[i].second );
+    }
+}
+
 URI
 StringExpression::evalURI() const
 {
@@ -0,0 +1,379 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthUtil/ClusterIndex>
+#include <osgEarth/GeoData>
+#include <osg/CullingSet>
+#include <osg/Polytope>
+
+#define LC "[ClusterIndex] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // Web Mercator's limit of latitude
+    const double MAX_LAT = 85.05112878;
+
+    // Length of the equator (meters); a cell at depth N spans 1/2^N of it
+    const double EQUATOR = 2.0 * osg::PI * 6378137.0;
+
+    // Geographic degrees to normalized ([0..1]) mercator.
+    void toMercator(double lon, double lat, double& x, double& y)
+    {
+        x = osg::clampBetween((lon + 180.0) / 360.0, 0.0, 1.0);
+        double s = sin(osg::DegreesToRadians(osg::clampBetween(lat, -MAX_LAT, MAX_LAT)));
+        y = osg::clampBetween(0.5 - 0.25 * log((1.0 + s) / (1.0 - s)) / osg::PI, 0.0, 1.0);
+    }
+
+    // Normalized mercator to geographic degrees.
+    void fromMercator(double x, double y, double& lon, double& lat)
+    {
+        lon = x * 360.0 - 180.0;
+        lat = osg::RadiansToDegrees(atan(sinh(osg::PI * (1.0 - 2.0 * y))));
+    }
+}
+
+ClusterIndex::ClusterIndex(const SpatialReference* srs, unsigned maxDepth) :
+_srs     ( srs ),
+_maxDepth( osg::minimum(maxDepth, 30u) ),
+_size    ( 0u )
+{
+    clear();
+}
+
+void
+ClusterIndex::clear()
+{
+    _points.clear();
+    _cells.clear();
+    _freeCells.clear();
+    _size = 0u;
+
+    // the root
+    newCell();
+}
+
+unsigned
+ClusterIndex::size() const
+{
+    return _size;
+}
+
+unsigned
+ClusterIndex::newCell()
+{
+    unsigned index;
+    if ( !_freeCells.empty() )
+    {
+        index = _freeCells.back();
+        _freeCells.pop_back();
+    }
+    else
+    {
+        index = _cells.size();
+        _cells.push_back( Cell() );
+    }
+
+    Cell& cell = _cells[index];
+    cell.child[0] = cell.child[1] = cell.child[2] = cell.child[3] = 0u;
+    cell.first  = NONE;
+    cell.count  = 0u;
+    cell.sumX   = cell.sumY = cell.sumAlt = 0.0;
+    cell.bound.init();
+    cell.bucket = true;
+    return index;
+}
+
+void
+ClusterIndex::freeCell(unsigned index)
+{
+    for(unsigned q=0; q<4; ++q)
+        if ( _cells[index].child[q] != 0u )
+            freeCell( _cells[index].child[q] );
+
+    _freeCells.push_back( index );
+}
+
+unsigned
+ClusterIndex::getOrCreateChild(unsigned index, unsigned depth, unsigned id)
+{
+    // quadrant of the point in the cell's children (at depth+1)
+    double scale = (double)(1u << (depth+1u));
+    const Point& p = _points[id];
+    unsigned ix = osg::minimum((unsigned)(p.x * scale), (1u << (depth+1u)) - 1u) & 1u;
+    unsigned iy = osg::minimum((unsigned)(p.y * scale), (1u << (depth+1u)) - 1u) & 1u;
+    unsigned q = ix + 2u*iy;
+
+    if ( _cells[index].child[q] == 0u )
+    {
+        unsigned child = newCell(); // may move _cells
+        _cells[index].child[q] = child;
+    }
+    return _cells[index].child[q];
+}
+
+void
+ClusterIndex::add(unsigned index, unsigned depth, unsigned id)
+{
+    for(;;)
+    {
+        const Point& p = _points[id];
+        {
+            Cell& cell = _cells[index];
+            cell.count++;
+            cell.sumX   += p.x;
+            cell.sumY   += p.y;
+            cell.sumAlt += p.alt;
+            cell.bound.expandBy( p.world );
+
+            if ( cell.bucket )
+            {
+                // An empty bucket, the bottom of the tree, or a point that sits
+                // right on top of the ones already here: just add it.
+                const Point* first = cell.first != NONE ? &_points[cell.first] : 0L;
+                if ( !first || depth >= _maxDepth || (first->x == p.x && first->y == p.y) )
+                {
+                    _points[id].next = cell.first;
+                    cell.first = id;
+                    return;
+                }
+
+                // Otherwise split the bucket, pushing its points down a level.
+                unsigned q = cell.first;
+                cell.first  = NONE;
+                cell.bucket = false;
+                while( q != NONE )
+                {
+                    unsigned next = _points[q].next;
+                    add( getOrCreateChild(index, depth, q), depth+1u, q );
+                    q = next;
+                }
+            }
+        }
+
+        index = getOrCreateChild(index, depth, id);
+        ++depth;
+    }
+}
+
+void
+ClusterIndex::insert(unsigned id, const osg::Vec3d& world)
+{
+    if ( id >= _points.size() )
+    {
+        Point unused;
+        unused.used = false;
+        _points.resize( id+1u, unused );
+    }
+
+    if ( _points[id].used )
+    {
+        OE_WARN << LC << "Point " << id << " is already in the index" << std::endl;
+        return;
+    }
+
+    GeoPoint geo;
+    geo.fromWorld( _srs.get(), world );
+    geo = geo.transform( _srs->getGeographicSRS() );
+
+    Point& p = _points[id];
+    toMercator( geo.x(), geo.y(), p.x, p.y );
+    p.alt   = geo.z();
+    p.world = world;
+    p.next  = NONE;
+    p.used  = true;
+
+    add( 0u, 0u, id );
+    ++_size;
+}
+
+bool
+ClusterIndex::remove(unsigned id)
+{
+    if ( id >= _points.size() || !_points[id].used )
+        return false;
+
+    Point& p = _points[id];
+
+    // Walk down to the point's bucket, taking it out of each cell's totals.
+    // The topmost cell left holding a single point collapses into a bucket.
+    unsigned index = 0u, depth = 0u, parent = NONE, collapse = NONE;
+    for(;;)
+    {
+        Cell& cell = _cells[index];
+        cell.count--;
+        cell.sumX   -= p.x;
+        cell.sumY   -= p.y;
+        cell.sumAlt -= p.alt;
+
+        if ( cell.count == 0u && index != 0u )
+        {
+            // drop the whole (now empty) subtree
+            for(unsigned q=0; q<4; ++q)
+                if ( _cells[parent].child[q] == index )
+                    _cells[parent].child[q] = 0u;
+            freeCell( index );
+            break;
+        }
+
+        if ( cell.count == 1u && collapse == NONE && !cell.bucket )
+            collapse = index;
+
+        if ( cell.bucket )
+        {
+            unsigned* link = &cell.first;
+            while( *link != id )
+                link = &_points[*link].next;
+            *link = p.next;
+            break;
+        }
+
+        parent = index;
+        index = getOrCreateChild(index, depth, id);
+        ++depth;
+    }
+
+    p.used = false;
+    --_size;
+
+    if ( collapse != NONE )
+    {
+        std::vector<unsigned> last;
+        getPoints( collapse, last );
+
+        Cell& cell = _cells[collapse];
+        for(unsigned q=0; q<4; ++q)
+        {
+            if ( cell.child[q] != 0u )
+            {
+                freeCell( cell.child[q] );
+                _cells[collapse].child[q] = 0u;
+            }
+        }
+
+        Cell& bucket = _cells[collapse];
+        bucket.bucket = true;
+        bucket.first  = last.front();
+        _points[bucket.first].next = NONE;
+        bucket.sumX   = _points[bucket.first].x;
+        bucket.sumY   = _points[bucket.first].y;
+        bucket.sumAlt = _points[bucket.first].alt;
+        bucket.bound.set( _points[bucket.first].world, 0.0 );
+    }
+    else if ( _cells[0].count == 0u )
+    {
+        // start over with a clean root, so its bound doesn't linger.
+        clear();
+    }
+
+    return true;
+}
+
+void
+ClusterIndex::getPoints(unsigned index, std::vector<unsigned>& out) const
+{
+    if ( index >= _cells.size() )
+        return;
+
+    std::vector<unsigned> stack;
+    stack.push_back( index );
+    while( !stack.empty() )
+    {
+        const Cell& cell = _cells[stack.back()];
+        stack.pop_back();
+
+        if ( cell.bucket )
+        {
+            for(unsigned q = cell.first; q != NONE; q = _points[q].next)
+                out.push_back( q );
+        }
+        else
+        {
+            for(unsigned q=0; q<4; ++q)
+                if ( cell.child[q] != 0u )
+                    stack.push_back( cell.child[q] );
+        }
+    }
+}
+
+void
+ClusterIndex::query(const osg::Matrixd&  viewMatrix,
+                    const osg::Matrixd&  projMatrix,
+                    const osg::Viewport& viewport,
+                    float                radius,
+                    const Horizon*       horizon,
+                    ClusterList&         out) const
+{
+    if ( _size == 0u )
+        return;
+
+    // view frustum in world coordinates (without near/far, which the camera may not know yet)
+    osg::Polytope frustum;
+    frustum.setToUnitFrustum( false, false );
+    frustum.transformProvidingInverse( viewMatrix * projMatrix );
+
+    // a sphere at a world position spans (radius / (world * psv)) pixels on screen
+    osg::Vec4d psv = osg::CullingSet::computePixelSizeVector( viewport, projMatrix, viewMatrix );
+
+    std::vector< std::pair<unsigned, unsigned> > stack;
+    stack.push_back( std::make_pair(0u, 0u) );
+
+    while( !stack.empty() )
+    {
+        unsigned index = stack.back().first;
+        unsigned depth = stack.back().second;
+        stack.pop_back();
+
+        const Cell& cell = _cells[index];
+        if ( cell.count == 0u )
+            continue;
+
+        osg::BoundingSphere bs( cell.bound.center(), cell.bound.radius() );
+        if ( !frustum.contains(bs) )
+            continue;
+
+        if ( horizon && !horizon->isVisible(cell.bound.center(), cell.bound.radius()) )
+            continue;
+
+        Cluster cluster;
+        cluster.cell  = index;
+        cluster.count = cell.count;
+        cluster.alt   = cell.sumAlt / (double)cell.count;
+        cluster.bound = cell.bound;
+        fromMercator( cell.sumX / (double)cell.count, cell.sumY / (double)cell.count, cluster.lon, cluster.lat );
+
+        if ( !cell.bucket )
+        {
+            // ground size of the cell where its points are, and that size on screen.
+            double meters = EQUATOR / (double)(1u << depth) * cos(osg::DegreesToRadians(cluster.lat));
+            const osg::Vec3d& c = cell.bound.center();
+            double distance = c.x()*psv.x() + c.y()*psv.y() + c.z()*psv.z() + psv.w();
+            if ( distance <= 0.0 || 0.5 * meters / distance > (double)radius )
+            {
+                for(unsigned q=0; q<4; ++q)
+                    if ( cell.child[q] != 0u )
+                        stack.push_back( std::make_pair(cell.child[q], depth+1u) );
+                continue;
+            }
+        }
+
+        out.push_back( cluster );
+    }
+}
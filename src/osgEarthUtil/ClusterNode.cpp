@@ -24,8 +24,11 @@ ClusterNode::ClusterNode(MapNode* mapNode, osg::Image* defaultImage) :
 void ClusterNode::addNode(osg::Node* node)
 {
     _nodes.push_back(node);
+    if (!_dirtyIndex)
+    {
+        indexNode(node);
+    }
     _dirty = true;
-    _dirtyIndex = true;
 }
 
 void ClusterNode::removeNode(osg::Node* node)
@@ -34,9 +37,22 @@ void ClusterNode::removeNode(osg::Node* node)
     if (itr != _nodes.end())
     {
         _nodes.erase(itr);
+        if (!_dirtyIndex && std::find(_nodes.begin(), _nodes.end(), node) == _nodes.end())
+        {
+            unindexNode(node);
+        }
+    }
+    _dirty = true;
+}
+
+void ClusterNode::updateNode(osg::Node* node)
+{
+    if (!_dirtyIndex && _nodeIds.find(node) != _nodeIds.end())
+    {
+        unindexNode(node);
+        indexNode(node);
     }
     _dirty = true;
-    _dirtyIndex = true;
 }
 
 void ClusterNode::clear()
@@ -108,40 +124,100 @@ void ClusterNode::setCanClusterCallback(ClusterNode::CanClusterCallback* callbac
     _dirty = true;
 }
 
-bool boundSort(const osg::ref_ptr< osg::Node> &i, const osg::ref_ptr< osg::Node> &j)
-{
-    osg::BoundingSphere bsI = i->getBound();
-    osg::BoundingSphere bsJ = j->getBound();
-
-    return bsI.center().x() < bsJ.center().x();
-}
-
-
 void ClusterNode::buildIndex()
 {
-    if (_dirtyIndex)
+    if (_dirtyIndex && _mapNode.valid())
     {
-        _clusterIndex.clear();
+        _index = new ClusterIndex(_mapNode->getMapSRS());
+        _nodeIds.clear();
+        _idNodes.clear();
+        _freeIds.clear();
 
-        std::sort(_nodes.begin(), _nodes.end(), boundSort);
+        _idCenters.clear();
 
-        unsigned int maxNodes = 10000;
+        for (unsigned int i = 0; i < _nodes.size(); i++)
+        {
+            indexNode(_nodes[i].get());
+        }
+        _dirtyIndex = false;
+    }
+}
 
-        osg::Group* currentGroup = 0;
+bool ClusterNode::reindexMovedNodes()
+{
+    if (!_index.valid())
+    {
+        return false;
+    }
 
-        for (unsigned int i = 0; i < _nodes.size(); i++)
+    bool moved = false;
+    for (unsigned int id = 0; id < _idNodes.size(); id++)
+    {
+        osg::Node* node = _idNodes[id];
+        if (node)
         {
-            if (!currentGroup || currentGroup->getNumChildren() >= maxNodes)
+            const osg::Vec3d center = node->getBound().center();
+            if (center != _idCenters[id])
             {
-                currentGroup = new osg::Group;
-                _clusterIndex.push_back(currentGroup);
+                _index->remove(id);
+                _index->insert(id, center);
+                _idCenters[id] = center;
+                moved = true;
             }
-            currentGroup->addChild(_nodes[i]);                      
         }
     }
-    _dirtyIndex = false;
+    return moved;
 }
 
+void ClusterNode::indexNode(osg::Node* node)
+{
+    if (!_index.valid() || _nodeIds.find(node) != _nodeIds.end())
+    {
+        return;
+    }
+
+    unsigned int id;
+    if (!_freeIds.empty())
+    {
+        id = _freeIds.back();
+        _freeIds.pop_back();
+        _idNodes[id] = node;
+    }
+    else
+    {
+        id = _idNodes.size();
+        _idNodes.push_back(node);
+        _idCenters.push_back(osg::Vec3d());
+    }
+
+    _nodeIds[node] = id;
+    _idCenters[id] = node->getBound().center();
+    _index->insert(id, _idCenters[id]);
+}
+
+void ClusterNode::unindexNode(osg::Node* node)
+{
+    std::map< osg::Node*, unsigned >::iterator itr = _nodeIds.find(node);
+    if (!_index.valid() || itr == _nodeIds.end())
+    {
+        return;
+    }
+
+    _index->remove(itr->second);
+    _idNodes[itr->second] = 0;
+    _freeIds.push_back(itr->second);
+    _nodeIds.erase(itr);
+}
+
+namespace
+{
+    // A group of nodes that may be clustered, and where its marker goes.
+    struct Candidate
+    {
+        osg::NodeList nodes;
+        GeoPoint position;
+    };
+}
 
 void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
 {
@@ -159,23 +235,33 @@ void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
         camera->getProjectionMatrix() *
         camera->getViewport()->computeWindowMatrix();
 
-    std::vector<TPoint> points;
+    // The index hands back the visible groups of nodes that are no bigger than the
+    // radius on screen, without looking at the nodes themselves.
+    ClusterIndex::ClusterList cells;
+    _index->query(camera->getViewMatrix(), camera->getProjectionMatrix(), *viewport, _radius, _horizon.get(), cells);
+
+    if (cells.size() == 0) return;
 
-    osg::NodeList validPlaces;
+    const SpatialReference* geoSRS = _mapNode->getMapSRS()->getGeographicSRS();
 
-    buildIndex();
+    std::vector<Candidate> candidates;
+    std::vector<TPoint> points;
+    std::vector<unsigned> ids;
+    osg::NodeList nodes;
 
-    for (osg::NodeList::iterator itr = _clusterIndex.begin(); itr != _clusterIndex.end(); ++itr)
+    for (unsigned int c = 0; c < cells.size(); c++)
     {
-        osg::Group* index = static_cast<osg::Group*>(itr->get());
-        if (cv->isCulled(index->getBound()))
-        {
-            continue;
-        }
+        const ClusterIndex::Cluster& cell = cells[c];
 
-        for (unsigned int i = 0; i < index->getNumChildren(); i++)
+        ids.clear();
+        _index->getPoints(cell.cell, ids);
+
+        // The cell is in view, but some of its nodes may not be.
+        nodes.clear();
+        osg::Vec3d sum;
+        for (unsigned int i = 0; i < ids.size(); i++)
         {
-            osg::Node* node = index->getChild(i);
+            osg::Node* node = _idNodes[ids[i]];
             osg::Vec3d world = node->getBound().center();
 
             if (cv->isCulled(*node))
@@ -188,34 +274,90 @@ void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
                 continue;
             }
 
+            nodes.push_back(node);
+            sum += world;
+        }
+
+        if (nodes.empty())
+        {
+            continue;
+        }
+
+        unsigned int first = candidates.size();
+
+        if (!_canClusterCallback.valid())
+        {
+            candidates.push_back(Candidate());
+            Candidate& candidate = candidates.back();
+            candidate.nodes = nodes;
+            if (nodes.size() == ids.size())
+            {
+                candidate.position.set(geoSRS, cell.lon, cell.lat, cell.alt, ALTMODE_ABSOLUTE);
+            }
+            else
+            {
+                candidate.position.fromWorld(_mapNode->getMapSRS(), sum / (double)nodes.size());
+            }
+        }
+        else
+        {
+            // Split the group into nodes that are allowed to cluster together.
+            for (unsigned int i = 0; i < nodes.size(); i++)
+            {
+                osg::Node* node = nodes[i].get();
+
+                unsigned int k = first;
+                while (k < candidates.size() && !(*_canClusterCallback)(candidates[k].nodes[0].get(), node))
+                {
+                    k++;
+                }
+
+                if (k == candidates.size())
+                {
+                    candidates.push_back(Candidate());
+                    candidates[k].position.fromWorld(_mapNode->getMapSRS(), node->getBound().center());
+                }
+                candidates[k].nodes.push_back(node);
+            }
+        }
+
+        // Where the markers land on screen; skip the ones that are off screen.
+        for (unsigned int k = first; k < candidates.size(); )
+        {
+            osg::Vec3d world;
+            candidates[k].position.toWorld(world);
             osg::Vec3d screen = world * mvpw;
 
             if (screen.x() >= 0 && screen.x() <= viewport->width() &&
                 screen.y() >= 0 && screen.y() <= viewport->height())
             {
-                validPlaces.push_back(node);
                 points.push_back(TPoint(screen.x(), screen.y()));
+                k++;
+            }
+            else
+            {
+                candidates.erase(candidates.begin() + k);
             }
         }
     }
 
-    if (validPlaces.size() == 0) return;
+    if (candidates.size() == 0) return;
 
+    // Groups from neighboring cells can still be within the radius of each other,
+    // so merge them the same way individual nodes used to be merged.
     kdbush::KDBush<TPoint> index(points);
-    std::set< unsigned int > clustered;
+    std::vector<bool> clustered(candidates.size(), false);
 
-    for (unsigned int i = 0; i < validPlaces.size(); i++)
+    for (unsigned int i = 0; i < candidates.size(); i++)
     {
-        TPoint &screen = points[i];
-        osg::Node* node = validPlaces[i].get();
-
         // If this thing is already part of a cluster then just continue.
-        if (clustered.find(i) != clustered.end())
+        if (clustered[i])
         {
             continue;
         }
 
-        osg::Vec3d world = node->getBound().center();
+        TPoint &screen = points[i];
+        osg::Node* node = candidates[i].nodes[0].get();
 
         // Get any matching indices that are part of this cluster.
         TIds indices;
@@ -224,40 +366,36 @@ void ClusterNode::getClusters(osgUtil::CullVisitor* cv, ClusterList& out)
 
         // Create a new cluster.
         Cluster cluster;
+        cluster.nodes = candidates[i].nodes;
+        clustered[i] = true;
 
-        unsigned int actualCount = 0;
-
-        // Add all of the points to the cluster.
+        // Add all of the other groups to the cluster.
         for (unsigned int j = 0; j < indices.size(); j++)
         {
-            if (clustered.find(indices[j]) == clustered.end())
+            if (!clustered[indices[j]])
             {
+                const osg::NodeList& nodes = candidates[indices[j]].nodes;
                 if (_canClusterCallback.valid())
                 {
-                    bool canCluster = (*_canClusterCallback)(node, validPlaces[indices[j]].get());
+                    bool canCluster = (*_canClusterCallback)(node, nodes[0].get());
                     if (!canCluster) {
                         continue;
                     }
                 }
-                cluster.nodes.push_back(validPlaces[indices[j]]);
-                actualCount++;
-                clustered.insert(indices[j]);
+                cluster.nodes.insert(cluster.nodes.end(), nodes.begin(), nodes.end());
+                clustered[indices[j]] = true;
             }
         }
 
         std::stringstream buf;
-        buf << actualCount << std::endl;
+        buf << cluster.nodes.size() << std::endl;
 
         PlaceNode* marker = getOrCreateLabel();
-        GeoPoint markerPos;
-        markerPos.fromWorld(_mapNode->getMapSRS(), world);
-        marker->setPosition(markerPos);
+        marker->setPosition(candidates[i].position);
         marker->setText(buf.str());
 
         cluster.marker = marker;
         out.push_back(cluster);
-
-        clustered.insert(i);
     }
 }
 
@@ -279,6 +417,13 @@ void ClusterNode::traverse(osg::NodeVisitor& nv)
         {
             if (_mapNode.valid())
             {
+                // Pick up nodes that moved since the last cull.
+                buildIndex();
+                if (reindexMovedNodes())
+                {
+                    _dirty = true;
+                }
+
                 const osg::Matrixd &currentViewMatrix = cv->getCurrentCamera()->getViewMatrix();
                 if (_lastViewMatrix != currentViewMatrix || _dirty)
                 {
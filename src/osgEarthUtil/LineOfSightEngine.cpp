@@ -0,0 +1,509 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+ * Copyright 2018 Pelican Mapping
+ * http://osgearth.org
+ *
+ * osgEarth is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+#include <osgEarthUtil/LineOfSightEngine>
+#include <osgEarth/ElevationPool>
+#include <osgEarth/GeoMath>
+#include <osgEarth/Metrics>
+#include <osg/Image>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#define LC "[LineOfSightEngine] "
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // Samples read from the elevation pool at a time along a line of sight.
+    // Small enough that a line blocked near the observer stops early.
+    const unsigned LOS_BATCH_SIZE = 256u;
+
+    // Walks the viewshed grid from the center cell (c, c) to (tx, ty),
+    // keeping the steepest slope of the terrain so far. A cell is visible
+    // if a target on it is at least that steep. "rel" holds each cell's
+    // height relative to the observer, already lowered for curvature.
+    // Marks every cell along the way, or just the last one if "all" is false.
+    void sweep(const float* rel, unsigned size, int c, int tx, int ty,
+               double cellSize, double targetHeight, bool all, unsigned char* visible)
+    {
+        int dx = tx - c, dy = ty - c;
+        int steps = osg::maximum(std::abs(dx), std::abs(dy));
+        double maxSlope = -DBL_MAX;
+
+        for (int k = 1; k <= steps; ++k)
+        {
+            int i = c + (int)floor((double)(dx * k) / (double)steps + 0.5);
+            int j = c + (int)floor((double)(dy * k) / (double)steps + 0.5);
+            unsigned index = (unsigned)j * size + (unsigned)i;
+
+            float h = rel[index];
+            if (h == NO_DATA_VALUE)
+                continue;
+
+            double d = cellSize * sqrt((double)((i - c)*(i - c) + (j - c)*(j - c)));
+
+            if ((all || k == steps) && ((double)h + targetHeight) / d >= maxSlope)
+                visible[index] = 1;
+
+            maxSlope = osg::maximum(maxSlope, (double)h / d);
+        }
+    }
+}
+
+//........................................................................
+
+struct LineOfSightEngine::LineOfSightChunk
+{
+    LineOfSightEngine*              _engine;
+    osg::ref_ptr<ElevationEnvelope> _envelope;
+    const Query*                    _queries;
+    Result*                         _results;
+    unsigned                        _count;
+
+    void execute()
+    {
+        for (unsigned i = 0; i < _count; ++i)
+        {
+            _engine->computeLineOfSight(_envelope.get(), _queries[i].start, _queries[i].end, _results[i]);
+        }
+    }
+};
+
+struct LineOfSightEngine::ViewshedChunk
+{
+    LineOfSightEngine* _engine;
+    const GeoPoint*    _observers;
+    GeoImage*          _out;
+    unsigned           _count;
+    double             _radius;
+    unsigned           _size;
+    Algorithm          _algorithm;
+
+    void execute()
+    {
+        for (unsigned i = 0; i < _count; ++i)
+        {
+            // already running in parallel, so sample each one on this thread
+            if (!_engine->computeViewshed(_observers[i], _radius, _size, _out[i], _algorithm, false))
+                _out[i] = GeoImage();
+        }
+    }
+};
+
+//........................................................................
+
+LineOfSightEngine::LineOfSightEngine(const Map* map, unsigned lod) :
+_map         ( map ),
+_lod         ( lod ),
+_spacing     ( 1.0 ),
+_radius      ( osg::WGS_84_RADIUS_EQUATOR ),
+_refraction  ( 0.13 ),
+_curvature   ( true ),
+_targetHeight( 0.0 ),
+_goodColor   ( 0.0f, 1.0f, 0.0f, 0.5f ),
+_badColor    ( 1.0f, 0.0f, 0.0f, 0.5f ),
+_numThreads  ( osg::maximum(OpenThreads::GetNumberOfProcessors(), 1) )
+{
+    if (_map.valid() && _map->getSRS())
+    {
+        _srs = _map->getSRS()->getGeographicSRS();
+        if (_map->getSRS()->getEllipsoid())
+            _radius = _map->getSRS()->getEllipsoid()->getRadiusEquator();
+    }
+    else
+    {
+        OE_WARN << LC << "No map; all queries will fail" << std::endl;
+    }
+
+    setLOD(lod);
+}
+
+void
+LineOfSightEngine::setLOD(unsigned value)
+{
+    _lod = value;
+
+    if (!_map.valid() || !_map->getProfile())
+        return;
+
+    // one elevation post at this LOD; finer sampling would only repeat it
+    double width, height;
+    _map->getProfile()->getTileDimensions(_lod, width, height);
+    if (_map->getProfile()->getSRS()->isGeographic())
+        width = osg::DegreesToRadians(width) * _radius;
+
+    unsigned tileSize = osg::maximum(_map->getElevationPool()->getTileSize(), 2u);
+    _spacing = width / (double)(tileSize - 1u);
+}
+
+void
+LineOfSightEngine::setNumThreads(unsigned value)
+{
+    Threading::ScopedMutexLock lock(_serviceMutex);
+    _numThreads = osg::maximum(value, 1u);
+    _service = 0L; // recreated with the new count on next use; batches in progress keep the old one
+}
+
+unsigned
+LineOfSightEngine::getNumThreads() const
+{
+    Threading::ScopedMutexLock lock(_serviceMutex);
+    return _numThreads;
+}
+
+osg::ref_ptr<TaskService>
+LineOfSightEngine::getTaskService()
+{
+    Threading::ScopedMutexLock lock(_serviceMutex);
+    if (!_service.valid())
+    {
+        _service = new TaskService("LineOfSightEngine", _numThreads);
+    }
+    return _service;
+}
+
+double
+LineOfSightEngine::getDrop(double d) const
+{
+    return _curvature ? d * d * (1.0 - _refraction) / (2.0 * _radius) : 0.0;
+}
+
+bool
+LineOfSightEngine::computeLineOfSight(const GeoPoint& start, const GeoPoint& end, GeoPoint* hit)
+{
+    if (!_srs.valid())
+        return false;
+
+    osg::ref_ptr<ElevationEnvelope> env = _map->getElevationPool()->createEnvelope(_srs.get(), _lod);
+
+    Result result;
+    computeLineOfSight(env.get(), start, end, result);
+    if (hit)
+        *hit = result.hit;
+    return result.visible;
+}
+
+void
+LineOfSightEngine::computeLineOfSight(ElevationEnvelope* env, const GeoPoint& start, const GeoPoint& end, Result& out)
+{
+    out = Result();
+    if (!env)
+        return;
+
+    GeoPoint p0 = start.transform(_srs.get());
+    GeoPoint p1 = end.transform(_srs.get());
+    if (!p0.isValid() || !p1.isValid())
+        return;
+
+    // the short way around, across the antimeridian if need be
+    double lon0 = p0.x(), lat0 = p0.y();
+    double dLon = p1.x() - lon0, dLat = p1.y() - lat0;
+    if (dLon > 180.0) dLon -= 360.0;
+    else if (dLon < -180.0) dLon += 360.0;
+
+    // a height above terrain we don't have is meaningless
+    double h0 = p0.z(), h1 = p1.z();
+    if (p0.altitudeMode() == ALTMODE_RELATIVE)
+    {
+        float e = env->getElevation(lon0, lat0);
+        if (e == NO_DATA_VALUE)
+            return;
+        h0 += e;
+    }
+    if (p1.altitudeMode() == ALTMODE_RELATIVE)
+    {
+        float e = env->getElevation(p1.x(), p1.y());
+        if (e == NO_DATA_VALUE)
+            return;
+        h1 += e;
+    }
+
+    out.valid = true;
+
+    double distance = GeoMath::distance(
+        osg::DegreesToRadians(lat0), osg::DegreesToRadians(lon0),
+        osg::DegreesToRadians(p1.y()), osg::DegreesToRadians(p1.x()),
+        _radius);
+
+    // One sample per elevation post, stepping evenly in lon/lat (a DDA over
+    // the heightfield). Over the ranges where line of sight matters, that
+    // line stays within a post of the great circle.
+    unsigned numSteps = osg::maximum((unsigned)ceil(distance / _spacing), 1u);
+
+    // The sight line runs straight from the observer to the target as it
+    // appears, lowered by the curvature of the earth.
+    double h1Apparent = h1 - getDrop(distance);
+
+    double x[LOS_BATCH_SIZE], y[LOS_BATCH_SIZE];
+    float  z[LOS_BATCH_SIZE];
+
+    for (unsigned first = 1u; first < numSteps; first += LOS_BATCH_SIZE)
+    {
+        unsigned count = osg::minimum(LOS_BATCH_SIZE, numSteps - first);
+        for (unsigned k = 0; k < count; ++k)
+        {
+            double t = (double)(first + k) / (double)numSteps;
+            x[k] = lon0 + dLon * t;
+            if (x[k] > 180.0) x[k] -= 360.0;
+            else if (x[k] < -180.0) x[k] += 360.0;
+            y[k] = lat0 + dLat * t;
+        }
+
+        env->getElevations(x, y, count, z);
+
+        for (unsigned k = 0; k < count; ++k)
+        {
+            if (z[k] == NO_DATA_VALUE)
+                continue;
+
+            double t = (double)(first + k) / (double)numSteps;
+            double line = h0 + (h1Apparent - h0) * t;
+            if ((double)z[k] - getDrop(distance * t) > line)
+            {
+                out.hit = GeoPoint(_srs.get(), x[k], y[k], z[k], ALTMODE_ABSOLUTE);
+                return;
+            }
+        }
+    }
+
+    out.visible = true;
+}
+
+void
+LineOfSightEngine::computeLineOfSight(const std::vector<Query>& queries, Results& results)
+{
+    METRIC_SCOPED_EX("LineOfSightEngine::computeLineOfSight", 1, "num", toString(queries.size()).c_str());
+
+    results.assign(queries.size(), Result());
+    if (queries.empty() || !_srs.valid())
+        return;
+
+    unsigned count = queries.size();
+    unsigned numChunks = osg::minimum(getNumThreads(), count);
+    unsigned chunkSize = (count + numChunks - 1u) / numChunks;
+    numChunks = (count + chunkSize - 1u) / chunkSize;
+
+    osg::ref_ptr<TaskService> service;
+    if (numChunks > 1u)
+        service = getTaskService();
+
+    // Each chunk gets its own envelope since envelopes are not thread-safe.
+    // The first chunk runs on the calling thread.
+    std::vector< osg::ref_ptr< ParallelTask<LineOfSightChunk> > > chunks;
+    Threading::MultiEvent done(numChunks - 1u);
+
+    for (unsigned c = 0; c < numChunks; ++c)
+    {
+        unsigned start = c * chunkSize;
+        ParallelTask<LineOfSightChunk>* chunk = new ParallelTask<LineOfSightChunk>(&done);
+        chunk->_engine = this;
+        chunk->_envelope = _map->getElevationPool()->createEnvelope(_srs.get(), _lod);
+        chunk->_queries = &queries[start];
+        chunk->_results = &results[start];
+        chunk->_count = osg::minimum(chunkSize, count - start);
+        chunks.push_back(chunk);
+
+        if (c > 0u)
+            service->add(chunk);
+    }
+
+    chunks.front()->execute();
+    done.wait();
+}
+
+bool
+LineOfSightEngine::computeViewshed(const GeoPoint& observer,
+                                   double          radius,
+                                   unsigned        size,
+                                   GeoImage&       out,
+                                   Algorithm       algorithm)
+{
+    return computeViewshed(observer, radius, size, out, algorithm, true);
+}
+
+bool
+LineOfSightEngine::computeViewshed(const GeoPoint& observer,
+                                   double          radius,
+                                   unsigned        size,
+                                   GeoImage&       out,
+                                   Algorithm       algorithm,
+                                   bool            parallel)
+{
+    METRIC_SCOPED("LineOfSightEngine::computeViewshed");
+
+    if (!_srs.valid() || size < 2u || radius <= 0.0)
+        return false;
+
+    GeoPoint p = observer.transform(_srs.get());
+    if (!p.isValid())
+        return false;
+
+    ElevationPool* pool = _map->getElevationPool();
+
+    double h0 = p.z();
+    if (p.altitudeMode() == ALTMODE_RELATIVE)
+    {
+        osg::ref_ptr<ElevationEnvelope> env = pool->createEnvelope(_srs.get(), _lod);
+        float e = env->getElevation(p.x(), p.y());
+        if (e == NO_DATA_VALUE)
+            return false;
+        h0 += e;
+    }
+
+    // A size x size grid of cells, equally spaced on the ground,
+    // with the observer in the center cell.
+    int c = (int)size / 2;
+    double cellSize = 2.0 * radius / (double)size;
+    double dLat = osg::RadiansToDegrees(cellSize / _radius);
+    double dLon = dLat / osg::maximum(cos(osg::DegreesToRadians(p.y())), 1e-6);
+
+    unsigned numCells = size * size;
+    std::vector<double> x(numCells), y(numCells);
+    for (unsigned j = 0; j < size; ++j)
+    {
+        for (unsigned i = 0; i < size; ++i)
+        {
+            x[j*size + i] = p.x() + (double)((int)i - c) * dLon;
+            y[j*size + i] = p.y() + (double)((int)j - c) * dLat;
+        }
+    }
+
+    std::vector<float> rel(numCells);
+    if (pool->getElevations(_srs.get(), _lod, &x[0], &y[0], numCells, &rel[0], 0L, parallel) == 0u)
+        return false;
+
+    // heights relative to the observer, as it sees them
+    for (unsigned j = 0; j < size; ++j)
+    {
+        for (unsigned i = 0; i < size; ++i)
+        {
+            float& h = rel[j*size + i];
+            if (h != NO_DATA_VALUE)
+            {
+                double d = cellSize * sqrt((double)(((int)i - c)*((int)i - c) + ((int)j - c)*((int)j - c)));
+                h = (float)((double)h - getDrop(d) - h0);
+            }
+        }
+    }
+
+    std::vector<unsigned char> visible(numCells, 0u);
+    visible[c*size + c] = 1u;
+
+    if (algorithm == ALGORITHM_R3)
+    {
+        for (int j = 0; j < (int)size; ++j)
+            for (int i = 0; i < (int)size; ++i)
+                sweep(&rel[0], size, c, i, j, cellSize, _targetHeight, false, &visible[0]);
+    }
+    else
+    {
+        // Rays to the edge of the grid cross every cell at least once. Near the
+        // center several rays cross the same cell; any one seeing it will do.
+        int last = (int)size - 1;
+        for (int k = 0; k < last; ++k)
+        {
+            sweep(&rel[0], size, c, k, 0, cellSize, _targetHeight, true, &visible[0]);
+            sweep(&rel[0], size, c, last, k, cellSize, _targetHeight, true, &visible[0]);
+            sweep(&rel[0], size, c, last - k, last, cellSize, _targetHeight, true, &visible[0]);
+            sweep(&rel[0], size, c, 0, last - k, cellSize, _targetHeight, true, &visible[0]);
+        }
+    }
+
+    // Rasterize, leaving the corners beyond the radius transparent.
+    unsigned char good[4], bad[4];
+    for (unsigned b = 0; b < 4; ++b)
+    {
+        good[b] = (unsigned char)(osg::clampBetween(_goodColor[b], 0.0f, 1.0f) * 255.0f + 0.5f);
+        bad[b]  = (unsigned char)(osg::clampBetween(_badColor[b],  0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    osg::ref_ptr<osg::Image> image = new osg::Image();
+    image->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+
+    double maxCells2 = (radius / cellSize) * (radius / cellSize);
+    for (unsigned j = 0; j < size; ++j)
+    {
+        unsigned char* ptr = image->data(0, j);
+        for (unsigned i = 0; i < size; ++i, ptr += 4)
+        {
+            double r2 = (double)(((int)i - c)*((int)i - c) + ((int)j - c)*((int)j - c));
+            if (r2 > maxCells2)
+                ptr[0] = ptr[1] = ptr[2] = ptr[3] = 0u;
+            else
+                memcpy(ptr, visible[j*size + i] ? good : bad, 4);
+        }
+    }
+
+    double west = p.x() - ((double)c + 0.5) * dLon;
+    double south = p.y() - ((double)c + 0.5) * dLat;
+    GeoExtent extent(_srs.get(), west, south, west + (double)size * dLon, south + (double)size * dLat);
+
+    out = GeoImage(image.get(), extent);
+    return true;
+}
+
+void
+LineOfSightEngine::computeViewsheds(const std::vector<GeoPoint>& observers,
+                                    double                       radius,
+                                    unsigned                     size,
+                                    std::vector<GeoImage>&       out,
+                                    Algorithm                    algorithm)
+{
+    METRIC_SCOPED_EX("LineOfSightEngine::computeViewsheds", 1, "num", toString(observers.size()).c_str());
+
+    out.assign(observers.size(), GeoImage());
+    if (observers.empty() || !_srs.valid())
+        return;
+
+    // One observer at a time per thread; each samples its grid on its own thread.
+    unsigned count = observers.size();
+    unsigned numChunks = osg::minimum(getNumThreads(), count);
+    unsigned chunkSize = (count + numChunks - 1u) / numChunks;
+    numChunks = (count + chunkSize - 1u) / chunkSize;
+
+    osg::ref_ptr<TaskService> service;
+    if (numChunks > 1u)
+        service = getTaskService();
+
+    std::vector< osg::ref_ptr< ParallelTask<ViewshedChunk> > > chunks;
+    Threading::MultiEvent done(numChunks - 1u);
+
+    for (unsigned c = 0; c < numChunks; ++c)
+    {
+        unsigned start = c * chunkSize;
+        ParallelTask<ViewshedChunk>* chunk = new ParallelTask<ViewshedChunk>(&done);
+        chunk->_engine = this;
+        chunk->_observers = &observers[start];
+        chunk->_out = &out[start];
+        chunk->_count = osg::minimum(chunkSize, count - start);
+        chunk->_radius = radius;
+        chunk->_size = size;
+        chunk->_algorithm = algorithm;
+        chunks.push_back(chunk);
+
+        if (c > 0u)
+            service->add(chunk);
+    }
+
+    chunks.front()->execute();
+    done.wait();
+}
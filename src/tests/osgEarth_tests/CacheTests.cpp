@@ -24,8 +24,87 @@
 #include <osgEarth/GeoData>
 #include <osgEarth/Registry>
 #include <osgEarth/Cache>
+#include <osgEarth/MemCache>
+#include <osgEarth/CachePack>
+#include <osgEarth/ImageUtils>
+#include <osgEarthDrivers/cache_filesystem/FileSystemCache>
+#include <osgEarthDrivers/cache_pack/PackCache>
+#include <OpenThreads/Thread>
+#include <osg/Group>
+#include <cstring>
+#include <fstream>
+#include <sstream>
 
 using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+namespace
+{
+    // Opens a filesystem cache at a root folder.
+    Cache* openFileSystemCache(const std::string& root, unsigned threads, unsigned maxSizeMB)
+    {
+        FileSystemCacheOptions options;
+        options.rootPath() = root;
+        options.threads() = threads;
+        options.maxSizeMB() = maxSizeMB;
+        return CacheFactory::create(options);
+    }
+
+    // Opens a pack cache on a pack file.
+    Cache* openPackCache(const std::string& path)
+    {
+        PackCacheOptions options;
+        options.path() = path;
+        return CacheFactory::create(options);
+    }
+
+    // Copies a pack file, applying "corrupt" to each record of a payload type.
+    void corruptPack(const std::string& in, const std::string& out, unsigned type, void (*corrupt)(CachePack::Record&))
+    {
+        std::ifstream input(in.c_str(), std::ios::binary);
+        std::stringstream buf;
+        buf << input.rdbuf();
+        std::string data = buf.str();
+
+        CachePack::Header header;
+        ::memcpy(&header, &data[0], sizeof(header));
+        for (unsigned b = 0; b < header.numBins; ++b)
+        {
+            CachePack::Bin bin;
+            ::memcpy(&bin, &data[header.binsOffset + b * sizeof(bin)], sizeof(bin));
+            for (unsigned r = 0; r < bin.numRecords; ++r)
+            {
+                char* ptr = &data[bin.recordsOffset + r * sizeof(CachePack::Record)];
+                CachePack::Record rec;
+                ::memcpy(&rec, ptr, sizeof(rec));
+                if (rec.type == type)
+                {
+                    corrupt(rec);
+                    ::memcpy(ptr, &rec, sizeof(rec));
+                }
+            }
+        }
+
+        std::ofstream output(out.c_str(), std::ios::binary);
+        output.write(data.data(), data.size());
+    }
+
+    void hugeImage(CachePack::Record& rec) { rec.s = 1 << 20; rec.t = 1 << 20; }
+    void shortHeightField(CachePack::Record& rec) { rec.dataLength = 4u; }
+
+    // A string that won't compress much.
+    std::string createPayload(unsigned length, unsigned seed)
+    {
+        std::string value(length, ' ');
+        unsigned x = seed * 2654435761u + 1u;
+        for (unsigned i = 0; i < length; ++i)
+        {
+            x = x * 1664525u + 1013904223u;
+            value[i] = (char)('a' + (x >> 24) % 26u);
+        }
+        return value;
+    }
+}
 
 TEST_CASE( "Cache" ) {
 
@@ -83,3 +162,272 @@ TEST_CASE( "Cache" ) {
         REQUIRE(r2.failed());
     }  
 }
+
+TEST_CASE( "MemCache byte-capped bins" ) {
+
+    osg::ref_ptr<MemCache> cache = new MemCache();
+    cache->setNumShards(1u);
+    cache->setMaxBinBytes(64u * 1024u);
+
+    osg::ref_ptr<CacheBin> bin = cache->addBin("test_bin");
+    REQUIRE(bin.valid());
+
+    std::string payload(4096, 'x');
+    osg::ref_ptr<StringObject> value = new StringObject(payload);
+    for(int i=0; i<64; ++i)
+    {
+        std::string key = Stringify() << "key" << i;
+        REQUIRE(bin->write(key, value.get(), Config(), 0L));
+    }
+
+    MemCacheBinStats stats;
+    REQUIRE(cache->getStats("test_bin", stats));
+    REQUIRE(stats._bytes <= stats._maxBytes);
+    REQUIRE(stats._evictions > 0u);
+    REQUIRE(stats._entries + stats._evictions == 64u);
+
+    // most recent write is always still there:
+    ReadResult r = bin->readString("key63", 0L);
+    REQUIRE(r.succeeded());
+    REQUIRE(r.getString() == payload);
+
+    // oldest one was evicted:
+    REQUIRE(bin->readString("key0", 0L).failed());
+
+    REQUIRE(cache->getStats("test_bin", stats));
+    REQUIRE(stats._hits == 1u);
+    REQUIRE(stats._misses == 1u);
+
+    // a record larger than the budget is refused
+    osg::ref_ptr<StringObject> huge = new StringObject(std::string(128u * 1024u, 'x'));
+    REQUIRE(!bin->write("huge", huge.get(), Config(), 0L));
+}
+
+TEST_CASE( "MemCache drops a key's old record on an oversize write" ) {
+
+    osg::ref_ptr<MemCache> cache = new MemCache();
+    cache->setNumShards(1u);
+    cache->setMaxBinBytes(64u * 1024u);
+
+    osg::ref_ptr<CacheBin> bin = cache->addBin("test_bin");
+    REQUIRE(bin.valid());
+
+    osg::ref_ptr<StringObject> small = new StringObject("old value");
+    REQUIRE(bin->write("key", small.get(), Config(), 0L));
+    REQUIRE(bin->readString("key", 0L).succeeded());
+
+    osg::ref_ptr<StringObject> huge = new StringObject(std::string(128u * 1024u, 'x'));
+    REQUIRE(!bin->write("key", huge.get(), Config(), 0L));
+
+    // the stale value must not come back
+    REQUIRE(bin->readString("key", 0L).failed());
+
+    MemCacheBinStats stats;
+    REQUIRE(cache->getStats("test_bin", stats));
+    REQUIRE(stats._entries == 0u);
+    REQUIRE(stats._bytes == 0u);
+}
+
+TEST_CASE( "MemCache charges a record's metadata" ) {
+
+    osg::ref_ptr<MemCache> cache = new MemCache();
+    cache->setNumShards(1u);
+    cache->setMaxBinBytes(64u * 1024u);
+
+    osg::ref_ptr<CacheBin> bin = cache->addBin("test_bin");
+    REQUIRE(bin.valid());
+
+    osg::ref_ptr<StringObject> value = new StringObject("value");
+
+    MemCacheBinStats stats;
+    REQUIRE(bin->write("plain", value.get(), Config(), 0L));
+    REQUIRE(cache->getStats("test_bin", stats));
+    unsigned plainBytes = stats._bytes;
+
+    Config meta("meta");
+    meta.add("note", std::string(8u * 1024u, 'x'));
+    meta.add("child", std::string(8u * 1024u, 'y'));
+    REQUIRE(bin->write("meta", value.get(), meta, 0L));
+    REQUIRE(cache->getStats("test_bin", stats));
+    REQUIRE(stats._bytes - plainBytes >= 16u * 1024u);
+
+    // metadata alone can make a record too big to cache
+    Config hugeMeta("meta");
+    hugeMeta.add("note", std::string(128u * 1024u, 'x'));
+    REQUIRE(!bin->write("huge", value.get(), hugeMeta, 0L));
+}
+
+TEST_CASE( "FileSystemCache write-behind" ) {
+
+    const std::string root = "osgearth_tests_cache_writebehind";
+    {
+        osg::ref_ptr<Cache> cache = openFileSystemCache(root, 0u, 0u);
+        REQUIRE(cache.valid());
+        REQUIRE(cache->addBin("test_bin")->clear());
+    }
+
+    SECTION("Queued writes are readable at once and reach the disk") {
+        {
+            osg::ref_ptr<Cache> cache = openFileSystemCache(root, 2u, 0u);
+            osg::ref_ptr<CacheBin> bin = cache->addBin("test_bin");
+
+            for (unsigned i = 0; i < 64u; ++i)
+            {
+                std::string key = Stringify() << "key" << i;
+                osg::ref_ptr<StringObject> value = new StringObject(createPayload(1024u, i));
+                REQUIRE(bin->write(key, value.get(), Config(), 0L));
+
+                ReadResult r = bin->readString(key, 0L);
+                REQUIRE(r.succeeded());
+                REQUIRE(r.getString() == value->getString());
+            }
+
+            // a record removed while its write is pending stays removed
+            REQUIRE(bin->remove("key0"));
+            REQUIRE(bin->readString("key0", 0L).failed());
+
+            // closing the cache flushes the queue
+        }
+
+        osg::ref_ptr<Cache> cache = openFileSystemCache(root, 0u, 0u);
+        osg::ref_ptr<CacheBin> bin = cache->addBin("test_bin");
+
+        REQUIRE(bin->readString("key0", 0L).failed());
+        for (unsigned i = 1; i < 64u; ++i)
+        {
+            std::string key = Stringify() << "key" << i;
+            ReadResult r = bin->readString(key, 0L);
+            REQUIRE(r.succeeded());
+            REQUIRE(r.getString() == createPayload(1024u, i));
+        }
+    }
+
+    SECTION("Writes are synchronous by default") {
+        FileSystemCacheOptions options;
+        REQUIRE(options.threads().get() == 0u);
+    }
+}
+
+TEST_CASE( "FileSystemCache prunes to its maximum size" ) {
+
+    const std::string root = "osgearth_tests_cache_prune";
+    {
+        osg::ref_ptr<Cache> cache = openFileSystemCache(root, 0u, 0u);
+        REQUIRE(cache->addBin("test_bin")->clear());
+    }
+
+    osg::ref_ptr<Cache> cache = openFileSystemCache(root, 0u, 1u);
+    osg::ref_ptr<CacheBin> bin = cache->addBin("test_bin");
+
+    // the usage index loads in the background; give it a moment, since
+    // nothing is pruned until it has.
+    OpenThreads::Thread::microSleep(500000);
+
+    // 3MB of records into a 1MB cache
+    for (unsigned i = 0; i < 48u; ++i)
+    {
+        std::string key = Stringify() << "key" << i;
+        osg::ref_ptr<StringObject> value = new StringObject(createPayload(65536u, i));
+        REQUIRE(bin->write(key, value.get(), Config(), 0L));
+    }
+
+    // access times have a one-second resolution, so which records go
+    // first within the same second is up to the index; just count them.
+    unsigned remaining = 0u;
+    for (unsigned i = 0; i < 48u; ++i)
+    {
+        std::string key = Stringify() << "key" << i;
+        if (bin->getRecordStatus(key) == CacheBin::STATUS_OK)
+            ++remaining;
+    }
+    REQUIRE(remaining > 0u);
+    REQUIRE(remaining <= 16u);
+}
+
+TEST_CASE( "PackCache reads back what CachePackWriter wrote" ) {
+
+    const std::string path = "osgearth_tests_cache.pack";
+
+    osg::ref_ptr<osg::Image> image = ImageUtils::createEmptyImage(8, 4);
+    ImageUtils::PixelWriter write(image.get());
+    write(osg::Vec4(1, 0, 0, 1), 3, 2);
+
+    osg::ref_ptr<osg::HeightField> hf = new osg::HeightField();
+    hf->allocate(5, 3);
+    for (unsigned i = 0; i < 15u; ++i)
+        hf->getFloatArray()->at(i) = (float)i * 0.5f;
+    hf->setOrigin(osg::Vec3d(-10.0, 20.0, 0.0));
+    hf->setXInterval(0.25);
+    hf->setYInterval(0.5);
+
+    osg::ref_ptr<osg::Group> group = new osg::Group();
+    group->setName("group");
+
+    osg::ref_ptr<StringObject> str = new StringObject("hello");
+
+    Config meta("meta");
+    meta.set("source", "test");
+
+    {
+        osg::ref_ptr<CachePackWriter> writer = new CachePackWriter(path);
+        REQUIRE(writer->isOpen());
+        REQUIRE(writer->write("bin", "image", image.get(), meta, 100));
+        REQUIRE(writer->write("bin", "heightfield", hf.get(), Config(), 0));
+        REQUIRE(writer->write("bin", "string", str.get(), Config(), 0));
+        REQUIRE(writer->write("bin", "group", group.get(), Config(), 0));
+        REQUIRE(writer->close());
+    }
+
+    osg::ref_ptr<Cache> cache = openPackCache(path);
+    REQUIRE(cache.valid());
+    osg::ref_ptr<CacheBin> bin = cache->addBin("bin");
+    REQUIRE(bin.valid());
+
+    SECTION("Each payload type round-trips") {
+        ReadResult ri = bin->readImage("image", 0L);
+        REQUIRE(ri.succeeded());
+        REQUIRE(ImageUtils::areEquivalent(ri.getImage(), image.get()));
+        REQUIRE(ri.metadata().value("source") == "test");
+        REQUIRE(ri.lastModifiedTime() == 100);
+
+        ReadResult rh = bin->readObject("heightfield", 0L);
+        REQUIRE(rh.succeeded());
+        osg::HeightField* hf2 = rh.get<osg::HeightField>();
+        REQUIRE(hf2 != 0L);
+        REQUIRE(hf2->getNumColumns() == 5u);
+        REQUIRE(hf2->getNumRows() == 3u);
+        REQUIRE(hf2->getOrigin() == hf->getOrigin());
+        REQUIRE(hf2->getXInterval() == 0.25f);
+        REQUIRE(hf2->getYInterval() == 0.5f);
+        REQUIRE(*hf2->getFloatArray() == *hf->getFloatArray());
+
+        ReadResult rs = bin->readString("string", 0L);
+        REQUIRE(rs.succeeded());
+        REQUIRE(rs.getString() == "hello");
+
+        ReadResult rg = bin->readObject("group", 0L);
+        REQUIRE(rg.succeeded());
+        REQUIRE(dynamic_cast<osg::Group*>(rg.getObject()) != 0L);
+        REQUIRE(rg.getObject()->getName() == "group");
+    }
+
+    SECTION("A missing key is not found") {
+        REQUIRE(bin->readObject("missing", 0L).code() == ReadResult::RESULT_NOT_FOUND);
+        REQUIRE(bin->getRecordStatus("missing") == CacheBin::STATUS_NOT_FOUND);
+        REQUIRE(bin->getRecordStatus("string") == CacheBin::STATUS_OK);
+        REQUIRE(cache->addBin("no_such_bin")->readString("string", 0L).failed());
+    }
+
+    SECTION("Records too short for their payload fail to read") {
+        const std::string badImages = "osgearth_tests_cache_bad_images.pack";
+        corruptPack(path, badImages, CachePack::PAYLOAD_IMAGE, hugeImage);
+        osg::ref_ptr<Cache> bad = openPackCache(badImages);
+        REQUIRE(bad->addBin("bin")->readImage("image", 0L).failed());
+        REQUIRE(bad->addBin("bin")->readString("string", 0L).succeeded());
+
+        const std::string badHeightFields = "osgearth_tests_cache_bad_heightfields.pack";
+        corruptPack(path, badHeightFields, CachePack::PAYLOAD_HEIGHTFIELD, shortHeightField);
+        bad = openPackCache(badHeightFields);
+        REQUIRE(bad->addBin("bin")->readObject("heightfield", 0L).failed());
+    }
+}
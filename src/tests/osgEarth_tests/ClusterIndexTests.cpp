@@ -0,0 +1,198 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/GeoData>
+#include <osgEarthUtil/ClusterIndex>
+#include <algorithm>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+TEST_CASE( "ClusterIndex" ) {
+
+    const SpatialReference* WGS84 = SpatialReference::get("wgs84");
+    osg::ref_ptr<ClusterIndex> index = new ClusterIndex(WGS84);
+
+    // a grid of points, plus two that sit on top of each other
+    std::vector<osg::Vec3d> world;
+    for (int lon = -170; lon <= 170; lon += 20)
+    {
+        for (int lat = -80; lat <= 80; lat += 20)
+        {
+            world.push_back(osg::Vec3d());
+            GeoPoint(WGS84, lon, lat, 0.0, ALTMODE_ABSOLUTE).toWorld(world.back());
+        }
+    }
+    world.push_back(world.front());
+
+    for (unsigned i = 0; i < world.size(); ++i)
+        index->insert(i, world[i]);
+
+    SECTION("The root cell holds every point") {
+        REQUIRE(index->size() == world.size());
+
+        std::vector<unsigned> points;
+        index->getPoints(0u, points);
+        std::sort(points.begin(), points.end());
+        REQUIRE(points.size() == world.size());
+        for (unsigned i = 0; i < points.size(); ++i)
+            REQUIRE(points[i] == i);
+    }
+
+    SECTION("Removing points takes them out of the index") {
+        REQUIRE(index->remove(0u));
+        REQUIRE(index->remove(5u));
+        REQUIRE(!index->remove(5u));
+        REQUIRE(index->size() == world.size() - 2u);
+
+        std::vector<unsigned> points;
+        index->getPoints(0u, points);
+        REQUIRE(points.size() == world.size() - 2u);
+        REQUIRE(std::find(points.begin(), points.end(), 0u) == points.end());
+        REQUIRE(std::find(points.begin(), points.end(), 5u) == points.end());
+
+        // and they can go back in
+        index->insert(5u, world[5]);
+        REQUIRE(index->size() == world.size() - 1u);
+    }
+
+    SECTION("Removing every point empties the index") {
+        for (unsigned i = 0; i < world.size(); ++i)
+            REQUIRE(index->remove(i));
+        REQUIRE(index->size() == 0u);
+
+        std::vector<unsigned> points;
+        index->getPoints(0u, points);
+        REQUIRE(points.empty());
+    }
+}
+
+
+namespace
+{
+    // Queries the index from a camera looking straight down at (lon, lat).
+    void queryFrom(const ClusterIndex& index, const SpatialReference* srs, double lon, double lat, double alt, ClusterIndex::ClusterList& out)
+    {
+        osg::Vec3d eye, center;
+        GeoPoint(srs, lon, lat, alt, ALTMODE_ABSOLUTE).toWorld(eye);
+        GeoPoint(srs, lon, lat, 0.0, ALTMODE_ABSOLUTE).toWorld(center);
+
+        osg::Matrixd view, proj;
+        view.makeLookAt(eye, center, osg::Vec3d(0, 0, 1));
+        proj.makePerspective(30.0, 1920.0/1080.0, 1.0, 1e8);
+
+        osg::ref_ptr<osg::Viewport> viewport = new osg::Viewport(0, 0, 1920, 1080);
+        osg::ref_ptr<Horizon> horizon = new Horizon(srs);
+        horizon->setEye(eye);
+
+        out.clear();
+        index.query(view, proj, *viewport.get(), 50.0f, horizon.get(), out);
+    }
+
+    // The cluster holding a point, or 0L.
+    const ClusterIndex::Cluster* findCluster(const ClusterIndex& index, const ClusterIndex::ClusterList& clusters, unsigned id)
+    {
+        for (unsigned i = 0; i < clusters.size(); ++i)
+        {
+            std::vector<unsigned> points;
+            index.getPoints(clusters[i].cell, points);
+            if (std::find(points.begin(), points.end(), id) != points.end())
+                return &clusters[i];
+        }
+        return 0L;
+    }
+}
+
+TEST_CASE( "ClusterIndex queries" ) {
+
+    const SpatialReference* WGS84 = SpatialReference::get("wgs84");
+    osg::ref_ptr<ClusterIndex> index = new ClusterIndex(WGS84);
+
+    // Three points a few meters apart (at 1/3 of the way across the mercator
+    // square, far from any cell boundary), one ~350km east of them, one on
+    // the far side of the earth and one far south, out of the frustum.
+    const double LON = -60.0, LAT = 51.26;
+    double coords[6][2] = {
+        { LON,           LAT           },
+        { LON + 0.0001,  LAT           },
+        { LON,           LAT + 0.0001  },
+        { LON + 5.0,     LAT           },
+        { LON + 180.0,  -LAT           },
+        { LON,           10.0          }
+    };
+
+    for (unsigned i = 0; i < 6; ++i)
+    {
+        osg::Vec3d world;
+        GeoPoint(WGS84, coords[i][0], coords[i][1], 0.0, ALTMODE_ABSOLUTE).toWorld(world);
+        index->insert(i, world);
+    }
+
+    ClusterIndex::ClusterList clusters;
+    queryFrom(*index.get(), WGS84, LON, LAT, 1e6, clusters);
+
+    SECTION("Close points cluster, distant ones don't, and hidden ones are culled") {
+        REQUIRE(clusters.size() == 2u);
+
+        const ClusterIndex::Cluster* group = findCluster(*index.get(), clusters, 0u);
+        REQUIRE(group != 0L);
+        REQUIRE(group->count == 3u);
+        REQUIRE(findCluster(*index.get(), clusters, 1u) == group);
+        REQUIRE(findCluster(*index.get(), clusters, 2u) == group);
+        REQUIRE(group->lon == Approx(LON + 0.0001/3.0).epsilon(1e-6));
+        REQUIRE(group->lat == Approx(LAT + 0.0001/3.0).epsilon(1e-6));
+
+        const ClusterIndex::Cluster* single = findCluster(*index.get(), clusters, 3u);
+        REQUIRE(single != 0L);
+        REQUIRE(single != group);
+        REQUIRE(single->count == 1u);
+
+        REQUIRE(findCluster(*index.get(), clusters, 4u) == 0L);
+        REQUIRE(findCluster(*index.get(), clusters, 5u) == 0L);
+    }
+
+    SECTION("A point that moves joins the cluster it moved to") {
+        osg::Vec3d world;
+        GeoPoint(WGS84, LON - 0.0001, LAT, 0.0, ALTMODE_ABSOLUTE).toWorld(world);
+        REQUIRE(index->remove(3u));
+        index->insert(3u, world);
+
+        queryFrom(*index.get(), WGS84, LON, LAT, 1e6, clusters);
+        REQUIRE(clusters.size() == 1u);
+        REQUIRE(clusters[0].count == 4u);
+        REQUIRE(findCluster(*index.get(), clusters, 3u) == &clusters[0]);
+    }
+
+    SECTION("A point that moves out of view drops out of the results") {
+        osg::Vec3d world;
+        GeoPoint(WGS84, LON, -10.0, 0.0, ALTMODE_ABSOLUTE).toWorld(world);
+        REQUIRE(index->remove(3u));
+        index->insert(3u, world);
+
+        queryFrom(*index.get(), WGS84, LON, LAT, 1e6, clusters);
+        REQUIRE(clusters.size() == 1u);
+        REQUIRE(clusters[0].count == 3u);
+        REQUIRE(findCluster(*index.get(), clusters, 3u) == 0L);
+    }
+}
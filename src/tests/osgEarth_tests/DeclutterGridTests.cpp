@@ -0,0 +1,206 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/DeclutterGrid>
+#include <osg/Geometry>
+#include <osg/Group>
+#include <cfloat>
+#include <limits>
+
+using namespace osgEarth;
+
+namespace
+{
+    // Deterministic random numbers, so a failure can be reproduced.
+    struct Random
+    {
+        Random(unsigned seed) : _state(seed) { }
+        unsigned next() { _state = _state * 1664525u + 1013904223u; return _state >> 8; }
+        float range(float lo, float hi) { return lo + (hi - lo) * (float)(next() & 0xFFFF) / 65535.0f; }
+        unsigned _state;
+    };
+
+    // The declutter test as it was before the grid: every box against every
+    // reserved box.
+    struct BruteForce
+    {
+        std::vector< std::pair<const osg::Node*, osg::BoundingBox> > _used;
+
+        bool isClear(const osg::Node* parent, const osg::BoundingBox& box) const
+        {
+            for (unsigned i = 0; i < _used.size(); ++i)
+            {
+                const osg::BoundingBox& used = _used[i].second;
+                bool isClear =
+                    box.xMin() > used.xMax() ||
+                    box.xMax() < used.xMin() ||
+                    box.yMin() > used.yMax() ||
+                    box.yMax() < used.yMin();
+                if (!isClear && parent != _used[i].first)
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    // Runs the boxes through the grid and the brute-force scan the way the
+    // layout engine does (reserving accepted boxes that have a parent), and
+    // counts the decisions that differ.
+    unsigned countMismatches(const osg::Viewport* vp, const std::vector<osg::BoundingBox>& boxes, const std::vector<const osg::Node*>& parents)
+    {
+        DeclutterGrid grid;
+        grid.reset(vp);
+        BruteForce brute;
+
+        unsigned mismatches = 0u;
+        for (unsigned i = 0; i < boxes.size(); ++i)
+        {
+            const osg::Node* parent = parents[i];
+            bool gridClear = grid.isClear(parent, boxes[i]);
+            bool bruteClear = brute.isClear(parent, boxes[i]);
+            if (gridClear != bruteClear)
+                ++mismatches;
+
+            if (bruteClear && parent)
+            {
+                grid.insert(parent, boxes[i]);
+                brute._used.push_back(std::make_pair(parent, boxes[i]));
+            }
+        }
+        return mismatches;
+    }
+
+    osg::BoundingBox makeBox(float x0, float y0, float x1, float y1)
+    {
+        return osg::BoundingBox(x0, y0, 0.0f, x1, y1, 0.0f);
+    }
+}
+
+TEST_CASE("DeclutterGrid accepts the same boxes as a brute-force scan") {
+
+    std::vector< osg::ref_ptr<osg::Group> > groups;
+    for (unsigned i = 0; i < 8; ++i)
+        groups.push_back(new osg::Group());
+
+    Random random(42u);
+
+    // a window that doesn't start at the origin or end on a cell boundary
+    osg::ref_ptr<osg::Viewport> vp = new osg::Viewport(100, 50, 1000, 700);
+    const float xMin = 100.0f, yMin = 50.0f, xMax = 1100.0f, yMax = 750.0f;
+
+    std::vector<osg::BoundingBox> boxes;
+    std::vector<const osg::Node*> parents;
+
+    SECTION("Random boxes, many straddling cells") {
+        for (unsigned i = 0; i < 4000; ++i)
+        {
+            float x = random.range(xMin - 50.0f, xMax + 50.0f);
+            float y = random.range(yMin - 50.0f, yMax + 50.0f);
+            boxes.push_back(makeBox(x, y, x + random.range(1.0f, 150.0f), y + random.range(1.0f, 40.0f)));
+        }
+    }
+
+    SECTION("Boxes on cell boundaries and the screen edges") {
+        float edgesX[] = { xMin, xMin + 64.0f, xMin + 128.0f, xMin + 960.0f, xMax - 1.0f, xMax, xMin - 1.0f, xMax + 1.0f };
+        float edgesY[] = { yMin, yMin + 64.0f, yMin + 128.0f, yMin + 640.0f, yMax - 1.0f, yMax, yMin - 1.0f, yMax + 1.0f };
+        for (unsigned i = 0; i < 4000; ++i)
+        {
+            float x = edgesX[random.next() % 8];
+            float y = edgesY[random.next() % 8];
+            float w = (random.next() & 1) ? 0.0f : random.range(1.0f, 100.0f);
+            float h = (random.next() & 1) ? 0.0f : random.range(1.0f, 100.0f);
+            // some boxes end on the edge, some start there
+            if (random.next() & 1)
+                boxes.push_back(makeBox(x - w, y - h, x, y));
+            else
+                boxes.push_back(makeBox(x, y, x + w, y + h));
+        }
+        // boxes entirely off the window, and one covering all of it
+        boxes.push_back(makeBox(-5000.0f, -5000.0f, -4000.0f, -4000.0f));
+        boxes.push_back(makeBox(5000.0f, 5000.0f, 6000.0f, 6000.0f));
+        boxes.push_back(makeBox(-FLT_MAX, -FLT_MAX, FLT_MAX, FLT_MAX));
+    }
+
+    SECTION("NaN, infinite and inverted boxes") {
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        const float inf = std::numeric_limits<float>::infinity();
+        for (unsigned i = 0; i < 4000; ++i)
+        {
+            float x = random.range(xMin - 50.0f, xMax + 50.0f);
+            float y = random.range(yMin - 50.0f, yMax + 50.0f);
+            float w = random.range(1.0f, 150.0f);
+            float h = random.range(1.0f, 40.0f);
+            switch (random.next() % 6)
+            {
+            case 0: boxes.push_back(makeBox(nan, y, x + w, y + h)); break;
+            case 1: boxes.push_back(makeBox(x, y, x + w, nan)); break;
+            case 2: boxes.push_back(makeBox(x, y, inf, y + h)); break;
+            case 3: boxes.push_back(makeBox(x + w, y + h, x, y)); break; // inverted
+            default: boxes.push_back(makeBox(x, y, x + w, y + h)); break;
+            }
+        }
+        // what an empty drawable's bound turns into
+        boxes.push_back(makeBox(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX));
+    }
+
+    // about one box in ten has no parent, and so never reserves space
+    for (unsigned i = 0; i < boxes.size(); ++i)
+    {
+        unsigned p = random.next() % 10;
+        parents.push_back(p < groups.size() ? groups[p].get() : 0L);
+    }
+
+    REQUIRE(countMismatches(vp.get(), boxes, parents) == 0u);
+}
+
+TEST_CASE("DeclutterRecord reuse") {
+
+    osg::ref_ptr<osg::Group> parent = new osg::Group();
+    osg::ref_ptr<osg::Geometry> drawable = new osg::Geometry();
+    osg::ref_ptr<osg::Geometry> other = new osg::Geometry();
+
+    DeclutterRecord record;
+    record._drawable = drawable.get();
+    record._parent = parent.get();
+    record._priority = 1.0f;
+    record._box = makeBox(10.0f, 10.0f, 50.0f, 20.0f);
+    record._visible = true;
+
+    SECTION("A tolerance of zero or less never reuses a layout") {
+        REQUIRE(record.matches(drawable.get(), parent.get(), 1.0f, record._box, 0.0f) == false);
+        REQUIRE(record.matches(drawable.get(), parent.get(), 1.0f, record._box, -1.0f) == false);
+    }
+
+    SECTION("A layout is reused within the tolerance") {
+        REQUIRE(record.matches(drawable.get(), parent.get(), 1.0f, record._box, 1.0f) == true);
+        REQUIRE(record.matches(drawable.get(), parent.get(), 1.0f, makeBox(11.0f, 9.0f, 51.0f, 19.0f), 1.0f) == true);
+        REQUIRE(record.matches(drawable.get(), parent.get(), 1.0f, makeBox(11.5f, 10.0f, 51.5f, 20.0f), 1.0f) == false);
+    }
+
+    SECTION("A layout is not reused for a different leaf") {
+        REQUIRE(record.matches(other.get(), parent.get(), 1.0f, record._box, 1.0f) == false);
+        REQUIRE(record.matches(drawable.get(), 0L, 1.0f, record._box, 1.0f) == false);
+        REQUIRE(record.matches(drawable.get(), parent.get(), 2.0f, record._box, 1.0f) == false);
+    }
+}
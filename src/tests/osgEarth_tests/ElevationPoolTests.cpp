@@ -0,0 +1,235 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/ElevationPool>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/Map>
+#include <osgEarth/Registry>
+
+#include <osgEarthDrivers/gdal/GDALOptions>
+
+#include <OpenThreads/Thread>
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+namespace
+{
+    Map* createElevationMap()
+    {
+        GDALOptions opt;
+        opt.url() = "../data/terrain/mt_rainier_90m.tif";
+
+        ElevationLayerOptions layerOptions("rainier", opt);
+        layerOptions.cachePolicy() = CachePolicy::NO_CACHE;
+
+        Map* map = new Map();
+        map->addLayer(new ElevationLayer(layerOptions));
+        return map;
+    }
+
+    // A grid of points over the data, with a border that falls off of it.
+    void createGrid(unsigned dim, std::vector<double>& x, std::vector<double>& y)
+    {
+        x.clear(); y.clear();
+        for (unsigned r = 0; r < dim; ++r)
+        {
+            for (unsigned c = 0; c < dim; ++c)
+            {
+                x.push_back(-122.0 + 0.5 * (double)c / (double)(dim - 1));
+                y.push_back(46.6 + 0.5 * (double)r / (double)(dim - 1));
+            }
+        }
+    }
+
+    // Samples the same points over and over through new envelopes, so
+    // every round goes back to the pool.
+    class QueryThread : public OpenThreads::Thread
+    {
+    public:
+        QueryThread(ElevationPool* pool, const std::vector<double>& x, const std::vector<double>& y) :
+            _pool(pool), _x(x), _y(y), _heights(x.size()) { }
+
+        void run()
+        {
+            const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+            for (unsigned round = 0; round < 20u; ++round)
+            {
+                osg::ref_ptr<ElevationEnvelope> env = _pool->createEnvelope(wgs84, 12u);
+                env->getElevations(&_x[0], &_y[0], _x.size(), &_heights[0]);
+                _rounds.push_back(_heights);
+            }
+        }
+
+        ElevationPool*                   _pool;
+        const std::vector<double>&       _x;
+        const std::vector<double>&       _y;
+        std::vector<float>               _heights;
+        std::vector<std::vector<float> > _rounds;
+    };
+
+    // Shrinks, grows and clears the pool while the queries run.
+    class EvictThread : public OpenThreads::Thread
+    {
+    public:
+        EvictThread(ElevationPool* pool) : _pool(pool) { }
+
+        void run()
+        {
+            for (unsigned i = 0; i < 200u; ++i)
+            {
+                _pool->setMaxEntries((i % 3u) == 0u ? 1u : 64u);
+                if ((i % 10u) == 0u)
+                    _pool->clear();
+                OpenThreads::Thread::microSleep(1000);
+            }
+        }
+
+        ElevationPool* _pool;
+    };
+}
+
+TEST_CASE( "ElevationPool batch queries" ) {
+
+    osg::ref_ptr<Map> map = createElevationMap();
+    ElevationPool* pool = map->getElevationPool();
+    REQUIRE(pool != 0L);
+
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+
+    // big enough to split into several chunks
+    std::vector<double> x, y;
+    createGrid(192u, x, y);
+    unsigned count = x.size();
+
+    SECTION("Serial and parallel batches give identical results") {
+        std::vector<float> serialHeights(count), serialRes(count);
+        unsigned serialValid = pool->getElevations(wgs84, 12u, &x[0], &y[0], count, &serialHeights[0], &serialRes[0], false);
+
+        std::vector<float> parallelHeights(count), parallelRes(count);
+        unsigned parallelValid = pool->getElevations(wgs84, 12u, &x[0], &y[0], count, &parallelHeights[0], &parallelRes[0], true);
+
+        REQUIRE(serialValid > 0u);
+        REQUIRE(serialValid < count);
+        REQUIRE(parallelValid == serialValid);
+        REQUIRE(parallelHeights == serialHeights);
+        REQUIRE(parallelRes == serialRes);
+    }
+
+    SECTION("Batches match single-point queries") {
+        osg::ref_ptr<ElevationEnvelope> env = pool->createEnvelope(wgs84, 12u);
+
+        std::vector<float> heights(count), res(count);
+        pool->getElevations(wgs84, 12u, &x[0], &y[0], count, &heights[0], &res[0], true);
+
+        for (unsigned i = 0; i < count; i += 97u)
+        {
+            std::pair<float, float> single = env->getElevationAndResolution(x[i], y[i]);
+            REQUIRE(heights[i] == single.first);
+            if (single.first != NO_DATA_VALUE)
+            {
+                // the resolution is the mean of the X and Y intervals
+                REQUIRE(res[i] == single.second);
+            }
+        }
+    }
+}
+
+TEST_CASE( "ElevationPool cache" ) {
+
+    osg::ref_ptr<Map> map = createElevationMap();
+    ElevationPool* pool = map->getElevationPool();
+    REQUIRE(pool != 0L);
+
+    const SpatialReference* wgs84 = SpatialReference::get("wgs84");
+
+    std::vector<double> x, y;
+    createGrid(24u, x, y);
+    unsigned count = x.size();
+
+    SECTION("A request for a loaded tile is a hit; a load is a miss") {
+        pool->clear();
+        pool->resetStats();
+
+        float h;
+        double px = -121.76, py = 46.85;
+        osg::ref_ptr<ElevationEnvelope> env1 = pool->createEnvelope(wgs84, 12u);
+        env1->getElevations(&px, &py, 1u, &h);
+        REQUIRE(pool->getHitRate() == 0.0f);
+
+        osg::ref_ptr<ElevationEnvelope> env2 = pool->createEnvelope(wgs84, 12u);
+        env2->getElevations(&px, &py, 1u, &h);
+        REQUIRE(pool->getHitRate() == 0.5f);
+    }
+
+    SECTION("Lowering the max entries trims the pool instead of clearing it") {
+        pool->setMaxEntries(256u);
+        pool->clear();
+
+        std::vector<float> heights(count);
+        pool->getElevations(wgs84, 14u, &x[0], &y[0], count, &heights[0]);
+        unsigned before = pool->getNumEntries();
+        REQUIRE(before > 32u);
+
+        // 16 shards of 2
+        pool->setMaxEntries(32u);
+        unsigned after = pool->getNumEntries();
+        REQUIRE(after > 0u);
+        REQUIRE(after <= 32u);
+    }
+
+    SECTION("Concurrent queries and evictions return the same heights") {
+        std::vector<float> expected(count);
+        {
+            osg::ref_ptr<ElevationEnvelope> env = pool->createEnvelope(wgs84, 12u);
+            env->getElevations(&x[0], &y[0], count, &expected[0]);
+        }
+
+        std::vector<QueryThread*> queries;
+        for (unsigned i = 0; i < 4u; ++i)
+            queries.push_back(new QueryThread(pool, x, y));
+
+        EvictThread evict(pool);
+
+        for (unsigned i = 0; i < queries.size(); ++i)
+            queries[i]->start();
+        evict.start();
+
+        for (unsigned i = 0; i < queries.size(); ++i)
+            queries[i]->join();
+        evict.join();
+
+        for (unsigned i = 0; i < queries.size(); ++i)
+        {
+            REQUIRE(queries[i]->_rounds.size() == 20u);
+            for (unsigned r = 0; r < queries[i]->_rounds.size(); ++r)
+                REQUIRE(queries[i]->_rounds[r] == expected);
+            delete queries[i];
+        }
+
+        // nothing is loading anymore, so a trim has to fit every shard
+        pool->setMaxEntries(16u);
+        REQUIRE(pool->getNumEntries() <= 16u);
+    }
+}
@@ -23,12 +23,51 @@
 #include <osgEarth/catch.hpp>
 
 #include <osgEarthFeatures/Feature>
+#include <osgEarthFeatures/FeatureTable>
+#include <osgEarthFeatures/ExpressionEvaluator>
 #include <osgEarthFeatures/GeometryUtils>
+#include <osgEarthFeatures/FilterContext>
+#include <osgEarthFeatures/Session>
+#include <osgEarth/Map>
 
 using namespace osgEarth;
 using namespace osgEarth::Symbology;
 using namespace osgEarth::Features;
 
+namespace
+{
+    // Appends "count" features with an empty geometry and FIDs 0 to count-1.
+    void createFeatures(unsigned count, FeatureList& out)
+    {
+        for (unsigned i = 0; i < count; ++i)
+            out.push_back(new Feature(new Geometry(), osgEarth::SpatialReference::create("wgs84"), Style(), i));
+    }
+
+    // Features with a "levels", "height" and "name" attribute each, except:
+    // every third one has no height, the fifth has a NULL height and the
+    // eighth a NULL name.
+    void createBuildings(unsigned count, FeatureList& out)
+    {
+        FeatureList features;
+        createFeatures(count, features);
+        for (FeatureList::iterator f = features.begin(); f != features.end(); ++f)
+        {
+            Feature* feature = f->get();
+            int i = (int)feature->getFID();
+            feature->set("levels", i);
+            if (i == 4)
+                feature->setNull("height", ATTRTYPE_DOUBLE);
+            else if (i % 3 != 2)
+                feature->set("height", 3.0);
+            if (i == 7)
+                feature->setNull("name", ATTRTYPE_STRING);
+            else
+                feature->set("name", std::string(i % 2 ? "odd" : "even"));
+        }
+        out.insert(out.end(), features.begin(), features.end());
+    }
+}
+
 TEST_CASE("Feature::splitAcrossDateLine doesn't modify features that don't cross the dateline") {
     osg::ref_ptr< Feature > feature = new Feature(GeometryUtils::geometryFromWKT("POLYGON((-81 26, -40.5 45, -40.5 75.5, -81 60))"), osgEarth::SpatialReference::create("wgs84"));
     FeatureList features;
@@ -105,3 +144,335 @@ TEST_CASE("Feature handles attributes correctly.") {
         REQUIRE(feature->getBool("bool") == false);
     }
 }
+
+TEST_CASE("FeatureTable stores attributes in columns") {
+    FeatureList features;
+    createFeatures(3u, features);
+    for (FeatureList::iterator f = features.begin(); f != features.end(); ++f)
+    {
+        Feature* feature = f->get();
+        int i = (int)feature->getFID();
+        feature->set("Name", std::string(i == 2 ? "b" : "a"));
+        feature->set("height", 10.0 * i);
+        if (i == 1)
+            feature->setNull("lanes", ATTRTYPE_INT);
+        else
+            feature->set("lanes", i);
+    }
+
+    FeatureSchema schema;
+    schema["lanes"] = ATTRTYPE_INT;
+    osg::ref_ptr<FeatureTable> table = new FeatureTable(features, schema);
+
+    const AttributeSchema* attrs = table->getSchema();
+    REQUIRE(attrs->size() == 3u);
+    int name = attrs->indexOf("NAME");
+    int height = attrs->indexOf("height");
+    int lanes = attrs->indexOf("lanes");
+    REQUIRE(name >= 0);
+    REQUIRE(height >= 0);
+    REQUIRE(lanes >= 0);
+    REQUIRE(attrs->indexOf("missing") == -1);
+    REQUIRE(attrs->getName(name) == "Name");
+    REQUIRE(attrs->getType(height) == ATTRTYPE_DOUBLE);
+
+    SECTION("Schemas are interned") {
+        FeatureSchema same = attrs->getFeatureSchema();
+        REQUIRE(AttributeSchema::intern(same) == attrs);
+    }
+
+    SECTION("Values and NULLs read back by index") {
+        REQUIRE(table->size() == 3u);
+        REQUIRE(table->getFeature(0)->getAttrs().empty());
+        REQUIRE(table->getString(2, name) == "b");
+        REQUIRE(table->getDouble(2, height) == 20.0);
+        REQUIRE(table->getInt(2, lanes) == 2);
+        REQUIRE(table->isSet(1, lanes) == false);
+        REQUIRE(table->hasAttr(1, lanes) == true);
+        REQUIRE(table->getInt(1, lanes, -1) == -1);
+
+        // equal strings share their storage
+        unsigned len0, len1;
+        REQUIRE(table->getCString(0, name, len0) == table->getCString(1, name, len1));
+        REQUIRE(len0 == 1u);
+    }
+
+    SECTION("Bound expressions evaluate per row") {
+        NumericExpression numExpr("[height] * 2 + [missing]");
+        AttributeBinding numBinding;
+        table->bind(numExpr, numBinding);
+        REQUIRE(numBinding.size() == 2u);
+        REQUIRE(numBinding[0] == height);
+        REQUIRE(numBinding[1] == -1);
+        REQUIRE(table->eval(numExpr, numBinding, 1, 0L) == 20.0);
+
+        StringExpression strExpr("[name] + \"-x\"");
+        AttributeBinding strBinding;
+        table->bind(strExpr, strBinding);
+        REQUIRE(table->eval(strExpr, strBinding, 2, 0L) == "b-x");
+    }
+
+    SECTION("release puts the attributes back") {
+        FeatureList output;
+        table->release(output);
+        REQUIRE(output.size() == 3u);
+        REQUIRE(table->size() == 0u);
+        REQUIRE(output.back()->getString("name") == "b");
+        REQUIRE(output.back()->getDouble("height") == 20.0);
+        REQUIRE(output.front()->getInt("lanes") == 0);
+        REQUIRE(output.front()->hasAttr("lanes"));
+        REQUIRE((*++output.begin())->isSet("lanes") == false);
+    }
+}
+
+TEST_CASE("FeatureTable values absent from a row run as script") {
+    // "Math.PI" is a column, but only the first feature has it; on the
+    // other, Feature::eval would run the name as script.
+    FeatureList features;
+    createFeatures(2u, features);
+    features.front()->set("Math.PI", 1.0);
+
+    osg::ref_ptr<Map> map = new Map();
+    osg::ref_ptr<Session> session = new Session(map.get());
+    REQUIRE(session->getScriptEngine() != 0L);
+    FilterContext context(session.get());
+
+    osg::ref_ptr<FeatureTable> table = new FeatureTable(features);
+
+    NumericExpression numExpr("[Math.PI]");
+    AttributeBinding binding;
+    table->bind(numExpr, binding);
+    REQUIRE(binding[0] >= 0);
+    REQUIRE(table->eval(numExpr, binding, 0, &context) == 1.0);
+    REQUIRE(table->eval(numExpr, binding, 1, &context) == Approx(osg::PI));
+
+    NumericExpressionEvaluator numEval(numExpr);
+    REQUIRE(numEval.eval(*table, 1, &context) == Approx(osg::PI));
+
+    StringExpressionEvaluator strEval(StringExpression("[Math.PI]"));
+    REQUIRE(strEval.eval(*table, 0, &context) == "1");
+    REQUIRE(strEval.eval(*table, 1, &context).substr(0, 4) == "3.14");
+}
+
+TEST_CASE("FeatureTable schemas are freed with the last table") {
+    FeatureList features;
+    createFeatures(1u, features);
+    features.front()->set("only_in_this_test", 1);
+
+    osg::ref_ptr<FeatureTable> table = new FeatureTable(features);
+    osg::observer_ptr<const AttributeSchema> schema = table->getSchema();
+    REQUIRE(schema.valid());
+
+    {
+        // an evaluator keeps the schema of its binding
+        NumericExpressionEvaluator eval(NumericExpression("[only_in_this_test]"));
+        REQUIRE(eval.eval(*table, 0, 0L) == 1.0);
+        table = 0L;
+        REQUIRE(schema.valid());
+    }
+    REQUIRE(!schema.valid());
+
+    // and interning it again makes a new one
+    FeatureSchema fs;
+    fs["only_in_this_test"] = ATTRTYPE_INT;
+    osg::ref_ptr<const AttributeSchema> again = AttributeSchema::intern(fs);
+    REQUIRE(again.valid());
+    REQUIRE(again->indexOf("only_in_this_test") == 0);
+}
+
+TEST_CASE("Expressions evaluate with pre-bound variables") {
+    FeatureList features;
+    createBuildings(4u, features);
+
+    SECTION("Compiled numeric programs match the stateful path") {
+        double values[3] = { 2.0, 3.0, 0.0 };
+        REQUIRE(NumericExpression("[a] * [b] + 1").eval(values) == 7.0);
+
+        NumericExpression expr("max([levels] * [height], 4) - [missing]");
+        double compiled = expr.eval(values);
+
+        NumericExpression::Variables vars = expr.variables();
+        REQUIRE(vars.size() == 3u);
+        for (unsigned i = 0; i < vars.size(); ++i)
+            expr.set(vars[i], values[i]);
+        REQUIRE(expr.eval() == compiled);
+
+        // eval(values) leaves the set() values alone
+        double zeros[3] = { 0.0, 0.0, 0.0 };
+        expr.eval(zeros);
+        REQUIRE(expr.eval() == compiled);
+    }
+
+    SECTION("Compiled string programs match the stateful path") {
+        StringExpression expr("[name] + \"-\" + [levels]");
+        StringExpression::StringRef values[2] = {
+            StringExpression::StringRef("a", 1),
+            StringExpression::StringRef("12", 2) };
+        std::string out;
+        expr.eval(values, out);
+        REQUIRE(out == "a-12");
+
+        expr.set("name", "a");
+        expr.set("levels", "12");
+        REQUIRE(expr.eval() == "a-12");
+
+        expr.setInfix("[name]");
+        REQUIRE(expr.variables().size() == 1u);
+    }
+
+    SECTION("Evaluators over a FeatureList") {
+        NumericExpressionEvaluator heights(NumericExpression("[levels] * [HEIGHT]"));
+        std::vector<double> results;
+        heights.evalAll(features, results, 0L);
+        REQUIRE(results.size() == 4u);
+        REQUIRE(results[3] == 9.0);
+        REQUIRE(heights.eval(features.front().get(), 0L) == 0.0);
+
+        StringExpressionEvaluator labels(StringExpression("[name] + \"/\" + [levels]"));
+        std::vector<std::string> text;
+        labels.evalAll(features, text, 0L);
+        REQUIRE(text[1] == "odd/1");
+        REQUIRE(text[2] == "even/2");
+    }
+
+    SECTION("Evaluators over a FeatureTable") {
+        osg::ref_ptr<FeatureTable> table = new FeatureTable(features);
+
+        NumericExpressionEvaluator heights(NumericExpression("[levels] * [height]"));
+        std::vector<double> results;
+        heights.evalAll(*table, results, 0L);
+        REQUIRE(results[3] == 9.0);
+
+        StringExpressionEvaluator labels(StringExpression("[name] + \"/\" + [levels]"));
+        std::vector<std::string> text;
+        labels.evalAll(*table, text, 0L);
+        REQUIRE(text[1] == "odd/1");
+
+        NumericExpressionEvaluator constant(NumericExpression(5.0));
+        REQUIRE(constant.eval(*table, 0, 0L) == 5.0);
+    }
+}
+
+TEST_CASE("StringExpression re-initializes from scratch") {
+
+    SECTION("setInfix replaces the old expression") {
+        StringExpression expr("[a] + \"-\" + [b]");
+        REQUIRE(expr.variables().size() == 2u);
+
+        expr.setInfix("\"x\" + [c]");
+        REQUIRE(expr.variables().size() == 1u);
+        REQUIRE(expr.variables()[0].first == "c");
+
+        expr.set("c", "1");
+        REQUIRE(expr.eval() == "x1");
+
+        StringExpression::StringRef values[1] = { StringExpression::StringRef("2", 1) };
+        std::string out;
+        expr.eval(values, out);
+        REQUIRE(out == "x2");
+    }
+
+    SECTION("setLiteral drops the variables") {
+        StringExpression expr("[a] + \"-\" + [b]");
+        expr.setLiteral("plain [text]");
+        REQUIRE(expr.variables().empty());
+        REQUIRE(expr.expr() == "\"plain [text]\"");
+        REQUIRE(expr.eval() == "plain [text]");
+
+        std::string out("stale");
+        expr.eval(0L, out);
+        REQUIRE(out == "plain [text]");
+    }
+
+    SECTION("setInfix after setLiteral") {
+        StringExpression expr;
+        expr.setLiteral("old");
+        expr.setInfix("[name] + \"!\"");
+        REQUIRE(expr.variables().size() == 1u);
+        expr.set("name", "new");
+        REQUIRE(expr.eval() == "new!");
+    }
+}
+
+TEST_CASE("Pre-bound expressions match Feature::eval") {
+    // Legacy results come from features that keep their attributes; the
+    // table takes the attributes of a second, identical list.
+    FeatureList features, tableFeatures;
+    createBuildings(9u, features);
+    createBuildings(9u, tableFeatures);
+    osg::ref_ptr<FeatureTable> table = new FeatureTable(tableFeatures);
+
+    osg::ref_ptr<Map> map = new Map();
+    osg::ref_ptr<Session> session = new Session(map.get());
+    FilterContext scriptContext(session.get());
+    const FilterContext* contexts[2] = { 0L, &scriptContext };
+
+    const char* numeric[4] = {
+        "[levels] * [height] + 1",
+        "max([HEIGHT], 2) - [levels]",
+        "[missing] + [levels]",
+        "7" };
+
+    const char* strings[4] = {
+        "[name] + \"/\" + [levels]",
+        "[height]",
+        "\"id-\" + [missing]",
+        "\"literal\"" };
+
+    for (unsigned c = 0; c < 2; ++c)
+    {
+        INFO("Context " << c);
+
+        for (unsigned e = 0; e < 4; ++e)
+        {
+            INFO("Numeric expression " << numeric[e]);
+
+            NumericExpression legacyExpr(numeric[e]);
+            NumericExpressionEvaluator evaluator(legacyExpr);
+            NumericExpression boundExpr(numeric[e]);
+            AttributeBinding binding;
+            table->bind(boundExpr, binding);
+
+            std::vector<double> listValues, tableValues;
+            evaluator.evalAll(features, listValues, contexts[c]);
+            evaluator.evalAll(*table, tableValues, contexts[c]);
+
+            unsigned row = 0;
+            for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f, ++row)
+            {
+                INFO("Row " << row);
+                double legacy = f->get()->eval(legacyExpr, contexts[c]);
+                REQUIRE(listValues[row] == legacy);
+                REQUIRE(tableValues[row] == legacy);
+                REQUIRE(evaluator.eval(f->get(), contexts[c]) == legacy);
+                REQUIRE(table->eval(boundExpr, binding, row, contexts[c]) == legacy);
+            }
+        }
+
+        for (unsigned e = 0; e < 4; ++e)
+        {
+            INFO("String expression " << strings[e]);
+
+            StringExpression legacyExpr(strings[e]);
+            StringExpressionEvaluator evaluator(legacyExpr);
+            StringExpression boundExpr(strings[e]);
+            AttributeBinding binding;
+            table->bind(boundExpr, binding);
+
+            std::vector<std::string> listValues, tableValues;
+            evaluator.evalAll(features, listValues, contexts[c]);
+            evaluator.evalAll(*table, tableValues, contexts[c]);
+
+            unsigned row = 0;
+            for (FeatureList::const_iterator f = features.begin(); f != features.end(); ++f, ++row)
+            {
+                INFO("Row " << row);
+                std::string legacy = f->get()->eval(legacyExpr, contexts[c]);
+                REQUIRE(listValues[row] == legacy);
+                REQUIRE(tableValues[row] == legacy);
+                REQUIRE(evaluator.eval(f->get(), contexts[c]) == legacy);
+                REQUIRE(table->eval(boundExpr, binding, row, contexts[c]) == legacy);
+            }
+        }
+    }
+}
@@ -0,0 +1,109 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/ElevationLayer>
+
+#include <osgEarthDrivers/gdal/GDALOptions>
+
+using namespace osgEarth;
+using namespace osgEarth::Drivers;
+
+namespace
+{
+    ElevationLayer* createWorldLayer(ElevationInterpolation interp, bool windowedReads, unsigned tileSize)
+    {
+        GDALOptions opt;
+        opt.url() = "../data/world.tif";
+        opt.interpolation() = interp;
+        opt.windowedReads() = windowedReads;
+        opt.maxDataLevelOverride() = 10u;
+
+        ElevationLayerOptions layerOptions("world", opt);
+        layerOptions.cachePolicy() = CachePolicy::NO_CACHE;
+        layerOptions.tileSize() = tileSize;
+
+        return new ElevationLayer(layerOptions);
+    }
+
+    // Builds the same tile with windowed reads and with one read per sample,
+    // and checks that every height matches exactly.
+    void compareReads(ElevationInterpolation interp, unsigned tileSize, unsigned lod, unsigned x, unsigned y)
+    {
+        osg::ref_ptr<ElevationLayer> windowed = createWorldLayer(interp, true, tileSize);
+        osg::ref_ptr<ElevationLayer> perSample = createWorldLayer(interp, false, tileSize);
+        REQUIRE(windowed->open().isOK());
+        REQUIRE(perSample->open().isOK());
+
+        TileKey key(lod, x, y, windowed->getProfile());
+        INFO("interpolation=" << (int)interp << " tileSize=" << tileSize << " key=" << key.str());
+
+        GeoHeightField a = windowed->createHeightField(key);
+        GeoHeightField b = perSample->createHeightField(key);
+        REQUIRE(a.valid());
+        REQUIRE(b.valid());
+
+        const osg::HeightField* hfa = a.getHeightField();
+        const osg::HeightField* hfb = b.getHeightField();
+        REQUIRE(hfa->getNumColumns() == tileSize);
+        REQUIRE(hfa->getNumRows() == tileSize);
+        REQUIRE(hfb->getNumColumns() == tileSize);
+        REQUIRE(hfb->getNumRows() == tileSize);
+
+        unsigned mismatches = 0u;
+        for (unsigned r = 0; r < tileSize; ++r)
+        {
+            for (unsigned c = 0; c < tileSize; ++c)
+            {
+                if (hfa->getHeight(c, r) != hfb->getHeight(c, r))
+                    ++mismatches;
+            }
+        }
+        REQUIRE(mismatches == 0u);
+    }
+}
+
+TEST_CASE("GDAL windowed elevation reads match per-sample reads") {
+
+    ElevationInterpolation modes[] = { INTERP_NEAREST, INTERP_AVERAGE, INTERP_BILINEAR };
+
+    SECTION("Windowed reads") {
+        // A small deep tile, so the window under the samples stays within
+        // the limit and is read in one piece.
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            compareReads(modes[i], 17u, 6u, 40u, 20u);
+            compareReads(modes[i], 17u, 6u, 0u, 0u);
+        }
+    }
+
+    SECTION("Oversized windows fall back to per-sample reads") {
+        // A whole hemisphere sampled by a 5x5 tile: the window would be far
+        // more than 16 pixels per sample, so the driver reads sample by sample.
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            compareReads(modes[i], 5u, 0u, 0u, 0u);
+            compareReads(modes[i], 5u, 0u, 1u, 0u);
+        }
+    }
+}
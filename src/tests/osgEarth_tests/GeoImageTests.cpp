@@ -0,0 +1,238 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/GeoData>
+#include <osgEarth/ImageUtils>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+using namespace osgEarth;
+
+namespace
+{
+    // Geodetic source images, reprojected to spherical mercator so the
+    // warp runs through GeoImage's own reprojection, not GDAL's.
+    const SpatialReference* sourceSRS() { return SpatialReference::get("wgs84"); }
+    const SpatialReference* destSRS()   { return SpatialReference::get("spherical-mercator"); }
+
+    GeoExtent sourceExtent() { return GeoExtent(sourceSRS(), -10.0, 30.0, 10.0, 60.0); }
+    GeoExtent destExtent()   { return GeoExtent(sourceSRS(), -8.0, 35.0, 8.0, 55.0).transform(destSRS()); }
+
+    // A 32-bit float image whose value is its column (or row) index, so a
+    // bilinear sample reads back the source coordinate it was taken at.
+    GeoImage createRamp(bool alongX)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(256, 256, 1, GL_LUMINANCE, GL_FLOAT);
+        for (int t = 0; t < image->t(); ++t)
+            for (int s = 0; s < image->s(); ++s)
+                *(float*)image->data(s, t) = (float)(alongX ? s : t);
+        return GeoImage(image, sourceExtent());
+    }
+
+    GeoImage createNoise(GLenum pixelFormat, GLenum dataType)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(256, 256, 1, pixelFormat, dataType);
+        unsigned x = 12345u;
+        if (dataType == GL_FLOAT)
+        {
+            float* ptr = (float*)image->data();
+            for (unsigned i = 0; i < image->getTotalSizeInBytes() / sizeof(float); ++i)
+            {
+                x = x * 1664525u + 1013904223u;
+                ptr[i] = (float)(x >> 8) / 65536.0f;
+            }
+        }
+        else
+        {
+            unsigned char* ptr = image->data();
+            for (unsigned i = 0; i < image->getTotalSizeInBytes(); ++i)
+            {
+                x = x * 1664525u + 1013904223u;
+                ptr[i] = (unsigned char)(x >> 24);
+            }
+        }
+        return GeoImage(image, sourceExtent());
+    }
+
+    GeoImage reproject(const GeoImage& source, unsigned size)
+    {
+        GeoExtent extent = destExtent();
+        return source.reproject(destSRS(), &extent, size, size, true);
+    }
+
+    float value(const GeoImage& image, int s, int t)
+    {
+        return *(const float*)image.getImage()->data(s, t);
+    }
+
+    // Restores the reprojection settings a test changes.
+    struct ReprojectSettings
+    {
+        ReprojectSettings() :
+            _tolerance(GeoImage::getReprojectTolerance()),
+            _parallel(GeoImage::getParallelReprojectEnabled()),
+            _kernels(ImageUtils::getKernelsEnabled()) { }
+
+        ~ReprojectSettings()
+        {
+            GeoImage::setReprojectTolerance(_tolerance);
+            GeoImage::setParallelReprojectEnabled(_parallel);
+            ImageUtils::setKernelsEnabled(_kernels);
+        }
+
+        double _tolerance;
+        bool   _parallel;
+        bool   _kernels;
+    };
+}
+
+TEST_CASE( "GeoImage::reproject" ) {
+
+    ReprojectSettings settings;
+    const unsigned size = 128u;
+
+    SECTION("A zero tolerance transforms every pixel exactly") {
+        GeoImage::setReprojectTolerance(0.0);
+
+        GeoImage xRamp = reproject(createRamp(true), size);
+        GeoImage yRamp = reproject(createRamp(false), size);
+        REQUIRE(xRamp.valid());
+        REQUIRE(yRamp.valid());
+
+        GeoExtent src = sourceExtent();
+        GeoExtent dest = destExtent();
+        double xfac = 255.0 / src.width(), yfac = 255.0 / src.height();
+
+        for (unsigned r = 0; r < size; r += 3u)
+        {
+            for (unsigned c = 0; c < size; c += 3u)
+            {
+                INFO("Pixel " << c << ", " << r);
+                osg::Vec3d p(
+                    dest.xMin() + ((double)c + 0.5) * dest.width() / (double)size,
+                    dest.yMin() + ((double)r + 0.5) * dest.height() / (double)size,
+                    0.0);
+                REQUIRE(destSRS()->transform(p, sourceSRS(), p));
+                REQUIRE(value(xRamp, c, r) == Approx((p.x() - src.xMin()) * xfac).margin(1e-3));
+                REQUIRE(value(yRamp, c, r) == Approx((p.y() - src.yMin()) * yfac).margin(1e-3));
+            }
+        }
+    }
+
+    SECTION("The sparse grid stays within the tolerance") {
+        GeoImage::setReprojectTolerance(0.0);
+        GeoImage xExact = reproject(createRamp(true), size);
+        GeoImage yExact = reproject(createRamp(false), size);
+
+        double tolerances[3] = { 0.5, 0.125, 0.02 };
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            INFO("Tolerance " << tolerances[i]);
+            GeoImage::setReprojectTolerance(tolerances[i]);
+            GeoImage x = reproject(createRamp(true), size);
+            GeoImage y = reproject(createRamp(false), size);
+
+            // The grid is checked at the center of each cell, where the
+            // error of a smooth mapping peaks; allow for float rounding.
+            double maxError = 0.0;
+            for (unsigned r = 0; r < size; ++r)
+            {
+                for (unsigned c = 0; c < size; ++c)
+                {
+                    maxError = osg::maximum(maxError, (double)fabs(value(x, c, r) - value(xExact, c, r)));
+                    maxError = osg::maximum(maxError, (double)fabs(value(y, c, r) - value(yExact, c, r)));
+                }
+            }
+            REQUIRE(maxError <= tolerances[i] + 0.01);
+        }
+    }
+
+    SECTION("Format kernels match the PixelReader/PixelWriter path") {
+        GLenum formats[4][2] = {
+            { GL_RGBA,      GL_UNSIGNED_BYTE },
+            { GL_RGB,       GL_UNSIGNED_BYTE },
+            { GL_LUMINANCE, GL_UNSIGNED_BYTE },
+            { GL_LUMINANCE, GL_FLOAT } };
+
+        for (unsigned f = 0; f < 4; ++f)
+        {
+            INFO("Format " << f);
+            GeoImage source = createNoise(formats[f][0], formats[f][1]);
+
+            ImageUtils::setKernelsEnabled(true);
+            GeoImage kernel = reproject(source, size);
+            ImageUtils::setKernelsEnabled(false);
+            GeoImage generic = reproject(source, size);
+            ImageUtils::setKernelsEnabled(true);
+
+            REQUIRE(kernel.valid());
+            REQUIRE(generic.valid());
+            unsigned bytes = kernel.getImage()->getTotalSizeInBytes();
+            REQUIRE(generic.getImage()->getTotalSizeInBytes() == bytes);
+
+            if (formats[f][1] == GL_FLOAT)
+            {
+                const float* k = (const float*)kernel.getImage()->data();
+                const float* g = (const float*)generic.getImage()->data();
+                for (unsigned i = 0; i < bytes / sizeof(float); ++i)
+                    REQUIRE(k[i] == Approx(g[i]).epsilon(1e-5).margin(1e-4));
+            }
+            else
+            {
+                // the kernels round 8-bit values; the generic writer truncates
+                const unsigned char* k = kernel.getImage()->data();
+                const unsigned char* g = generic.getImage()->data();
+                for (unsigned i = 0; i < bytes; ++i)
+                    REQUIRE(abs((int)k[i] - (int)g[i]) <= 1);
+            }
+        }
+    }
+
+    SECTION("Parallel bands match a single band") {
+        // large enough to be split into bands
+        GeoImage source = createNoise(GL_RGBA, GL_UNSIGNED_BYTE);
+
+        GeoImage::setParallelReprojectEnabled(true);
+        GeoImage multi = reproject(source, 256u);
+        GeoImage::setParallelReprojectEnabled(false);
+        GeoImage single = reproject(source, 256u);
+
+        REQUIRE(multi.valid());
+        REQUIRE(single.valid());
+        unsigned bytes = multi.getImage()->getTotalSizeInBytes();
+        REQUIRE(single.getImage()->getTotalSizeInBytes() == bytes);
+        REQUIRE(::memcmp(multi.getImage()->data(), single.getImage()->data(), bytes) == 0);
+
+        GeoImage source32 = createNoise(GL_LUMINANCE, GL_FLOAT);
+        GeoImage::setParallelReprojectEnabled(true);
+        multi = reproject(source32, 256u);
+        GeoImage::setParallelReprojectEnabled(false);
+        single = reproject(source32, 256u);
+        bytes = multi.getImage()->getTotalSizeInBytes();
+        REQUIRE(::memcmp(multi.getImage()->data(), single.getImage()->data(), bytes) == 0);
+    }
+}
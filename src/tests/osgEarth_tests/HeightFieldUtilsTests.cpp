@@ -0,0 +1,113 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/HeightFieldUtils>
+
+using namespace osgEarth;
+
+namespace
+{
+    osg::HeightField* createHeightField(unsigned size, float value)
+    {
+        osg::HeightField* hf = new osg::HeightField();
+        hf->allocate(size, size);
+        for (unsigned r = 0; r < size; ++r)
+            for (unsigned c = 0; c < size; ++c)
+                hf->setHeight(c, r, value);
+        return hf;
+    }
+}
+
+TEST_CASE("HeightFieldUtils::downsampleIntoQuadrant") {
+
+    const unsigned SIZE = 5u;
+    osg::ref_ptr<osg::HeightField> target = createHeightField(SIZE, -1.0f);
+
+    SECTION("Each quadrant lands in its corner of the target") {
+        // Quadrants are in TileKey::createChildKey order: 0 and 1 are the
+        // top (north) half, which is the last rows of a heightfield.
+        unsigned colOffset[4] = { 0u, 2u, 0u, 2u };
+        unsigned rowOffset[4] = { 2u, 2u, 0u, 0u };
+
+        for (unsigned q = 0; q < 4; ++q)
+        {
+            // a plane, which averaging leaves as it is
+            osg::ref_ptr<osg::HeightField> source = createHeightField(SIZE, 0.0f);
+            for (unsigned r = 0; r < SIZE; ++r)
+                for (unsigned c = 0; c < SIZE; ++c)
+                    source->setHeight(c, r, 100.0f*q + c + 10.0f*r);
+
+            REQUIRE(HeightFieldUtils::downsampleIntoQuadrant(target.get(), source.get(), q));
+
+            for (unsigned r = 0; r < 3; ++r)
+                for (unsigned c = 0; c < 3; ++c)
+                    REQUIRE(target->getHeight(colOffset[q]+c, rowOffset[q]+r) == Approx(100.0f*q + 2*c + 20.0f*r));
+        }
+
+        // the center post is shared by all four quadrants; q3 wrote it last.
+        REQUIRE(target->getHeight(2, 2) == Approx(340.0f));
+    }
+
+    SECTION("Interior posts average their neighbors") {
+        osg::ref_ptr<osg::HeightField> source = createHeightField(SIZE, 0.0f);
+
+        // a spike on a kept post keeps 4/16 of its height
+        source->setHeight(2, 2, 16.0f);
+        REQUIRE(HeightFieldUtils::downsampleIntoQuadrant(target.get(), source.get(), 2u));
+        REQUIRE(target->getHeight(1, 1) == Approx(4.0f));
+
+        // a spike on a dropped post still shows, with 1/16 of its height
+        source->setHeight(2, 2, 0.0f);
+        source->setHeight(1, 1, 16.0f);
+        REQUIRE(HeightFieldUtils::downsampleIntoQuadrant(target.get(), source.get(), 2u));
+        REQUIRE(target->getHeight(1, 1) == Approx(1.0f));
+        REQUIRE(target->getHeight(0, 0) == 0.0f);
+    }
+
+    SECTION("Edge posts are copied, so neighboring tiles still match") {
+        osg::ref_ptr<osg::HeightField> source = createHeightField(SIZE, 0.0f);
+        source->setHeight(0, 2, 16.0f);
+        source->setHeight(1, 2, 32.0f);
+        REQUIRE(HeightFieldUtils::downsampleIntoQuadrant(target.get(), source.get(), 2u));
+        REQUIRE(target->getHeight(0, 1) == 16.0f);
+    }
+
+    SECTION("NO_DATA neighbors are left out of the average") {
+        osg::ref_ptr<osg::HeightField> source = createHeightField(SIZE, 8.0f);
+        source->setHeight(1, 2, NO_DATA_VALUE);
+        source->setHeight(3, 3, NO_DATA_VALUE);
+        REQUIRE(HeightFieldUtils::downsampleIntoQuadrant(target.get(), source.get(), 2u));
+        REQUIRE(target->getHeight(1, 1) == Approx(8.0f));
+
+        // and a NO_DATA post stays NO_DATA
+        source->setHeight(2, 2, NO_DATA_VALUE);
+        REQUIRE(HeightFieldUtils::downsampleIntoQuadrant(target.get(), source.get(), 2u));
+        REQUIRE(target->getHeight(1, 1) == NO_DATA_VALUE);
+    }
+
+    SECTION("Mismatched sizes are refused") {
+        osg::ref_ptr<osg::HeightField> source = createHeightField(SIZE + 2u, 0.0f);
+        REQUIRE(!HeightFieldUtils::downsampleIntoQuadrant(target.get(), source.get(), 0u));
+    }
+}
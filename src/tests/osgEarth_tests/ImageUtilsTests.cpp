@@ -0,0 +1,235 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+#include <osgEarth/ImageUtils>
+#include <cmath>
+#include <cstdlib>
+
+using namespace osgEarth;
+
+namespace
+{
+    osg::Image* createImage(int s, int t, GLenum pixelFormat, GLenum dataType)
+    {
+        osg::Image* image = new osg::Image();
+        image->allocateImage(s, t, 1, pixelFormat, dataType);
+        image->setInternalTextureFormat(pixelFormat);
+        if (dataType == GL_FLOAT)
+        {
+            float* f = reinterpret_cast<float*>(image->data());
+            for (int i = 0; i < s*t; ++i)
+                f[i] = (float)(rand() % 10000) - 500.0f;
+        }
+        else
+        {
+            for (unsigned i = 0; i < image->getTotalSizeInBytes(); ++i)
+                image->data()[i] = (unsigned char)(rand() & 0xFF);
+        }
+        return image;
+    }
+
+    // The kernels must reproduce the generic path exactly, mipmaps included.
+    bool matches(const osg::Image* a, const osg::Image* b)
+    {
+        if (a->getTotalSizeInBytesIncludingMipmaps() != b->getTotalSizeInBytesIncludingMipmaps() ||
+            a->getNumMipmapLevels() != b->getNumMipmapLevels())
+            return false;
+
+        if (a->getDataType() == GL_FLOAT)
+        {
+            const float* fa = reinterpret_cast<const float*>(a->data());
+            const float* fb = reinterpret_cast<const float*>(b->data());
+            for (unsigned i = 0; i < a->getTotalSizeInBytesIncludingMipmaps() / sizeof(float); ++i)
+                if (fa[i] != fb[i])
+                    return false;
+        }
+        else
+        {
+            for (unsigned i = 0; i < a->getTotalSizeInBytesIncludingMipmaps(); ++i)
+                if (a->data()[i] != b->data()[i])
+                    return false;
+        }
+        return true;
+    }
+
+    bool resizeMatches(const osg::Image* input, int s, int t, bool bilinear)
+    {
+        osg::ref_ptr<osg::Image> generic, kernel;
+        ImageUtils::setKernelsEnabled(false);
+        ImageUtils::resizeImage(input, s, t, generic, 0, bilinear);
+        ImageUtils::setKernelsEnabled(true);
+        ImageUtils::resizeImage(input, s, t, kernel, 0, bilinear);
+        return generic.valid() && kernel.valid() && matches(generic.get(), kernel.get());
+    }
+
+    bool mixMatches(const osg::Image* dest, const osg::Image* src, float a)
+    {
+        osg::ref_ptr<osg::Image> generic = ImageUtils::cloneImage(dest);
+        osg::ref_ptr<osg::Image> kernel = ImageUtils::cloneImage(dest);
+        ImageUtils::setKernelsEnabled(false);
+        ImageUtils::mix(generic.get(), src, a);
+        ImageUtils::setKernelsEnabled(true);
+        ImageUtils::mix(kernel.get(), src, a);
+        return matches(generic.get(), kernel.get());
+    }
+
+    bool bicubicMatches(const osg::Image* source, unsigned quadrant)
+    {
+        osg::ref_ptr<osg::Image> generic = ImageUtils::cloneImage(source);
+        osg::ref_ptr<osg::Image> kernel = ImageUtils::cloneImage(source);
+        ImageUtils::setKernelsEnabled(false);
+        ImageUtils::bicubicUpsample(source, generic.get(), quadrant, 1u);
+        ImageUtils::setKernelsEnabled(true);
+        ImageUtils::bicubicUpsample(source, kernel.get(), quadrant, 1u);
+        return matches(generic.get(), kernel.get());
+    }
+
+    bool nearestMipmapsMatch(const osg::Image* input)
+    {
+        ImageUtils::setKernelsEnabled(false);
+        osg::ref_ptr<osg::Image> generic = ImageUtils::buildNearestNeighborMipmaps(input);
+        ImageUtils::setKernelsEnabled(true);
+        osg::ref_ptr<osg::Image> kernel = ImageUtils::buildNearestNeighborMipmaps(input);
+        return generic.valid() && kernel.valid() && generic->isMipmap() && matches(generic.get(), kernel.get());
+    }
+
+    bool blendedMipmapsMatch(const osg::Image* primary, const osg::Image* secondary)
+    {
+        ImageUtils::setKernelsEnabled(false);
+        osg::ref_ptr<osg::Image> generic = ImageUtils::createMipmapBlendedImage(primary, secondary);
+        ImageUtils::setKernelsEnabled(true);
+        osg::ref_ptr<osg::Image> kernel = ImageUtils::createMipmapBlendedImage(primary, secondary);
+        return generic.valid() && kernel.valid() && generic->isMipmap() && matches(generic.get(), kernel.get());
+    }
+}
+
+TEST_CASE( "ImageUtils kernels match the generic pixel path" ) {
+
+    srand(42);
+
+    osg::ref_ptr<osg::Image> rgba = createImage(67, 33, GL_RGBA, GL_UNSIGNED_BYTE);
+    osg::ref_ptr<osg::Image> rgb  = createImage(67, 33, GL_RGB, GL_UNSIGNED_BYTE);
+    osg::ref_ptr<osg::Image> r32f = createImage(67, 33, GL_RED, GL_FLOAT);
+
+    SECTION("resize") {
+        REQUIRE(resizeMatches(rgba.get(), 128, 64, true));
+        REQUIRE(resizeMatches(rgba.get(), 31, 17, true));
+        REQUIRE(resizeMatches(rgba.get(), 31, 17, false));
+        REQUIRE(resizeMatches(rgb.get(), 100, 100, true));
+        REQUIRE(resizeMatches(rgb.get(), 100, 100, false));
+        REQUIRE(resizeMatches(r32f.get(), 257, 257, true));
+        REQUIRE(resizeMatches(r32f.get(), 16, 16, false));
+    }
+
+    SECTION("mix") {
+        osg::ref_ptr<osg::Image> rgba2 = createImage(67, 33, GL_RGBA, GL_UNSIGNED_BYTE);
+        osg::ref_ptr<osg::Image> r32f2 = createImage(67, 33, GL_RED, GL_FLOAT);
+        REQUIRE(mixMatches(rgba.get(), rgba2.get(), 0.6f));
+        REQUIRE(mixMatches(rgb.get(), rgba2.get(), 1.0f));
+        REQUIRE(mixMatches(rgba.get(), rgb.get(), 0.3f));
+        REQUIRE(mixMatches(r32f.get(), r32f2.get(), 0.25f));
+    }
+
+    SECTION("premultiply") {
+        osg::ref_ptr<osg::Image> generic = ImageUtils::cloneImage(rgba.get());
+        osg::ref_ptr<osg::Image> kernel = ImageUtils::cloneImage(rgba.get());
+        ImageUtils::setKernelsEnabled(false);
+        ImageUtils::convertToPremultipliedAlpha(generic.get());
+        ImageUtils::setKernelsEnabled(true);
+        ImageUtils::convertToPremultipliedAlpha(kernel.get());
+        REQUIRE(matches(generic.get(), kernel.get()));
+    }
+
+    SECTION("convert") {
+        ImageUtils::setKernelsEnabled(false);
+        osg::ref_ptr<osg::Image> generic = ImageUtils::convertToRGBA8(rgb.get());
+        ImageUtils::setKernelsEnabled(true);
+        osg::ref_ptr<osg::Image> kernel = ImageUtils::convertToRGBA8(rgb.get());
+        REQUIRE(generic.valid());
+        REQUIRE(kernel.valid());
+        REQUIRE(matches(generic.get(), kernel.get()));
+    }
+
+    SECTION("bicubic upsample") {
+        // one-pixel border around an odd interior, like an elevation tile
+        osg::ref_ptr<osg::Image> rgba35 = createImage(35, 35, GL_RGBA, GL_UNSIGNED_BYTE);
+        osg::ref_ptr<osg::Image> rgb35  = createImage(35, 35, GL_RGB, GL_UNSIGNED_BYTE);
+        osg::ref_ptr<osg::Image> r32f35 = createImage(35, 35, GL_RED, GL_FLOAT);
+        for (unsigned q = 0; q < 4u; ++q)
+        {
+            REQUIRE(bicubicMatches(rgba35.get(), q));
+            REQUIRE(bicubicMatches(rgb35.get(), q));
+            REQUIRE(bicubicMatches(r32f35.get(), q));
+        }
+    }
+
+    SECTION("mipmaps") {
+        osg::ref_ptr<osg::Image> rgba64 = createImage(64, 64, GL_RGBA, GL_UNSIGNED_BYTE);
+        osg::ref_ptr<osg::Image> rgba64b = createImage(64, 64, GL_RGBA, GL_UNSIGNED_BYTE);
+        osg::ref_ptr<osg::Image> rgb64 = createImage(64, 64, GL_RGB, GL_UNSIGNED_BYTE);
+        osg::ref_ptr<osg::Image> rgb64b = createImage(64, 64, GL_RGB, GL_UNSIGNED_BYTE);
+
+        REQUIRE(nearestMipmapsMatch(rgba64.get()));
+        REQUIRE(nearestMipmapsMatch(rgb64.get()));
+        REQUIRE(blendedMipmapsMatch(rgba64.get(), rgba64b.get()));
+        REQUIRE(blendedMipmapsMatch(rgb64.get(), rgb64b.get()));
+    }
+
+    ImageUtils::setKernelsEnabled(true);
+}
+
+TEST_CASE( "ImageUtils::downsampleIntoQuadrant averages 2x2 blocks" ) {
+
+    srand(7);
+
+    osg::ref_ptr<osg::Image> child = createImage(66, 34, GL_RGBA, GL_UNSIGNED_BYTE);
+    osg::ref_ptr<osg::Image> parent = createImage(66, 34, GL_RGBA, GL_UNSIGNED_BYTE);
+
+    SECTION("upper right") {
+        REQUIRE(ImageUtils::downsampleIntoQuadrant(parent.get(), child.get(), 1));
+        bool ok = true;
+        for(int t=0; t<17; ++t)
+        {
+            for(int s=0; s<33; ++s)
+            {
+                for(int c=0; c<4; ++c)
+                {
+                    unsigned sum =
+                        child->data(2*s, 2*t)[c] + child->data(2*s+1, 2*t)[c] +
+                        child->data(2*s, 2*t+1)[c] + child->data(2*s+1, 2*t+1)[c];
+                    if (parent->data(33+s, 17+t)[c] != (sum+2)/4)
+                        ok = false;
+                }
+            }
+        }
+        REQUIRE(ok);
+    }
+
+    SECTION("mismatched images") {
+        osg::ref_ptr<osg::Image> rgb = createImage(66, 34, GL_RGB, GL_UNSIGNED_BYTE);
+        osg::ref_ptr<osg::Image> odd = createImage(65, 34, GL_RGBA, GL_UNSIGNED_BYTE);
+        osg::ref_ptr<osg::Image> oddParent = createImage(65, 34, GL_RGBA, GL_UNSIGNED_BYTE);
+        REQUIRE(ImageUtils::downsampleIntoQuadrant(parent.get(), rgb.get(), 0) == false);
+        REQUIRE(ImageUtils::downsampleIntoQuadrant(oddParent.get(), odd.get(), 0) == false);
+    }
+}
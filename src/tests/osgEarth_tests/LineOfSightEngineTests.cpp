@@ -0,0 +1,309 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarthUtil/LineOfSightEngine>
+#include <osgEarth/ElevationLayer>
+#include <osgEarth/Map>
+#include <osgEarth/Registry>
+
+#include <cstring>
+
+using namespace osgEarth;
+using namespace osgEarth::Util;
+
+namespace
+{
+    // Flat terrain at 0 m, with an optional north-south ridge between
+    // longitudes 0.02 and 0.03. Optionally leaves the western hemisphere
+    // without data.
+    class RidgeTileSource : public TileSource
+    {
+    public:
+        RidgeTileSource(float ridgeHeight, bool westData) :
+            TileSource(TileSourceOptions()),
+            _ridgeHeight(ridgeHeight),
+            _westData(westData) { }
+
+        Status initialize(const osgDB::Options* readOptions)
+        {
+            setProfile(Registry::instance()->getGlobalGeodeticProfile());
+            return STATUS_OK;
+        }
+
+        osg::Image* createImage(const TileKey& key, ProgressCallback* progress)
+        {
+            return 0L;
+        }
+
+        osg::HeightField* createHeightField(const TileKey& key, ProgressCallback* progress)
+        {
+            const GeoExtent& extent = key.getExtent();
+            if (!_westData && extent.xMax() <= 0.0)
+                return 0L;
+
+            unsigned size = getPixelsPerTile();
+            osg::HeightField* hf = new osg::HeightField();
+            hf->allocate(size, size);
+            for (unsigned c = 0; c < size; ++c)
+            {
+                double lon = extent.xMin() + extent.width() * (double)c / (double)(size - 1);
+                float h = lon >= 0.02 && lon <= 0.03 ? _ridgeHeight : 0.0f;
+                for (unsigned r = 0; r < size; ++r)
+                    hf->setHeight(c, r, h);
+            }
+            return hf;
+        }
+
+        float _ridgeHeight;
+        bool  _westData;
+    };
+
+    Map* createMap(float ridgeHeight, bool westData =true)
+    {
+        ElevationLayerOptions options("ridge");
+        options.cachePolicy() = CachePolicy::NO_CACHE;
+
+        Map* map = new Map();
+        map->addLayer(new ElevationLayer(options, new RidgeTileSource(ridgeHeight, westData)));
+        return map;
+    }
+
+    LineOfSightEngine* createEngine(const Map* map)
+    {
+        LineOfSightEngine* engine = new LineOfSightEngine(map, 12u);
+        engine->setEarthCurvature(false);
+        return engine;
+    }
+
+    GeoPoint point(const Map* map, double lon, double lat, double z, AltitudeMode mode =ALTMODE_RELATIVE)
+    {
+        return GeoPoint(map->getSRS()->getGeographicSRS(), lon, lat, z, mode);
+    }
+
+    // Green channel of the viewshed cell (col, row)
+    unsigned char green(const GeoImage& image, unsigned col, unsigned row)
+    {
+        return image.getImage()->data(col, row)[1];
+    }
+
+    unsigned char red(const GeoImage& image, unsigned col, unsigned row)
+    {
+        return image.getImage()->data(col, row)[0];
+    }
+}
+
+TEST_CASE( "LineOfSightEngine lines of sight" ) {
+
+    SECTION("Everything is visible over flat terrain") {
+        osg::ref_ptr<Map> map = createMap(0.0f);
+        osg::ref_ptr<LineOfSightEngine> engine = createEngine(map.get());
+
+        GeoPoint observer = point(map.get(), 0.0, 0.0, 2.0);
+        REQUIRE(engine->computeLineOfSight(observer, point(map.get(), 0.05, 0.0, 2.0)));
+        REQUIRE(engine->computeLineOfSight(observer, point(map.get(), -0.05, 0.0, 2.0)));
+        REQUIRE(engine->computeLineOfSight(observer, point(map.get(), 0.03, 0.03, 2.0)));
+    }
+
+    SECTION("A ridge blocks the lines across it") {
+        osg::ref_ptr<Map> map = createMap(100.0f);
+        osg::ref_ptr<LineOfSightEngine> engine = createEngine(map.get());
+
+        GeoPoint observer = point(map.get(), 0.0, 0.0, 2.0);
+
+        GeoPoint hit;
+        REQUIRE(!engine->computeLineOfSight(observer, point(map.get(), 0.05, 0.0, 2.0), &hit));
+        REQUIRE(hit.isValid());
+        REQUIRE(hit.x() >= 0.019);
+        REQUIRE(hit.x() <= 0.031);
+        REQUIRE(hit.z() > 2.0);
+
+        // away from the ridge
+        REQUIRE(engine->computeLineOfSight(observer, point(map.get(), -0.05, 0.0, 2.0)));
+
+        // over it
+        REQUIRE(engine->computeLineOfSight(observer, point(map.get(), 0.05, 0.0, 1000.0, ALTMODE_ABSOLUTE)));
+    }
+
+    SECTION("Batches match single lines of sight") {
+        osg::ref_ptr<Map> map = createMap(100.0f);
+        osg::ref_ptr<LineOfSightEngine> engine = createEngine(map.get());
+
+        std::vector<LineOfSightEngine::Query> queries;
+        for (int i = -8; i <= 8; ++i)
+        {
+            queries.push_back(LineOfSightEngine::Query(
+                point(map.get(), 0.0, 0.0, 2.0),
+                point(map.get(), 0.006 * (double)i, 0.002 * (double)i, 2.0)));
+        }
+
+        unsigned threads[2] = { 2u, 3u };
+        for (unsigned t = 0; t < 2; ++t)
+        {
+            engine->setNumThreads(threads[t]);
+            REQUIRE(engine->getNumThreads() == threads[t]);
+
+            LineOfSightEngine::Results results;
+            engine->computeLineOfSight(queries, results);
+            REQUIRE(results.size() == queries.size());
+
+            for (unsigned i = 0; i < queries.size(); ++i)
+            {
+                INFO("Query " << i);
+                GeoPoint hit;
+                bool visible = engine->computeLineOfSight(queries[i].start, queries[i].end, &hit);
+                REQUIRE(results[i].valid);
+                REQUIRE(results[i].visible == visible);
+                if (!visible)
+                    REQUIRE(results[i].hit == hit);
+            }
+        }
+    }
+
+    SECTION("A relative altitude over no data is invalid") {
+        osg::ref_ptr<Map> map = createMap(100.0f, false);
+        osg::ref_ptr<LineOfSightEngine> engine = createEngine(map.get());
+
+        std::vector<LineOfSightEngine::Query> queries;
+        queries.push_back(LineOfSightEngine::Query(point(map.get(), 0.01, 0.0, 2.0), point(map.get(), -0.05, 0.0, 2.0)));
+        queries.push_back(LineOfSightEngine::Query(point(map.get(), -0.05, 0.0, 2.0), point(map.get(), 0.01, 0.0, 2.0)));
+        queries.push_back(LineOfSightEngine::Query(point(map.get(), 0.01, 0.0, 2.0), point(map.get(), 0.015, 0.0, 2.0)));
+
+        LineOfSightEngine::Results results;
+        engine->computeLineOfSight(queries, results);
+        REQUIRE(results.size() == 3u);
+        REQUIRE(!results[0].valid);
+        REQUIRE(!results[0].visible);
+        REQUIRE(!results[1].valid);
+        REQUIRE(!results[1].visible);
+        REQUIRE(results[2].valid);
+        REQUIRE(results[2].visible);
+
+        REQUIRE(!engine->computeLineOfSight(queries[0].start, queries[0].end));
+        REQUIRE(!engine->computeLineOfSight(queries[1].start, queries[1].end));
+
+        // an absolute target needs no data under it
+        queries[0].end = point(map.get(), -0.05, 0.0, 2.0, ALTMODE_ABSOLUTE);
+        engine->computeLineOfSight(queries, results);
+        REQUIRE(results[0].valid);
+    }
+}
+
+TEST_CASE( "LineOfSightEngine viewsheds" ) {
+
+    const double radius = 5000.0;
+    const unsigned size = 64u;
+    const unsigned c = size / 2u;
+
+    LineOfSightEngine::Algorithm algorithms[2] = {
+        LineOfSightEngine::ALGORITHM_R2,
+        LineOfSightEngine::ALGORITHM_R3
+    };
+
+    SECTION("Everything is visible over flat terrain") {
+        osg::ref_ptr<Map> map = createMap(0.0f);
+        osg::ref_ptr<LineOfSightEngine> engine = createEngine(map.get());
+
+        for (unsigned a = 0; a < 2; ++a)
+        {
+            INFO("Algorithm " << a);
+            GeoImage image;
+            REQUIRE(engine->computeViewshed(point(map.get(), 0.0, 0.0, 2.0), radius, size, image, algorithms[a]));
+            REQUIRE(image.valid());
+            REQUIRE(image.getImage()->s() == (int)size);
+            REQUIRE(image.getImage()->t() == (int)size);
+
+            unsigned cells = 0u;
+            for (unsigned row = 0; row < size; ++row)
+            {
+                for (unsigned col = 0; col < size; ++col)
+                {
+                    if (image.getImage()->data(col, row)[3] == 0u)
+                        continue; // beyond the radius
+                    INFO("Cell " << col << ", " << row);
+                    REQUIRE(green(image, col, row) == 255u);
+                    ++cells;
+                }
+            }
+            REQUIRE(cells > size * size / 2u);
+        }
+    }
+
+    SECTION("A ridge hides the terrain behind it") {
+        osg::ref_ptr<Map> map = createMap(100.0f);
+        osg::ref_ptr<LineOfSightEngine> engine = createEngine(map.get());
+
+        for (unsigned a = 0; a < 2; ++a)
+        {
+            INFO("Algorithm " << a);
+            GeoImage image;
+            REQUIRE(engine->computeViewshed(point(map.get(), 0.0, 0.0, 2.0), radius, size, image, algorithms[a]));
+
+            // cells are ~156 m, so the ridge spans about cells c+15 to c+21
+            for (unsigned col = c - 30u; col <= c + 13u; ++col)
+            {
+                INFO("Cell " << col);
+                REQUIRE(green(image, col, c) == 255u);
+            }
+            for (unsigned col = c + 23u; col <= c + 30u; ++col)
+            {
+                INFO("Cell " << col);
+                REQUIRE(red(image, col, c) == 255u);
+            }
+        }
+    }
+
+    SECTION("Batches match single viewsheds") {
+        osg::ref_ptr<Map> map = createMap(100.0f);
+        osg::ref_ptr<LineOfSightEngine> engine = createEngine(map.get());
+        engine->setNumThreads(2u);
+
+        std::vector<GeoPoint> observers;
+        observers.push_back(point(map.get(), 0.0, 0.0, 2.0));
+        observers.push_back(point(map.get(), 0.05, 0.01, 2.0));
+        observers.push_back(point(map.get(), 0.025, -0.01, 2.0));
+
+        std::vector<GeoImage> images;
+        engine->computeViewsheds(observers, radius, size, images);
+        REQUIRE(images.size() == observers.size());
+
+        for (unsigned i = 0; i < observers.size(); ++i)
+        {
+            INFO("Observer " << i);
+            GeoImage single;
+            REQUIRE(engine->computeViewshed(observers[i], radius, size, single));
+            REQUIRE(images[i].valid());
+            REQUIRE(images[i].getExtent() == single.getExtent());
+            REQUIRE(memcmp(images[i].getImage()->data(), single.getImage()->data(), size * size * 4u) == 0);
+        }
+    }
+
+    SECTION("A relative observer over no data fails") {
+        osg::ref_ptr<Map> map = createMap(100.0f, false);
+        osg::ref_ptr<LineOfSightEngine> engine = createEngine(map.get());
+
+        GeoImage image;
+        REQUIRE(!engine->computeViewshed(point(map.get(), -0.05, 0.0, 2.0), radius, size, image));
+        REQUIRE(!image.valid());
+    }
+}
@@ -0,0 +1,144 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarthFeatures/Feature>
+#include <osgEarthFeatures/GeometryUtils>
+#include <osgEarthFeatures/ScriptEngine>
+
+using namespace osgEarth;
+using namespace osgEarth::Symbology;
+using namespace osgEarth::Features;
+
+namespace
+{
+    // Same type, structure and points, in the same order.
+    bool sameGeometry(const Geometry* a, const Geometry* b)
+    {
+        if (!a || !b)
+            return a == b;
+
+        if (a->getType() != b->getType() || a->size() != b->size())
+            return false;
+
+        for (unsigned i = 0; i < a->size(); ++i)
+            if (((*a)[i] - (*b)[i]).length() > 1e-9)
+                return false;
+
+        if (a->getType() == Geometry::TYPE_POLYGON)
+        {
+            const RingCollection& ah = static_cast<const Polygon*>(a)->getHoles();
+            const RingCollection& bh = static_cast<const Polygon*>(b)->getHoles();
+            if (ah.size() != bh.size())
+                return false;
+            for (unsigned i = 0; i < ah.size(); ++i)
+                if (!sameGeometry(ah[i].get(), bh[i].get()))
+                    return false;
+        }
+
+        if (a->getType() == Geometry::TYPE_MULTI)
+        {
+            const GeometryCollection& ap = static_cast<const MultiGeometry*>(a)->getComponents();
+            const GeometryCollection& bp = static_cast<const MultiGeometry*>(b)->getComponents();
+            if (ap.size() != bp.size())
+                return false;
+            for (unsigned i = 0; i < ap.size(); ++i)
+                if (!sameGeometry(ap[i].get(), bp[i].get()))
+                    return false;
+        }
+
+        return true;
+    }
+
+    // Compares two GeoJSON geometry objects in script.
+    const char* SAME_FUNCTION =
+        "function same(a, b) {\n"
+        "  if (typeof a === 'number' && typeof b === 'number')\n"
+        "    return Math.abs(a - b) <= 1e-9;\n"
+        "  if (a instanceof Array || b instanceof Array) {\n"
+        "    if (!(a instanceof Array && b instanceof Array) || a.length !== b.length) return false;\n"
+        "    for (var i = 0; i < a.length; ++i) if (!same(a[i], b[i])) return false;\n"
+        "    return true;\n"
+        "  }\n"
+        "  if (a && b && typeof a === 'object' && typeof b === 'object')\n"
+        "    return same(a.type, b.type) && same(a.coordinates, b.coordinates) && same(a.geometries, b.geometries);\n"
+        "  return a === b;\n"
+        "}\n";
+}
+
+TEST_CASE("Duktape geometry matches the OGR GeoJSON path") {
+
+    osg::ref_ptr<ScriptEngine> engine = ScriptEngineFactory::create("javascript", "", true);
+    REQUIRE(engine.valid());
+    engine->setProfile("full");
+
+    const char* wkt[] = {
+        "POINT (1.5 2.25 3)",
+        "LINESTRING (0 0 1, 1.5 2 2, 3 -1 3)",
+        "POLYGON ((0 0 1, 10 0 1, 10 10 1, 0 10 1, 0 0 1), (2 2 1, 2 4 1, 4 4 1, 4 2 1, 2 2 1), (6 6 1, 8 6 1, 8 8 1, 6 6 1))",
+        "MULTIPOINT ((1 2 3), (4 5 6))",
+        "MULTILINESTRING ((0 0 0, 1 1 0), (2 2 0, 3 1 0, 4 2 0))",
+        "MULTIPOLYGON (((0 0 0, 4 0 0, 4 4 0, 0 4 0, 0 0 0), (1 1 0, 2 1 0, 2 2 0, 1 1 0)), ((10 10 0, 12 10 0, 12 12 0, 10 10 0)))"
+    };
+
+    for (unsigned i = 0; i < sizeof(wkt)/sizeof(wkt[0]); ++i)
+    {
+        INFO(wkt[i]);
+
+        osg::ref_ptr<Geometry> geometry = GeometryUtils::geometryFromWKT(wkt[i]);
+        REQUIRE(geometry.valid());
+
+        std::string geojson = GeometryUtils::geometryToGeoJSON(geometry.get());
+        REQUIRE(!geojson.empty());
+
+        // push: the script sees what OGR's GeoJSON decoded to.
+        {
+            osg::ref_ptr<Feature> feature = new Feature(geometry.get(), 0L);
+            ScriptResult result = engine->run(
+                std::string(SAME_FUNCTION) + "same(feature.geometry, " + geojson + ");",
+                feature.get());
+            REQUIRE(result.success());
+            REQUIRE(result.asBool());
+        }
+
+        // push, then read: the same geometry OGR gives back from its own GeoJSON.
+        {
+            osg::ref_ptr<Feature> feature = new Feature(GeometryUtils::geometryFromWKT(wkt[i]), 0L);
+            ScriptResult result = engine->run("feature.geometry; feature.save(); true;", feature.get());
+            REQUIRE(result.success());
+
+            osg::ref_ptr<Geometry> expected = GeometryUtils::geometryFromGeoJSON(geojson);
+            REQUIRE(sameGeometry(feature->getGeometry(), expected.get()));
+        }
+
+        // read: a geometry the script assigns.
+        {
+            osg::ref_ptr<Feature> feature = new Feature(0L, 0L);
+            ScriptResult result = engine->run("feature.geometry = " + geojson + "; feature.save(); true;", feature.get());
+            REQUIRE(result.success());
+
+            osg::ref_ptr<Geometry> expected = GeometryUtils::geometryFromGeoJSON(geojson);
+            REQUIRE(sameGeometry(feature->getGeometry(), expected.get()));
+        }
+    }
+}
@@ -23,9 +23,55 @@
 #include <osgEarth/catch.hpp>
 
 #include <osgEarth/SpatialReference>
+#include <cmath>
 
 using namespace osgEarth;
 
+namespace
+{
+    // Transforms a grid of points with and without the native kernels
+    // and checks that the results agree to within the tolerance.
+    bool nativeMatchesOGR(const std::string& from, const std::string& to,
+                          double xmin, double ymin, double xmax, double ymax,
+                          double tolerance)
+    {
+        osg::ref_ptr<const SpatialReference> fromSRS = SpatialReference::create(from);
+        osg::ref_ptr<const SpatialReference> toSRS = SpatialReference::create(to);
+        if (!fromSRS.valid() || !toSRS.valid())
+            return false;
+
+        std::vector<osg::Vec3d> input;
+        for (int i = 0; i <= 10; ++i)
+            for (int j = 0; j <= 10; ++j)
+                input.push_back(osg::Vec3d(xmin + (xmax-xmin)*0.1*i, ymin + (ymax-ymin)*0.1*j, 0.0));
+
+        std::vector<osg::Vec3d> ogr(input);
+        SpatialReference::setNativeTransformsEnabled(false);
+        bool ogrOK = fromSRS->transform(ogr, toSRS.get());
+        SpatialReference::setNativeTransformsEnabled(true);
+        if (!ogrOK)
+            return false;
+
+        // call the kernels directly, so a silent fallback to OGR can't pass
+        std::vector<double> x(input.size()), y(input.size());
+        for (unsigned i = 0; i < input.size(); ++i)
+        {
+            x[i] = input[i].x();
+            y[i] = input[i].y();
+        }
+        if (!fromSRS->transformXYNative(&x[0], &y[0], input.size(), toSRS.get()))
+            return false;
+
+        for (unsigned i = 0; i < input.size(); ++i)
+        {
+            if (fabs(ogr[i].x() - x[i]) > tolerance ||
+                fabs(ogr[i].y() - y[i]) > tolerance)
+                return false;
+        }
+        return true;
+    }
+}
+
 TEST_CASE( "SpatialReferences are cached" ) {
     osg::ref_ptr< const SpatialReference > srs1 = SpatialReference::create("spherical-mercator");
     REQUIRE(srs1.valid());
@@ -90,3 +136,26 @@ TEST_CASE("Plate Carre SpatialReferences can be created") {
     REQUIRE(!plateCarre->isGeodetic());
     REQUIRE(plateCarre->isProjected());
 }
+
+TEST_CASE("Native SRS transforms match OGR") {
+
+    SECTION("geodetic to and from spherical mercator") {
+        REQUIRE(nativeMatchesOGR("wgs84", "spherical-mercator", -180, -85, 180, 85, 1e-3));
+        REQUIRE(nativeMatchesOGR("spherical-mercator", "wgs84", -2e7, -2e7, 2e7, 2e7, 1e-8));
+    }
+
+    SECTION("geodetic to and from world mercator") {
+        REQUIRE(nativeMatchesOGR("wgs84", "epsg:3395", -180, -85, 180, 85, 1e-3));
+        REQUIRE(nativeMatchesOGR("epsg:3395", "wgs84", -2e7, -1.9e7, 2e7, 1.9e7, 1e-8));
+    }
+
+    SECTION("geodetic to and from UTM") {
+        REQUIRE(nativeMatchesOGR("wgs84", "epsg:32633", 12, 0, 18, 80, 1e-2));
+        REQUIRE(nativeMatchesOGR("wgs84", "epsg:32733", 12, -80, 18, 0, 1e-2));
+        REQUIRE(nativeMatchesOGR("epsg:32633", "wgs84", 200000, 0, 800000, 7000000, 1e-7));
+    }
+
+    SECTION("projected to projected") {
+        REQUIRE(nativeMatchesOGR("epsg:32633", "spherical-mercator", 200000, 0, 800000, 7000000, 1e-2));
+    }
+}
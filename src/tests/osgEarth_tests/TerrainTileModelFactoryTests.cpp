@@ -0,0 +1,112 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/TerrainTileModelFactory>
+#include <osgEarth/ImageUtils>
+#include <osgEarth/Map>
+#include <osgEarth/Registry>
+
+using namespace osgEarth;
+
+namespace
+{
+    // Tile source that either returns an empty image or fails the way a
+    // timed-out HTTP request does: no image, and the progress canceled.
+    class TestTileSource : public TileSource
+    {
+    public:
+        TestTileSource(bool recoverableFailure) :
+            TileSource(TileSourceOptions()),
+            _fail(recoverableFailure) { }
+
+        Status initialize(const osgDB::Options* readOptions)
+        {
+            setProfile(Registry::instance()->getGlobalGeodeticProfile());
+            return STATUS_OK;
+        }
+
+        osg::Image* createImage(const TileKey& key, ProgressCallback* progress)
+        {
+            if (_fail)
+            {
+                if (progress)
+                    progress->cancel();
+                return 0L;
+            }
+            return ImageUtils::createEmptyImage(16, 16);
+        }
+
+        bool _fail;
+    };
+
+    struct TestRequirements : public TerrainEngineRequirements
+    {
+        bool elevationTexturesRequired() const { return false; }
+        bool normalTexturesRequired() const { return false; }
+        bool parentTexturesRequired() const { return false; }
+        bool elevationBorderRequired() const { return false; }
+        bool fullDataAtFirstLodRequired() const { return false; }
+    };
+
+    ImageLayer* createTestLayer(const std::string& name, bool recoverableFailure)
+    {
+        ImageLayerOptions options(name);
+        options.cachePolicy() = CachePolicy::NO_CACHE;
+        return new ImageLayer(options, new TestTileSource(recoverableFailure));
+    }
+}
+
+TEST_CASE( "TerrainTileModelFactory parallel layer fetch" ) {
+
+    osg::ref_ptr<Map> map = new Map();
+    map->addLayer(createTestLayer("good", false));
+
+    TerrainOptions options;
+    options.layerFetchThreads() = 2u;
+    osg::ref_ptr<TerrainTileModelFactory> factory = new TerrainTileModelFactory(options);
+
+    TestRequirements requirements;
+    TileKey key(1, 0, 0, map->getProfile());
+
+    SECTION("Layers that succeed leave the tile's callback alone") {
+        osg::ref_ptr<ProgressCallback> progress = new ProgressCallback();
+        osg::ref_ptr<TerrainTileModel> model = factory->createTileModel(
+            map.get(), key, CreateTileModelFilter(), &requirements, progress.get());
+
+        REQUIRE(model.valid());
+        REQUIRE(model->colorLayers().size() == 1u);
+        REQUIRE(!progress->isCanceled());
+    }
+
+    SECTION("A recoverable failure in one layer cancels the tile") {
+        map->addLayer(createTestLayer("bad", true));
+
+        osg::ref_ptr<ProgressCallback> progress = new ProgressCallback();
+        osg::ref_ptr<TerrainTileModel> model = factory->createTileModel(
+            map.get(), key, CreateTileModelFilter(), &requirements, progress.get());
+
+        REQUIRE(model.valid());
+        REQUIRE(progress->isCanceled());
+    }
+}
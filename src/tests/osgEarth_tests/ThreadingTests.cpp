@@ -22,6 +22,7 @@
 
 #include <osgEarth/catch.hpp>
 #include <osgEarth/ThreadingUtils>
+#include <osgEarth/TaskService>
 
 using namespace osgEarth;
 
@@ -132,4 +133,121 @@ TEST_CASE( "ReadWriteMutex can handle multiple read locks from the same thread w
     REQUIRE(!thread2.isRunning());
     REQUIRE(elapsedTime < maxTimeSeconds);
 }
-*/
\ No newline at end of file
+*/
+
+namespace WorkStealingTest
+{
+    struct Counter
+    {
+        static OpenThreads::Atomic s_count;
+        void execute() { ++s_count; }
+    };
+    OpenThreads::Atomic Counter::s_count;
+
+    // Blocks the worker that runs it until released.
+    struct Gate
+    {
+        Threading::Event* _started;
+        Threading::Event* _release;
+        void execute() { _started->set(); _release->wait(); }
+    };
+
+    // Records the order in which tasks run.
+    struct Recorder
+    {
+        int               _id;
+        std::vector<int>* _order;
+        OpenThreads::Mutex* _mutex;
+        void execute() {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(*_mutex);
+            _order->push_back(_id);
+        }
+    };
+}
+
+TEST_CASE( "Work-stealing TaskService runs every ParallelTask and reports per-thread stats" ) {
+
+    osg::ref_ptr<TaskService> service = new TaskService("WorkStealingTest", 4, 0u, TaskService::SCHEDULER_WORK_STEALING);
+    REQUIRE(service->getScheduler() == TaskService::SCHEDULER_WORK_STEALING);
+
+    const int numTasks = 1000;
+    Threading::MultiEvent done(numTasks);
+    for(int i=0; i<numTasks; ++i)
+    {
+        ParallelTask<WorkStealingTest::Counter>* task = new ParallelTask<WorkStealingTest::Counter>(&done);
+        task->setPriority( (float)((i % 3) - 1) );
+        service->add(task);
+    }
+    done.wait();
+
+    REQUIRE((unsigned)WorkStealingTest::Counter::s_count == (unsigned)numTasks);
+    REQUIRE(service->getNumRequests() == 0u);
+
+    std::vector<TaskService::ThreadStats> stats;
+    REQUIRE(service->getThreadStats(stats));
+    REQUIRE(stats.size() == 4u);
+
+    unsigned tasksRun = 0u;
+    for(unsigned i=0; i<stats.size(); ++i)
+    {
+        REQUIRE(stats[i]._queueDepth == 0u);
+        tasksRun += stats[i]._tasksRun;
+    }
+    REQUIRE(tasksRun == (unsigned)numTasks);
+}
+
+TEST_CASE( "Work-stealing TaskService keeps one slot per thread" ) {
+
+    osg::ref_ptr<TaskService> service = new TaskService("WorkStealingSlots", 2, 0u, TaskService::SCHEDULER_WORK_STEALING);
+
+    std::vector<TaskService::ThreadStats> stats;
+    service->getThreadStats(stats);
+    REQUIRE(stats.size() == 2u);
+
+    service->setNumThreads(5);
+    service->getThreadStats(stats);
+    REQUIRE(stats.size() == 5u);
+
+    service->setNumThreads(3);
+    service->getThreadStats(stats);
+    REQUIRE(stats.size() == 3u);
+}
+
+TEST_CASE( "Work-stealing TaskService runs requests in full priority order, FIFO among equals" ) {
+
+    osg::ref_ptr<TaskService> service = new TaskService("WorkStealingOrder", 1, 0u, TaskService::SCHEDULER_WORK_STEALING);
+
+    // hold the only worker so that every request below is queued before any runs.
+    Threading::Event started, release;
+    Threading::Event gateDone;
+    ParallelTask<WorkStealingTest::Gate>* gate = new ParallelTask<WorkStealingTest::Gate>(&gateDone);
+    gate->_started = &started;
+    gate->_release = &release;
+    service->add(gate);
+    started.wait();
+
+    // priorities closer than the old three-band mapping could tell apart
+    const float priorities[] = { 0.5f, 0.25f, -1.0f, 0.25f, 0.75f, -0.5f, 0.5f };
+    const int numTasks = sizeof(priorities)/sizeof(priorities[0]);
+
+    std::vector<int> order;
+    OpenThreads::Mutex orderMutex;
+    Threading::MultiEvent done(numTasks);
+    for(int i=0; i<numTasks; ++i)
+    {
+        ParallelTask<WorkStealingTest::Recorder>* task = new ParallelTask<WorkStealingTest::Recorder>(&done);
+        task->_id = i;
+        task->_order = &order;
+        task->_mutex = &orderMutex;
+        task->setPriority(priorities[i]);
+        service->add(task);
+    }
+
+    release.set();
+    done.wait();
+
+    const int expected[] = { 2, 5, 1, 3, 0, 6, 4 };
+    REQUIRE(order.size() == (unsigned)numTasks);
+    for(int i=0; i<numTasks; ++i)
+        REQUIRE(order[i] == expected[i]);
+}
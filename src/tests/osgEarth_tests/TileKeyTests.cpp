@@ -0,0 +1,109 @@
+/* -*-c++-*- */
+/* osgEarth - Geospatial SDK for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/TileKey>
+#include <osgEarth/Containers>
+#include <cstdlib>
+#include <map>
+
+using namespace osgEarth;
+
+TEST_CASE( "TileKey" ) {
+
+    osg::ref_ptr<const Profile> profile = Profile::create("global-geodetic");
+
+    SECTION("str") {
+        REQUIRE(TileKey(3, 5, 2, profile.get()).str() == "3/5/2");
+        REQUIRE(TileKey::INVALID.str() == "invalid");
+    }
+
+    SECTION("Invalid keys are equal to each other and to no valid key") {
+        TileKey a(3, 5, 2, 0L);
+        TileKey b(4, 1, 1, 0L);
+        TileKey valid(3, 5, 2, profile.get());
+        REQUIRE(a == b);
+        REQUIRE(a == TileKey::INVALID);
+        REQUIRE(a.hash() == b.hash());
+        REQUIRE(!(a < b));
+        REQUIRE(!(b < a));
+        REQUIRE(a != valid);
+        REQUIRE(valid != a);
+        REQUIRE(a < valid);
+        REQUIRE(!(valid < a));
+
+        // so hashed containers find them
+        hash_map<TileKey, int, TileKey::Hash> hashed;
+        hashed[a] = 1;
+        hashed[b] = 2;
+        REQUIRE(hashed.size() == 1u);
+        REQUIRE(hashed.find(TileKey::INVALID) != hashed.end());
+        REQUIRE(hashed.find(TileKey::INVALID)->second == 2);
+        hashed.erase(TileKey::INVALID);
+        REQUIRE(hashed.empty());
+    }
+
+    SECTION("Packed codes are unique and keep parents ahead of their children") {
+        TileKey a(10, 513, 200, profile.get());
+        TileKey b(10, 200, 513, profile.get());
+        TileKey c(11, 513, 200, profile.get());
+        REQUIRE(a.getCode() != b.getCode());
+        REQUIRE(a.getCode() != c.getCode());
+        REQUIRE(a.getCode() < c.getCode());
+        REQUIRE(TileKey(10, 513, 200, profile.get()).hash() == a.hash());
+
+        // the 4 children of a key have consecutive codes
+        TileKey parent(4, 9, 3, profile.get());
+        for(unsigned q=0; q<4; ++q)
+            REQUIRE((parent.createChildKey(q).getCode() & 3u) == q);
+    }
+
+    SECTION("hash_map matches std::map") {
+        hash_map<TileKey, int, TileKey::Hash> hashed;
+        std::map<TileKey, int> ordered;
+
+        srand(7);
+        for(int i=0; i<20000; ++i)
+        {
+            unsigned lod = rand() % 6;
+            TileKey key(lod, rand() % (2u << lod), rand() % (1u << lod), profile.get());
+            switch(rand() % 3)
+            {
+            case 0:
+                hashed[key] = i;
+                ordered[key] = i;
+                break;
+            case 1:
+                hashed.erase(key);
+                ordered.erase(key);
+                break;
+            default:
+                REQUIRE((hashed.find(key) != hashed.end()) == (ordered.find(key) != ordered.end()));
+            }
+            REQUIRE(hashed.size() == ordered.size());
+        }
+
+        for(hash_map<TileKey, int, TileKey::Hash>::const_iterator i = hashed.begin(); i != hashed.end(); ++i)
+            REQUIRE(ordered[i->first] == i->second);
+    }
+}
@@ -0,0 +1,215 @@
+/* -*-c++-*- */
+/* osgEarth - Dynamic map generation toolkit for OpenSceneGraph
+* Copyright 2018 Pelican Mapping
+* http://osgearth.org
+*
+* osgEarth is free software; you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+* IN THE SOFTWARE.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>
+*/
+
+#include <osgEarth/catch.hpp>
+
+#include <osgEarth/URI>
+#include <osgEarth/Progress>
+#include <osgEarth/ThreadingUtils>
+
+#include <OpenThreads/Atomic>
+#include <OpenThreads/Thread>
+
+using namespace osgEarth;
+
+namespace
+{
+    // Answers every fetch with the same result, the way HTTPClient would:
+    // recoverable failures cancel the caller's progress. Can hold fetches
+    // until released, so other readers have time to pile up behind one.
+    struct TestFetcher : public URIReadSharing::Fetcher
+    {
+        TestFetcher(ReadResult::Code code, bool hold) : _code(code)
+        {
+            if ( !hold )
+                _release.set();
+        }
+
+        ReadResult fetch(const URI& uri, ProgressCallback* progress)
+        {
+            ++_fetches;
+            _release.wait();
+
+            if ( _code == ReadResult::RESULT_OK )
+                return ReadResult( new StringObject("contents of " + uri.full()) );
+
+            if ( progress && HTTPClient::isRecoverable(_code) )
+                progress->cancel();
+            return ReadResult( _code );
+        }
+
+        ReadResult::Code    _code;
+        Threading::Event    _release;
+        OpenThreads::Atomic _fetches;
+    };
+
+    class ReadThread : public OpenThreads::Thread
+    {
+    public:
+        ReadThread(const URI& uri) : _uri(uri), _progress(new ProgressCallback()) { }
+
+        void run()
+        {
+            _result = _uri.readString(0L, _progress.get());
+        }
+
+        URI                            _uri;
+        osg::ref_ptr<ProgressCallback> _progress;
+        ReadResult                     _result;
+    };
+
+    // Starts the threads and waits until all but one (the leader) are
+    // waiting on the leader's fetch.
+    bool startAndPileUp(std::vector<ReadThread*>& threads)
+    {
+        for (unsigned i = 0; i < threads.size(); ++i)
+            threads[i]->start();
+
+        for (unsigned ms = 0; ms < 10000u; ms += 10u)
+        {
+            if ( URIReadSharing::getStats().coalesced >= threads.size()-1 )
+                return true;
+            OpenThreads::Thread::microSleep(10000);
+        }
+        return false;
+    }
+
+    void joinAll(std::vector<ReadThread*>& threads)
+    {
+        for (unsigned i = 0; i < threads.size(); ++i)
+            threads[i]->join();
+    }
+
+    void deleteAll(std::vector<ReadThread*>& threads)
+    {
+        for (unsigned i = 0; i < threads.size(); ++i)
+            delete threads[i];
+        threads.clear();
+    }
+}
+
+TEST_CASE("URIReadSharing") {
+
+    const unsigned numThreads = 8u;
+    double ttl = URIReadSharing::getNegativeCacheTTL();
+
+    URIReadSharing::clearNegativeCache();
+    URIReadSharing::resetStats();
+
+    std::vector<ReadThread*> threads;
+
+    SECTION("Concurrent reads of one URI share a single fetch") {
+        osg::ref_ptr<TestFetcher> fetcher = new TestFetcher(ReadResult::RESULT_OK, true);
+        URIReadSharing::setFetcher(fetcher.get());
+
+        URI uri("http://sharing.test/shared.txt");
+        for (unsigned i = 0; i < numThreads; ++i)
+            threads.push_back(new ReadThread(uri));
+
+        bool piledUp = startAndPileUp(threads);
+        fetcher->_release.set();
+        joinAll(threads);
+        REQUIRE(piledUp);
+
+        REQUIRE((unsigned)fetcher->_fetches == 1u);
+        for (unsigned i = 0; i < threads.size(); ++i)
+        {
+            REQUIRE(threads[i]->_result.succeeded());
+            REQUIRE(threads[i]->_result.getString() == "contents of " + uri.full());
+            // the followers got the leader's object, not a copy:
+            REQUIRE(threads[i]->_result.getObject() == threads[0]->_result.getObject());
+        }
+
+        URIReadSharing::Stats stats = URIReadSharing::getStats();
+        REQUIRE(stats.fetches == 1u);
+        REQUIRE(stats.coalesced == numThreads-1);
+        REQUIRE(stats.negativeHits == 0u);
+        REQUIRE(stats.negativeInserts == 0u);
+    }
+
+    SECTION("A 404 comes from the negative cache until it expires") {
+        osg::ref_ptr<TestFetcher> fetcher = new TestFetcher(ReadResult::RESULT_NOT_FOUND, false);
+        URIReadSharing::setFetcher(fetcher.get());
+        URIReadSharing::setNegativeCacheTTL(0.5);
+
+        URI uri("http://sharing.test/missing.txt");
+
+        ReadResult r = uri.readString();
+        REQUIRE(r.code() == ReadResult::RESULT_NOT_FOUND);
+        REQUIRE((unsigned)fetcher->_fetches == 1u);
+        REQUIRE(URIReadSharing::getStats().negativeInserts == 1u);
+
+        r = uri.readString();
+        REQUIRE(r.code() == ReadResult::RESULT_NOT_FOUND);
+        REQUIRE((unsigned)fetcher->_fetches == 1u);
+        REQUIRE(URIReadSharing::getStats().negativeHits == 1u);
+
+        OpenThreads::Thread::microSleep(750000);
+
+        r = uri.readString();
+        REQUIRE(r.code() == ReadResult::RESULT_NOT_FOUND);
+        REQUIRE((unsigned)fetcher->_fetches == 2u);
+
+        URIReadSharing::Stats stats = URIReadSharing::getStats();
+        REQUIRE(stats.fetches == 2u);
+        REQUIRE(stats.coalesced == 0u);
+        REQUIRE(stats.negativeHits == 1u);
+        REQUIRE(stats.negativeInserts == 2u);
+    }
+
+    SECTION("A recoverable failure cancels the followers and isn't remembered") {
+        osg::ref_ptr<TestFetcher> fetcher = new TestFetcher(ReadResult::RESULT_SERVER_ERROR, true);
+        URIReadSharing::setFetcher(fetcher.get());
+
+        URI uri("http://sharing.test/unavailable.txt");
+        for (unsigned i = 0; i < numThreads; ++i)
+            threads.push_back(new ReadThread(uri));
+
+        bool piledUp = startAndPileUp(threads);
+        fetcher->_release.set();
+        joinAll(threads);
+        REQUIRE(piledUp);
+
+        REQUIRE((unsigned)fetcher->_fetches == 1u);
+        for (unsigned i = 0; i < threads.size(); ++i)
+        {
+            REQUIRE(threads[i]->_progress->isCanceled());
+            REQUIRE(threads[i]->_result.succeeded() == false);
+        }
+
+        // nothing was cached, so the next read goes back to the server:
+        ReadResult r = uri.readString();
+        REQUIRE(r.code() == ReadResult::RESULT_SERVER_ERROR);
+        REQUIRE((unsigned)fetcher->_fetches == 2u);
+
+        URIReadSharing::Stats stats = URIReadSharing::getStats();
+        REQUIRE(stats.fetches == 2u);
+        REQUIRE(stats.coalesced == numThreads-1);
+        REQUIRE(stats.negativeHits == 0u);
+        REQUIRE(stats.negativeInserts == 0u);
+    }
+
+    deleteAll(threads);
+    URIReadSharing::setFetcher(0L);
+    URIReadSharing::setNegativeCacheTTL(ttl);
+    URIReadSharing::clearNegativeCache();
+}